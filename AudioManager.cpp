@@ -7,7 +7,7 @@
 #endif
 
 AudioManager::AudioManager()
-    : rainLoaded(false), rainVolume(0.5f),
+    : engineInitialized(false), rainLoaded(false), rainVolume(0.5f),
     thunderLoaded(false), thunderVolume(0.5f),
     fireLoaded(false), fireVolume(0.5f) {}
 
@@ -21,6 +21,7 @@ bool AudioManager::initialize() {
         std::cerr << "Failed to initialize audio engine." << std::endl;
         return false;
     }
+    engineInitialized = true;
     return true;
 }
 
@@ -37,7 +38,10 @@ void AudioManager::shutdown() {
         ma_sound_uninit(&fireSound);
         fireLoaded = false;
     }
-    ma_engine_uninit(&engine);
+    if (engineInitialized) {
+        ma_engine_uninit(&engine);
+        engineInitialized = false;
+    }
 }
 
 bool AudioManager::loadRainSound(const std::string& filePath) {
@@ -43,6 +43,8 @@ public:
 
 private:
     ma_engine engine;
+    // shutdown may run twice (cleanup, then the destructor) or without an engine
+    bool engineInitialized;
 
     ma_sound rainSound;
     bool rainLoaded;
@@ -27,9 +27,9 @@ namespace gps {
             root = buildRecursive(batches, 0, batches.size());
         }
 
-        // Frustum cull traverse
-        void frustumCulledDraw(const Frustum& frustum, Shader& shader) {
-            traverseAndDraw(root, frustum, shader);
+        // Frustum cull traverse, detail (may be null) coarsens the batches drawn
+        void frustumCulledDraw(const Frustum& frustum, Shader& shader, const GeometryDetail* detail = nullptr) {
+            traverseAndDraw(root, frustum, shader, detail);
         }
 
     private:
@@ -79,7 +79,7 @@ namespace gps {
             return node;
         }
 
-        void traverseAndDraw(BVHNode* node, const Frustum& frustum, Shader& shader) {
+        void traverseAndDraw(BVHNode* node, const Frustum& frustum, Shader& shader, const GeometryDetail* detail) {
             if (!node) return;
 
             // If bounding box is not visible, skip entire subtree
@@ -90,12 +90,12 @@ namespace gps {
             // If it's a leaf, draw the stored meshBatches
             if (node->isLeaf()) {
                 for (auto mb : node->meshBatches) {
-                    mb->Draw(shader, frustum);
+                    mb->Draw(shader, frustum, detail);
                 }
             }
             else {
-                traverseAndDraw(node->leftChild, frustum, shader);
-                traverseAndDraw(node->rightChild, frustum, shader);
+                traverseAndDraw(node->leftChild, frustum, shader, detail);
+                traverseAndDraw(node->rightChild, frustum, shader, detail);
             }
         }
 
@@ -0,0 +1,555 @@
+#include "Benchmarks.hpp"
+
+#include "ThreadPool.hpp"
+#include "ClusteredLights.hpp"
+#include "RainSimulation.hpp"
+#include "FireParticles.hpp"
+#include "DepthSorter.hpp"
+#include "Random.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/random.hpp"
+#include "glm/gtc/noise.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        bool hasFlag(int argc, const char* argv[], const char* flag) {
+            for (int i = 1; i < argc; i++) {
+                if (std::strcmp(argv[i], flag) == 0) return true;
+            }
+            return false;
+        }
+
+        // The argument after flag, or nullptr
+        const char* flagValue(int argc, const char* argv[], const char* flag) {
+            for (int i = 1; i + 1 < argc; i++) {
+                if (std::strcmp(argv[i], flag) == 0) return argv[i + 1];
+            }
+            return nullptr;
+        }
+
+        // CPU cost of ClusteredLights::assign alone; the shading pass that reads
+        // the clusters runs on the GPU and is not part of it
+        void benchmarkLightAssignment() {
+            const int lightCounts[] = { 1, 10, 100, 250, 500, 1000 };
+            const int iterations = 200;
+
+            ThreadPool pool;
+            ClusteredLights clusters;
+
+            glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 2.0f, 3.0f), glm::vec3(0.0f, 2.0f, -10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 projection = glm::perspective(glm::radians(45.0f), 3200.0f / 2000.0f, 0.1f, 300.0f);
+
+            std::cout << "Clustered light assignment (CPU only, shading not measured), " << ClusteredLights::GRID_X << "x" << ClusteredLights::GRID_Y << "x"
+                << ClusteredLights::GRID_Z << " clusters, " << pool.getThreadCount() << " threads" << std::endl;
+            std::cout << std::setw(8) << "lights" << std::setw(12) << "assign ms" << std::setw(12) << "max ms" << std::setw(12) << "indices" << std::endl;
+
+            for (int count : lightCounts) {
+                clusters.scatter(count, glm::vec3(-60.0f, 0.5f, -60.0f), glm::vec3(60.0f, 4.0f, 60.0f), 1337u);
+
+                // First call also builds the cluster bounds
+                clusters.assign(view, projection, 0.1f, 300.0f, pool);
+
+                double total = 0.0;
+                double worst = 0.0;
+                for (int i = 0; i < iterations; i++) {
+                    clusters.assign(view, projection, 0.1f, 300.0f, pool);
+                    total += clusters.getLastAssignMs();
+                    worst = std::max(worst, clusters.getLastAssignMs());
+                }
+
+                std::cout << std::setw(8) << count
+                    << std::setw(12) << std::fixed << std::setprecision(4) << total / iterations
+                    << std::setw(12) << worst
+                    << std::setw(12) << clusters.getIndexCount() << std::endl;
+            }
+        }
+
+        // The rain update as it was before RainSimulation: vec3 arrays (AoS),
+        // rand() on respawn, one thread
+        struct LegacyRain {
+            std::vector<glm::vec3> positions, velocities;
+            std::vector<glm::vec2> params;
+
+            void respawn(size_t i) {
+                float x = -100.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 200.0f));
+                float z = -100.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 200.0f));
+                float y = 25.0f + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 5.0f));
+                float lengthFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
+                float speedFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
+
+                positions[i] = glm::vec3(x, y, z);
+                velocities[i] = glm::vec3(0.0f, RainSimulation::GRAVITY * speedFactor, 0.0f);
+                params[i] = glm::vec2(lengthFactor, speedFactor);
+            }
+
+            void reset(size_t count) {
+                positions.resize(count);
+                velocities.resize(count);
+                params.resize(count);
+                for (size_t i = 0; i < count; i++) respawn(i);
+            }
+
+            void update(float deltaTime) {
+                for (size_t i = 0; i < positions.size(); i++) {
+                    velocities[i].y += RainSimulation::GRAVITY * deltaTime;
+                    if (velocities[i].y < RainSimulation::TERMINAL_VELOCITY) {
+                        velocities[i].y = RainSimulation::TERMINAL_VELOCITY;
+                    }
+                    positions[i] += velocities[i] * deltaTime;
+                    if (positions[i].y < -1.0f) respawn(i);
+                }
+            }
+        };
+
+        // Runs frames at 60 Hz for at least a second of wall time, returns items per second
+        template <typename Step>
+        double measureItemsPerSecond(size_t itemCount, Step step) {
+            // Warm up past the first wave of respawns, the steady state has a mix
+            for (int i = 0; i < 120; i++) step(1.0f / 60.0f);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            int frames = 0;
+            double seconds = 0.0;
+            while (seconds < 1.0) {
+                step(1.0f / 60.0f);
+                frames++;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+            return static_cast<double>(itemCount) * frames / seconds;
+        }
+
+        struct RateRow {
+            std::string name;
+            double rate;
+        };
+
+        // Rates relative to the first row
+        void printRateTable(const char* unit, size_t itemCount, const std::vector<RateRow>& rows) {
+            std::string rateHeader = std::string("M") + unit + "/s";
+            std::cout << std::setw(24) << "variant" << std::setw(16) << rateHeader << std::setw(12) << "ms/frame" << std::setw(10) << "speedup" << std::endl;
+            for (const RateRow& row : rows) {
+                std::cout << std::setw(24) << row.name
+                    << std::setw(16) << std::fixed << std::setprecision(1) << row.rate / 1.0e6
+                    << std::setw(12) << std::setprecision(3) << itemCount / row.rate * 1000.0
+                    << std::setw(9) << std::setprecision(2) << row.rate / rows[0].rate << "x" << std::endl;
+            }
+        }
+
+        void benchmarkRain() {
+            const size_t dropCount = 1000000;
+
+            ThreadPool pool;
+            LegacyRain legacy;
+            RainSimulation rain;
+
+            legacy.reset(dropCount);
+            rain.reset(dropCount, 1337u);
+
+            // Where the upload data is written, as into the stream buffer
+            std::vector<glm::vec3> legacyStaging(dropCount);
+            std::vector<float> heights(dropCount);
+            std::vector<RainSimulation::RespawnRecord> respawns(dropCount);
+            size_t uploadBytes = 0;
+            size_t uploadFrames = 0;
+
+            double legacyRate = measureItemsPerSecond(dropCount, [&](float dt) {
+                legacy.update(dt);
+                std::memcpy(&legacyStaging[0], &legacy.positions[0], dropCount * sizeof(glm::vec3));
+            });
+            double singleRate = measureItemsPerSecond(dropCount, [&](float dt) {
+                rain.update(dt);
+                rain.stageUpload(&heights[0], &respawns[0]);
+            });
+            double pooledRate = measureItemsPerSecond(dropCount, [&](float dt) {
+                rain.update(dt, pool);
+                uploadBytes += rain.getUploadSize();
+                uploadFrames++;
+                rain.stageUpload(&heights[0], &respawns[0]);
+            });
+
+            std::cout << "Rain update and upload staging, " << dropCount << " drops, CPU only (the GL transfer is not timed)" << std::endl;
+            printRateTable("drops", dropCount, {
+                { "AoS + rand()", legacyRate },
+                { "SoA SIMD, 1 thread", singleRate },
+                { "SoA SIMD, " + std::to_string(pool.getThreadCount()) + " threads", pooledRate },
+            });
+            std::cout << "Uploaded per frame: AoS " << std::fixed << std::setprecision(2)
+                << dropCount * sizeof(glm::vec3) / 1.0e6 << " MB, SoA "
+                << uploadBytes / static_cast<double>(uploadFrames) / 1.0e6 << " MB (heights and respawns)" << std::endl;
+        }
+
+        // The fire update as it was before FireParticles: one vector of ~76 byte
+        // structs, a switch on the type per particle, glm::linearRand and
+        // glm::perlin in the loop, one thread
+        struct LegacyFire {
+            struct Particle {
+                glm::vec3 position;
+                glm::vec3 velocity;
+                glm::vec4 color;
+                float life;
+                float size;
+                float initialLife;
+                float rotation;
+                float rotationSpeed;
+                int type;
+                int textureIndex;
+            };
+
+            std::vector<Particle> particles;
+            glm::vec3 origin;
+            size_t capacity;
+
+            void spawn(Particle& p, int type) {
+                float radiusScale = type == 0 ? 1.0f : (type == 1 ? 0.6f : 0.4f);
+                float angle = glm::linearRand(0.0f, 2.f * 3.14159f);
+                float r = glm::linearRand(0.0f, 0.2f * radiusScale);
+                p.position = origin + glm::vec3(r * cos(angle), 0.0f, r * sin(angle));
+                if (type == 0) {
+                    p.position.y += glm::linearRand(0.01f, 0.03f);
+                    p.velocity = glm::vec3(glm::linearRand(-0.15f, 0.15f), glm::linearRand(1.8f, 2.6f), glm::linearRand(-0.15f, 0.15f));
+                    p.life = glm::linearRand(2.0f, 4.0f);
+                    p.size = glm::linearRand(0.1f, 0.18f);
+                    p.rotationSpeed = glm::linearRand(-60.0f, 60.0f);
+                }
+                else if (type == 1) {
+                    p.position.y += glm::linearRand(0.7f, 1.0f);
+                    p.velocity = glm::vec3(glm::linearRand(-0.1f, 0.1f), glm::linearRand(0.3f, 0.6f), glm::linearRand(-0.1f, 0.1f));
+                    p.life = glm::linearRand(0.6f, 1.2f);
+                    p.size = glm::linearRand(0.2f, 0.35f);
+                    p.rotationSpeed = glm::linearRand(-20.0f, 20.0f);
+                }
+                else {
+                    p.position.y += glm::linearRand(0.03f, 0.06f);
+                    float upMax = glm::linearRand(0.0f, 1.0f) < 0.1f ? 5.0f : 3.5f;
+                    p.velocity = glm::vec3(glm::linearRand(-0.2f, 0.2f), glm::linearRand(2.5f, upMax), glm::linearRand(-0.2f, 0.2f));
+                    p.life = glm::linearRand(0.4f, 1.5f);
+                    p.size = glm::linearRand(0.07f, 0.12f);
+                    p.rotationSpeed = glm::linearRand(-80.0f, 80.0f);
+                }
+                p.initialLife = p.life;
+                p.color = glm::vec4(1.0f);
+                p.rotation = glm::linearRand(0.0f, 360.0f);
+                p.type = type;
+                p.textureIndex = glm::linearRand(0, 6);
+            }
+
+            void reset(int flames, int smoke, int embers) {
+                origin = glm::vec3(0.0f);
+                capacity = flames + smoke + embers;
+                particles.resize(capacity);
+                for (size_t i = 0; i < capacity; i++) {
+                    spawn(particles[i], i < (size_t)flames ? 0 : (i < (size_t)(flames + smoke) ? 1 : 2));
+                }
+            }
+
+            glm::vec4 stageColor(const Particle& p) {
+                float lifeRatio = p.life / p.initialLife;
+                switch (p.type) {
+                case 0:
+                    if (lifeRatio < 0.4f) return glm::vec4(glm::mix(glm::vec3(1.0f, 0.9f, 0.6f), glm::vec3(1.0f, 0.5f, 0.1f), lifeRatio / 0.4f), 1.0f);
+                    if (lifeRatio < 0.8f) return glm::vec4(glm::mix(glm::vec3(1.0f, 0.5f, 0.1f), glm::vec3(0.6f, 0.0f, 0.0f), (lifeRatio - 0.4f) / 0.4f), 1.0f);
+                    return glm::vec4(glm::mix(glm::vec3(0.6f, 0.0f, 0.0f), glm::vec3(0.15f, 0.0f, 0.0f), (lifeRatio - 0.8f) / 0.2f), 1.0f - 0.5f * (lifeRatio - 0.8f) / 0.2f);
+                case 1:
+                    return glm::vec4(glm::mix(glm::vec3(0.1f), glm::vec3(0.45f), 1.0f - lifeRatio), lifeRatio * 0.7f);
+                default:
+                    return glm::vec4(glm::mix(glm::vec3(1.0f, 0.9f, 0.4f), glm::vec3(1.0f, 0.2f, 0.0f), 1.0f - lifeRatio), lifeRatio);
+                }
+            }
+
+            void update(float deltaTime, float globalTime) {
+                for (auto& p : particles) {
+                    p.life -= deltaTime;
+                    if (p.life <= 0.0f) {
+                        float roll = glm::linearRand(0.0f, 1.0f);
+                        spawn(p, roll < 0.70f ? 0 : (roll < 0.90f ? 1 : 2));
+                        continue;
+                    }
+
+                    float lifeRatio = p.life / p.initialLife;
+                    float swirlSpeed;
+                    if (p.type == 0) {
+                        swirlSpeed = (0.3f + 0.1f * sin(globalTime * 1.5f)) + glm::linearRand(-0.05f, 0.05f);
+                        float heightAbove = p.position.y - origin.y;
+                        swirlSpeed += 0.2f * glm::smoothstep(0.2f, 0.6f, heightAbove);
+                        if (glm::linearRand(0.0f, 1.0f) < 0.005f) {
+                            p.velocity.y += glm::linearRand(0.5f, 1.5f);
+                        }
+                        if (heightAbove > 0.4f) {
+                            float randomShift = glm::linearRand(-0.1f, 0.1f) * glm::smoothstep(0.4f, 1.0f, heightAbove);
+                            p.color.r = glm::clamp(p.color.r + randomShift, 0.0f, 1.0f);
+                            p.color.g = glm::clamp(p.color.g + randomShift * 0.5f, 0.0f, 1.0f);
+                        }
+                    }
+                    else if (p.type == 1) {
+                        swirlSpeed = (0.3f + 0.2f * glm::linearRand(0.0f, 1.0f)) + glm::linearRand(-0.05f, 0.05f);
+                        p.velocity.y += sin(p.position.x + p.position.z + globalTime * 2.0f) * 0.07f * deltaTime;
+                    }
+                    else {
+                        swirlSpeed = (0.25f + glm::linearRand(-0.05f, 0.05f)) + glm::linearRand(-0.05f, 0.05f);
+                    }
+
+                    float c = cos(swirlSpeed * deltaTime);
+                    float s = sin(swirlSpeed * deltaTime);
+                    float vx = p.velocity.x * c - p.velocity.z * s;
+                    float vz = p.velocity.x * s + p.velocity.z * c;
+                    p.velocity.x = vx;
+                    p.velocity.z = vz;
+
+                    float noiseScale = (p.type == 0) ? 3.0f : 2.0f;
+                    float noiseStrength = (p.type == 0) ? 0.05f : ((p.type == 1) ? 0.02f : 0.03f);
+                    glm::vec3 noiseVec = glm::vec3(
+                        glm::perlin(p.position * noiseScale + glm::vec3(0.0f, 1.0f, 0.0f)),
+                        0.0f,
+                        glm::perlin(p.position * noiseScale + glm::vec3(2.0f, 1.0f, 0.0f))) * noiseStrength;
+
+                    p.velocity += noiseVec * deltaTime;
+                    p.position += p.velocity * deltaTime;
+
+                    if (p.type == 0) {
+                        if (p.position.y > origin.y + 1.0f) {
+                            p.position.y = origin.y + 1.0f;
+                            p.velocity.y *= 0.3f;
+                        }
+                    }
+                    else if (p.type == 1) {
+                        p.velocity.y += 0.03f * deltaTime;
+                    }
+                    else {
+                        p.velocity.y -= 0.5f * deltaTime;
+                    }
+
+                    glm::vec4 cStage = stageColor(p);
+                    if (p.type == 0) {
+                        cStage.a *= 0.8f + 0.05f * glm::linearRand(0.0f, 1.0f);
+                        float heightAbove = p.position.y - origin.y;
+                        if (heightAbove > 0.3f) {
+                            cStage.a *= glm::clamp(1.0f - (heightAbove - 0.3f) * 2.0f, 0.0f, 1.0f);
+                        }
+                        cStage.r *= p.color.r;
+                        cStage.g *= p.color.g;
+                        cStage = glm::clamp(cStage, 0.0f, 1.0f);
+                    }
+                    p.color = cStage;
+
+                    if (p.type == 0) {
+                        p.size = lifeRatio > 0.9f ? 0.22f * (1.0f - lifeRatio) / 0.1f : glm::mix(0.05f, 0.22f, lifeRatio / 0.9f);
+                    }
+                    else if (p.type == 1) {
+                        p.size = glm::mix(0.35f, 0.15f, lifeRatio);
+                    }
+                    else {
+                        p.size = glm::mix(0.02f, 0.1f, lifeRatio);
+                    }
+
+                    p.rotation += p.rotationSpeed * deltaTime;
+                    if (p.rotation > 360.f) p.rotation -= 360.f;
+                    if (p.rotation < 0.f) p.rotation += 360.f;
+                }
+            }
+        };
+
+        void benchmarkFire() {
+            const int flames = 10000, smoke = 4000, embers = 1000;
+            const size_t particleCount = flames + smoke + embers;
+
+            ThreadPool pool;
+            LegacyFire legacy;
+            FireParticles fire;
+
+            legacy.reset(flames, smoke, embers);
+            fire.reset(flames, smoke, embers, glm::vec3(0.0f), 1337u);
+
+            float time = 0.0f;
+            double legacyRate = measureItemsPerSecond(particleCount, [&](float dt) { legacy.update(dt, time += dt); });
+            double singleRate = measureItemsPerSecond(particleCount, [&](float dt) { fire.update(dt, time += dt, glm::vec3(0.0f)); });
+            double pooledRate = measureItemsPerSecond(particleCount, [&](float dt) { fire.update(dt, time += dt, glm::vec3(0.0f), pool); });
+
+            std::cout << "Fire update, " << particleCount << " particles (" << fire.getCount(FireParticles::FLAME) << " flame, "
+                << fire.getCount(FireParticles::SMOKE) << " smoke, " << fire.getCount(FireParticles::EMBER)
+                << " ember after the run), CPU only (no upload)" << std::endl;
+            printRateTable("particles", particleCount, {
+                { "AoS + glm::perlin", legacyRate },
+                { "SoA pools, 1 thread", singleRate },
+                { "SoA pools, " + std::to_string(pool.getThreadCount()) + " threads", pooledRate },
+            });
+        }
+
+        // Average ms of fn over at least half a second of wall time
+        template <typename Fn>
+        double measureMs(Fn fn) {
+            fn();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            int runs = 0;
+            double seconds = 0.0;
+            while (seconds < 0.5 || runs < 5) {
+                fn();
+                runs++;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+            return seconds * 1000.0 / runs;
+        }
+
+        void benchmarkSort() {
+            const size_t counts[] = { 10000, 100000, 1000000 };
+
+            ThreadPool pool;
+            glm::vec3 eye(0.0f, 2.0f, 6.0f);
+            glm::vec3 forward = glm::normalize(glm::vec3(0.0f, -0.2f, -1.0f));
+
+            std::cout << "Smoke depth sort (back to front), " << pool.getThreadCount() << " threads" << std::endl;
+            std::cout << std::setw(10) << "particles" << std::setw(14) << "std::sort ms" << std::setw(14) << "radix 1t ms"
+                << std::setw(14) << "radix ms" << std::setw(16) << "incremental ms" << std::setw(14) << "incremental" << std::endl;
+
+            for (size_t count : counts) {
+                std::vector<float> x(count), y(count), z(count);
+                FastRandom random(1337u);
+                for (size_t i = 0; i < count; i++) {
+                    x[i] = random.range(-0.6f, 0.6f);
+                    y[i] = random.range(0.0f, 4.0f);
+                    z[i] = random.range(-0.6f, 0.6f);
+                }
+
+                // Reference: float depths and std::sort on one thread
+                std::vector<float> depth(count);
+                std::vector<uint32_t> order(count);
+                double referenceMs = measureMs([&]() {
+                    for (size_t i = 0; i < count; i++) {
+                        depth[i] = glm::dot(glm::vec3(x[i], y[i], z[i]) - eye, forward);
+                        order[i] = static_cast<uint32_t>(i);
+                    }
+                    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return depth[a] > depth[b]; });
+                });
+
+                DepthSorter sorter;
+                double singleMs = measureMs([&]() {
+                    sorter.invalidate();
+                    sorter.sort(x.data(), y.data(), z.data(), count, eye, forward, nullptr);
+                });
+                double pooledMs = measureMs([&]() {
+                    sorter.invalidate();
+                    sorter.sort(x.data(), y.data(), z.data(), count, eye, forward, &pool);
+                });
+
+                // A frame of smoke: everything rises a little, 1% respawns at the
+                // bottom. Only the sort is timed.
+                int incrementalSorts = 0, sorts = 0;
+                double sortMs = 0.0;
+                measureMs([&]() {
+                    for (size_t i = 0; i < count; i++) {
+                        y[i] += 0.01f;
+                        if (y[i] > 4.0f) y[i] -= 4.0f;
+                    }
+                    for (size_t i = 0; i < count / 100; i++) {
+                        size_t j = static_cast<size_t>(random.rangeInt(0, static_cast<int>(count) - 1));
+                        x[j] = random.range(-0.6f, 0.6f);
+                        z[j] = random.range(-0.6f, 0.6f);
+                    }
+                    sorter.sort(x.data(), y.data(), z.data(), count, eye, forward, &pool);
+                    incrementalSorts += sorter.wasIncremental() ? 1 : 0;
+                    sortMs += sorter.getLastSortMs();
+                    sorts++;
+                });
+                double incrementalMs = sortMs / sorts;
+
+                std::cout << std::setw(10) << count << std::fixed << std::setprecision(3)
+                    << std::setw(14) << referenceMs
+                    << std::setw(14) << singleMs
+                    << std::setw(14) << pooledMs
+                    << std::setw(16) << incrementalMs
+                    << std::setw(13) << std::setprecision(0) << 100.0 * incrementalSorts / sorts << "%" << std::endl;
+            }
+        }
+
+    }
+
+    bool runBenchmarks(int argc, const char* argv[]) {
+        bool ran = false;
+
+        if (hasFlag(argc, argv, "--bench-light-assign")) {
+            benchmarkLightAssignment();
+            ran = true;
+        }
+        if (hasFlag(argc, argv, "--bench-rain")) {
+            benchmarkRain();
+            ran = true;
+        }
+        if (hasFlag(argc, argv, "--bench-fire")) {
+            benchmarkFire();
+            ran = true;
+        }
+        if (hasFlag(argc, argv, "--bench-sort")) {
+            benchmarkSort();
+            ran = true;
+        }
+
+        return ran;
+    }
+
+    TourBenchmarkOptions parseTourBenchmarkOptions(int argc, const char* argv[]) {
+        TourBenchmarkOptions options;
+        options.enabled = hasFlag(argc, argv, "--benchmark");
+        options.outputPath = "benchmark.json";
+        options.width = 1280;
+        options.height = 720;
+        options.timeStep = 1.0f / 60.0f;
+        options.seed = 1337u;
+        options.warmupFrames = 30;
+
+        if (const char* output = flagValue(argc, argv, "--benchmark-output")) {
+            options.outputPath = output;
+        }
+        if (const char* size = flagValue(argc, argv, "--benchmark-size")) {
+            int width = 0, height = 0;
+            if (std::sscanf(size, "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                options.width = width;
+                options.height = height;
+            }
+            else {
+                std::cerr << "Ignoring --benchmark-size " << size << ", expected <width>x<height>" << std::endl;
+            }
+        }
+        return options;
+    }
+
+    GpuFireOptions parseGpuFireOptions(int argc, const char* argv[]) {
+        // With the spark room this stays under GpuFireParticles' 64 * 65535
+        const long MAX_PARTICLES = 3900000;
+
+        GpuFireOptions options = {};
+        const char* value = flagValue(argc, argv, "--gpu-fire");
+        if (value == nullptr) {
+            return options;
+        }
+        long particles = std::strtol(value, nullptr, 10);
+        if (particles < 15) {
+            std::cerr << "Ignoring --gpu-fire " << value << ", expected at least 15 particles" << std::endl;
+            return options;
+        }
+        if (particles > MAX_PARTICLES) {
+            std::cerr << "--gpu-fire " << value << " capped at " << MAX_PARTICLES << " particles" << std::endl;
+            particles = MAX_PARTICLES;
+        }
+
+        options.enabled = true;
+        options.smoke = static_cast<int>(particles * 4 / 15);
+        options.embers = static_cast<int>(particles / 15);
+        options.flames = static_cast<int>(particles) - options.smoke - options.embers;
+        options.sparkRoom = options.embers;
+        return options;
+    }
+
+}
@@ -0,0 +1,54 @@
+#ifndef Benchmarks_hpp
+#define Benchmarks_hpp
+
+#include <string>
+
+namespace gps {
+
+    // Offline CPU benchmarks selected from the command line, they run before
+    // any window/GL context exists:
+    //   --bench-light-assign  CPU side of clustered lighting only: assigning
+    //                         1..1000 point lights to clusters, no shading
+    //   --bench-rain     rain update and upload staging drops/s and bytes per
+    //                    frame, old AoS loop vs RainSimulation
+    //   --bench-fire     fire particle update throughput, old AoS loop vs FireParticles
+    //   --bench-sort     smoke depth sort time for 10k..1M particles, std::sort vs
+    //                    DepthSorter (full radix sort and frame to frame)
+    // Returns true when a benchmark ran and the application should exit.
+    bool runBenchmarks(int argc, const char* argv[]);
+
+    // Headless run of the whole scene along waypoints.txt, played by main:
+    //   --benchmark                  offscreen context, rain, fire and wind on,
+    //                                writes per-frame timings and statistics
+    //   --benchmark-output <path>    benchmark.json unless given
+    //   --benchmark-size <w>x<h>     1280x720 unless given
+    struct TourBenchmarkOptions {
+        bool enabled;
+        std::string outputPath;
+        int width, height;
+        // Simulated seconds per frame, whatever the frame took
+        float timeStep;
+        unsigned int seed;
+        // Frames drawn at the first waypoint before timing starts (shader
+        // variants, pool textures, stream buffer warm-up)
+        int warmupFrames;
+    };
+
+    TourBenchmarkOptions parseTourBenchmarkOptions(int argc, const char* argv[]);
+
+    // Size of the compute shader fire, which otherwise matches the CPU pools:
+    //   --gpu-fire <particles>   population in the CPU pools' 10:4:1 mix of
+    //                            flames, smoke and embers, plus room for as
+    //                            many sparks as there are embers. Up to 3.9M,
+    //                            the fire starts on the GPU when given.
+    struct GpuFireOptions {
+        bool enabled;
+        int flames, smoke, embers;
+        int sparkRoom;
+    };
+
+    GpuFireOptions parseGpuFireOptions(int argc, const char* argv[]);
+
+}
+
+#endif
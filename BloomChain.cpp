@@ -0,0 +1,135 @@
+#include "BloomChain.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    BloomChain::BloomChain()
+        : sourceScaleLoc(-1), framebuffer(0) {
+    }
+
+    void BloomChain::init() {
+        prefilterShader.loadShader("shaders/particleFullscreen.vert", "shaders/bloomPrefilter.frag", PARTICLE_SHADER);
+        downsampleShader.loadShader("shaders/particleFullscreen.vert", "shaders/bloomDownsample.frag", PARTICLE_SHADER);
+        upsampleShader.loadShader("shaders/particleFullscreen.vert", "shaders/bloomUpsample.frag", PARTICLE_SHADER);
+
+        prefilterShader.useShaderProgram();
+        glUniform1i(prefilterShader.getUniformLocation("source"), 0);
+        sourceScaleLoc = prefilterShader.getUniformLocation("sourceScale");
+        downsampleShader.useShaderProgram();
+        glUniform1i(downsampleShader.getUniformLocation("source"), 0);
+        upsampleShader.useShaderProgram();
+        glUniform1i(upsampleShader.getUniformLocation("source"), 0);
+
+        triangle.init();
+        glGenFramebuffers(1, &framebuffer);
+        timer.init();
+    }
+
+    void BloomChain::cleanup() {
+        deleteLevels();
+        glDeleteFramebuffers(1, &framebuffer);
+        triangle.cleanup();
+        timer.cleanup();
+        glDeleteProgram(prefilterShader.shaderProgram);
+        glDeleteProgram(downsampleShader.shaderProgram);
+        glDeleteProgram(upsampleShader.shaderProgram);
+    }
+
+    void BloomChain::resize(int width, int height) {
+        deleteLevels();
+
+        // Stops early when a level would be a few texels across, the tent
+        // filter has nothing left to spread
+        int levelWidth = std::max(width / 2, 1);
+        int levelHeight = std::max(height / 2, 1);
+        while (static_cast<int>(levels.size()) < MAX_LEVELS &&
+            (levels.empty() || std::min(levelWidth, levelHeight) >= 4)) {
+            Level level = { 0, levelWidth, levelHeight };
+            glGenTextures(1, &level.texture);
+            glBindTexture(GL_TEXTURE_2D, level.texture);
+            // Bloom is never negative and needs no alpha: half the memory of RGBA16F
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R11F_G11F_B10F, levelWidth, levelHeight, 0, GL_RGB, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            levels.push_back(level);
+
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, levels[0].texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Bloom chain framebuffer not complete!" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void BloomChain::deleteLevels() {
+        for (Level& level : levels) {
+            glDeleteTextures(1, &level.texture);
+        }
+        levels.clear();
+    }
+
+    size_t BloomChain::getAllocatedBytes() const {
+        size_t bytes = 0;
+        for (const Level& level : levels) {
+            bytes += static_cast<size_t>(level.width) * level.height * 4;
+        }
+        return bytes;
+    }
+
+    void BloomChain::drawInto(const Level& level) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0);
+        glViewport(0, 0, level.width, level.height);
+        triangle.draw();
+    }
+
+    void BloomChain::render(GLuint brightTexture, const glm::vec2& sourceScale) {
+        if (levels.empty()) {
+            return;
+        }
+
+        timer.begin();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        triangle.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glDisable(GL_BLEND);
+
+        prefilterShader.useShaderProgram();
+        glUniform2fv(sourceScaleLoc, 1, &sourceScale[0]);
+        glBindTexture(GL_TEXTURE_2D, brightTexture);
+        drawInto(levels[0]);
+
+        downsampleShader.useShaderProgram();
+        for (size_t i = 1; i < levels.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, levels[i - 1].texture);
+            drawInto(levels[i]);
+        }
+
+        // Each level is read before the one above is written, so the level
+        // being added to is never also the source
+        upsampleShader.useShaderProgram();
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        for (size_t i = levels.size() - 1; i > 0; i--) {
+            glBindTexture(GL_TEXTURE_2D, levels[i].texture);
+            drawInto(levels[i - 1]);
+        }
+        glDisable(GL_BLEND);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        timer.end();
+    }
+
+}
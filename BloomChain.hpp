@@ -0,0 +1,88 @@
+#ifndef BloomChain_hpp
+#define BloomChain_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "Shader.hpp"
+#include "GpuTimer.hpp"
+#include "FullscreenTriangle.hpp"
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Bloom from a chain of ever smaller targets instead of blurring at full
+    // resolution. The bright texture is filtered down to half size, then
+    // halved again level by level; each step below the first uses a 13 tap
+    // filter (a 4 x 4 box made of five overlapping 2 x 2 boxes), so nothing
+    // flickers as small highlights move. The chain is then walked back up,
+    // every level blurred with a 3 x 3 tent and added onto the one above.
+    // Level 0 ends up holding the sum of all levels, a wide, smooth glow.
+    //
+    // The first downsample reads the most texels, so it covers the same
+    // 4 x 4 footprint with four bilinear taps, one per 2 x 2 box, in its own
+    // program. It weights the boxes by 1 / (1 + luma) (Karis average) so
+    // single very bright pixels, sparks and embers, do not bloom into
+    // blinking squares.
+    class BloomChain {
+
+    public:
+        static const int MAX_LEVELS = 6;
+
+        BloomChain();
+
+        void init();
+        void cleanup();
+
+        // Size of the bright texture; the chain starts at half of it
+        void resize(int width, int height);
+
+        // Filters the bright texture down and back up the chain. Only the
+        // part given by sourceScale (from the lower left corner, dynamic
+        // resolution) is read; the chain always covers the window. Leaves
+        // framebuffer 0 bound and blending disabled; the viewport is changed.
+        void render(GLuint brightTexture, const glm::vec2& sourceScale);
+
+        // Half resolution, to be sampled with linear filtering and scaled by
+        // getScale
+        GLuint getTexture() const { return levels.empty() ? 0 : levels[0].texture; }
+        // The levels are summed, this brings the glow back to the bright
+        // texture's energy
+        float getScale() const { return levels.empty() ? 0.0f : 1.0f / levels.size(); }
+        int getLevelCount() const { return static_cast<int>(levels.size()); }
+        size_t getAllocatedBytes() const;
+
+        // GPU time of the most recent render that has finished, in ms
+        double getGpuMs() const { return timer.getGpuMs(); }
+
+    private:
+        struct Level {
+            GLuint texture;
+            int width, height;
+        };
+
+        void deleteLevels();
+        void drawInto(const Level& level);
+
+        Shader prefilterShader;
+        Shader downsampleShader;
+        Shader upsampleShader;
+        GLint sourceScaleLoc;
+        FullscreenTriangle triangle;
+        // Reattached to each level in turn
+        GLuint framebuffer;
+        std::vector<Level> levels;
+
+        GpuTimer timer;
+    };
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include "ClusteredLights.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+namespace gps {
+
+    ClusteredLights::ClusteredLights()
+        : lightBuffer(0), lightTexture(0), gridBuffer(0), gridTexture(0), indexBuffer(0), indexTexture(0),
+        zNear(0.1f), zFar(300.0f), sliceScale(0.0f), sliceBias(0.0f), boundsProjection(0.0f),
+        lastAssignMs(0.0) {
+
+        grid.resize(CLUSTER_COUNT, glm::uvec2(0));
+        sliceIndices.resize(GRID_Z);
+        sliceCounts.resize(GRID_Z, std::vector<GLuint>(GRID_X * GRID_Y, 0));
+        sliceCandidates.resize(GRID_Z);
+    }
+
+    ClusteredLights::~ClusteredLights() {
+    }
+
+    void ClusteredLights::init() {
+        glGenBuffers(1, &lightBuffer);
+        glGenBuffers(1, &gridBuffer);
+        glGenBuffers(1, &indexBuffer);
+        glGenTextures(1, &lightTexture);
+        glGenTextures(1, &gridTexture);
+        glGenTextures(1, &indexTexture);
+
+        // Start with empty, but valid, buffers so the samplers are always complete
+        upload();
+
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLights::cleanup() {
+        glDeleteTextures(1, &lightTexture);
+        glDeleteTextures(1, &gridTexture);
+        glDeleteTextures(1, &indexTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &gridBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+    }
+
+    void ClusteredLights::scatter(size_t count, const glm::vec3& minBounds, const glm::vec3& maxBounds, unsigned int seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        lights.resize(std::min<size_t>(count, MAX_LIGHTS));
+        for (ClusteredPointLight& light : lights) {
+            light.position = glm::mix(minBounds, maxBounds, glm::vec3(unit(rng), unit(rng), unit(rng)));
+            light.radius = 2.0f + unit(rng) * 4.0f;
+            light.color = glm::mix(glm::vec3(1.0f, 0.55f, 0.2f), glm::vec3(1.0f, 0.9f, 0.6f), unit(rng));
+            light.intensity = 1.0f + unit(rng) * 2.0f;
+        }
+    }
+
+    void ClusteredLights::rebuildClusterBounds(const glm::mat4& projectionMatrix, float nearPlane, float farPlane) {
+        zNear = nearPlane;
+        zFar = farPlane;
+        boundsProjection = projectionMatrix;
+
+        float logRatio = std::log(zFar / zNear);
+        sliceScale = GRID_Z / logRatio;
+        sliceBias = GRID_Z * std::log(zNear) / logRatio;
+
+        clusterMin.resize(CLUSTER_COUNT);
+        clusterMax.resize(CLUSTER_COUNT);
+
+        glm::mat4 inverseProjection = glm::inverse(projectionMatrix);
+
+        // View space point on the ray through an NDC xy coordinate, at a given depth
+        auto pointAtDepth = [&](float ndcX, float ndcY, float depth) {
+            glm::vec4 p = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+            glm::vec3 v = glm::vec3(p) / p.w;
+            return v * (depth / -v.z);
+        };
+
+        for (int z = 0; z < GRID_Z; z++) {
+            float sliceNear = zNear * std::pow(zFar / zNear, static_cast<float>(z) / GRID_Z);
+            float sliceFar = zNear * std::pow(zFar / zNear, static_cast<float>(z + 1) / GRID_Z);
+
+            for (int y = 0; y < GRID_Y; y++) {
+                float ndcY0 = -1.0f + 2.0f * y / GRID_Y;
+                float ndcY1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+
+                for (int x = 0; x < GRID_X; x++) {
+                    float ndcX0 = -1.0f + 2.0f * x / GRID_X;
+                    float ndcX1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+
+                    glm::vec3 corners[8] = {
+                        pointAtDepth(ndcX0, ndcY0, sliceNear), pointAtDepth(ndcX1, ndcY0, sliceNear),
+                        pointAtDepth(ndcX0, ndcY1, sliceNear), pointAtDepth(ndcX1, ndcY1, sliceNear),
+                        pointAtDepth(ndcX0, ndcY0, sliceFar),  pointAtDepth(ndcX1, ndcY0, sliceFar),
+                        pointAtDepth(ndcX0, ndcY1, sliceFar),  pointAtDepth(ndcX1, ndcY1, sliceFar)
+                    };
+
+                    glm::vec3 minBounds = corners[0];
+                    glm::vec3 maxBounds = corners[0];
+                    for (int i = 1; i < 8; i++) {
+                        minBounds = glm::min(minBounds, corners[i]);
+                        maxBounds = glm::max(maxBounds, corners[i]);
+                    }
+
+                    int index = x + y * GRID_X + z * GRID_X * GRID_Y;
+                    clusterMin[index] = minBounds;
+                    clusterMax[index] = maxBounds;
+                }
+            }
+        }
+    }
+
+    void ClusteredLights::assign(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float nearPlane, float farPlane, ThreadPool& pool) {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        if (projectionMatrix != boundsProjection || nearPlane != zNear || farPlane != zFar || clusterMin.empty()) {
+            rebuildClusterBounds(projectionMatrix, nearPlane, farPlane);
+        }
+
+        size_t lightCount = std::min<size_t>(lights.size(), MAX_LIGHTS);
+
+        viewLights.resize(lightCount);
+        lightTexels.resize(lightCount * 2);
+        for (size_t i = 0; i < lightCount; i++) {
+            const ClusteredPointLight& light = lights[i];
+            viewLights[i] = glm::vec4(glm::vec3(viewMatrix * glm::vec4(light.position, 1.0f)), light.radius);
+            lightTexels[i * 2 + 0] = glm::vec4(light.position, light.radius);
+            lightTexels[i * 2 + 1] = glm::vec4(light.color, light.intensity);
+        }
+
+        const int tilesPerSlice = GRID_X * GRID_Y;
+
+        // Every slice is independent, so slices are spread over the pool
+        pool.parallelFor(GRID_Z, 1, [&](size_t begin, size_t end, size_t) {
+            for (size_t z = begin; z < end; z++) {
+                float sliceNear = zNear * std::pow(zFar / zNear, static_cast<float>(z) / GRID_Z);
+                float sliceFar = zNear * std::pow(zFar / zNear, static_cast<float>(z + 1) / GRID_Z);
+
+                std::vector<GLuint>& candidates = sliceCandidates[z];
+                std::vector<GLuint>& indices = sliceIndices[z];
+                std::vector<GLuint>& counts = sliceCounts[z];
+                candidates.clear();
+                indices.clear();
+
+                for (size_t i = 0; i < lightCount; i++) {
+                    float depth = -viewLights[i].z;
+                    float radius = viewLights[i].w;
+                    if (depth + radius >= sliceNear && depth - radius <= sliceFar) {
+                        candidates.push_back(static_cast<GLuint>(i));
+                    }
+                }
+
+                for (int tile = 0; tile < tilesPerSlice; tile++) {
+                    int cluster = tile + static_cast<int>(z) * tilesPerSlice;
+                    const glm::vec3& minBounds = clusterMin[cluster];
+                    const glm::vec3& maxBounds = clusterMax[cluster];
+
+                    GLuint count = 0;
+                    for (GLuint lightIndex : candidates) {
+                        glm::vec3 center = glm::vec3(viewLights[lightIndex]);
+                        float radius = viewLights[lightIndex].w;
+                        glm::vec3 closest = glm::clamp(center, minBounds, maxBounds);
+                        glm::vec3 delta = closest - center;
+                        if (glm::dot(delta, delta) <= radius * radius) {
+                            indices.push_back(lightIndex);
+                            count++;
+                        }
+                    }
+                    counts[tile] = count;
+                }
+            }
+        });
+
+        indexList.clear();
+        for (int z = 0; z < GRID_Z; z++) {
+            for (int tile = 0; tile < tilesPerSlice; tile++) {
+                grid[tile + z * tilesPerSlice] = glm::uvec2(0, sliceCounts[z][tile]);
+            }
+            GLuint offset = static_cast<GLuint>(indexList.size());
+            for (int tile = 0; tile < tilesPerSlice; tile++) {
+                grid[tile + z * tilesPerSlice].x = offset;
+                offset += sliceCounts[z][tile];
+            }
+            indexList.insert(indexList.end(), sliceIndices[z].begin(), sliceIndices[z].end());
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        lastAssignMs = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void ClusteredLights::upload() {
+        static const glm::vec4 emptyLight[2] = { glm::vec4(0.0f), glm::vec4(0.0f) };
+        static const GLuint emptyIndex = 0;
+
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+        if (lightTexels.empty()) {
+            glBufferData(GL_TEXTURE_BUFFER, sizeof(emptyLight), emptyLight, GL_STREAM_DRAW);
+        }
+        else {
+            glBufferData(GL_TEXTURE_BUFFER, lightTexels.size() * sizeof(glm::vec4), &lightTexels[0], GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(glm::uvec2), &grid[0], GL_STREAM_DRAW);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, indexBuffer);
+        if (indexList.empty()) {
+            glBufferData(GL_TEXTURE_BUFFER, sizeof(emptyIndex), &emptyIndex, GL_STREAM_DRAW);
+        }
+        else {
+            glBufferData(GL_TEXTURE_BUFFER, indexList.size() * sizeof(GLuint), &indexList[0], GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void ClusteredLights::bindTextures(GLuint firstUnit) const {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTexture);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+}
@@ -0,0 +1,95 @@
+#ifndef ClusteredLights_hpp
+#define ClusteredLights_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Small unshadowed point light (lanterns, fireflies, ...)
+    struct ClusteredPointLight {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+        float intensity;
+    };
+
+    // Froxel grid laid over the main camera frustum. Lights are binned on the CPU
+    // and handed to the fragment shader through three texture buffers:
+    //   lights  (RGBA32F) : 2 texels per light, position/radius and color/intensity
+    //   grid    (RG32UI)  : offset/count into the index list, one texel per cluster
+    //   indices (R32UI)   : light indices, grouped per cluster
+    class ClusteredLights {
+
+    public:
+        static const int GRID_X = 16;
+        static const int GRID_Y = 9;
+        static const int GRID_Z = 24;
+        static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+        static const int MAX_LIGHTS = 4096;
+
+        ClusteredLights();
+        ~ClusteredLights();
+
+        void init();
+        void cleanup();
+
+        std::vector<ClusteredPointLight> lights;
+
+        // Replaces the light list with count random warm lights inside the given box
+        void scatter(size_t count, const glm::vec3& minBounds, const glm::vec3& maxBounds, unsigned int seed);
+
+        // Bins the lights into froxels (CPU only, can run without a GL context)
+        void assign(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, float zNear, float zFar, ThreadPool& pool);
+        // Sends the result of the last assign to the texture buffers
+        void upload();
+
+        // Binds lights/grid/indices to three consecutive texture units
+        void bindTextures(GLuint firstUnit) const;
+
+        glm::vec4 getZParams() const { return glm::vec4(zNear, zFar, sliceScale, sliceBias); }
+        glm::ivec3 getDimensions() const { return glm::ivec3(GRID_X, GRID_Y, GRID_Z); }
+        size_t getIndexCount() const { return indexList.size(); }
+        double getLastAssignMs() const { return lastAssignMs; }
+
+    private:
+        void rebuildClusterBounds(const glm::mat4& projectionMatrix, float zNear, float zFar);
+
+        GLuint lightBuffer, lightTexture;
+        GLuint gridBuffer, gridTexture;
+        GLuint indexBuffer, indexTexture;
+
+        float zNear, zFar;
+        float sliceScale, sliceBias;
+        glm::mat4 boundsProjection;
+
+        // View space AABB per cluster, rebuilt when the projection changes
+        std::vector<glm::vec3> clusterMin;
+        std::vector<glm::vec3> clusterMax;
+
+        // Per z-slice scratch, each slice is written by a single worker
+        std::vector<glm::vec4> viewLights;
+        std::vector<std::vector<GLuint>> sliceCandidates;
+        std::vector<std::vector<GLuint>> sliceIndices;
+        std::vector<std::vector<GLuint>> sliceCounts;
+
+        std::vector<glm::uvec2> grid;
+        std::vector<GLuint> indexList;
+        std::vector<glm::vec4> lightTexels;
+
+        double lastAssignMs;
+    };
+
+}
+
+#endif
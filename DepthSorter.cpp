@@ -0,0 +1,232 @@
+#include "DepthSorter.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace gps {
+
+    namespace {
+
+        const size_t MIN_CHUNK = 8192;
+        const int RADIX = 256;
+
+        // Share of entries allowed out of place before a full sort is cheaper
+        const size_t MAX_MOVED_FRACTION = 8;
+        // Kept entries one out of place entry may push out
+        const size_t MAX_EVICTED = 8;
+
+        template <typename Fn>
+        void forEachChunk(ThreadPool* pool, size_t chunkCount, size_t count, Fn fn) {
+            auto run = [&](size_t chunk) {
+                size_t begin = count * chunk / chunkCount;
+                size_t end = count * (chunk + 1) / chunkCount;
+                fn(chunk, begin, end);
+            };
+            if (pool != nullptr && chunkCount > 1) {
+                pool->parallelFor(chunkCount, 1, [&](size_t first, size_t last, size_t) {
+                    for (size_t chunk = first; chunk < last; chunk++) {
+                        run(chunk);
+                    }
+                });
+            }
+            else {
+                for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+                    run(chunk);
+                }
+            }
+        }
+    }
+
+    DepthSorter::DepthSorter()
+        : count(0), incremental(false), lastSortMs(0.0) {
+    }
+
+    size_t DepthSorter::getChunkCount(ThreadPool* pool) const {
+        if (pool == nullptr) {
+            return 1;
+        }
+        size_t chunks = std::min(pool->getThreadCount() * 2, count / MIN_CHUNK);
+        return std::max<size_t>(chunks, 1);
+    }
+
+    void DepthSorter::sort(const float* x, const float* y, const float* z, size_t newCount,
+        const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool) {
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        size_t previousCount = count;
+        count = newCount;
+        keys.resize(count);
+        scratch.resize(count);
+
+        computeKeys(x, y, z, eye, forward, pool);
+
+        incremental = refine(previousCount);
+        if (!incremental) {
+            radixSort(pool);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        lastSortMs = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // Farthest point gets key 0, so ascending keys are back to front
+    void DepthSorter::computeKeys(const float* x, const float* y, const float* z,
+        const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool) {
+
+        if (count == 0) {
+            return;
+        }
+
+        size_t chunkCount = getChunkCount(pool);
+        chunkMin.assign(chunkCount, 0.0f);
+        chunkMax.assign(chunkCount, 0.0f);
+
+        forEachChunk(pool, chunkCount, count, [&](size_t chunk, size_t begin, size_t end) {
+            float low = 1.0e30f, high = -1.0e30f;
+            for (size_t i = begin; i < end; i++) {
+                float depth = (x[i] - eye.x) * forward.x + (y[i] - eye.y) * forward.y + (z[i] - eye.z) * forward.z;
+                low = std::min(low, depth);
+                high = std::max(high, depth);
+            }
+            chunkMin[chunk] = low;
+            chunkMax[chunk] = high;
+        });
+
+        float minDepth = *std::min_element(chunkMin.begin(), chunkMin.end());
+        float maxDepth = *std::max_element(chunkMax.begin(), chunkMax.end());
+        float scale = maxDepth > minDepth ? 65535.0f / (maxDepth - minDepth) : 0.0f;
+
+        forEachChunk(pool, chunkCount, count, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                float depth = (x[i] - eye.x) * forward.x + (y[i] - eye.y) * forward.y + (z[i] - eye.z) * forward.z;
+                float quantised = std::min(std::max((depth - minDepth) * scale, 0.0f), 65535.0f);
+                keys[i] = static_cast<uint16_t>(65535 - static_cast<int>(quantised));
+            }
+        });
+    }
+
+    // Patches last frame's order: drops indices past the new count, appends
+    // the new ones, then pulls out the entries that are out of place, sorts
+    // those alone and merges them back. False when that would not pay off.
+    bool DepthSorter::refine(size_t previousCount) {
+        if (previousCount == 0 || order.size() != previousCount || count == 0) {
+            return false;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < previousCount; i++) {
+            if (order[i] < count) {
+                order[write++] = order[i];
+            }
+        }
+        order.resize(count);
+        for (size_t i = previousCount; i < count; i++) {
+            order[write++] = static_cast<uint32_t>(i);
+        }
+
+        // Kept entries stay in order, give or take one key: particles that
+        // shared a key last frame fall either side of a step this frame, and
+        // that much error the quantisation has anyway. An entry too far below
+        // the kept ones before it either evicts the few kept entries above it
+        // (they were the misplaced ones) or, with more than a handful above
+        // it, is moved out itself. keptCeiling holds the running maximum.
+        kept.clear();
+        keptKeys.clear();
+        keptCeiling.clear();
+        moved.clear();
+        kept.reserve(count);
+        keptKeys.reserve(count);
+        keptCeiling.reserve(count);
+        size_t maxMoved = count / MAX_MOVED_FRACTION + 16;
+        uint16_t ceiling = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index = order[i];
+            uint16_t key = keys[index];
+
+            if (ceiling > key + 1) {
+                size_t above = 1;
+                while (above < kept.size() && above <= MAX_EVICTED && keptCeiling[kept.size() - 1 - above] > key + 1) {
+                    above++;
+                }
+                if (above > MAX_EVICTED) {
+                    moved.push_back(index);
+                    if (moved.size() > maxMoved) {
+                        return false;
+                    }
+                    continue;
+                }
+                moved.insert(moved.end(), kept.end() - above, kept.end());
+                kept.resize(kept.size() - above);
+                keptKeys.resize(kept.size());
+                keptCeiling.resize(kept.size());
+                ceiling = keptCeiling.empty() ? 0 : keptCeiling.back();
+            }
+
+            ceiling = std::max(ceiling, key);
+            kept.push_back(index);
+            keptKeys.push_back(key);
+            keptCeiling.push_back(ceiling);
+        }
+        if (moved.size() > maxMoved) {
+            return false;
+        }
+
+        std::sort(moved.begin(), moved.end(), [this](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+
+        // Not std::merge, kept is only nearly sorted
+        size_t k = 0, m = 0, out = 0;
+        while (k < kept.size() && m < moved.size()) {
+            order[out++] = keys[moved[m]] < keptKeys[k] ? moved[m++] : kept[k++];
+        }
+        while (k < kept.size()) order[out++] = kept[k++];
+        while (m < moved.size()) order[out++] = moved[m++];
+        return true;
+    }
+
+    void DepthSorter::radixSort(ThreadPool* pool) {
+        order.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            order[i] = static_cast<uint32_t>(i);
+        }
+        radixPass(order.data(), scratch.data(), 0, pool);
+        radixPass(scratch.data(), order.data(), 8, pool);
+    }
+
+    // Stable counting sort of source by one key byte
+    void DepthSorter::radixPass(const uint32_t* source, uint32_t* destination, int shift, ThreadPool* pool) {
+        if (count == 0) {
+            return;
+        }
+
+        size_t chunkCount = getChunkCount(pool);
+        histograms.assign(chunkCount * RADIX, 0);
+
+        forEachChunk(pool, chunkCount, count, [&](size_t chunk, size_t begin, size_t end) {
+            uint32_t* histogram = &histograms[chunk * RADIX];
+            for (size_t i = begin; i < end; i++) {
+                histogram[(keys[source[i]] >> shift) & 0xFF]++;
+            }
+        });
+
+        // Digit major, chunk minor, so equal digits keep their chunk order
+        uint32_t offset = 0;
+        for (int digit = 0; digit < RADIX; digit++) {
+            for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+                uint32_t& slot = histograms[chunk * RADIX + digit];
+                uint32_t digitCount = slot;
+                slot = offset;
+                offset += digitCount;
+            }
+        }
+
+        forEachChunk(pool, chunkCount, count, [&](size_t chunk, size_t begin, size_t end) {
+            uint32_t* offsets = &histograms[chunk * RADIX];
+            for (size_t i = begin; i < end; i++) {
+                uint32_t index = source[i];
+                destination[offsets[(keys[index] >> shift) & 0xFF]++] = index;
+            }
+        });
+    }
+
+}
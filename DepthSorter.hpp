@@ -0,0 +1,66 @@
+#ifndef DepthSorter_hpp
+#define DepthSorter_hpp
+
+#include "ThreadPool.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Back to front order of a point set (SoA positions) for alpha blending.
+    // Depth along the view direction is quantised to a 16 bit key and sorted
+    // with a two pass (8 bit) LSD radix sort, histograms and scatter split in
+    // chunks over the pool.
+    //
+    // One sorter per view. Particles move little between frames, so the last
+    // order is tried first: the few entries that broke the order (respawned
+    // or swapped into a new slot) are pulled out, sorted on their own and
+    // merged back. When too many moved it falls back to the full sort.
+    class DepthSorter {
+
+    public:
+        DepthSorter();
+
+        // Indices [0, count) ordered farthest first from eye along forward
+        void sort(const float* x, const float* y, const float* z, size_t count,
+            const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool);
+
+        const std::vector<uint32_t>& getOrder() const { return order; }
+        size_t getCount() const { return count; }
+
+        // The next sort starts from scratch
+        void invalidate() { count = 0; }
+        // The last sort patched the previous order instead of a full radix sort
+        bool wasIncremental() const { return incremental; }
+        double getLastSortMs() const { return lastSortMs; }
+
+    private:
+        void computeKeys(const float* x, const float* y, const float* z,
+            const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool);
+        bool refine(size_t previousCount);
+        void radixSort(ThreadPool* pool);
+        void radixPass(const uint32_t* source, uint32_t* destination, int shift, ThreadPool* pool);
+        size_t getChunkCount(ThreadPool* pool) const;
+
+        size_t count;
+        std::vector<uint16_t> keys;
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> scratch;
+        std::vector<uint32_t> kept;
+        std::vector<uint32_t> moved;
+        std::vector<uint16_t> keptKeys;
+        std::vector<uint16_t> keptCeiling;
+        // 256 digit counts per chunk, then the chunk's scatter offsets
+        std::vector<uint32_t> histograms;
+        std::vector<float> chunkMin, chunkMax;
+
+        bool incremental;
+        double lastSortMs;
+    };
+
+}
+
+#endif
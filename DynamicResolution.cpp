@@ -0,0 +1,144 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+        // Per controller step, on the error in pixel fraction
+        const double PROPORTIONAL_GAIN = 0.25;
+        const double INTEGRAL_GAIN = 0.5;
+        const double DERIVATIVE_GAIN = 0.05;
+    }
+
+    const float DynamicResolution::SCALE_STEP = 0.05f;
+    const float DynamicResolution::MIN_SCALE = 0.5f;
+
+    DynamicResolution::DynamicResolution()
+        : frameIndex(0), enabled(false), targetMs(1000.0 / 60.0), gpuMs(0.0),
+        pixelFraction(1.0f), lastError(0.0), previousError(0.0), scale(1.0f), framesSinceChange(0),
+        measuredSum(0.0), measuredCount(0) {
+
+        for (int i = 0; i < QUERY_FRAMES; i++) {
+            startQueries[i] = 0;
+            endQueries[i] = 0;
+            pending[i] = false;
+        }
+    }
+
+    void DynamicResolution::init() {
+        glGenQueries(QUERY_FRAMES, startQueries);
+        glGenQueries(QUERY_FRAMES, endQueries);
+    }
+
+    void DynamicResolution::cleanup() {
+        glDeleteQueries(QUERY_FRAMES, startQueries);
+        glDeleteQueries(QUERY_FRAMES, endQueries);
+    }
+
+    bool DynamicResolution::setEnabled(bool enable) {
+        if (enable == enabled) {
+            return false;
+        }
+        enabled = enable;
+        pixelFraction = 1.0f;
+        lastError = previousError = 0.0;
+        framesSinceChange = 0;
+        measuredSum = 0.0;
+        measuredCount = 0;
+        if (scale == 1.0f) {
+            return false;
+        }
+        scale = 1.0f;
+        std::cout << "Dynamic resolution: scale 1 (" << (enabled ? "enabled" : "disabled") << ")" << std::endl;
+        return true;
+    }
+
+    void DynamicResolution::beginFrame() {
+        // A frame still in flight after QUERY_FRAMES is skipped, not waited for
+        if (pending[frameIndex]) {
+            return;
+        }
+        glQueryCounter(startQueries[frameIndex], GL_TIMESTAMP);
+    }
+
+    bool DynamicResolution::endFrame() {
+        if (!pending[frameIndex]) {
+            glQueryCounter(endQueries[frameIndex], GL_TIMESTAMP);
+            pending[frameIndex] = true;
+        }
+        frameIndex = (frameIndex + 1) % QUERY_FRAMES;
+
+        // The oldest frame, which the next beginFrame reuses
+        if (!pending[frameIndex]) {
+            return false;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(endQueries[frameIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(startQueries[frameIndex], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(endQueries[frameIndex], GL_QUERY_RESULT, &end);
+        pending[frameIndex] = false;
+        gpuMs = (end - start) / 1000000.0;
+
+        return enabled && update(gpuMs);
+    }
+
+    bool DynamicResolution::update(double measuredMs) {
+        // The first results after a change were drawn at the old scale
+        framesSinceChange++;
+        if (framesSinceChange <= QUERY_FRAMES) {
+            return false;
+        }
+        measuredSum += measuredMs;
+        measuredCount++;
+        if (framesSinceChange < HOLD_FRAMES) {
+            return false;
+        }
+
+        double averageMs = measuredSum / measuredCount;
+        step(averageMs);
+        measuredSum = 0.0;
+        measuredCount = 0;
+        // Measured again from here whether the scale changes or not
+        framesSinceChange = QUERY_FRAMES;
+
+        float wanted = std::sqrt(pixelFraction);
+        // Only once the controller is three quarters of a step away from the
+        // current scale, so noise around a step boundary does not flip it
+        if (std::fabs(wanted - scale) < SCALE_STEP * 0.75f) {
+            return false;
+        }
+        float stepped = std::round(wanted / SCALE_STEP) * SCALE_STEP;
+        stepped = std::min(std::max(stepped, MIN_SCALE), 1.0f);
+        if (stepped == scale) {
+            return false;
+        }
+
+        std::cout << "Dynamic resolution: scale " << scale << " -> " << stepped << " (GPU " << averageMs <<
+            " ms averaged, target " << targetMs << " ms)" << std::endl;
+        scale = stepped;
+        framesSinceChange = 0;
+        return true;
+    }
+
+    void DynamicResolution::step(double measuredMs) {
+        // The pixel fraction that would meet the target if the cost were
+        // all per pixel, less the one drawn: positive while there is headroom
+        double drawnFraction = static_cast<double>(scale) * scale;
+        double error = drawnFraction * (targetMs / std::max(measuredMs, 0.001) - 1.0);
+        double change = PROPORTIONAL_GAIN * (error - lastError) + INTEGRAL_GAIN * error +
+            DERIVATIVE_GAIN * (error - 2.0 * lastError + previousError);
+        previousError = lastError;
+        lastError = error;
+
+        pixelFraction = static_cast<float>(pixelFraction + change);
+        pixelFraction = std::min(std::max(pixelFraction, MIN_SCALE * MIN_SCALE), 1.0f);
+    }
+
+}
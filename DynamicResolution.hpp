@@ -0,0 +1,87 @@
+#ifndef DynamicResolution_hpp
+#define DynamicResolution_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+namespace gps {
+
+    // Picks the fraction of the window the main pass is drawn at so the GPU
+    // frame time stays near a target.
+    //
+    // Each frame is bracketed by two timestamp queries (GL_TIMESTAMP, so the
+    // GL_TIME_ELAPSED timers of single passes can run inside it), kept in a
+    // ring and read a few frames later without stalling.
+    //
+    // A PID controller works on the pixel fraction, scale squared, which the
+    // cost follows roughly linearly. It steps once per HOLD_FRAMES on the
+    // mean frame time since the last change, leaving out the frames still in
+    // flight at the change, since every change reallocates the targets sized
+    // to the scene. It is written in velocity form: each step adds a change,
+    // so clamping the fraction cannot wind the integral up. The scale applied
+    // moves in steps of SCALE_STEP.
+    class DynamicResolution {
+
+    public:
+        static const int QUERY_FRAMES = 4;
+        static const int HOLD_FRAMES = 30;
+        static const float SCALE_STEP;
+        static const float MIN_SCALE;
+
+        DynamicResolution();
+
+        void init();
+        void cleanup();
+
+        // Disabling goes back to full resolution. Returns true when the
+        // scale changed.
+        bool setEnabled(bool enabled);
+        bool isEnabled() const { return enabled; }
+
+        void setTargetMs(double milliseconds) { targetMs = milliseconds; }
+        double getTargetMs() const { return targetMs; }
+
+        // Around all of a frame's GPU work. endFrame reads the oldest
+        // finished frame, steps the controller and returns true when the
+        // scale changed.
+        void beginFrame();
+        bool endFrame();
+
+        // Of the window size along each axis, 1 when disabled
+        float getScale() const { return scale; }
+        // Latest measured frame, in ms
+        double getGpuMs() const { return gpuMs; }
+
+    private:
+        // One measured frame, returns true when the scale changed
+        bool update(double measuredMs);
+        void step(double measuredMs);
+
+        GLuint startQueries[QUERY_FRAMES];
+        GLuint endQueries[QUERY_FRAMES];
+        bool pending[QUERY_FRAMES];
+        int frameIndex;
+
+        bool enabled;
+        double targetMs;
+        double gpuMs;
+
+        // Controller state: the pixel fraction it asks for and the last two errors
+        float pixelFraction;
+        double lastError;
+        double previousError;
+
+        float scale;
+        int framesSinceChange;
+        double measuredSum;
+        int measuredCount;
+    };
+
+}
+
+#endif
@@ -0,0 +1,684 @@
+#include "FireParticles.hpp"
+
+#include "glm/gtc/noise.hpp"
+#include "glm/gtc/packing.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        const float PI = 3.14159265f;
+        const size_t MIN_CHUNK = 2048;
+        // A pool below its target grows back over at least this many updates
+        const size_t GROWTH_STEPS = 32;
+
+        const GLfloat QUAD_VERTICES[] = {
+            -0.5f, -0.5f,   0.0f, 0.0f,
+             0.5f, -0.5f,   1.0f, 0.0f,
+             0.5f,  0.5f,   1.0f, 1.0f,
+
+            -0.5f, -0.5f,   0.0f, 0.0f,
+             0.5f,  0.5f,   1.0f, 1.0f,
+            -0.5f,  0.5f,   0.0f, 1.0f
+        };
+
+        // Two channels of periodic Perlin noise, sampled trilinearly instead of
+        // calling glm::perlin twice per particle per frame. Channel 0 is
+        // perlin(p + (0, 1, 0)), channel 1 perlin(p + (2, 1, 0)).
+        class NoiseTable {
+
+        public:
+            static const int SIZE = 32;
+            static const int SAMPLES_PER_UNIT = 4;
+
+            NoiseTable() : data(SIZE * SIZE * SIZE * 2) {
+                const float period = static_cast<float>(SIZE / SAMPLES_PER_UNIT);
+                const glm::vec3 repeat(period);
+                for (int z = 0; z < SIZE; z++) {
+                    for (int y = 0; y < SIZE; y++) {
+                        for (int x = 0; x < SIZE; x++) {
+                            glm::vec3 p = glm::vec3(x, y, z) / static_cast<float>(SAMPLES_PER_UNIT);
+                            float* cell = &data[index(x, y, z)];
+                            cell[0] = glm::perlin(p + glm::vec3(0.0f, 1.0f, 0.0f), repeat);
+                            cell[1] = glm::perlin(p + glm::vec3(2.0f, 1.0f, 0.0f), repeat);
+                        }
+                    }
+                }
+            }
+
+            void sample(float x, float y, float z, float& n0, float& n1) const {
+                x *= SAMPLES_PER_UNIT;
+                y *= SAMPLES_PER_UNIT;
+                z *= SAMPLES_PER_UNIT;
+                float fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+                float tx = x - fx, ty = y - fy, tz = z - fz;
+                int x0 = static_cast<int>(fx) & (SIZE - 1), x1 = (x0 + 1) & (SIZE - 1);
+                int y0 = static_cast<int>(fy) & (SIZE - 1), y1 = (y0 + 1) & (SIZE - 1);
+                int z0 = static_cast<int>(fz) & (SIZE - 1), z1 = (z0 + 1) & (SIZE - 1);
+
+                const float* c000 = &data[index(x0, y0, z0)];
+                const float* c100 = &data[index(x1, y0, z0)];
+                const float* c010 = &data[index(x0, y1, z0)];
+                const float* c110 = &data[index(x1, y1, z0)];
+                const float* c001 = &data[index(x0, y0, z1)];
+                const float* c101 = &data[index(x1, y0, z1)];
+                const float* c011 = &data[index(x0, y1, z1)];
+                const float* c111 = &data[index(x1, y1, z1)];
+
+                for (int c = 0; c < 2; c++) {
+                    float a = c000[c] + (c100[c] - c000[c]) * tx;
+                    float b = c010[c] + (c110[c] - c010[c]) * tx;
+                    float d = c001[c] + (c101[c] - c001[c]) * tx;
+                    float e = c011[c] + (c111[c] - c011[c]) * tx;
+                    float front = a + (b - a) * ty;
+                    float back = d + (e - d) * ty;
+                    (c == 0 ? n0 : n1) = front + (back - front) * tz;
+                }
+            }
+
+        private:
+            static int index(int x, int y, int z) {
+                return ((z * SIZE + y) * SIZE + x) * 2;
+            }
+
+            std::vector<float> data;
+        };
+
+        const NoiseTable& noiseTable() {
+            static const NoiseTable table;
+            return table;
+        }
+
+        inline float clamp01(float value) {
+            return std::min(std::max(value, 0.0f), 1.0f);
+        }
+
+        inline float smoothstep(float edge0, float edge1, float value) {
+            float t = clamp01((value - edge0) / (edge1 - edge0));
+            return t * t * (3.0f - 2.0f * t);
+        }
+
+        // Parabolic sine with one refinement step, error below 0.001
+        inline float fastSin(float x) {
+            x -= 2.0f * PI * std::floor(x * (0.5f / PI) + 0.5f);
+            float y = (4.0f / PI) * x - (4.0f / (PI * PI)) * x * std::fabs(x);
+            return 0.225f * (y * std::fabs(y) - y) + y;
+        }
+
+        // Turns the horizontal velocity by angle. The angle is swirl speed times
+        // the frame time, well under 0.1 rad, so the short series is exact to float precision
+        inline void swirl(float& vx, float& vz, float angle) {
+            float angle2 = angle * angle;
+            float c = 1.0f - 0.5f * angle2;
+            float s = angle - angle * angle2 * (1.0f / 6.0f);
+            float x = vx * c - vz * s;
+            vz = vx * s + vz * c;
+            vx = x;
+        }
+
+        inline float wrapDegrees(float degrees) {
+            return degrees - 360.0f * std::floor(degrees * (1.0f / 360.0f));
+        }
+    }
+
+    GLuint createFireQuadBuffer() {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(QUAD_VERTICES), QUAD_VERTICES, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return buffer;
+    }
+
+    void setupFireAttributes(GLuint quadBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, quadBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
+
+        for (GLuint attribute = 2; attribute <= 6; attribute++) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void pointFireInstanceAttributes(GLuint instanceBuffer, size_t base) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(FireInstance), (void*)(base + offsetof(FireInstance, position)));
+        glVertexAttribPointer(3, 4, GL_HALF_FLOAT, GL_FALSE, sizeof(FireInstance), (void*)(base + offsetof(FireInstance, color)));
+        glVertexAttribPointer(4, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(FireInstance), (void*)(base + offsetof(FireInstance, size)));
+        glVertexAttribPointer(5, 1, GL_HALF_FLOAT, GL_FALSE, sizeof(FireInstance), (void*)(base + offsetof(FireInstance, rotation)));
+        glVertexAttribIPointer(6, 1, GL_UNSIGNED_BYTE, sizeof(FireInstance), (void*)(base + offsetof(FireInstance, textureIndex)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void FireParticles::Pool::resize(size_t capacity) {
+        std::vector<float>* arrays[] = { &x, &y, &z, &vx, &vy, &vz, &r, &g, &b, &a, &life, &initialLife, &size, &rotation, &rotationSpeed };
+        for (std::vector<float>* array : arrays) {
+            array->assign(capacity, 0.0f);
+        }
+        textureIndex.assign(capacity, 0);
+        count = 0;
+    }
+
+    void FireParticles::Pool::move(size_t from, size_t to) {
+        x[to] = x[from]; y[to] = y[from]; z[to] = z[from];
+        vx[to] = vx[from]; vy[to] = vy[from]; vz[to] = vz[from];
+        r[to] = r[from]; g[to] = g[from]; b[to] = b[from]; a[to] = a[from];
+        life[to] = life[from]; initialLife[to] = initialLife[from];
+        size[to] = size[from]; rotation[to] = rotation[from]; rotationSpeed[to] = rotationSpeed[from];
+        textureIndex[to] = textureIndex[from];
+    }
+
+    FireParticles::FireParticles()
+        : spawnRadius(0.2f), minUpVelocity(1.8f), maxUpVelocity(2.6f), minHorizontalVel(-0.15f), maxHorizontalVel(0.15f),
+        capacity(0), targetCount(0), seed(0), frame(0), quadBuffer(0), instanceBuffer(0), vao(0),
+        instanceSource(0), instanceOffset(0), baseInstanceSupported(false), attributeBase(0),
+        smokeRegionCount(0) {
+
+        for (Pool& pool : pools) {
+            pool.count = 0;
+        }
+        for (int view = 0; view < SMOKE_VIEW_COUNT; view++) {
+            smokeRegion[view] = 0;
+        }
+    }
+
+    size_t FireParticles::getTotalCount() const {
+        return pools[FLAME].count + pools[SMOKE].count + pools[EMBER].count;
+    }
+
+    void FireParticles::reset(int flameCount, int smokeCount, int emberCount, const glm::vec3& origin, uint32_t seed) {
+        this->seed = seed;
+        frame = 0;
+
+        // Any pool may end up holding every particle after enough respawns
+        capacity = static_cast<size_t>(flameCount + smokeCount + emberCount);
+        targetCount = capacity;
+        for (Pool& pool : pools) {
+            pool.resize(capacity);
+        }
+        instances.assign(capacity * SMOKE_VIEW_COUNT, FireInstance());
+        for (int view = 0; view < SMOKE_VIEW_COUNT; view++) {
+            smokeSorters[view].invalidate();
+            smokeRegion[view] = 0;
+        }
+        smokeRegionCount = 0;
+
+        FastRandom random(seed);
+        for (int i = 0; i < flameCount; i++) spawn(FLAME, origin, random);
+        for (int i = 0; i < smokeCount; i++) spawn(SMOKE, origin, random);
+        for (int i = 0; i < emberCount; i++) spawn(EMBER, origin, random);
+
+        for (int type = 0; type < TYPE_COUNT; type++) {
+            pack(static_cast<Type>(type), 0, pools[type].count, getPackOffset(static_cast<Type>(type)));
+        }
+    }
+
+    // Appends one particle, returns its index
+    size_t FireParticles::spawn(Type type, const glm::vec3& origin, FastRandom& random) {
+        Pool& p = pools[type];
+        size_t i = p.count++;
+
+        float angle = random.range(0.0f, 2.0f * PI);
+        float radiusScale = type == FLAME ? 1.0f : (type == SMOKE ? 0.6f : 0.4f);
+        float radius = random.range(0.0f, spawnRadius * radiusScale);
+        p.x[i] = origin.x + radius * std::cos(angle);
+        p.z[i] = origin.z + radius * std::sin(angle);
+
+        switch (type) {
+        case FLAME:
+            p.y[i] = origin.y + random.range(0.01f, 0.03f);
+            p.vx[i] = random.range(minHorizontalVel, maxHorizontalVel);
+            p.vy[i] = random.range(minUpVelocity, maxUpVelocity);
+            p.vz[i] = random.range(minHorizontalVel, maxHorizontalVel);
+            p.life[i] = random.range(2.0f, 4.0f);
+            p.size[i] = random.range(0.1f, 0.18f);
+            p.rotationSpeed[i] = random.range(-60.0f, 60.0f);
+            break;
+        case SMOKE:
+            p.y[i] = origin.y + random.range(0.7f, 1.0f);
+            p.vx[i] = random.range(-0.1f, 0.1f);
+            p.vy[i] = random.range(0.3f, 0.6f);
+            p.vz[i] = random.range(-0.1f, 0.1f);
+            p.life[i] = random.range(0.6f, 1.2f);
+            p.size[i] = random.range(0.2f, 0.35f);
+            p.rotationSpeed[i] = random.range(-20.0f, 20.0f);
+            break;
+        default: {
+            // One ember in ten shoots higher
+            float upMax = random.range(0.0f, 1.0f) < 0.1f ? 5.0f : 3.5f;
+            p.y[i] = origin.y + random.range(0.03f, 0.06f);
+            p.vx[i] = random.range(-0.2f, 0.2f);
+            p.vy[i] = random.range(2.5f, upMax);
+            p.vz[i] = random.range(-0.2f, 0.2f);
+            p.life[i] = random.range(0.4f, 1.5f);
+            p.size[i] = random.range(0.07f, 0.12f);
+            p.rotationSpeed[i] = random.range(-80.0f, 80.0f);
+            break;
+        }
+        }
+
+        p.initialLife[i] = p.life[i];
+        p.r[i] = p.g[i] = p.b[i] = p.a[i] = 1.0f;
+        p.rotation[i] = random.range(0.0f, 360.0f);
+        p.textureIndex[i] = random.rangeInt(0, 6);
+        return i;
+    }
+
+    void FireParticles::simulateFlames(size_t begin, size_t end, const Step& frame, FastRandom& random) {
+        Pool& p = pools[FLAME];
+        const NoiseTable& noise = noiseTable();
+        const float dt = frame.deltaTime;
+        const float swirlBase = 0.3f + 0.1f * std::sin(frame.globalTime * 1.5f);
+        const float maxHeight = frame.origin.y + 1.0f;
+
+        for (size_t i = begin; i < end; i++) {
+            float life = p.life[i] - dt;
+            float lifeRatio = life / p.initialLife[i];
+            float heightAbove = p.y[i] - frame.origin.y;
+
+            float swirlSpeed = swirlBase + random.range(-0.05f, 0.05f) + 0.2f * smoothstep(0.2f, 0.6f, heightAbove);
+
+            // Occasional upward kick
+            float kickRoll = random.range(0.0f, 1.0f);
+            float kick = random.range(0.5f, 1.5f);
+            float vy = p.vy[i] + (kickRoll < 0.005f ? kick : 0.0f);
+
+            // Colour jitter near the top of the flame, feeds into this frame's colour
+            float shift = random.range(-0.1f, 0.1f) * smoothstep(0.4f, 1.0f, heightAbove);
+            float tintR = clamp01(p.r[i] + shift);
+            float tintG = clamp01(p.g[i] + shift * 0.5f);
+
+            float vx = p.vx[i];
+            float vz = p.vz[i];
+            swirl(vx, vz, swirlSpeed * dt);
+
+            float n0, n1;
+            noise.sample(p.x[i] * 3.0f, p.y[i] * 3.0f, p.z[i] * 3.0f, n0, n1);
+            vx += n0 * 0.05f * dt;
+            vz += n1 * 0.05f * dt;
+
+            float x = p.x[i] + vx * dt;
+            float y = p.y[i] + vy * dt;
+            float z = p.z[i] + vz * dt;
+
+            // Capped at a meter above the fire, losing most of the lift
+            vy *= y > maxHeight ? 0.3f : 1.0f;
+            y = std::min(y, maxHeight);
+
+            // White-yellow, orange, red, dark red as the life ratio goes up
+            float t0 = clamp01(lifeRatio / 0.4f);
+            float t1 = clamp01((lifeRatio - 0.4f) / 0.4f);
+            float t2 = clamp01((lifeRatio - 0.8f) / 0.2f);
+            float red = 1.0f;
+            float green = 0.9f + (0.5f - 0.9f) * t0;
+            float blue = 0.6f + (0.1f - 0.6f) * t0;
+            red += (0.6f - red) * t1;
+            green += (0.0f - green) * t1;
+            blue += (0.0f - blue) * t1;
+            red += (0.15f - red) * t2;
+            green += (0.0f - green) * t2;
+            blue += (0.0f - blue) * t2;
+            float alpha = 1.0f - 0.5f * t2;
+
+            alpha *= 0.8f + 0.05f * random.range(0.0f, 1.0f);
+            alpha *= clamp01(1.0f - (y - frame.origin.y - 0.3f) * 2.0f);
+
+            p.r[i] = clamp01(red * tintR);
+            p.g[i] = clamp01(green * tintG);
+            p.b[i] = clamp01(blue);
+            p.a[i] = clamp01(alpha);
+
+            // Grows in quickly, then shrinks back over the rest of its life
+            p.size[i] = lifeRatio > 0.9f ? 0.22f * (1.0f - lifeRatio) / 0.1f : 0.05f + (0.22f - 0.05f) * (lifeRatio / 0.9f);
+
+            p.rotation[i] = wrapDegrees(p.rotation[i] + p.rotationSpeed[i] * dt);
+            p.x[i] = x; p.y[i] = y; p.z[i] = z;
+            p.vx[i] = vx; p.vy[i] = vy; p.vz[i] = vz;
+            p.life[i] = life;
+        }
+    }
+
+    void FireParticles::simulateSmoke(size_t begin, size_t end, const Step& frame, FastRandom& random) {
+        Pool& p = pools[SMOKE];
+        const NoiseTable& noise = noiseTable();
+        const float dt = frame.deltaTime;
+
+        for (size_t i = begin; i < end; i++) {
+            float life = p.life[i] - dt;
+            float lifeRatio = life / p.initialLife[i];
+
+            float swirlSpeed = 0.3f + 0.2f * random.range(0.0f, 1.0f) + random.range(-0.05f, 0.05f);
+
+            // Slow vertical wobble
+            float vy = p.vy[i] + fastSin(p.x[i] + p.z[i] + frame.globalTime * 2.0f) * 0.07f * dt;
+
+            float vx = p.vx[i];
+            float vz = p.vz[i];
+            swirl(vx, vz, swirlSpeed * dt);
+
+            float n0, n1;
+            noise.sample(p.x[i] * 2.0f, p.y[i] * 2.0f, p.z[i] * 2.0f, n0, n1);
+            vx += n0 * 0.02f * dt;
+            vz += n1 * 0.02f * dt;
+
+            p.x[i] += vx * dt;
+            p.y[i] += vy * dt;
+            p.z[i] += vz * dt;
+            vy += 0.03f * dt;
+
+            // Dark grey to light grey while fading out
+            float grey = 0.1f + (0.45f - 0.1f) * (1.0f - lifeRatio);
+            p.r[i] = grey;
+            p.g[i] = grey;
+            p.b[i] = grey;
+            p.a[i] = lifeRatio * 0.7f;
+            p.size[i] = 0.35f + (0.15f - 0.35f) * lifeRatio;
+
+            p.rotation[i] = wrapDegrees(p.rotation[i] + p.rotationSpeed[i] * dt);
+            p.vx[i] = vx; p.vy[i] = vy; p.vz[i] = vz;
+            p.life[i] = life;
+        }
+    }
+
+    void FireParticles::simulateEmbers(size_t begin, size_t end, const Step& frame, FastRandom& random) {
+        Pool& p = pools[EMBER];
+        const NoiseTable& noise = noiseTable();
+        const float dt = frame.deltaTime;
+
+        for (size_t i = begin; i < end; i++) {
+            float life = p.life[i] - dt;
+            float lifeRatio = life / p.initialLife[i];
+
+            float swirlSpeed = 0.25f + random.range(-0.05f, 0.05f) + random.range(-0.05f, 0.05f);
+
+            float vx = p.vx[i];
+            float vz = p.vz[i];
+            swirl(vx, vz, swirlSpeed * dt);
+
+            float n0, n1;
+            noise.sample(p.x[i] * 2.0f, p.y[i] * 2.0f, p.z[i] * 2.0f, n0, n1);
+            vx += n0 * 0.03f * dt;
+            vz += n1 * 0.03f * dt;
+
+            float vy = p.vy[i];
+            p.x[i] += vx * dt;
+            p.y[i] += vy * dt;
+            p.z[i] += vz * dt;
+            vy -= 0.5f * dt;
+
+            // Yellow to orange, fading with the life left
+            float age = 1.0f - lifeRatio;
+            p.r[i] = 1.0f;
+            p.g[i] = 0.9f + (0.2f - 0.9f) * age;
+            p.b[i] = 0.4f + (0.0f - 0.4f) * age;
+            p.a[i] = lifeRatio;
+            p.size[i] = 0.02f + (0.1f - 0.02f) * lifeRatio;
+
+            p.rotation[i] = wrapDegrees(p.rotation[i] + p.rotationSpeed[i] * dt);
+            p.vx[i] = vx; p.vy[i] = vy; p.vz[i] = vz;
+            p.life[i] = life;
+        }
+    }
+
+    void FireParticles::setTargetCount(size_t count) {
+        targetCount = std::min(count, capacity);
+    }
+
+    // Swap-removes dead particles, then respawns each one as a random type,
+    // fewer while above the target count and a few more while below it
+    void FireParticles::respawnDead(const glm::vec3& origin, FastRandom& random) {
+        size_t dead = 0;
+        for (Pool& p : pools) {
+            size_t i = 0;
+            while (i < p.count) {
+                if (p.life[i] <= 0.0f) {
+                    p.move(--p.count, i);
+                    dead++;
+                }
+                else {
+                    i++;
+                }
+            }
+        }
+
+        size_t alive = getTotalCount();
+        size_t respawns = 0;
+        if (alive < targetCount) {
+            // Growing all at once would spawn the missing particles in step
+            respawns = std::min(targetCount - alive, dead + capacity / GROWTH_STEPS);
+        }
+        for (size_t i = 0; i < respawns; i++) {
+            float roll = random.range(0.0f, 1.0f);
+            spawn(roll < 0.70f ? FLAME : (roll < 0.90f ? SMOKE : EMBER), origin, random);
+        }
+    }
+
+    // Short-lived sparks left behind by embers, only while there is spare room
+    void FireParticles::emitTrails(FastRandom& random) {
+        Pool& embers = pools[EMBER];
+        size_t emberCount = embers.count;
+        for (size_t i = 0; i < emberCount && getTotalCount() < targetCount; i++) {
+            if (random.range(0.0f, 1.0f) >= 0.05f) {
+                continue;
+            }
+            size_t t = embers.count++;
+            embers.x[t] = embers.x[i] - embers.vx[i] * 0.02f;
+            embers.y[t] = embers.y[i] - embers.vy[i] * 0.02f;
+            embers.z[t] = embers.z[i] - embers.vz[i] * 0.02f;
+            embers.vx[t] = embers.vy[t] = embers.vz[t] = 0.0f;
+            embers.life[t] = embers.initialLife[t] = 0.5f;
+            embers.r[t] = embers.g[t] = embers.b[t] = embers.a[t] = 1.0f;
+            embers.size[t] = 0.03f;
+            embers.rotation[t] = random.range(0.0f, 360.0f);
+            embers.rotationSpeed[t] = random.range(-80.0f, 80.0f);
+            embers.textureIndex[t] = random.rangeInt(0, 6);
+        }
+    }
+
+    size_t FireParticles::getPackOffset(Type type) const {
+        switch (type) {
+        case FLAME: return 0;
+        case EMBER: return pools[FLAME].count;
+        default:    return pools[FLAME].count + pools[EMBER].count;
+        }
+    }
+
+    void FireParticles::pack(Type type, size_t begin, size_t end, size_t offset, const uint32_t* order) {
+        const Pool& p = pools[type];
+        FireInstance* out = &instances[offset];
+        for (size_t o = begin; o < end; o++) {
+            FireInstance& instance = out[o];
+            size_t i = order != nullptr ? order[o] : o;
+            instance.position = glm::vec3(p.x[i], p.y[i], p.z[i]);
+            instance.color[0] = glm::packHalf1x16(p.r[i]);
+            instance.color[1] = glm::packHalf1x16(p.g[i]);
+            instance.color[2] = glm::packHalf1x16(p.b[i]);
+            instance.color[3] = glm::packHalf1x16(p.a[i]);
+            instance.size = glm::packHalf1x16(p.size[i]);
+            instance.rotation = glm::packHalf1x16(p.rotation[i]);
+            instance.textureIndex = static_cast<uint8_t>(p.textureIndex[i]);
+        }
+    }
+
+    void FireParticles::forEachChunk(ThreadPool* pool, size_t count, const ThreadPool::RangeFunction& fn) {
+        if (pool != nullptr) {
+            pool->parallelFor(count, MIN_CHUNK, fn);
+        }
+        else if (count > 0) {
+            fn(0, count, 0);
+        }
+    }
+
+    void FireParticles::step(const Step& frameStep, ThreadPool* pool) {
+        frame++;
+        uint32_t frameSeed = pcgHash(seed ^ pcgHash(frame));
+
+        typedef void (FireParticles::*Simulate)(size_t, size_t, const Step&, FastRandom&);
+        const Simulate simulate[TYPE_COUNT] = { &FireParticles::simulateFlames, &FireParticles::simulateSmoke, &FireParticles::simulateEmbers };
+
+        for (int type = 0; type < TYPE_COUNT; type++) {
+            forEachChunk(pool, pools[type].count, [&](size_t begin, size_t end, size_t) {
+                // Seeded by the chunk, not the worker, so results do not depend on scheduling
+                FastRandom random(frameSeed ^ pcgHash(static_cast<uint32_t>(type) * 0x9E3779B9u + static_cast<uint32_t>(begin)));
+                (this->*simulate[type])(begin, end, frameStep, random);
+            });
+        }
+
+        FastRandom random(frameSeed);
+        respawnDead(frameStep.origin, random);
+        emitTrails(random);
+
+        for (int type = 0; type < TYPE_COUNT; type++) {
+            size_t offset = getPackOffset(static_cast<Type>(type));
+            forEachChunk(pool, pools[type].count, [&](size_t begin, size_t end, size_t) {
+                pack(static_cast<Type>(type), begin, end, offset);
+            });
+        }
+
+        // Unsorted smoke in the first range until a view sorts
+        for (int view = 0; view < SMOKE_VIEW_COUNT; view++) {
+            smokeRegion[view] = 0;
+        }
+        smokeRegionCount = 0;
+    }
+
+    void FireParticles::sortSmoke(int view, const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool) {
+        const Pool& smoke = pools[SMOKE];
+        DepthSorter& sorter = smokeSorters[view];
+        sorter.sort(smoke.x.data(), smoke.y.data(), smoke.z.data(), smoke.count, eye, forward, pool);
+
+        int region = std::min(smokeRegionCount, SMOKE_VIEW_COUNT - 1);
+        smokeRegionCount = region + 1;
+        smokeRegion[view] = region;
+
+        size_t offset = getPackOffset(SMOKE) + region * smoke.count;
+        const uint32_t* order = sorter.getOrder().data();
+        forEachChunk(pool, smoke.count, [&](size_t begin, size_t end, size_t) {
+            pack(SMOKE, begin, end, offset, order);
+        });
+    }
+
+    void FireParticles::shareSmokeOrder(int view, int source) {
+        smokeRegion[view] = smokeRegion[source];
+    }
+
+    void FireParticles::update(float deltaTime, float globalTime, const glm::vec3& origin, ThreadPool& pool) {
+        step(Step{ deltaTime, globalTime, origin }, &pool);
+    }
+
+    void FireParticles::update(float deltaTime, float globalTime, const glm::vec3& origin) {
+        step(Step{ deltaTime, globalTime, origin }, nullptr);
+    }
+
+    void FireParticles::initBuffers() {
+#if defined (__APPLE__)
+        baseInstanceSupported = false;
+#else
+        baseInstanceSupported = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+#endif
+
+        quadBuffer = createFireQuadBuffer();
+
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(FireInstance), nullptr, GL_STREAM_DRAW);
+
+        instanceSource = instanceBuffer;
+        instanceOffset = 0;
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
+        setupFireAttributes(quadBuffer);
+        pointInstanceAttributes(0);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        upload();
+    }
+
+    // Expects the VAO to be bound
+    void FireParticles::pointInstanceAttributes(size_t firstInstance) {
+        pointFireInstanceAttributes(instanceSource, instanceOffset + firstInstance * sizeof(FireInstance));
+        attributeBase = firstInstance;
+    }
+
+    void FireParticles::cleanup() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &quadBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+
+    void FireParticles::upload(StreamBuffer* stream) {
+        size_t count = getTotalCount() + pools[SMOKE].count * (std::max(smokeRegionCount, 1) - 1);
+        if (count == 0) {
+            return;
+        }
+
+        StreamAllocation copy = {};
+        if (stream != nullptr) {
+            copy = stream->allocate(count * sizeof(FireInstance), sizeof(float));
+        }
+
+        GLuint source = instanceBuffer;
+        GLintptr offset = 0;
+        if (copy.data != nullptr) {
+            std::memcpy(copy.data, &instances[0], count * sizeof(FireInstance));
+            stream->commit(copy);
+            source = stream->getBuffer();
+            offset = copy.offset;
+        }
+        else {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(FireInstance), &instances[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        if (source != instanceSource || offset != instanceOffset) {
+            instanceSource = source;
+            instanceOffset = offset;
+            glBindVertexArray(vao);
+            pointInstanceAttributes(attributeBase);
+            glBindVertexArray(0);
+        }
+    }
+
+    void FireParticles::drawRange(size_t first, size_t count) {
+        if (count == 0) {
+            return;
+        }
+
+        glBindVertexArray(vao);
+#if !defined (__APPLE__)
+        if (baseInstanceSupported) {
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(count), static_cast<GLuint>(first));
+            glBindVertexArray(0);
+            return;
+        }
+#endif
+        if (attributeBase != first) {
+            pointInstanceAttributes(first);
+        }
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, static_cast<GLsizei>(count));
+        glBindVertexArray(0);
+    }
+
+    void FireParticles::drawAdditive() {
+        drawRange(getPackOffset(FLAME), pools[FLAME].count + pools[EMBER].count);
+    }
+
+    void FireParticles::drawSmoke(int view) {
+        drawRange(getPackOffset(SMOKE) + smokeRegion[view] * pools[SMOKE].count, pools[SMOKE].count);
+    }
+
+}
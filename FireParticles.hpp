@@ -0,0 +1,176 @@
+#ifndef FireParticles_hpp
+#define FireParticles_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "ThreadPool.hpp"
+#include "Random.hpp"
+#include "DepthSorter.hpp"
+#include "StreamBuffer.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Per instance data read by fire.vert (attributes 2 to 6), 28 bytes.
+    // Colour, size and rotation (degrees) are half floats.
+    struct FireInstance {
+        glm::vec3 position;
+        uint16_t color[4];
+        uint16_t size;
+        uint16_t rotation;
+        uint8_t textureIndex;
+        uint8_t pad[3];
+    };
+
+    // fire.vert input layout, shared with GpuFireParticles: the quad (6
+    // vertices) at attributes 0 and 1, FireInstance at 2 to 6, one per instance.
+    // The attribute functions expect the VAO to be bound.
+    GLuint createFireQuadBuffer();
+    void setupFireAttributes(GLuint quadBuffer);
+    void pointFireInstanceAttributes(GLuint instanceBuffer, size_t byteOffset);
+
+    // Campfire flames, smoke and embers. Each type has its own pool stored as
+    // separate arrays (SoA), so the per-type update never branches on the type
+    // and runs in chunks on the worker pool. A particle that dies is compacted
+    // out of its pool and respawned as a random type (70% flame, 20% smoke,
+    // 10% ember).
+    //
+    // After each update the live particles are packed into one instance buffer
+    // as two ranges, flames and embers (additive blending) then smoke (alpha),
+    // and uploaded once. Every pass that draws the fire reuses that upload.
+    // Given a stream buffer the instances are copied into it and the
+    // attributes follow the copy; without one (or when it is full) they go to
+    // the fire's own buffer.
+    //
+    // Smoke is alpha blended and drawn back to front once sorted. Each view
+    // that sorts gets its own copy of the smoke range after the first, views
+    // that look the same way share one (see shareSmokeOrder).
+    class FireParticles {
+
+    public:
+        enum Type {
+            FLAME,
+            SMOKE,
+            EMBER,
+            TYPE_COUNT
+        };
+
+        // Views that may each want their own smoke order (main, reflection, refraction)
+        static const int SMOKE_VIEW_COUNT = 3;
+
+        FireParticles();
+
+        // Flame spawn shape; smoke and embers use a fraction of the radius
+        float spawnRadius;
+        float minUpVelocity, maxUpVelocity;
+        float minHorizontalVel, maxHorizontalVel;
+
+        // Allocates room for the given counts and spawns them (CPU only)
+        void reset(int flameCount, int smokeCount, int emberCount, const glm::vec3& origin, uint32_t seed);
+
+        // Integrates, respawns and packs the instances, chunks are spread over the pool
+        void update(float deltaTime, float globalTime, const glm::vec3& origin, ThreadPool& pool);
+        // The same on the calling thread only
+        void update(float deltaTime, float globalTime, const glm::vec3& origin);
+
+        void initBuffers();
+        void cleanup();
+        // Orders the view's smoke back to front from eye along forward. Call
+        // after update and before upload, once per view that needs its own order.
+        void sortSmoke(int view, const glm::vec3& eye, const glm::vec3& forward, ThreadPool* pool);
+        // The view draws the smoke in the order sorted for source
+        void shareSmokeOrder(int view, int source);
+
+        void upload(StreamBuffer* stream = nullptr);
+        void drawAdditive();
+        void drawSmoke(int view = 0);
+
+        size_t getCount(Type type) const { return pools[type].count; }
+        size_t getTotalCount() const;
+        // Most particles alive at once, the size of the instance data is this
+        // times sizeof(FireInstance)
+        size_t getCapacity() const { return capacity; }
+        // Particles to keep alive, at most the capacity. Above it the dead are
+        // not replaced, below it the pools grow back over a few updates.
+        void setTargetCount(size_t count);
+        size_t getTargetCount() const { return targetCount; }
+        // Instances the buffer holds with a smoke copy per view
+        size_t getInstanceCapacity() const { return instances.size(); }
+        double getSmokeSortMs(int view) const { return smokeSorters[view].getLastSortMs(); }
+
+    private:
+        struct Pool {
+            std::vector<float> x, y, z;
+            std::vector<float> vx, vy, vz;
+            std::vector<float> r, g, b, a;
+            std::vector<float> life, initialLife;
+            std::vector<float> size, rotation, rotationSpeed;
+            std::vector<int> textureIndex;
+            size_t count;
+
+            void resize(size_t capacity);
+            void move(size_t from, size_t to);
+        };
+
+        struct Step {
+            float deltaTime;
+            float globalTime;
+            glm::vec3 origin;
+        };
+
+        void step(const Step& frame, ThreadPool* pool);
+        void forEachChunk(ThreadPool* pool, size_t count, const ThreadPool::RangeFunction& fn);
+
+        void simulateFlames(size_t begin, size_t end, const Step& frame, FastRandom& random);
+        void simulateSmoke(size_t begin, size_t end, const Step& frame, FastRandom& random);
+        void simulateEmbers(size_t begin, size_t end, const Step& frame, FastRandom& random);
+
+        size_t spawn(Type type, const glm::vec3& origin, FastRandom& random);
+        void respawnDead(const glm::vec3& origin, FastRandom& random);
+        void emitTrails(FastRandom& random);
+        // With an order, instance i is particle order[i]
+        void pack(Type type, size_t begin, size_t end, size_t offset, const uint32_t* order = nullptr);
+        size_t getPackOffset(Type type) const;
+
+        void drawRange(size_t first, size_t count);
+        void pointInstanceAttributes(size_t firstInstance);
+
+        Pool pools[TYPE_COUNT];
+        size_t capacity;
+        size_t targetCount;
+        uint32_t seed;
+        uint32_t frame;
+
+        // Flames, embers, then one smoke range per sorted view
+        std::vector<FireInstance> instances;
+
+        GLuint quadBuffer;
+        GLuint instanceBuffer;
+        GLuint vao;
+        // Where the last upload went, instanceBuffer at 0 or a stream copy
+        GLuint instanceSource;
+        GLintptr instanceOffset;
+        // Without base instance (GL 4.1) the attributes are re-pointed at the
+        // range being drawn instead; the instance they currently start at
+        bool baseInstanceSupported;
+        size_t attributeBase;
+
+        DepthSorter smokeSorters[SMOKE_VIEW_COUNT];
+        // Smoke range each view draws, ranges used so far this frame
+        int smokeRegion[SMOKE_VIEW_COUNT];
+        int smokeRegionCount;
+    };
+
+}
+
+#endif
@@ -10,7 +10,9 @@ namespace gps {
 
     struct Frustum {
 
-        std::array<glm::vec4, 6> planes;
+        // The six view planes, then an optional clip plane
+        std::array<glm::vec4, 7> planes;
+        int planeCount = 6;
 
         void update(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
             glm::mat4 vp = projectionMatrix * viewMatrix;
@@ -64,15 +66,25 @@ namespace gps {
             );
 
             // Normalize the planes
-            for (auto& plane : planes) {
-                float length = glm::length(glm::vec3(plane));
-                plane /= length;
+            for (int i = 0; i < 6; i++) {
+                float length = glm::length(glm::vec3(planes[i]));
+                planes[i] /= length;
             }
+            planeCount = 6;
+        }
+
+        // Also rejects boxes wholly behind a world space clip plane, the same
+        // plane the shaders write to gl_ClipDistance (kept where
+        // dot(plane.xyz, p) + plane.w >= 0). Reset by update.
+        void setClipPlane(const glm::vec4& clipPlane) {
+            planes[6] = clipPlane / glm::length(glm::vec3(clipPlane));
+            planeCount = 7;
         }
 
         // Check if an AABB is visible within the frustum
         bool isVisible(const glm::vec3& min, const glm::vec3& max) const {
-            for (const auto& plane : planes) {
+            for (int i = 0; i < planeCount; i++) {
+                const glm::vec4& plane = planes[i];
                 glm::vec3 positive = min;
 
                 if (plane.x >= 0) positive.x = max.x;
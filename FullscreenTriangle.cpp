@@ -0,0 +1,26 @@
+#include "FullscreenTriangle.hpp"
+
+namespace gps {
+
+    FullscreenTriangle::FullscreenTriangle()
+        : vao(0) {
+    }
+
+    void FullscreenTriangle::init() {
+        glGenVertexArrays(1, &vao);
+    }
+
+    void FullscreenTriangle::cleanup() {
+        glDeleteVertexArrays(1, &vao);
+        vao = 0;
+    }
+
+    void FullscreenTriangle::bind() const {
+        glBindVertexArray(vao);
+    }
+
+    void FullscreenTriangle::draw() const {
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+}
@@ -0,0 +1,36 @@
+#ifndef FullscreenTriangle_hpp
+#define FullscreenTriangle_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+namespace gps {
+
+    // One triangle covering the viewport, for shaders/particleFullscreen.vert
+    // which builds it from gl_VertexID. Core profile draws still need a VAO,
+    // this one has no attributes.
+    class FullscreenTriangle {
+
+    public:
+        FullscreenTriangle();
+
+        void init();
+        void cleanup();
+
+        // For several draws in a row; unbind with glBindVertexArray(0)
+        void bind() const;
+        // Draws with the bound VAO
+        void draw() const;
+
+    private:
+        GLuint vao;
+    };
+
+}
+
+#endif
@@ -0,0 +1,268 @@
+#include "GpuFireParticles.hpp"
+#include "FireParticles.hpp"
+
+#include "glm/gtc/noise.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        const GLuint WORK_GROUP_SIZE = 64;
+        const size_t MAX_CAPACITY = static_cast<size_t>(WORK_GROUP_SIZE) * 65535;
+
+        // Same table as the CPU fire's NoiseTable
+        const int NOISE_SIZE = 32;
+        const int NOISE_SAMPLES_PER_UNIT = 4;
+
+        // std430 layout of the FireState block in fireParticles.glsl
+        const GLintptr SIMULATE_ARGS_OFFSET = 0;
+        const GLintptr EMIT_ARGS_OFFSET = 12;
+        const GLintptr ADDITIVE_DRAW_OFFSET = 64;
+        const GLintptr SMOKE_DRAW_OFFSET = 80;
+        const GLsizeiptr STATE_SIZE = 96;
+
+        // Word indices into the same block
+        const int EMIT_ARGS_WORD = 3;
+        const int DEAD_COUNT_WORD = 8;
+        const int EMIT_RESPAWNS_WORD = 11;
+
+        // Shader storage binding points, see fireParticles.glsl
+        enum StorageBinding {
+            PARTICLES_BINDING = 0,
+            STATE_BINDING = 1,
+            DEAD_BINDING = 2,
+            CURRENT_ALIVE_BINDING = 3,
+            NEXT_ALIVE_BINDING = 4,
+            INSTANCES_BINDING = 5,
+            TRAILS_BINDING = 6
+        };
+
+        const size_t PARTICLE_SIZE = 16 * sizeof(float);
+
+        GLuint createStorage(GLsizeiptr size, const void* data) {
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_COPY);
+            return buffer;
+        }
+    }
+
+    GpuFireParticles::GpuFireParticles()
+        : spawnRadius(0.2f), minUpVelocity(1.8f), maxUpVelocity(2.6f), minHorizontalVel(-0.15f), maxHorizontalVel(0.15f),
+        capacity(0), population(0), initialCounts(0), seed(0), frame(0),
+        particleBuffer(0), stateBuffer(0), deadBuffer(0), aliveBuffers(), instanceBuffer(0), trailBuffer(0),
+        noiseTexture(0), quadBuffer(0), vao(0) {
+    }
+
+#if defined (__APPLE__)
+
+    bool GpuFireParticles::isSupported() {
+        return false;
+    }
+
+    void GpuFireParticles::init(int, int, int, int, uint32_t) {}
+    void GpuFireParticles::cleanup() {}
+    void GpuFireParticles::update(float, float, const glm::vec3&) {}
+    void GpuFireParticles::drawAdditive() {}
+    void GpuFireParticles::drawSmoke() {}
+    void GpuFireParticles::createNoiseTexture() {}
+    void GpuFireParticles::setCommonUniforms(Kernel, float, float, const glm::vec3&) {}
+    void GpuFireParticles::draw(GLintptr) {}
+
+#else
+
+    bool GpuFireParticles::isSupported() {
+        return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+            GLEW_ARB_draw_indirect && GLEW_ARB_base_instance);
+    }
+
+    void GpuFireParticles::init(int flameCount, int smokeCount, int emberCount, int sparkRoom, uint32_t seed) {
+        this->seed = seed;
+        frame = 0;
+        population = static_cast<size_t>(flameCount + smokeCount + emberCount);
+        capacity = std::min(population + static_cast<size_t>(std::max(sparkRoom, 0)), MAX_CAPACITY);
+        population = std::min(population, capacity);
+        initialCounts = glm::uvec3(flameCount, smokeCount, emberCount);
+
+        const char* files[KERNEL_COUNT] = {
+            "shaders/fireEmit.comp",
+            "shaders/fireSimulate.comp",
+            "shaders/fireCompact.comp",
+            "shaders/fireFinalize.comp"
+        };
+        for (int i = 0; i < KERNEL_COUNT; i++) {
+            kernels[i].loadComputeShader(files[i], PARTICLE_SHADER);
+        }
+
+        // Every slot starts dead, the first emit spawns the population
+        std::vector<GLuint> dead(capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            dead[i] = static_cast<GLuint>(i);
+        }
+        GLuint state[STATE_SIZE / sizeof(GLuint)] = {};
+        state[EMIT_ARGS_WORD] = static_cast<GLuint>((population + WORK_GROUP_SIZE - 1) / WORK_GROUP_SIZE);
+        state[EMIT_ARGS_WORD + 1] = 1;
+        state[EMIT_ARGS_WORD + 2] = 1;
+        state[SIMULATE_ARGS_OFFSET / sizeof(GLuint) + 1] = 1;
+        state[SIMULATE_ARGS_OFFSET / sizeof(GLuint) + 2] = 1;
+        state[DEAD_COUNT_WORD] = static_cast<GLuint>(capacity);
+        state[EMIT_RESPAWNS_WORD] = static_cast<GLuint>(population);
+
+        particleBuffer = createStorage(capacity * PARTICLE_SIZE, nullptr);
+        stateBuffer = createStorage(STATE_SIZE, state);
+        deadBuffer = createStorage(capacity * sizeof(GLuint), &dead[0]);
+        aliveBuffers[0] = createStorage(capacity * sizeof(GLuint), nullptr);
+        aliveBuffers[1] = createStorage(capacity * sizeof(GLuint), nullptr);
+        instanceBuffer = createStorage(capacity * sizeof(FireInstance), nullptr);
+        trailBuffer = createStorage(capacity * 4 * sizeof(float), nullptr);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        createNoiseTexture();
+
+        quadBuffer = createFireQuadBuffer();
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        setupFireAttributes(quadBuffer);
+        pointFireInstanceAttributes(instanceBuffer, 0);
+        glBindVertexArray(0);
+
+        timer.init();
+    }
+
+    void GpuFireParticles::createNoiseTexture() {
+        std::vector<float> data(NOISE_SIZE * NOISE_SIZE * NOISE_SIZE * 2);
+        const glm::vec3 repeat(static_cast<float>(NOISE_SIZE / NOISE_SAMPLES_PER_UNIT));
+        for (int z = 0; z < NOISE_SIZE; z++) {
+            for (int y = 0; y < NOISE_SIZE; y++) {
+                for (int x = 0; x < NOISE_SIZE; x++) {
+                    glm::vec3 p = glm::vec3(x, y, z) / static_cast<float>(NOISE_SAMPLES_PER_UNIT);
+                    float* texel = &data[((z * NOISE_SIZE + y) * NOISE_SIZE + x) * 2];
+                    texel[0] = glm::perlin(p + glm::vec3(0.0f, 1.0f, 0.0f), repeat);
+                    texel[1] = glm::perlin(p + glm::vec3(2.0f, 1.0f, 0.0f), repeat);
+                }
+            }
+        }
+
+        glGenTextures(1, &noiseTexture);
+        glBindTexture(GL_TEXTURE_3D, noiseTexture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32F, NOISE_SIZE, NOISE_SIZE, NOISE_SIZE, 0, GL_RG, GL_FLOAT, &data[0]);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+
+    void GpuFireParticles::cleanup() {
+        if (vao == 0) {
+            return;
+        }
+        for (Shader& kernel : kernels) {
+            glDeleteProgram(kernel.shaderProgram);
+        }
+        GLuint buffers[] = { particleBuffer, stateBuffer, deadBuffer, aliveBuffers[0], aliveBuffers[1], instanceBuffer, trailBuffer, quadBuffer };
+        glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+        glDeleteTextures(1, &noiseTexture);
+        glDeleteVertexArrays(1, &vao);
+        timer.cleanup();
+        vao = 0;
+    }
+
+    // Each kernel only declares the uniforms it reads
+    void GpuFireParticles::setCommonUniforms(Kernel kernel, float deltaTime, float globalTime, const glm::vec3& origin) {
+        Shader& shader = kernels[kernel];
+        shader.useShaderProgram();
+        glUniform1ui(shader.getUniformLocation("fireCapacity"), static_cast<GLuint>(capacity));
+        if (kernel == EMIT || kernel == SIMULATE) {
+            glUniform1ui(shader.getUniformLocation("fireSeed"), seed);
+            glUniform1ui(shader.getUniformLocation("fireFrame"), frame);
+            glUniform3fv(shader.getUniformLocation("fireOrigin"), 1, glm::value_ptr(origin));
+        }
+        if (kernel == SIMULATE) {
+            glUniform1f(shader.getUniformLocation("fireDeltaTime"), deltaTime);
+            glUniform1f(shader.getUniformLocation("fireTime"), globalTime);
+        }
+    }
+
+    void GpuFireParticles::update(float deltaTime, float globalTime, const glm::vec3& origin) {
+        if (vao == 0) {
+            return;
+        }
+        frame++;
+
+        timer.begin();
+
+        // The alive lists swap roles every frame
+        GLuint current = aliveBuffers[frame & 1];
+        GLuint next = aliveBuffers[(frame + 1) & 1];
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_BINDING, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_BINDING, stateBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_BINDING, deadBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CURRENT_ALIVE_BINDING, current);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NEXT_ALIVE_BINDING, next);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCES_BINDING, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TRAILS_BINDING, trailBuffer);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, stateBuffer);
+
+        const GLbitfield storageAndArgs = GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT;
+
+        setCommonUniforms(EMIT, deltaTime, globalTime, origin);
+        Shader& emit = kernels[EMIT];
+        // Only the first frame spawns fixed counts per type
+        glm::uvec3 forced = frame == 1 ? initialCounts : glm::uvec3(0);
+        glUniform3ui(emit.getUniformLocation("emitInitial"), forced.x, forced.y, forced.z);
+        glUniform1f(emit.getUniformLocation("spawnRadius"), spawnRadius);
+        glUniform2f(emit.getUniformLocation("upVelocity"), minUpVelocity, maxUpVelocity);
+        glUniform2f(emit.getUniformLocation("horizontalVelocity"), minHorizontalVel, maxHorizontalVel);
+        glDispatchComputeIndirect(EMIT_ARGS_OFFSET);
+        glMemoryBarrier(storageAndArgs);
+
+        setCommonUniforms(SIMULATE, deltaTime, globalTime, origin);
+        glUniform1f(kernels[SIMULATE].getUniformLocation("noiseScale"), static_cast<float>(NOISE_SAMPLES_PER_UNIT) / NOISE_SIZE);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, noiseTexture);
+        glDispatchComputeIndirect(SIMULATE_ARGS_OFFSET);
+        glMemoryBarrier(storageAndArgs);
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        setCommonUniforms(COMPACT, deltaTime, globalTime, origin);
+        glDispatchComputeIndirect(SIMULATE_ARGS_OFFSET);
+        glMemoryBarrier(storageAndArgs);
+
+        setCommonUniforms(FINALIZE, deltaTime, globalTime, origin);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(storageAndArgs | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+        timer.end();
+    }
+
+    void GpuFireParticles::draw(GLintptr commandOffset) {
+        if (vao == 0) {
+            return;
+        }
+        glBindVertexArray(vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stateBuffer);
+        glDrawArraysIndirect(GL_TRIANGLES, (void*)commandOffset);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    void GpuFireParticles::drawAdditive() {
+        draw(ADDITIVE_DRAW_OFFSET);
+    }
+
+    void GpuFireParticles::drawSmoke() {
+        draw(SMOKE_DRAW_OFFSET);
+    }
+
+#endif
+
+}
@@ -0,0 +1,101 @@
+#ifndef GpuFireParticles_hpp
+#define GpuFireParticles_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "Shader.hpp"
+#include "GpuTimer.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+namespace gps {
+
+    // The campfire simulated with compute shaders (GL 4.3), the alternative to
+    // FireParticles when the particle count is too high for the CPU. Nothing
+    // is read back: every frame runs
+    //   fireEmit.comp      revives the population's dead of last frame as a random
+    //                      type and spawns the ember sparks asked for last frame
+    //   fireSimulate.comp  integrates the alive list, the dead go to the dead list
+    //   fireCompact.comp   copies the survivors to the next alive list and
+    //                      writes their instances
+    //   fireFinalize.comp  turns the counters into the draw commands and the
+    //                      next frame's dispatch arguments
+    // The first three are dispatched indirectly. Instances use the FireInstance
+    // layout, so fire.vert draws them unchanged: flames and embers from the
+    // front of the buffer, smoke from the back, each with one indirect draw.
+    //
+    // Unlike the CPU pools the capacity is larger than the population, the
+    // free part gives the ember sparks room. Up to 64 * 65535 particles.
+    class GpuFireParticles {
+
+    public:
+        GpuFireParticles();
+
+        // Same meaning as in FireParticles
+        float spawnRadius;
+        float minUpVelocity, maxUpVelocity;
+        float minHorizontalVel, maxHorizontalVel;
+
+        // Compute shaders and indirect dispatch, never true on macOS
+        static bool isSupported();
+
+        // Allocates room for the population plus sparkRoom free particles; the
+        // given counts are spawned by the first update
+        void init(int flameCount, int smokeCount, int emberCount, int sparkRoom, uint32_t seed);
+        void cleanup();
+        bool isInitialized() const { return vao != 0; }
+
+        void update(float deltaTime, float globalTime, const glm::vec3& origin);
+        void drawAdditive();
+        void drawSmoke();
+
+        size_t getCapacity() const { return capacity; }
+        size_t getPopulation() const { return population; }
+        // GPU time of the most recent update that has finished, in ms
+        double getGpuMs() const { return timer.getGpuMs(); }
+
+    private:
+        enum Kernel {
+            EMIT,
+            SIMULATE,
+            COMPACT,
+            FINALIZE,
+            KERNEL_COUNT
+        };
+
+        void createNoiseTexture();
+        void setCommonUniforms(Kernel kernel, float deltaTime, float globalTime, const glm::vec3& origin);
+        void draw(GLintptr commandOffset);
+
+        Shader kernels[KERNEL_COUNT];
+
+        size_t capacity;
+        size_t population;
+        glm::uvec3 initialCounts;
+        uint32_t seed;
+        uint32_t frame;
+
+        GLuint particleBuffer;
+        GLuint stateBuffer;
+        GLuint deadBuffer;
+        GLuint aliveBuffers[2];
+        GLuint instanceBuffer;
+        GLuint trailBuffer;
+        GLuint noiseTexture;
+        GLuint quadBuffer;
+        GLuint vao;
+
+        GpuTimer timer;
+    };
+
+}
+
+#endif
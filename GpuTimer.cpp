@@ -0,0 +1,46 @@
+#include "GpuTimer.hpp"
+
+namespace gps {
+
+    GpuTimer::GpuTimer()
+        : query(0), pending(false), timing(false), gpuMs(0.0) {
+    }
+
+    void GpuTimer::init() {
+        glGenQueries(1, &query);
+    }
+
+    void GpuTimer::cleanup() {
+        glDeleteQueries(1, &query);
+        query = 0;
+        pending = false;
+        timing = false;
+    }
+
+    bool GpuTimer::begin() {
+        if (pending) {
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                gpuMs = elapsed / 1000000.0;
+                pending = false;
+            }
+        }
+        timing = !pending;
+        if (timing) {
+            glBeginQuery(GL_TIME_ELAPSED, query);
+        }
+        return timing;
+    }
+
+    void GpuTimer::end() {
+        if (timing) {
+            glEndQuery(GL_TIME_ELAPSED);
+            pending = true;
+            timing = false;
+        }
+    }
+
+}
@@ -0,0 +1,43 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+namespace gps {
+
+    // GPU time of the work between begin and end, with one GL_TIME_ELAPSED
+    // query in flight. The result is picked up by a later begin once it has
+    // arrived, so nothing ever waits on the GPU; frames started while the
+    // query is still pending are not timed.
+    class GpuTimer {
+
+    public:
+        GpuTimer();
+
+        void init();
+        void cleanup();
+
+        // Returns false while the previous query is still in flight
+        bool begin();
+        // Does nothing unless the matching begin started the query
+        void end();
+
+        // The most recent result that has finished, in ms
+        double getGpuMs() const { return gpuMs; }
+
+    private:
+        GLuint query;
+        bool pending;
+        bool timing;
+        double gpuMs;
+    };
+
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 namespace gps {
     struct Vertex {
@@ -57,9 +58,23 @@ namespace gps {
         }
     };
 
+    // Geometry detail of one pass, filled in from its ViewQuality
+    struct GeometryDetail {
+        glm::vec3 eye;
+        // projection[1][1], cot(fovy / 2)
+        float focalScale;
+        // Draw the simplified index range where a batch has one
+        bool simplified;
+        // Skip batches whose bounding sphere spans less of the view height
+        float minScreenSize;
+    };
+
     struct MeshBatch {
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
+        // Coarser version of indices for secondary views, stored after them
+        // in the same EBO. Empty when simplifying did not save enough.
+        std::vector<GLuint> lodIndices;
         std::vector<Texture> textures;
         bool isRockMaterial;
         bool isWindMovable;
@@ -67,6 +82,16 @@ namespace gps {
         bool isFern;
         GLuint VAO, VBO, EBO;
         GLuint indexCount;
+        GLuint lodIndexCount;
+
+        // Wind movable batches only: the swayed positions written once per frame
+        // by WindDeformer (attribute 0 of VAO reads them) and the VAO it reads
+        // the rest pose through
+        GLuint windVBO, windSourceVAO;
+        // The pose drawn the frame before, for motion vectors (attribute 5).
+        // windMoved is set while it differs from windVBO.
+        GLuint windPreviousVBO;
+        bool windMoved;
 
         // Bounding box for frustum culling
         glm::vec3 minBounds;
@@ -84,6 +109,11 @@ namespace gps {
             VBO(0),
             EBO(0),
             indexCount(0),
+            lodIndexCount(0),
+            windVBO(0),
+            windSourceVAO(0),
+            windPreviousVBO(0),
+            windMoved(false),
             minBounds(glm::vec3(0.0f)),
             maxBounds(glm::vec3(0.0f)) {}
 
@@ -98,7 +128,12 @@ namespace gps {
             glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
             glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (indices.size() + lodIndices.size()) * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), &indices[0]);
+            if (!lodIndices.empty()) {
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), lodIndices.size() * sizeof(GLuint), &lodIndices[0]);
+            }
+            lodIndexCount = static_cast<GLuint>(lodIndices.size());
 
             glEnableVertexAttribArray(0);
             glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
@@ -115,11 +150,80 @@ namespace gps {
             glEnableVertexAttribArray(4);
             glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
 
+            // Previous position, the same as the current one unless the wind moves it
+            glEnableVertexAttribArray(5);
+            glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+
             glBindVertexArray(0);
 
+            if (isWindMovable) {
+                setupWindBuffers();
+            }
+
             calculateBounds();
         }
 
+        void setupWindBuffers() {
+            // Starts out as the rest pose, so the batch is valid before the first update
+            std::vector<glm::vec3> positions(vertices.size());
+            for (size_t i = 0; i < vertices.size(); i++) {
+                positions[i] = vertices[i].Position;
+            }
+
+            glGenBuffers(1, &windVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, windVBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_DYNAMIC_COPY);
+
+            glGenBuffers(1, &windPreviousVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, windPreviousVBO);
+            glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_DYNAMIC_COPY);
+
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, windVBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+            glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+
+            glGenVertexArrays(1, &windSourceVAO);
+            glBindVertexArray(windSourceVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        // Before WindDeformer writes a new pose: the one drawn so far becomes
+        // the previous pose and its buffer is written next
+        void swapWindBuffers() {
+            std::swap(windVBO, windPreviousVBO);
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, windVBO);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, windPreviousVBO);
+            glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            windMoved = true;
+        }
+
+        // A frame without a new pose: nothing moved since the last one
+        void holdWindPose() {
+            if (!windMoved) {
+                return;
+            }
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, windVBO);
+            glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            windMoved = false;
+        }
+
         void calculateBounds() {
             if (vertices.empty()) return;
 
@@ -132,29 +236,30 @@ namespace gps {
             }
         }
 
-        void Draw(Shader shader, const Frustum& frustum) {
+        void Draw(Shader& shader, const Frustum& frustum, const GeometryDetail* detail = nullptr) {
             if (!frustum.isVisible(minBounds, maxBounds))
                 return;
 
-            shader.useShaderProgram();
-
-            if (shader.shaderType == MAIN_SHADER || shader.shaderType == SHADOW_SHADER) {
-                GLint objectTypeLoc = shader.getUniformLocation("u_ObjectType");
-                if (objectTypeLoc != -1) {
-                    glUniform1i(objectTypeLoc, (isGrass ? 0 : (isFern ? 2 : 1)));
+            GLsizei count = indexCount;
+            size_t firstIndex = 0;
+            if (detail != nullptr) {
+                glm::vec3 center = (minBounds + maxBounds) * 0.5f;
+                float radius = glm::length(maxBounds - minBounds) * 0.5f;
+                float distance = glm::length(center - detail->eye);
+                if (distance > radius && radius * detail->focalScale < detail->minScreenSize * distance) {
+                    return;
                 }
-                GLint isWindMovableLoc = shader.getUniformLocation("isWindMovable");
-                if (isWindMovableLoc != -1) {
-                    glUniform1i(isWindMovableLoc, isWindMovable ? 1 : 0);
+                if (detail->simplified && lodIndexCount > 0) {
+                    count = lodIndexCount;
+                    firstIndex = indices.size();
                 }
             }
 
-            if (shader.shaderType == MAIN_SHADER) {
+            // Material switches pick the compiled variant, see Shader::useVariant.
+            // Wind needs none, the VAO already reads the swayed positions.
+            shader.useVariant(isRockMaterial ? static_cast<unsigned int>(FEATURE_BLINN_PHONG) : 0u);
 
-                GLint useBlinnLoc = shader.getUniformLocation("useBlinnPhong");
-                if (useBlinnLoc != -1) {
-                    glUniform1i(useBlinnLoc, isRockMaterial ? 1 : 0);
-                }
+            if (shader.shaderType == MAIN_SHADER) {
 
                 // Conditionally bind and set texture uniforms
                 for (GLuint i = 0; i < textures.size(); i++) {
@@ -171,7 +276,7 @@ namespace gps {
 
             // Draw the mesh
             glBindVertexArray(VAO);
-            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (GLvoid*)(firstIndex * sizeof(GLuint)));
             glBindVertexArray(0);
 
             // Unbind textures if they were bound
@@ -189,6 +294,11 @@ namespace gps {
             glDeleteVertexArrays(1, &VAO);
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
+            if (windVBO != 0) {
+                glDeleteBuffers(1, &windVBO);
+                glDeleteBuffers(1, &windPreviousVBO);
+                glDeleteVertexArrays(1, &windSourceVAO);
+            }
         }
     };
 
@@ -80,7 +80,7 @@ namespace gps {
 
 
     // Updated Draw method to accept view and projection matrices
-    void Model3D::Draw(gps::Shader shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
+    void Model3D::Draw(gps::Shader& shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
         // Create and update the frustum
         Frustum frustum;
         frustum.update(viewMatrix, projectionMatrix);
@@ -92,6 +92,16 @@ namespace gps {
 		bvh.frustumCulledDraw(frustum, shaderProgram);
     }
 
+    // The forest only turns about the vertical axis, so a horizontal water
+    // plane is the same in model and world space
+    void Model3D::Draw(gps::Shader& shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::vec4& clipPlane,
+        const GeometryDetail* detail) {
+        Frustum frustum;
+        frustum.update(viewMatrix, projectionMatrix);
+        frustum.setClipPlane(clipPlane);
+		bvh.frustumCulledDraw(frustum, shaderProgram, detail);
+    }
+
 	void OptimizeMesh(int MeshIndex, std::vector <Vertex>& vertices, std::vector<GLuint>& indices) {
 		size_t vertexCount = vertices.size();
 		size_t indexCount = indices.size();
@@ -117,6 +127,28 @@ namespace gps {
 
 	}   
 
+    // Index range for secondary views at about a third of the triangles. Not
+    // kept when the simplifier cannot get below two thirds.
+    void BuildLodIndices(MeshBatch& batch) {
+        const float LOD_RATIO = 0.35f;
+        const float LOD_ERROR = 5e-2f;
+
+        batch.lodIndices.clear();
+        size_t indexCount = batch.indices.size();
+        if (indexCount == 0) {
+            return;
+        }
+        size_t targetIndexCount = static_cast<size_t>(indexCount * LOD_RATIO) / 3 * 3;
+        std::vector<GLuint> lodIndices(indexCount);
+        size_t lodCount = meshopt_simplify(lodIndices.data(), batch.indices.data(), indexCount, &batch.vertices[0].Position.x,
+            batch.vertices.size(), sizeof(Vertex), targetIndexCount, LOD_ERROR);
+
+        if (lodCount > 0 && lodCount * 3 < indexCount * 2) {
+            lodIndices.resize(lodCount);
+            batch.lodIndices = lodIndices;
+        }
+    }
+
     void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
 
         std::cout << "Loading : " << fileName << std::endl;
@@ -382,20 +414,22 @@ namespace gps {
                 std::vector<MeshBatch> subBatches = SplitBatch(batch);
 
                 for (auto& subBatch : subBatches) {
+                    BuildLodIndices(subBatch);
                     subBatch.setupBuffers();
                     meshBatches.push_back(subBatch);
                     std::cout << "Sub-Batch with material ID " << matId << " has "
                         << subBatch.vertices.size() << " vertices and "
-                        << subBatch.indices.size() << " indices" << std::endl;
+                        << subBatch.indices.size() << " indices (" << subBatch.lodIndices.size() << " simplified)" << std::endl;
                 }
             }
             else {
                 // Setup buffers normally
+                BuildLodIndices(batch);
                 batch.setupBuffers();
                 meshBatches.push_back(batch);
                 std::cout << "Batch with material ID " << matId << " has "
                     << batch.vertices.size() << " vertices and "
-                    << batch.indices.size() << " indices" << std::endl;
+                    << batch.indices.size() << " indices (" << batch.lodIndices.size() << " simplified)" << std::endl;
             }
 
             std::cout << "Processed batch with material ID " << matId << std::endl;
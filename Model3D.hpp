@@ -25,7 +25,12 @@ namespace gps {
 
         void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+		void Draw(gps::Shader& shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix);
+		// Also culls what the pass clips away (world space plane, kept side
+		// dot(plane.xyz, p) + plane.w >= 0). With a detail (eye in model
+		// space) batches are coarsened or skipped for a cheaper view.
+		void Draw(gps::Shader& shaderProgram, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::vec4& clipPlane,
+			const GeometryDetail* detail = nullptr);
 
     private:
         std::vector<gps::Texture> loadedTextures;
@@ -0,0 +1,130 @@
+#include "ParticleBudget.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    ParticleBudget::ParticleBudget()
+        : budget(0), fullDetailCoverage(0.05f), lowRateCoverage(0.005f), keepAliveInterval(8), maxTickTime(0.25f),
+        requestedCost(0), grantedCost(0), offscreenCount(0) {
+    }
+
+    int ParticleBudget::addEmitter(const std::string& name, size_t maxCount, size_t minCount) {
+        Emitter emitter;
+        emitter.name = name;
+        emitter.maxCount = maxCount;
+        emitter.minCount = std::min(minCount, maxCount);
+        emitter.minBounds = emitter.maxBounds = glm::vec3(0.0f);
+        emitter.enabled = true;
+        emitter.allocation = Allocation{ maxCount, 1, true, 1.0f };
+        emitter.framesSinceTick = 0;
+        emitter.pendingTime = 0.0f;
+        emitters.push_back(emitter);
+        return static_cast<int>(emitters.size()) - 1;
+    }
+
+    void ParticleBudget::setMaxCount(int emitter, size_t maxCount, size_t minCount) {
+        emitters[emitter].maxCount = maxCount;
+        emitters[emitter].minCount = std::min(minCount, maxCount);
+    }
+
+    void ParticleBudget::setBounds(int emitter, const glm::vec3& minBounds, const glm::vec3& maxBounds) {
+        emitters[emitter].minBounds = minBounds;
+        emitters[emitter].maxBounds = maxBounds;
+    }
+
+    void ParticleBudget::setEnabled(int emitter, bool enabled) {
+        emitters[emitter].enabled = enabled;
+    }
+
+    // Screen share of the bounding sphere, 1 with the camera inside it
+    float ParticleBudget::computeCoverage(const Emitter& emitter, const glm::mat4& view, const glm::mat4& projection) const {
+        glm::vec3 center = (emitter.minBounds + emitter.maxBounds) * 0.5f;
+        float radius = glm::length(emitter.maxBounds - emitter.minBounds) * 0.5f;
+        float distance = glm::length(glm::vec3(view * glm::vec4(center, 1.0f)));
+        if (distance <= radius) {
+            return 1.0f;
+        }
+
+        // Ellipse of the projected sphere over the 2 x 2 NDC square
+        float scale = radius * radius / (distance * distance - radius * radius);
+        float area = 3.14159265f * scale * projection[0][0] * projection[1][1];
+        return std::min(area / 4.0f, 1.0f);
+    }
+
+    void ParticleBudget::update(const glm::mat4& view, const glm::mat4& projection) {
+        frustum.update(view, projection);
+
+        requestedCost = 0;
+        grantedCost = 0;
+        offscreenCount = 0;
+
+        double visibleCost = 0.0;
+        double fixedCost = 0.0;
+        for (Emitter& emitter : emitters) {
+            Allocation& allocation = emitter.allocation;
+            if (!emitter.enabled) {
+                allocation = Allocation{ 0, 1, false, 0.0f };
+                continue;
+            }
+            allocation.visible = frustum.isVisible(emitter.minBounds, emitter.maxBounds);
+            allocation.coverage = allocation.visible ? computeCoverage(emitter, view, projection) : 0.0f;
+            if (!allocation.visible) {
+                offscreenCount++;
+            }
+            if (budget == 0) {
+                allocation.count = emitter.maxCount;
+                allocation.interval = 1;
+                requestedCost += emitter.maxCount;
+                continue;
+            }
+
+            if (!allocation.visible) {
+                allocation.count = emitter.minCount;
+                allocation.interval = keepAliveInterval;
+                fixedCost += static_cast<double>(allocation.count) / allocation.interval;
+                requestedCost += allocation.count / allocation.interval;
+                continue;
+            }
+
+            float detail = std::min(allocation.coverage / fullDetailCoverage, 1.0f);
+            allocation.count = std::max(static_cast<size_t>(emitter.maxCount * detail), emitter.minCount);
+            allocation.interval = allocation.coverage < lowRateCoverage ? 2 : 1;
+            visibleCost += static_cast<double>(allocation.count) / allocation.interval;
+            requestedCost += allocation.count / allocation.interval;
+        }
+
+        if (budget == 0) {
+            grantedCost = requestedCost;
+            return;
+        }
+
+        // Off-screen emitters are already at their floor, the visible ones share the rest
+        double available = std::max(static_cast<double>(budget) - fixedCost, 0.0);
+        double scale = visibleCost > available ? available / visibleCost : 1.0;
+        for (Emitter& emitter : emitters) {
+            Allocation& allocation = emitter.allocation;
+            if (!emitter.enabled) {
+                continue;
+            }
+            if (allocation.visible && scale < 1.0) {
+                allocation.count = std::max(static_cast<size_t>(allocation.count * scale), emitter.minCount);
+            }
+            grantedCost += allocation.count / allocation.interval;
+        }
+    }
+
+    bool ParticleBudget::tick(int emitter, float deltaTime, float& tickTime) {
+        Emitter& e = emitters[emitter];
+        e.pendingTime += deltaTime;
+        e.framesSinceTick++;
+        if (e.framesSinceTick < e.allocation.interval) {
+            return false;
+        }
+        tickTime = std::min(e.pendingTime, maxTickTime);
+        e.pendingTime = 0.0f;
+        e.framesSinceTick = 0;
+        return true;
+    }
+
+}
@@ -0,0 +1,94 @@
+#ifndef ParticleBudget_hpp
+#define ParticleBudget_hpp
+
+#include "Frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Shares one per frame particle budget between the emitters (fire, rain)
+    // by how much of the screen each covers. Once per frame, each emitter's
+    // bounds are tested against the view frustum and projected to a share of
+    // the screen (coverage):
+    //   visible   asks for maxCount * coverage / fullDetailCoverage particles
+    //             (at least minCount, at most maxCount), simulated every
+    //             frame, or every other frame below lowRateCoverage
+    //   off-screen keeps minCount particles alive and ticks every
+    //             keepAliveInterval frames
+    // A particle simulated every n frames costs 1/n. When the total cost is
+    // over the budget, every visible emitter is scaled down alike (never
+    // below minCount). With a budget of 0 every emitter gets maxCount and
+    // ticks every frame; visibility and coverage are still filled in.
+    //
+    // The emitters apply the allocation themselves; tick accumulates the
+    // time of skipped frames so a slowed emitter keeps real time.
+    class ParticleBudget {
+
+    public:
+        struct Allocation {
+            size_t count;
+            // Simulate every interval frames
+            int interval;
+            bool visible;
+            // Share of the screen covered by the bounds, 0 to 1
+            float coverage;
+        };
+
+        ParticleBudget();
+
+        // Particles per frame over all emitters, 0 for no limit
+        size_t budget;
+        float fullDetailCoverage;
+        float lowRateCoverage;
+        int keepAliveInterval;
+        // Longest step a slowed emitter takes, the rest of the time is dropped
+        float maxTickTime;
+
+        int addEmitter(const std::string& name, size_t maxCount, size_t minCount);
+        void setMaxCount(int emitter, size_t maxCount, size_t minCount);
+        void setBounds(int emitter, const glm::vec3& minBounds, const glm::vec3& maxBounds);
+        // Disabled emitters get nothing and cost nothing
+        void setEnabled(int emitter, bool enabled);
+
+        void update(const glm::mat4& view, const glm::mat4& projection);
+
+        const Allocation& getAllocation(int emitter) const { return emitters[emitter].allocation; }
+        // Call every frame. True when the emitter simulates this frame, with
+        // the time since its last tick in tickTime.
+        bool tick(int emitter, float deltaTime, float& tickTime);
+
+        // Counters of the last update, in particles per frame (cost)
+        size_t getRequestedCost() const { return requestedCost; }
+        size_t getGrantedCost() const { return grantedCost; }
+        int getOffscreenCount() const { return offscreenCount; }
+        const std::string& getName(int emitter) const { return emitters[emitter].name; }
+        int getEmitterCount() const { return static_cast<int>(emitters.size()); }
+
+    private:
+        struct Emitter {
+            std::string name;
+            size_t maxCount, minCount;
+            glm::vec3 minBounds, maxBounds;
+            bool enabled;
+            Allocation allocation;
+            int framesSinceTick;
+            float pendingTime;
+        };
+
+        float computeCoverage(const Emitter& emitter, const glm::mat4& view, const glm::mat4& projection) const;
+
+        std::vector<Emitter> emitters;
+        Frustum frustum;
+
+        size_t requestedCost;
+        size_t grantedCost;
+        int offscreenCount;
+    };
+
+}
+
+#endif
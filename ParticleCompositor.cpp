@@ -0,0 +1,232 @@
+#include "ParticleCompositor.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        // Colour and transmittance of an empty target
+        const GLfloat CLEAR_VALUE[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+        int roundDivisor(int divisor) {
+            if (divisor >= 4) return 4;
+            if (divisor >= 2) return 2;
+            return 1;
+        }
+    }
+
+    ParticleCompositor::ParticleCompositor()
+        : sceneFramebuffer(0), sceneColor(0), sceneBright(0), sceneDepth(0),
+        sceneWidth(0), sceneHeight(0), compositeFramebuffer(0) {
+
+        for (Target& target : targets) {
+            target = Target{ 0, 0, 0, 0, 0, 0, false };
+        }
+        for (int effect = 0; effect < EFFECT_COUNT; effect++) {
+            divisors[effect] = 1;
+        }
+    }
+
+    void ParticleCompositor::init(const UniformBlocks& uniformBlocks) {
+        depthShader.loadShader("shaders/particleFullscreen.vert", "shaders/particleDepth.frag", PARTICLE_SHADER);
+        compositeShader.loadShader("shaders/particleFullscreen.vert", "shaders/particleComposite.frag", PARTICLE_SHADER);
+        uniformBlocks.attach(compositeShader);
+
+        compositeShader.useShaderProgram();
+        glUniform1i(compositeShader.getUniformLocation("particleColor"), 0);
+        glUniform1i(compositeShader.getUniformLocation("particleDepth"), 1);
+        glUniform1i(compositeShader.getUniformLocation("sceneDepth"), 2);
+        glUniform1i(compositeShader.getUniformLocation("particleBright"), 3);
+        depthShader.useShaderProgram();
+        glUniform1i(depthShader.getUniformLocation("sceneDepth"), 0);
+
+        triangle.init();
+        glGenFramebuffers(1, &compositeFramebuffer);
+        for (GpuTimer& timer : timers) {
+            timer.init();
+        }
+    }
+
+    void ParticleCompositor::cleanup() {
+        for (Target& target : targets) {
+            deleteTarget(target);
+        }
+        glDeleteFramebuffers(1, &compositeFramebuffer);
+        triangle.cleanup();
+        for (GpuTimer& timer : timers) {
+            timer.cleanup();
+        }
+        glDeleteProgram(depthShader.shaderProgram);
+        glDeleteProgram(compositeShader.shaderProgram);
+    }
+
+    void ParticleCompositor::setScene(GLuint framebuffer, GLuint color, GLuint bright, GLuint depth, int width, int height) {
+        sceneFramebuffer = framebuffer;
+        sceneColor = color;
+        sceneBright = bright;
+        sceneDepth = depth;
+        sceneWidth = width;
+        sceneHeight = height;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, compositeFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneColor, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, sceneBright, 0);
+        GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(sceneBright != 0 ? 2 : 1, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Particle composite framebuffer not complete!" << std::endl;
+        }
+
+        for (int divisor = 2; divisor <= MAX_DIVISOR; divisor *= 2) {
+            deleteTarget(targets[divisor]);
+            createTarget(targets[divisor], divisor);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    }
+
+    void ParticleCompositor::createTarget(Target& target, int divisor) {
+        target.width = std::max(sceneWidth / divisor, 1);
+        target.height = std::max(sceneHeight / divisor, 1);
+        target.depthReady = false;
+
+        GLuint* colors[2] = { &target.color, &target.bright };
+        for (GLuint* color : colors) {
+            glGenTextures(1, color);
+            glBindTexture(GL_TEXTURE_2D, *color);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, target.width, target.height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        glGenTextures(1, &target.depth);
+        glBindTexture(GL_TEXTURE_2D, target.depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, target.width, target.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &target.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, target.bright, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target.depth, 0);
+        GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Particle target 1/" << divisor << " not complete!" << std::endl;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void ParticleCompositor::deleteTarget(Target& target) {
+        if (target.framebuffer == 0) {
+            return;
+        }
+        glDeleteFramebuffers(1, &target.framebuffer);
+        glDeleteTextures(1, &target.color);
+        glDeleteTextures(1, &target.bright);
+        glDeleteTextures(1, &target.depth);
+        target = Target{ 0, 0, 0, 0, 0, 0, false };
+    }
+
+    void ParticleCompositor::setDivisor(Effect effect, int divisor) {
+        divisors[effect] = roundDivisor(divisor);
+    }
+
+    void ParticleCompositor::beginFrame() {
+        for (Target& target : targets) {
+            target.depthReady = false;
+        }
+    }
+
+    void ParticleCompositor::begin(Effect effect) {
+        timers[effect].begin();
+
+        int divisor = divisors[effect];
+        if (divisor == 1) {
+            return;
+        }
+
+        Target& target = targets[divisor];
+        if (!target.depthReady) {
+            downsampleDepth(target, divisor);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glViewport(0, 0, target.width, target.height);
+        glClearBufferfv(GL_COLOR, 0, CLEAR_VALUE);
+        glClearBufferfv(GL_COLOR, 1, CLEAR_VALUE);
+    }
+
+    void ParticleCompositor::end(Effect effect) {
+        int divisor = divisors[effect];
+        if (divisor != 1) {
+            composite(targets[divisor]);
+        }
+
+        timers[effect].end();
+    }
+
+    // Farthest depth of each divisor x divisor block, written as the target's depth
+    void ParticleCompositor::downsampleDepth(Target& target, int divisor) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glViewport(0, 0, target.width, target.height);
+
+        depthShader.useShaderProgram();
+        glUniform1i(depthShader.getUniformLocation("divisor"), divisor);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneDepth);
+
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        triangle.bind();
+        triangle.draw();
+        glBindVertexArray(0);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_LESS);
+
+        target.depthReady = true;
+    }
+
+    void ParticleCompositor::composite(Target& target) {
+        glBindFramebuffer(GL_FRAMEBUFFER, compositeFramebuffer);
+        glViewport(0, 0, sceneWidth, sceneHeight);
+
+        compositeShader.useShaderProgram();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, target.color);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, target.depth);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, sceneDepth);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, target.bright);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+        triangle.bind();
+        triangle.draw();
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    }
+
+    void ParticleCompositor::additiveBlend() {
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE);
+    }
+
+    void ParticleCompositor::alphaBlend() {
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+}
@@ -0,0 +1,114 @@
+#ifndef ParticleCompositor_hpp
+#define ParticleCompositor_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "Shader.hpp"
+#include "UniformBlocks.hpp"
+#include "GpuTimer.hpp"
+#include "FullscreenTriangle.hpp"
+
+namespace gps {
+
+    // Draws particle effects at a fraction of the scene resolution. Billboards
+    // near the camera cover much of the screen, and their blending is paid
+    // per pixel, so at a divisor of 2 the fill costs about a quarter.
+    //
+    // Per frame and divisor, the scene depth is reduced to the target size
+    // once. Each texel keeps the farthest depth of its block, so particles
+    // behind a thin edge still reach the low resolution target. An effect is
+    // drawn there with its usual depth test. It is then blended into the scene
+    // by a depth aware (bilateral) upsample: of the four low resolution texels
+    // around a pixel, those whose depth is close to the pixel's count most, so
+    // particles do not bleed over foreground edges.
+    //
+    // The target's colour is premultiplied, its alpha is the transmittance
+    // left. Effects must blend with additiveBlend/alphaBlend so the alpha
+    // channel tracks it; the composite is then scene * alpha + colour. The
+    // target has a bright attachment too, composited into the scene's bright
+    // one the same way, so effects that write to the bloom at full resolution
+    // still do at a lower one.
+    class ParticleCompositor {
+
+    public:
+        enum Effect {
+            FIRE_EFFECT,
+            RAIN_EFFECT,
+            EFFECT_COUNT
+        };
+
+        // Resolution divisors, 1 draws straight into the scene
+        static const int MAX_DIVISOR = 4;
+
+        ParticleCompositor();
+
+        void init(const UniformBlocks& uniformBlocks);
+        void cleanup();
+
+        // The scene the effects end up in: its framebuffer, colour and bright
+        // (bloom) attachments and depth texture. Call again when they change size.
+        void setScene(GLuint framebuffer, GLuint color, GLuint bright, GLuint depth, int width, int height);
+
+        // 1, 2 or 4; anything else is rounded down to one of those
+        void setDivisor(Effect effect, int divisor);
+        int getDivisor(Effect effect) const { return divisors[effect]; }
+
+        // Once per frame, after the opaque scene and before the first begin
+        void beginFrame();
+        // Binds the effect's target and starts timing it. The scene's view
+        // block must be bound.
+        void begin(Effect effect);
+        // Blends a reduced target into the scene, stops the timer and leaves
+        // the scene framebuffer bound
+        void end(Effect effect);
+
+        // GPU time of the effect's most recent begin/end that has finished,
+        // composite included, in ms
+        double getGpuMs(Effect effect) const { return timers[effect].getGpuMs(); }
+
+        // Blend modes that keep the transmittance in the alpha channel
+        static void additiveBlend();
+        static void alphaBlend();
+
+    private:
+        struct Target {
+            GLuint framebuffer;
+            GLuint color;
+            GLuint bright;
+            GLuint depth;
+            int width, height;
+            bool depthReady;
+        };
+
+        void createTarget(Target& target, int divisor);
+        void deleteTarget(Target& target);
+        void downsampleDepth(Target& target, int divisor);
+        void composite(Target& target);
+
+        Shader depthShader;
+        Shader compositeShader;
+        FullscreenTriangle triangle;
+
+        // Indexed by divisor, 0 and 1 unused
+        Target targets[MAX_DIVISOR + 1];
+        int divisors[EFFECT_COUNT];
+
+        GLuint sceneFramebuffer;
+        GLuint sceneColor, sceneBright, sceneDepth;
+        int sceneWidth, sceneHeight;
+        // The scene colour attachments without the depth, so the composite
+        // can read the depth texture while writing the colour
+        GLuint compositeFramebuffer;
+
+        GpuTimer timers[EFFECT_COUNT];
+    };
+
+}
+
+#endif
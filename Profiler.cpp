@@ -0,0 +1,516 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    const int Profiler::FRAME_LATENCY;
+    const int Profiler::HISTORY_FRAMES;
+    const int Profiler::MAX_GPU_ZONES;
+    const int Profiler::CALIBRATION_FRAMES;
+
+    Profiler* Profiler::active = nullptr;
+
+    namespace {
+
+        // JSON string contents; zone names are plain ASCII
+        std::string escapeJson(const std::string& text) {
+            std::string escaped;
+            for (char c : text) {
+                if (c == '"' || c == '\\') escaped += '\\';
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        void writeTraceEvent(std::ostream& out, bool& first, const std::string& name, int thread, double startMs, double durationMs) {
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << escapeJson(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread <<
+                ",\"ts\":" << startMs * 1000.0 << ",\"dur\":" << durationMs * 1000.0 << "}";
+            first = false;
+        }
+
+        void writeJsonSummary(std::ostream& out, const std::vector<double>& values) {
+            double mean = 0.0;
+            for (double value : values) mean += value;
+            mean = values.empty() ? 0.0 : mean / values.size();
+            out << "{\"mean\":" << mean <<
+                ",\"min\":" << (values.empty() ? 0.0 : *std::min_element(values.begin(), values.end())) <<
+                ",\"max\":" << (values.empty() ? 0.0 : *std::max_element(values.begin(), values.end())) <<
+                ",\"p50\":" << Profiler::percentile(values, 50.0) << ",\"p95\":" << Profiler::percentile(values, 95.0) <<
+                ",\"p99\":" << Profiler::percentile(values, 99.0) << "}";
+        }
+
+    }
+
+    Profiler::Profiler() : initialized(false), gpuOffsetNs(0), clockCostUs(0.0), currentSlot(0), inFrame(false), gpuDepth(0),
+        overheadMs(0.0), clockReads(0), frameIndex(0), droppedGpuFrames(0), historyFrames(HISTORY_FRAMES) {
+        for (Slot& slot : slots) {
+            std::fill(slot.queries, slot.queries + 2 * MAX_GPU_ZONES, 0u);
+            slot.used = 0;
+        }
+    }
+
+    void Profiler::init() {
+        epoch = std::chrono::steady_clock::now();
+        for (Slot& slot : slots) {
+            glGenQueries(2 * MAX_GPU_ZONES, slot.queries);
+            slot.used = 0;
+        }
+        initialized = true;
+        calibrate();
+
+        // What one clock read costs; the calls time their bookkeeping between
+        // two reads, so one read per call is not seen otherwise
+        const int reads = 10000;
+        auto start = std::chrono::steady_clock::now();
+        volatile double sink = 0.0;
+        for (int i = 0; i < reads; i++) {
+            sink = sink + nowMs();
+        }
+        double totalUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        clockCostUs = totalUs / reads;
+    }
+
+    void Profiler::cleanup() {
+        if (!initialized) {
+            return;
+        }
+        for (Slot& slot : slots) {
+            glDeleteQueries(2 * MAX_GPU_ZONES, slot.queries);
+            slot.used = 0;
+        }
+        pending.clear();
+        initialized = false;
+    }
+
+    double Profiler::nowMs() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void Profiler::calibrate() {
+        GLint64 gpuNs = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+        double cpuMs = nowMs();
+        gpuOffsetNs = static_cast<long long>(gpuNs) - static_cast<long long>(cpuMs * 1000000.0);
+    }
+
+    void Profiler::beginFrame() {
+        if (!initialized) {
+            return;
+        }
+        double start = nowMs();
+
+        current = Frame();
+        current.index = frameIndex;
+        current.cpuStartMs = start;
+        current.gpuMs = 0.0;
+        current.gpuValid = false;
+        currentSlot = static_cast<int>(frameIndex % FRAME_LATENCY);
+        stack.clear();
+        gpuDepth = 0;
+        overheadMs = 0.0;
+        clockReads = 1;
+        inFrame = true;
+
+        // This frame's queries are still owned by the frame FRAME_LATENCY ago
+        while (static_cast<int>(pending.size()) >= FRAME_LATENCY) {
+            resolvePending(true);
+        }
+        while (!pending.empty() && resolvePending(false)) {
+        }
+
+        if (frameIndex % CALIBRATION_FRAMES == 0) {
+            calibrate();
+        }
+        overheadMs += nowMs() - start;
+    }
+
+    void Profiler::endFrame() {
+        if (!inFrame) {
+            return;
+        }
+        double end = nowMs();
+        while (!stack.empty()) {
+            endZone();
+        }
+        current.cpuMs = end - current.cpuStartMs;
+        clockReads++;
+        current.overheadUs = overheadMs * 1000.0 + clockReads * clockCostUs;
+
+        PendingFrame frame = { current, currentSlot, gpuOffsetNs };
+        pending.push_back(frame);
+        current.events.clear();
+        inFrame = false;
+        frameIndex++;
+    }
+
+    void Profiler::beginZone(int zone, bool gpu) {
+        if (!inFrame) {
+            return;
+        }
+        double start = nowMs();
+
+        Event event = { zone, static_cast<int>(stack.size()), -1, 0.0, 0.0, -1.0, -1.0 };
+        OpenZone open = { static_cast<int>(current.events.size()), -1 };
+        Slot& slot = slots[currentSlot];
+        if (gpu && slot.used < MAX_GPU_ZONES) {
+            open.pair = slot.used++;
+            slot.events[open.pair] = open.event;
+            event.gpuDepth = gpuDepth++;
+            glQueryCounter(slot.queries[2 * open.pair], GL_TIMESTAMP);
+        }
+        current.events.push_back(event);
+        stack.push_back(open);
+
+        double end = nowMs();
+        current.events.back().cpuStartMs = end;
+        overheadMs += end - start;
+        clockReads++;
+    }
+
+    void Profiler::endZone() {
+        if (!inFrame || stack.empty()) {
+            return;
+        }
+        double start = nowMs();
+
+        OpenZone open = stack.back();
+        stack.pop_back();
+        Event& event = current.events[open.event];
+        event.cpuMs = start - event.cpuStartMs;
+        if (open.pair >= 0) {
+            glQueryCounter(slots[currentSlot].queries[2 * open.pair + 1], GL_TIMESTAMP);
+            gpuDepth--;
+        }
+
+        overheadMs += nowMs() - start;
+        clockReads++;
+    }
+
+    void Profiler::flush() {
+        if (!initialized) {
+            return;
+        }
+        glFinish();
+        while (!pending.empty()) {
+            resolvePending(true);
+        }
+    }
+
+    bool Profiler::resolvePending(bool force) {
+        PendingFrame& frame = pending.front();
+        Slot& slot = slots[frame.slot];
+
+        if (slot.used > 0) {
+            GLint available = 0;
+            glGetQueryObjectiv(slot.queries[2 * slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                if (!force) {
+                    return false;
+                }
+                droppedGpuFrames++;
+            }
+            else {
+                // Results arrive in order, the last one being there means all are
+                for (int pair = 0; pair < slot.used; pair++) {
+                    GLuint64 begin = 0, end = 0;
+                    glGetQueryObjectui64v(slot.queries[2 * pair], GL_QUERY_RESULT, &begin);
+                    glGetQueryObjectui64v(slot.queries[2 * pair + 1], GL_QUERY_RESULT, &end);
+                    Event& event = frame.frame.events[slot.events[pair]];
+                    event.gpuStartMs = (static_cast<long long>(begin) - frame.gpuOffsetNs) / 1000000.0;
+                    event.gpuMs = (end > begin ? end - begin : 0) / 1000000.0;
+                    if (event.gpuDepth == 0) {
+                        frame.frame.gpuMs += event.gpuMs;
+                    }
+                }
+                frame.frame.gpuValid = true;
+            }
+        }
+        slot.used = 0;
+
+        finish(frame.frame);
+        pending.pop_front();
+        return true;
+    }
+
+    void Profiler::finish(Frame& frame) {
+        history.push_back(std::move(frame));
+        while (history.size() > historyFrames) {
+            history.pop_front();
+        }
+    }
+
+    int Profiler::registerZone(const std::string& name) {
+        std::vector<std::string>& names = zoneNames();
+        for (size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        names.push_back(name);
+        return static_cast<int>(names.size()) - 1;
+    }
+
+    const std::string& Profiler::getZoneName(int zone) {
+        return zoneNames()[zone];
+    }
+
+    std::vector<std::string>& Profiler::zoneNames() {
+        // Function local so zones can be registered from static initialisers
+        static std::vector<std::string> names;
+        return names;
+    }
+
+    double Profiler::percentile(std::vector<double> values, double percentile) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        double rank = std::min(std::max(percentile, 0.0), 100.0) / 100.0 * (values.size() - 1);
+        size_t below = static_cast<size_t>(rank);
+        size_t above = std::min(below + 1, values.size() - 1);
+        return values[below] + (values[above] - values[below]) * (rank - below);
+    }
+
+    double Profiler::getFramePercentile(double percentile, bool gpu) const {
+        std::vector<double> values;
+        values.reserve(history.size());
+        for (const Frame& frame : history) {
+            if (!gpu) {
+                values.push_back(frame.cpuMs);
+            }
+            else if (frame.gpuValid) {
+                values.push_back(frame.gpuMs);
+            }
+        }
+        return Profiler::percentile(values, percentile);
+    }
+
+    double Profiler::getMeanOverheadUs() const {
+        if (history.empty()) {
+            return 0.0;
+        }
+        double total = 0.0;
+        for (const Frame& frame : history) {
+            total += frame.overheadUs;
+        }
+        return total / history.size();
+    }
+
+    std::vector<Profiler::ZoneStats> Profiler::computeStats() const {
+        size_t zoneCount = zoneNames().size();
+        std::vector<std::vector<double>> cpuTimes(zoneCount), gpuTimes(zoneCount);
+        std::vector<int> calls(zoneCount, 0);
+        std::vector<bool> gpuZones(zoneCount, false);
+
+        std::vector<double> cpuFrame(zoneCount), gpuFrame(zoneCount);
+        std::vector<int> callsFrame(zoneCount);
+        std::vector<bool> gpuKnown(zoneCount);
+        for (const Frame& frame : history) {
+            std::fill(cpuFrame.begin(), cpuFrame.end(), 0.0);
+            std::fill(gpuFrame.begin(), gpuFrame.end(), 0.0);
+            std::fill(callsFrame.begin(), callsFrame.end(), 0);
+            std::fill(gpuKnown.begin(), gpuKnown.end(), false);
+            for (const Event& event : frame.events) {
+                // A zone that ran more than once in the frame counts its total
+                cpuFrame[event.zone] += event.cpuMs;
+                callsFrame[event.zone]++;
+                if (event.gpuDepth >= 0) {
+                    gpuZones[event.zone] = true;
+                }
+                if (event.gpuMs >= 0.0) {
+                    gpuFrame[event.zone] += event.gpuMs;
+                    gpuKnown[event.zone] = true;
+                }
+            }
+            for (size_t zone = 0; zone < zoneCount; zone++) {
+                if (callsFrame[zone] == 0) {
+                    continue;
+                }
+                cpuTimes[zone].push_back(cpuFrame[zone]);
+                calls[zone] += callsFrame[zone];
+                if (gpuKnown[zone]) {
+                    gpuTimes[zone].push_back(gpuFrame[zone]);
+                }
+            }
+        }
+
+        std::vector<ZoneStats> stats;
+        for (size_t zone = 0; zone < zoneCount; zone++) {
+            if (cpuTimes[zone].empty()) {
+                continue;
+            }
+            ZoneStats zoneStats;
+            zoneStats.name = zoneNames()[zone];
+            zoneStats.gpu = gpuZones[zone];
+            zoneStats.callsPerFrame = static_cast<double>(calls[zone]) / history.size();
+
+            const std::vector<double>& cpu = cpuTimes[zone];
+            zoneStats.cpuMean = 0.0;
+            for (double value : cpu) zoneStats.cpuMean += value;
+            zoneStats.cpuMean /= cpu.size();
+            zoneStats.cpuP50 = percentile(cpu, 50.0);
+            zoneStats.cpuP95 = percentile(cpu, 95.0);
+            zoneStats.cpuP99 = percentile(cpu, 99.0);
+
+            const std::vector<double>& gpu = gpuTimes[zone];
+            zoneStats.gpuMean = 0.0;
+            for (double value : gpu) zoneStats.gpuMean += value;
+            zoneStats.gpuMean = gpu.empty() ? 0.0 : zoneStats.gpuMean / gpu.size();
+            zoneStats.gpuP50 = percentile(gpu, 50.0);
+            zoneStats.gpuP95 = percentile(gpu, 95.0);
+            zoneStats.gpuP99 = percentile(gpu, 99.0);
+            stats.push_back(zoneStats);
+        }
+        return stats;
+    }
+
+    std::string Profiler::report() const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3);
+        out << "Profile of the last " << history.size() << " frames (" << droppedGpuFrames << " without GPU times so far)" << std::endl;
+        out << "frame cpu ms p50 " << getFramePercentile(50.0, false) << ", p95 " << getFramePercentile(95.0, false) << ", p99 " <<
+            getFramePercentile(99.0, false) << "; gpu ms p50 " << getFramePercentile(50.0, true) << ", p95 " <<
+            getFramePercentile(95.0, true) << ", p99 " << getFramePercentile(99.0, true) << std::endl;
+
+        double overheadUs = getMeanOverheadUs();
+        double frameMs = 0.0;
+        for (const Frame& frame : history) frameMs += frame.cpuMs;
+        frameMs = history.empty() ? 0.0 : frameMs / history.size();
+        out << "profiler overhead " << overheadUs << " us/frame (" << (frameMs > 0.0 ? overheadUs / (frameMs * 10.0) : 0.0) <<
+            "% of the CPU frame), clock read " << clockCostUs * 1000.0 << " ns" << std::endl;
+
+        out << std::left << std::setw(24) << "zone" << std::right << std::setw(8) << "calls" <<
+            std::setw(10) << "cpu mean" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" <<
+            std::setw(10) << "gpu mean" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+        for (const ZoneStats& zone : computeStats()) {
+            out << std::left << std::setw(24) << zone.name << std::right << std::setw(8) << std::setprecision(2) << zone.callsPerFrame <<
+                std::setprecision(3) << std::setw(10) << zone.cpuMean << std::setw(10) << zone.cpuP50 << std::setw(10) << zone.cpuP95 <<
+                std::setw(10) << zone.cpuP99;
+            if (zone.gpu) {
+                out << std::setw(10) << zone.gpuMean << std::setw(10) << zone.gpuP50 << std::setw(10) << zone.gpuP95 <<
+                    std::setw(10) << zone.gpuP99;
+            }
+            out << std::endl;
+        }
+        return out.str();
+    }
+
+    bool Profiler::writeChromeTrace(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Could not write " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        out << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}}";
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        bool first = false;
+        for (const Frame& frame : history) {
+            writeTraceEvent(out, first, "frame " + std::to_string(frame.index), 1, frame.cpuStartMs, frame.cpuMs);
+            for (const Event& event : frame.events) {
+                writeTraceEvent(out, first, zoneNames()[event.zone], 1, event.cpuStartMs, event.cpuMs);
+                if (event.gpuMs >= 0.0) {
+                    writeTraceEvent(out, first, zoneNames()[event.zone], 2, event.gpuStartMs, event.gpuMs);
+                }
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+    bool Profiler::writeCsv(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Could not write " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(4);
+        // One row per frame (zone "frame", depth -1), then one per zone;
+        // GPU columns are empty where there is no GPU time
+        out << "frame,zone,depth,cpu_start_ms,cpu_ms,gpu_start_ms,gpu_ms\n";
+        for (const Frame& frame : history) {
+            out << frame.index << ",frame,-1," << frame.cpuStartMs << "," << frame.cpuMs << ",,";
+            if (frame.gpuValid) out << frame.gpuMs;
+            out << "\n";
+            for (const Event& event : frame.events) {
+                out << frame.index << ",\"" << zoneNames()[event.zone] << "\"," << event.depth << "," << event.cpuStartMs << "," <<
+                    event.cpuMs << ",";
+                if (event.gpuMs >= 0.0) out << event.gpuStartMs << "," << event.gpuMs;
+                else out << ",";
+                out << "\n";
+            }
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool Profiler::writeJson(const std::string& path, const std::vector<std::pair<std::string, std::string>>& info) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Could not write " << path << std::endl;
+            return false;
+        }
+        out << std::fixed << std::setprecision(4);
+
+        out << "{\n\"run\": {";
+        for (size_t i = 0; i < info.size(); i++) {
+            out << (i == 0 ? "" : ", ") << "\"" << escapeJson(info[i].first) << "\": \"" << escapeJson(info[i].second) << "\"";
+        }
+        out << "},\n";
+
+        std::vector<double> cpu, gpu, overhead;
+        for (const Frame& frame : history) {
+            cpu.push_back(frame.cpuMs);
+            overhead.push_back(frame.overheadUs);
+            if (frame.gpuValid) gpu.push_back(frame.gpuMs);
+        }
+        double cpuMean = 0.0;
+        for (double value : cpu) cpuMean += value;
+        cpuMean = cpu.empty() ? 0.0 : cpuMean / cpu.size();
+        out << "\"summary\": {\"frames\": " << history.size() << ", \"gpu_frames\": " << gpu.size() <<
+            ", \"dropped_gpu_frames\": " << droppedGpuFrames << ",\n  \"cpu_ms\": ";
+        writeJsonSummary(out, cpu);
+        out << ",\n  \"gpu_ms\": ";
+        writeJsonSummary(out, gpu);
+        out << ",\n  \"overhead_us\": ";
+        writeJsonSummary(out, overhead);
+        out << ",\n  \"overhead_percent\": " << (cpuMean > 0.0 ? getMeanOverheadUs() / (cpuMean * 10.0) : 0.0) <<
+            ", \"clock_read_ns\": " << clockCostUs * 1000.0 << "},\n";
+
+        out << "\"zones\": [";
+        std::vector<ZoneStats> stats = computeStats();
+        for (size_t i = 0; i < stats.size(); i++) {
+            const ZoneStats& zone = stats[i];
+            out << (i == 0 ? "\n" : ",\n") << "  {\"name\": \"" << escapeJson(zone.name) << "\", \"gpu\": " <<
+                (zone.gpu ? "true" : "false") << ", \"calls_per_frame\": " << zone.callsPerFrame <<
+                ", \"cpu_ms\": {\"mean\":" << zone.cpuMean << ",\"p50\":" << zone.cpuP50 << ",\"p95\":" << zone.cpuP95 <<
+                ",\"p99\":" << zone.cpuP99 << "}";
+            if (zone.gpu) {
+                out << ", \"gpu_ms\": {\"mean\":" << zone.gpuMean << ",\"p50\":" << zone.gpuP50 << ",\"p95\":" << zone.gpuP95 <<
+                    ",\"p99\":" << zone.gpuP99 << "}";
+            }
+            out << "}";
+        }
+        out << "\n],\n";
+
+        // GPU time is null for frames whose queries were not read
+        out << "\"frames\": [";
+        bool first = true;
+        for (const Frame& frame : history) {
+            out << (first ? "\n" : ",\n") << "  {\"index\": " << frame.index << ", \"cpu_start_ms\": " << frame.cpuStartMs <<
+                ", \"cpu_ms\": " << frame.cpuMs << ", \"gpu_ms\": ";
+            if (frame.gpuValid) out << frame.gpuMs;
+            else out << "null";
+            out << ", \"overhead_us\": " << frame.overheadUs << "}";
+            first = false;
+        }
+        out << "\n]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+}
@@ -0,0 +1,224 @@
+#ifndef Profiler_hpp
+#define Profiler_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Zones compile to nothing with -DGPS_PROFILING=0; the profiler itself stays
+// and reports empty frames
+#ifndef GPS_PROFILING
+#define GPS_PROFILING 1
+#endif
+
+namespace gps {
+
+    // Frame profiler. CPU zones are scopes timed with steady_clock, GPU zones
+    // also put a timestamp query into the command stream at either end. The
+    // queries of a frame are read FRAME_LATENCY frames later, and only if the
+    // GPU has got that far: a frame whose results are not there yet when its
+    // queries come round again loses its GPU times instead of waiting.
+    //
+    // Timestamps rather than GL_TIME_ELAPSED: elapsed queries cannot nest, and
+    // the passes already time parts of themselves with them (bloom, TAA, the
+    // water views). Timestamps also give each pass a start, for the trace.
+    // GPU time is mapped to CPU time by reading GL_TIMESTAMP now and then.
+    //
+    // The last HISTORY_FRAMES finished frames are kept, for percentiles per
+    // zone and for the Chrome trace (chrome://tracing, Perfetto) and CSV
+    // exports. Time spent in the profiler's own calls is counted every frame
+    // and reported as its overhead.
+    //
+    // Zones are registered once by name and used through the GPS_PROFILE_*
+    // macros, on the GL thread only.
+    class Profiler {
+
+    public:
+        static const int FRAME_LATENCY = 3;
+        static const int HISTORY_FRAMES = 300;
+        // Timestamp pairs per frame, zones past it are timed on the CPU only
+        static const int MAX_GPU_ZONES = 64;
+        // Frames between two GPU clock calibrations
+        static const int CALIBRATION_FRAMES = 60;
+
+        struct Event {
+            int zone;
+            // Nesting among all zones, and among GPU zones (-1 for CPU zones)
+            int depth;
+            int gpuDepth;
+            // ms since init
+            double cpuStartMs, cpuMs;
+            // Negative while unknown
+            double gpuStartMs, gpuMs;
+        };
+
+        struct Frame {
+            unsigned int index;
+            double cpuStartMs, cpuMs;
+            // Sum of the outermost GPU zones
+            double gpuMs;
+            bool gpuValid;
+            double overheadUs;
+            std::vector<Event> events;
+        };
+
+        struct ZoneStats {
+            std::string name;
+            bool gpu;
+            double callsPerFrame;
+            // Per frame totals over the frames the zone ran in
+            double cpuMean, cpuP50, cpuP95, cpuP99;
+            double gpuMean, gpuP50, gpuP95, gpuP99;
+        };
+
+        Profiler();
+
+        void init();
+        void cleanup();
+
+        // Around everything a frame does, swap included
+        void beginFrame();
+        void endFrame();
+        // Waits for the GPU and reads every frame still in flight
+        void flush();
+
+        // Frames kept, HISTORY_FRAMES unless set; the oldest are dropped
+        void setHistoryFrames(size_t frames) { historyFrames = frames; }
+
+        void beginZone(int zone, bool gpu);
+        void endZone();
+
+        // Same name, same id
+        static int registerZone(const std::string& name);
+        static const std::string& getZoneName(int zone);
+
+        // Where the GPS_PROFILE_* macros record to, nothing when null
+        static void setActive(Profiler* profiler) { active = profiler; }
+        static Profiler* getActive() { return active; }
+
+        // Oldest first
+        const std::deque<Frame>& getHistory() const { return history; }
+        // Over the history, gpu only counts frames with GPU times
+        double getFramePercentile(double percentile, bool gpu) const;
+        double getMeanOverheadUs() const;
+        // Frames whose GPU times were not ready in time
+        unsigned int getDroppedGpuFrames() const { return droppedGpuFrames; }
+
+        std::vector<ZoneStats> computeStats() const;
+        // Percentile table per zone and the overhead
+        std::string report() const;
+
+        bool writeChromeTrace(const std::string& path) const;
+        bool writeCsv(const std::string& path) const;
+        // Frame times, frame percentiles and the zone stats. info is added
+        // as string members of a "run" object.
+        bool writeJson(const std::string& path, const std::vector<std::pair<std::string, std::string>>& info) const;
+
+        static double percentile(std::vector<double> values, double percentile);
+
+    private:
+        struct Slot {
+            GLuint queries[2 * MAX_GPU_ZONES];
+            // Used this frame, in pairs
+            int used;
+            // Event of each pair, in the frame being recorded
+            int events[MAX_GPU_ZONES];
+        };
+
+        struct PendingFrame {
+            Frame frame;
+            int slot;
+            long long gpuOffsetNs;
+        };
+
+        struct OpenZone {
+            int event;
+            // Query pair, -1 for CPU zones
+            int pair;
+        };
+
+        double nowMs() const;
+        void calibrate();
+        // Reads the oldest unfinished frame if its queries are done, or
+        // drops its GPU times when force is set
+        bool resolvePending(bool force);
+        void finish(Frame& frame);
+
+        static std::vector<std::string>& zoneNames();
+        static Profiler* active;
+
+        bool initialized;
+        std::chrono::steady_clock::time_point epoch;
+        // GPU timestamp minus ns since epoch
+        long long gpuOffsetNs;
+        // One steady_clock read, measured in init
+        double clockCostUs;
+
+        Slot slots[FRAME_LATENCY];
+        // Recorded but not yet read back
+        std::deque<PendingFrame> pending;
+
+        Frame current;
+        int currentSlot;
+        bool inFrame;
+        std::vector<OpenZone> stack;
+        int gpuDepth;
+        double overheadMs;
+        unsigned int clockReads;
+
+        unsigned int frameIndex;
+        unsigned int droppedGpuFrames;
+        size_t historyFrames;
+        std::deque<Frame> history;
+    };
+
+    // Zone for the rest of a scope
+    class ProfileScope {
+    public:
+        ProfileScope(int zone, bool gpu) : profiler(Profiler::getActive()) {
+            if (profiler != nullptr) profiler->beginZone(zone, gpu);
+        }
+        ~ProfileScope() {
+            if (profiler != nullptr) profiler->endZone();
+        }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        Profiler* profiler;
+    };
+
+}
+
+#define GPS_PROFILE_JOIN_(a, b) a##b
+#define GPS_PROFILE_JOIN(a, b) GPS_PROFILE_JOIN_(a, b)
+
+#if GPS_PROFILING
+// name is a string literal, registered the first time the scope runs
+#define GPS_PROFILE_ZONE(name) \
+    static const int GPS_PROFILE_JOIN(profileZone, __LINE__) = gps::Profiler::registerZone(name); \
+    gps::ProfileScope GPS_PROFILE_JOIN(profileScope, __LINE__)(GPS_PROFILE_JOIN(profileZone, __LINE__), false)
+#define GPS_PROFILE_GPU_ZONE(name) \
+    static const int GPS_PROFILE_JOIN(profileZone, __LINE__) = gps::Profiler::registerZone(name); \
+    gps::ProfileScope GPS_PROFILE_JOIN(profileScope, __LINE__)(GPS_PROFILE_JOIN(profileZone, __LINE__), true)
+// For names only known at run time, looked up on every call
+#define GPS_PROFILE_GPU_ZONE_DYNAMIC(name) \
+    gps::ProfileScope GPS_PROFILE_JOIN(profileScope, __LINE__)(gps::Profiler::registerZone(name), true)
+#else
+#define GPS_PROFILE_ZONE(name)
+#define GPS_PROFILE_GPU_ZONE(name)
+#define GPS_PROFILE_GPU_ZONE_DYNAMIC(name)
+#endif
+
+#endif
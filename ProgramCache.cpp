@@ -0,0 +1,144 @@
+#include "ProgramCache.hpp"
+
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+        const unsigned int CACHE_MAGIC = 0x31435047; // "GPC1"
+
+        unsigned long long fnv1a(unsigned long long hash, const std::string& text) {
+            for (unsigned char c : text) {
+                hash ^= c;
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        std::string glString(GLenum name) {
+            const GLubyte* value = glGetString(name);
+            return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+        }
+    }
+
+    ProgramCache::ProgramCache()
+        : enabled(false), dirty(false), hitCount(0), missCount(0) {
+    }
+
+    void ProgramCache::init(const std::string& fileName) {
+        this->fileName = fileName;
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        enabled = formatCount > 0;
+        if (!enabled) {
+            std::cout << "Program binary cache disabled, the driver has no binary formats" << std::endl;
+            return;
+        }
+
+        driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+        std::ifstream file(fileName, std::ios::binary);
+        if (!file.is_open()) {
+            return;
+        }
+
+        unsigned int magic = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        if (magic != CACHE_MAGIC) {
+            return;
+        }
+
+        unsigned long long key;
+        while (file.read(reinterpret_cast<char*>(&key), sizeof(key))) {
+            Entry entry;
+            unsigned int size = 0;
+            file.read(reinterpret_cast<char*>(&entry.format), sizeof(entry.format));
+            file.read(reinterpret_cast<char*>(&size), sizeof(size));
+            entry.binary.resize(size);
+            if (size == 0 || !file.read(&entry.binary[0], size)) {
+                break;
+            }
+            entries[key] = std::move(entry);
+        }
+    }
+
+    void ProgramCache::save() {
+        if (!enabled || !dirty) {
+            return;
+        }
+
+        std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Failed to write program cache: " << fileName << std::endl;
+            return;
+        }
+
+        file.write(reinterpret_cast<const char*>(&CACHE_MAGIC), sizeof(CACHE_MAGIC));
+        for (const auto& entry : entries) {
+            unsigned int size = static_cast<unsigned int>(entry.second.binary.size());
+            file.write(reinterpret_cast<const char*>(&entry.first), sizeof(entry.first));
+            file.write(reinterpret_cast<const char*>(&entry.second.format), sizeof(entry.second.format));
+            file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            file.write(&entry.second.binary[0], size);
+        }
+        dirty = false;
+    }
+
+    unsigned long long ProgramCache::makeKey(const std::vector<std::string>& sources) const {
+        unsigned long long hash = fnv1a(14695981039346656037ull, driver);
+        for (const std::string& source : sources) {
+            // Separator so moving text between stages changes the key
+            hash = fnv1a(hash, std::string(1, '\0'));
+            hash = fnv1a(hash, source);
+        }
+        return hash;
+    }
+
+    bool ProgramCache::load(unsigned long long key, GLuint program) {
+        if (!enabled) {
+            return false;
+        }
+
+        auto found = entries.find(key);
+        if (found == entries.end()) {
+            missCount++;
+            return false;
+        }
+
+        const Entry& entry = found->second;
+        glProgramBinary(program, entry.format, &entry.binary[0], static_cast<GLsizei>(entry.binary.size()));
+
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            entries.erase(found);
+            dirty = true;
+            missCount++;
+            return false;
+        }
+
+        hitCount++;
+        return true;
+    }
+
+    void ProgramCache::store(unsigned long long key, GLuint program) {
+        if (!enabled) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+
+        Entry entry;
+        entry.binary.resize(length);
+        glGetProgramBinary(program, length, nullptr, &entry.format, &entry.binary[0]);
+        entries[key] = std::move(entry);
+        dirty = true;
+    }
+
+}
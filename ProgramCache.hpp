@@ -0,0 +1,62 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    // Linked program binaries kept in one file between runs. Entries are keyed
+    // by a hash of the preprocessed sources (defines included) and the driver
+    // strings, so editing a shader or updating the driver simply misses.
+    class ProgramCache {
+
+    public:
+        ProgramCache();
+
+        // Reads the cache file; disabled when the driver exposes no binary formats
+        void init(const std::string& fileName);
+        // Writes the file back if anything was stored since init
+        void save();
+
+        bool isEnabled() const { return enabled; }
+
+        // Hash of the driver strings and the given sources, in order
+        unsigned long long makeKey(const std::vector<std::string>& sources) const;
+
+        // Loads a stored binary into program; false on a miss or when the
+        // driver rejects the binary (the entry is dropped then)
+        bool load(unsigned long long key, GLuint program);
+        // Stores the binary of a successfully linked program
+        void store(unsigned long long key, GLuint program);
+
+        unsigned int getHitCount() const { return hitCount; }
+        unsigned int getMissCount() const { return missCount; }
+
+    private:
+        struct Entry {
+            GLenum format;
+            std::vector<char> binary;
+        };
+
+        std::string fileName;
+        std::string driver;
+        std::unordered_map<unsigned long long, Entry> entries;
+        bool enabled;
+        bool dirty;
+        unsigned int hitCount;
+        unsigned int missCount;
+    };
+
+}
+
+#endif
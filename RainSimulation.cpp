@@ -0,0 +1,405 @@
+#include "RainSimulation.hpp"
+#include "Random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAIN_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    const float RainSimulation::GRAVITY = -4.905f;
+    const float RainSimulation::TERMINAL_VELOCITY = -25.0f;
+
+    namespace {
+
+        // Triangle strip: top, middle left, middle right, bottom
+        const float STREAK_VERTICES[] = {
+             0.0f, 0.0f,
+            -1.0f, 0.5f,
+             1.0f, 0.5f,
+             0.0f, 1.0f,
+        };
+
+        const size_t LANES = 4;
+        const size_t MIN_CHUNK = 16384;
+    }
+
+    RainSimulation::RainSimulation()
+        : minX(-100.0f), maxX(100.0f), minZ(-100.0f), maxZ(100.0f), topY(25.0f), bottomY(-1.0f),
+        proceduralDensity(25.0f), tileSize(20.0f), tileGrid(6),
+        seed(0), frame(0), activeCount(0), respawnCount(0), fullUpload(true), vao(0), heightBuffer(0), streakBuffer(0),
+        dropTexture(0), dropTextureRows(0), scatterFramebuffer(0), scatterVAO(0), scatterBuffer(0), proceduralVAO(0), heightSource(0) {
+    }
+
+    void RainSimulation::reset(size_t count, uint32_t seed) {
+        this->seed = seed;
+        frame = 0;
+
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+        velocityY.resize(count);
+        lengthFactor.resize(count);
+        speedFactor.resize(count);
+        activeCount = count;
+
+        for (size_t i = 0; i < count; i++) {
+            respawn(i);
+        }
+        fullUpload = true;
+    }
+
+    void RainSimulation::respawn(size_t index) {
+        uint32_t state = pcgHash(seed ^ pcgHash(static_cast<uint32_t>(index) ^ pcgHash(frame)));
+
+        float u0 = unitFloat(state = pcgHash(state));
+        float u1 = unitFloat(state = pcgHash(state));
+        float u2 = unitFloat(state = pcgHash(state));
+        float u3 = unitFloat(state = pcgHash(state));
+        float u4 = unitFloat(pcgHash(state));
+
+        x[index] = minX + u0 * (maxX - minX);
+        z[index] = minZ + u1 * (maxZ - minZ);
+        y[index] = topY + u2 * 5.0f;
+        lengthFactor[index] = 0.5f + u3 * 2.0f;
+        speedFactor[index] = 0.5f + u4 * 2.0f;
+        velocityY[index] = GRAVITY * speedFactor[index];
+    }
+
+    // begin is a multiple of LANES, only the last chunk may have a scalar tail
+    void RainSimulation::simulate(size_t begin, size_t end, float deltaTime, std::vector<uint32_t>& respawned) {
+        float* py = &y[0];
+        float* pv = &velocityY[0];
+        size_t i = begin;
+
+        auto markRespawn = [&](size_t index) {
+            respawn(index);
+            respawned.push_back(static_cast<uint32_t>(index));
+        };
+
+#if defined(RAIN_USE_SSE2)
+        const __m128 gravityStep = _mm_set1_ps(GRAVITY * deltaTime);
+        const __m128 terminal = _mm_set1_ps(TERMINAL_VELOCITY);
+        const __m128 dt = _mm_set1_ps(deltaTime);
+        const __m128 bottom = _mm_set1_ps(bottomY);
+
+        for (; i + LANES <= end; i += LANES) {
+            __m128 velocity = _mm_loadu_ps(pv + i);
+            velocity = _mm_max_ps(_mm_add_ps(velocity, gravityStep), terminal);
+            __m128 height = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(velocity, dt));
+            _mm_storeu_ps(pv + i, velocity);
+            _mm_storeu_ps(py + i, height);
+
+            // Respawns are rare (a drop falls for seconds), handle those lanes one by one
+            int below = _mm_movemask_ps(_mm_cmplt_ps(height, bottom));
+            while (below != 0) {
+                int lane = 0;
+                while (!(below & (1 << lane))) lane++;
+                below &= ~(1 << lane);
+                markRespawn(i + lane);
+            }
+        }
+#endif
+
+        for (; i < end; i++) {
+            pv[i] = std::max(pv[i] + GRAVITY * deltaTime, TERMINAL_VELOCITY);
+            py[i] += pv[i] * deltaTime;
+            if (py[i] < bottomY) {
+                markRespawn(i);
+            }
+        }
+    }
+
+    void RainSimulation::setActiveCount(size_t count) {
+        activeCount = std::min(count, getCount());
+    }
+
+    void RainSimulation::update(float deltaTime, ThreadPool& pool) {
+        frame++;
+
+        // Grown only: lists still pending keep their entries
+        if (workerRespawns.size() < pool.getThreadCount()) {
+            workerRespawns.resize(pool.getThreadCount());
+        }
+        size_t pending = getPendingRespawns();
+
+        // Work on whole SSE groups so chunks never share a vector
+        size_t groups = (activeCount + LANES - 1) / LANES;
+        pool.parallelFor(groups, MIN_CHUNK / LANES, [&](size_t begin, size_t end, size_t worker) {
+            simulate(begin * LANES, std::min(end * LANES, activeCount), deltaTime, workerRespawns[worker]);
+        });
+
+        respawnCount = getPendingRespawns() - pending;
+    }
+
+    void RainSimulation::update(float deltaTime) {
+        frame++;
+
+        if (workerRespawns.empty()) {
+            workerRespawns.resize(1);
+        }
+        size_t pending = getPendingRespawns();
+        simulate(0, activeCount, deltaTime, workerRespawns[0]);
+        respawnCount = getPendingRespawns() - pending;
+    }
+
+    size_t RainSimulation::getPendingRespawns() const {
+        size_t count = 0;
+        for (const std::vector<uint32_t>& list : workerRespawns) {
+            count += list.size();
+        }
+        return count;
+    }
+
+    void RainSimulation::initBuffers() {
+        glGenBuffers(1, &streakBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, streakBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(STREAK_VERTICES), STREAK_VERTICES, GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &heightBuffer);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, heightBuffer);
+        glBufferData(GL_ARRAY_BUFFER, getCount() * sizeof(float), nullptr, GL_STREAM_DRAW);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        bindStreak();
+
+        glGenVertexArrays(1, &proceduralVAO);
+        glBindVertexArray(proceduralVAO);
+        bindStreak();
+
+        // One texel per drop, rows of DROP_TEXTURE_WIDTH
+        dropTextureRows = std::max(static_cast<GLsizei>((getCount() + DROP_TEXTURE_WIDTH - 1) / DROP_TEXTURE_WIDTH), 1);
+        glGenTextures(1, &dropTexture);
+        glBindTexture(GL_TEXTURE_2D, dropTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, DROP_TEXTURE_WIDTH, dropTextureRows, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &scatterFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, scatterFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dropTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Rain drop framebuffer not complete!" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // Attributes are pointed at the records on every scatter
+        glGenVertexArrays(1, &scatterVAO);
+        glBindVertexArray(scatterVAO);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glGenBuffers(1, &scatterBuffer);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        scatterShader.loadShader("shaders/rainScatter.vert", "shaders/rainScatter.frag", RAIN_SHADER);
+        scatterShader.useShaderProgram();
+        glUniform1i(scatterShader.getUniformLocation("dropTextureWidth"), DROP_TEXTURE_WIDTH);
+        glUniform2f(scatterShader.getUniformLocation("dropTextureSize"), static_cast<float>(DROP_TEXTURE_WIDTH), static_cast<float>(dropTextureRows));
+        glUseProgram(0);
+
+        heightSource = heightBuffer;
+        fullUpload = true;
+        upload();
+    }
+
+    // Attribute 5 of the bound VAO
+    void RainSimulation::bindStreak() {
+        glBindBuffer(GL_ARRAY_BUFFER, streakBuffer);
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    }
+
+    void RainSimulation::cleanup() {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteVertexArrays(1, &proceduralVAO);
+        glDeleteVertexArrays(1, &scatterVAO);
+        GLuint deleted[] = { heightBuffer, streakBuffer, scatterBuffer };
+        glDeleteBuffers(3, deleted);
+        glDeleteFramebuffers(1, &scatterFramebuffer);
+        glDeleteTextures(1, &dropTexture);
+        glDeleteProgram(scatterShader.shaderProgram);
+    }
+
+    void RainSimulation::pointHeights(GLuint buffer, GLintptr offset) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)offset);
+        glBindVertexArray(0);
+        heightSource = buffer;
+    }
+
+    size_t RainSimulation::getUploadSize() const {
+        return activeCount * sizeof(float) + getPendingRespawns() * sizeof(RespawnRecord);
+    }
+
+    void RainSimulation::stageUpload(float* heights, RespawnRecord* respawns) {
+        if (activeCount > 0) {
+            std::memcpy(heights, &y[0], activeCount * sizeof(float));
+        }
+        stageRespawns(respawns);
+    }
+
+    void RainSimulation::stageRespawns(RespawnRecord* respawns) {
+        for (std::vector<uint32_t>& list : workerRespawns) {
+            for (uint32_t index : list) {
+                *respawns++ = RespawnRecord{ index, x[index], z[index], lengthFactor[index], speedFactor[index] };
+            }
+            list.clear();
+        }
+    }
+
+    // Every drop at once, after a reset
+    void RainSimulation::writeDropTexture() {
+        std::vector<float> texels(static_cast<size_t>(dropTextureRows) * DROP_TEXTURE_WIDTH * 4, 0.0f);
+        for (size_t i = 0; i < getCount(); i++) {
+            float* texel = &texels[i * 4];
+            texel[0] = x[i];
+            texel[1] = z[i];
+            texel[2] = lengthFactor[i];
+            texel[3] = speedFactor[i];
+        }
+        glBindTexture(GL_TEXTURE_2D, dropTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DROP_TEXTURE_WIDTH, dropTextureRows, GL_RGBA, GL_FLOAT, &texels[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // One point per record, drawn into the drop texture
+    void RainSimulation::scatterRespawns(GLuint buffer, GLintptr offset, size_t count) {
+        GLint previousFramebuffer = 0;
+        GLint viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scatterFramebuffer);
+        glViewport(0, 0, DROP_TEXTURE_WIDTH, dropTextureRows);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        glBindVertexArray(scatterVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(RespawnRecord), (void*)offset);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(RespawnRecord), (void*)(offset + sizeof(uint32_t)));
+        scatterShader.useShaderProgram();
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+        glBindVertexArray(0);
+
+        if (depthTest) glEnable(GL_DEPTH_TEST);
+        if (blend) glEnable(GL_BLEND);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    void RainSimulation::upload(StreamBuffer* stream) {
+        if (fullUpload) {
+            writeDropTexture();
+            for (std::vector<uint32_t>& list : workerRespawns) {
+                list.clear();
+            }
+            fullUpload = false;
+        }
+        if (activeCount == 0) {
+            return;
+        }
+
+        // y moves every frame, so it goes through the stream buffer when there is
+        // one (and it has room), else heightBuffer is orphaned for fresh storage
+        StreamAllocation heights = {};
+        if (stream != nullptr) {
+            heights = stream->allocate(activeCount * sizeof(float), sizeof(float));
+        }
+        if (heights.data != nullptr) {
+            std::memcpy(heights.data, &y[0], activeCount * sizeof(float));
+            stream->commit(heights);
+            pointHeights(stream->getBuffer(), heights.offset);
+        }
+        else {
+            if (heightSource != heightBuffer) {
+                pointHeights(heightBuffer, 0);
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, heightBuffer);
+            glBufferData(GL_ARRAY_BUFFER, getCount() * sizeof(float), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, activeCount * sizeof(float), &y[0]);
+        }
+
+        // The respawns the same way, into scatterBuffer when the stream is full
+        size_t respawns = getPendingRespawns();
+        if (respawns > 0) {
+            GLsizeiptr size = static_cast<GLsizeiptr>(respawns * sizeof(RespawnRecord));
+            StreamAllocation records = {};
+            if (stream != nullptr) {
+                records = stream->allocate(size, sizeof(uint32_t));
+            }
+            if (records.data != nullptr) {
+                stageRespawns(static_cast<RespawnRecord*>(records.data));
+                stream->commit(records);
+                scatterRespawns(stream->getBuffer(), records.offset, respawns);
+            }
+            else {
+                respawnStaging.resize(respawns);
+                stageRespawns(&respawnStaging[0]);
+                glBindBuffer(GL_ARRAY_BUFFER, scatterBuffer);
+                glBufferData(GL_ARRAY_BUFFER, size, &respawnStaging[0], GL_STREAM_DRAW);
+                scatterRespawns(scatterBuffer, 0, respawns);
+            }
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void RainSimulation::draw() const {
+        glActiveTexture(GL_TEXTURE0 + DROP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, dropTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(activeCount));
+        glBindVertexArray(0);
+    }
+
+    int RainSimulation::getDropsPerTile() const {
+        return static_cast<int>(proceduralDensity * tileSize * tileSize);
+    }
+
+    size_t RainSimulation::getProceduralCount() const {
+        return static_cast<size_t>(getDropsPerTile()) * tileGrid * tileGrid;
+    }
+
+    void RainSimulation::setProceduralUniforms(Shader& shader, const glm::vec3& cameraPosition, float time) const {
+        // Centred on the tile corner closest to the camera, so at least
+        // (tileGrid / 2 - 0.5) tiles of rain surround it in every direction
+        glm::vec2 corner = glm::floor(glm::vec2(cameraPosition.x, cameraPosition.z) / tileSize + 0.5f);
+        glm::vec2 tileOrigin = corner - glm::vec2(static_cast<float>(tileGrid / 2));
+
+        shader.setUniform("rainTime", time);
+        shader.setUniform("rainSeed", static_cast<GLint>(seed));
+        shader.setUniform("rainTileOrigin", tileOrigin);
+        shader.setUniform("rainTileSize", tileSize);
+        shader.setUniform("rainTileGrid", static_cast<GLint>(tileGrid));
+        shader.setUniform("rainDropsPerTile", static_cast<GLint>(getDropsPerTile()));
+        shader.setUniform("rainGravity", GRAVITY);
+        shader.setUniform("rainTerminalVelocity", TERMINAL_VELOCITY);
+        shader.setUniform("rainTopY", topY);
+        shader.setUniform("rainBottomY", bottomY);
+    }
+
+    void RainSimulation::drawProcedural() const {
+        glBindVertexArray(proceduralVAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(getProceduralCount()));
+        glBindVertexArray(0);
+    }
+
+}
@@ -0,0 +1,151 @@
+#ifndef RainSimulation_hpp
+#define RainSimulation_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "ThreadPool.hpp"
+#include "Shader.hpp"
+#include "StreamBuffer.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // CPU rain, one instance of a 4 vertex streak per drop. Drops are stored as
+    // separate arrays (SoA) so the integrate step runs four drops per SSE
+    // instruction. Drops only fall straight down: y is uploaded every frame as
+    // per instance attribute 1, attribute 5 is the streak template shared by
+    // every instance.
+    //
+    // x, z and the two factors only change on respawn. They live in an RGBA32F
+    // texture, one texel per drop, that rain.vert reads by instance ID. Each
+    // upload streams one RespawnRecord per drop respawned since the last one
+    // and scatters them into the texture as points, so a frame sends the
+    // heights plus 20 bytes per respawn rather than every array.
+    //
+    // The procedural mode keeps no drop state at all: rain.vert (built with
+    // FEATURE_PROCEDURAL_RAIN) derives every drop from its instance ID, the seed
+    // and the time, and the CPU only sets a few uniforms. Drops live in a
+    // tileGrid x tileGrid block of tiles that follows the camera, so the
+    // density stays that of the CPU volume with far fewer drops.
+    class RainSimulation {
+
+    public:
+        static const float GRAVITY;
+        static const float TERMINAL_VELOCITY;
+        // Texels per row of the drop texture
+        static const int DROP_TEXTURE_WIDTH = 1024;
+        // Where draw() binds the drop texture, the rain shader's rainDrops
+        static const int DROP_TEXTURE_UNIT = 1;
+
+        // A respawned drop as streamed to the GPU
+        struct RespawnRecord {
+            uint32_t index;
+            float x, z;
+            float lengthFactor, speedFactor;
+        };
+
+        RainSimulation();
+
+        float minX, maxX;
+        float minZ, maxZ;
+        float topY, bottomY;
+
+        // Procedural mode, drops per square meter and the tile layout
+        float proceduralDensity;
+        float tileSize;
+        int tileGrid;
+
+        // Allocates and spawns every drop (CPU only)
+        void reset(size_t count, uint32_t seed);
+
+        // Integrates and respawns, chunks are spread over the pool
+        void update(float deltaTime, ThreadPool& pool);
+        // The same kernel on the calling thread only
+        void update(float deltaTime);
+
+        void initBuffers();
+        void cleanup();
+        // Sends y and the drops respawned since the last upload, through the
+        // stream buffer when there is one with room; attribute 1 follows the
+        // copy of y. Changes the framebuffer binding and viewport only for the
+        // scatter and restores them.
+        void upload(StreamBuffer* stream = nullptr);
+        void draw() const;
+
+        // Bytes the next upload sends: the active heights plus one record per
+        // pending respawn
+        size_t getUploadSize() const;
+        // The CPU half of upload: copies the active heights and the pending
+        // respawns (getUploadSize says how many) out, the respawns are no
+        // longer pending after
+        void stageUpload(float* heights, RespawnRecord* respawns);
+
+        // Sets the procedural uniforms on a FEATURE_PROCEDURAL_RAIN rain shader
+        void setProceduralUniforms(Shader& shader, const glm::vec3& cameraPosition, float time) const;
+        // Draws getProceduralCount() streaks, only the template is read
+        void drawProcedural() const;
+        int getDropsPerTile() const;
+        size_t getProceduralCount() const;
+
+        size_t getCount() const { return y.size(); }
+        // Only the first count drops are simulated, uploaded and drawn; the
+        // rest keep their state until they are active again
+        void setActiveCount(size_t count);
+        size_t getActiveCount() const { return activeCount; }
+        // Drops respawned by the last update
+        size_t getRespawnCount() const { return respawnCount; }
+
+    private:
+        void simulate(size_t begin, size_t end, float deltaTime, std::vector<uint32_t>& respawned);
+        void respawn(size_t index);
+        size_t getPendingRespawns() const;
+        void stageRespawns(RespawnRecord* respawns);
+        void writeDropTexture();
+        void scatterRespawns(GLuint buffer, GLintptr offset, size_t count);
+        void bindStreak();
+        void pointHeights(GLuint buffer, GLintptr offset);
+
+        std::vector<float> x, y, z;
+        std::vector<float> velocityY;
+        std::vector<float> lengthFactor, speedFactor;
+
+        uint32_t seed;
+        uint32_t frame;
+        size_t activeCount;
+
+        // Indices respawned since the last upload, per worker so the chunks
+        // append without locking. A drop may be listed twice, its record is
+        // read from the arrays when staged.
+        std::vector<std::vector<uint32_t>> workerRespawns;
+        size_t respawnCount;
+        bool fullUpload;
+        // Records when the stream buffer has no room
+        std::vector<RespawnRecord> respawnStaging;
+
+        GLuint vao;
+        GLuint heightBuffer;
+        GLuint streakBuffer;
+        GLuint dropTexture;
+        GLsizei dropTextureRows;
+        GLuint scatterFramebuffer;
+        GLuint scatterVAO;
+        GLuint scatterBuffer;
+        Shader scatterShader;
+        GLuint proceduralVAO;
+        // Buffer attribute 1 reads y from, heightBuffer or the stream buffer
+        GLuint heightSource;
+    };
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef Random_hpp
+#define Random_hpp
+
+#include <cstdint>
+
+namespace gps {
+
+    // PCG output permutation used as a stateless hash: hashing (seed, index,
+    // frame) gives every particle its own stream, so simulation threads never
+    // share RNG state
+    inline uint32_t pcgHash(uint32_t value) {
+        uint32_t state = value * 747796405u + 2891336453u;
+        uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    // [0, 1) from the top 24 bits
+    inline float unitFloat(uint32_t bits) {
+        return (bits >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Small sequential generator (32 bit PCG), one per thread or chunk
+    struct FastRandom {
+        uint32_t state;
+
+        explicit FastRandom(uint32_t seed) : state(pcgHash(seed)) {}
+
+        uint32_t next() {
+            state = state * 747796405u + 2891336453u;
+            uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+            return (word >> 22u) ^ word;
+        }
+
+        // [min, max)
+        float range(float min, float max) {
+            return min + unitFloat(next()) * (max - min);
+        }
+
+        // [min, max], like glm::linearRand on ints
+        int rangeInt(int min, int max) {
+            return min + static_cast<int>(next() % static_cast<uint32_t>(max - min + 1));
+        }
+    };
+
+}
+
+#endif
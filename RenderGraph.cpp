@@ -0,0 +1,480 @@
+#include "RenderGraph.hpp"
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    const RenderGraph::Resource RenderGraph::NO_RESOURCE;
+    const unsigned int RenderGraph::POOL_FRAMES;
+
+    RenderGraph::Resource RenderGraph::PassBuilder::create(const std::string& name, const RenderTextureDesc& desc) {
+        ResourceNode node = { name, desc, false, false, 0, 0, std::vector<int>(), 0, -1, -1, -1 };
+        graph.resources.push_back(node);
+        Resource resource = static_cast<Resource>(graph.resources.size()) - 1;
+        write(resource);
+        return resource;
+    }
+
+    void RenderGraph::PassBuilder::read(Resource resource) {
+        if (resource == NO_RESOURCE) {
+            return;
+        }
+        std::vector<Resource>& reads = graph.passes[pass].reads;
+        if (std::find(reads.begin(), reads.end(), resource) == reads.end()) {
+            reads.push_back(resource);
+        }
+    }
+
+    void RenderGraph::PassBuilder::write(Resource resource) {
+        if (resource == NO_RESOURCE) {
+            return;
+        }
+        std::vector<Resource>& writes = graph.passes[pass].writes;
+        if (std::find(writes.begin(), writes.end(), resource) == writes.end()) {
+            writes.push_back(resource);
+        }
+        if (graph.resources[resource].backbuffer) {
+            setSideEffect();
+        }
+    }
+
+    void RenderGraph::PassBuilder::setSideEffect() {
+        graph.passes[pass].sideEffect = true;
+    }
+
+    RenderGraph::RenderGraph()
+        : windowWidth(1), windowHeight(1), frameIndex(0), transientBytes(0), aliasedBytes(0) {
+    }
+
+    void RenderGraph::cleanup() {
+        while (!pool.empty()) {
+            deletePoolTexture(pool.size() - 1);
+        }
+        for (const CachedFramebuffer& cached : framebuffers) {
+            glDeleteFramebuffers(1, &cached.framebuffer);
+        }
+        framebuffers.clear();
+        resources.clear();
+        passes.clear();
+    }
+
+    void RenderGraph::setWindowSize(int width, int height) {
+        windowWidth = std::max(width, 1);
+        windowHeight = std::max(height, 1);
+        for (size_t i = pool.size(); i-- > 0;) {
+            if (pool[i].windowSized) {
+                deletePoolTexture(i);
+            }
+        }
+        resources.clear();
+        passes.clear();
+    }
+
+    void RenderGraph::beginFrame() {
+        frameIndex++;
+        resources.clear();
+        passes.clear();
+        transientBytes = 0;
+        aliasedBytes = 0;
+    }
+
+    RenderGraph::Resource RenderGraph::import(const std::string& name, GLuint texture, size_t bytes) {
+        ResourceNode node = { name, RenderTextureDesc(), true, false, texture, bytes, std::vector<int>(), 0, -1, -1, -1 };
+        resources.push_back(node);
+        return static_cast<Resource>(resources.size()) - 1;
+    }
+
+    RenderGraph::Resource RenderGraph::importBackbuffer() {
+        Resource resource = import("backbuffer", 0, 0);
+        resources[resource].backbuffer = true;
+        return resource;
+    }
+
+    void RenderGraph::addPass(const std::string& name, const SetupFunction& setup, const ExecuteFunction& execute) {
+        PassNode node = { name, execute, std::vector<Resource>(), std::vector<Resource>(), false, 0, false };
+        passes.push_back(node);
+        PassBuilder builder(*this, static_cast<int>(passes.size()) - 1);
+        setup(builder);
+    }
+
+    void RenderGraph::compile() {
+        cull();
+        assignLifetimes();
+
+        // Walks the passes in order: a transient takes a free pool texture
+        // before its first pass and gives it back after its last, so the
+        // next transient of the same shape can take it over
+        for (PoolTexture& texture : pool) {
+            texture.inUse = false;
+        }
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            if (passes[pass].culled) {
+                continue;
+            }
+            for (ResourceNode& resource : resources) {
+                if (!resource.imported && resource.firstPass == static_cast<int>(pass)) {
+                    RenderTextureDesc desc = resolve(resource.desc);
+                    resource.poolIndex = acquire(desc, resource.desc.width == 0 || resource.desc.height == 0);
+                    resource.texture = pool[resource.poolIndex].texture;
+                    resource.bytes = textureBytes(desc);
+                    transientBytes += resource.bytes;
+                }
+            }
+            for (ResourceNode& resource : resources) {
+                if (!resource.imported && resource.lastPass == static_cast<int>(pass)) {
+                    pool[resource.poolIndex].inUse = false;
+                }
+            }
+        }
+
+        for (size_t i = pool.size(); i-- > 0;) {
+            if (pool[i].lastUsedFrame == frameIndex) {
+                aliasedBytes += textureBytes(pool[i].desc);
+            }
+            else if (frameIndex - pool[i].lastUsedFrame > POOL_FRAMES) {
+                deletePoolTexture(i);
+            }
+        }
+        // Pool indices moved with the deletions
+        for (ResourceNode& resource : resources) {
+            if (resource.poolIndex >= 0) {
+                for (size_t i = 0; i < pool.size(); i++) {
+                    if (pool[i].texture == resource.texture) {
+                        resource.poolIndex = static_cast<int>(i);
+                    }
+                }
+            }
+        }
+    }
+
+    // A resource nothing reads lets go of its writers; a writer left with no
+    // read write is culled, and lets go of what it reads in turn
+    void RenderGraph::cull() {
+        for (ResourceNode& resource : resources) {
+            resource.writers.clear();
+            resource.readerCount = 0;
+        }
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            PassNode& node = passes[pass];
+            node.culled = false;
+            node.refCount = static_cast<int>(node.writes.size());
+            for (Resource resource : node.reads) {
+                resources[resource].readerCount++;
+            }
+            for (Resource resource : node.writes) {
+                resources[resource].writers.push_back(static_cast<int>(pass));
+            }
+        }
+
+        std::vector<Resource> unread;
+        for (size_t resource = 0; resource < resources.size(); resource++) {
+            if (resources[resource].readerCount == 0) {
+                unread.push_back(static_cast<Resource>(resource));
+            }
+        }
+        // Passes that write nothing at all
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            PassNode& node = passes[pass];
+            if (node.refCount == 0 && !node.sideEffect) {
+                node.culled = true;
+                for (Resource resource : node.reads) {
+                    if (--resources[resource].readerCount == 0) {
+                        unread.push_back(resource);
+                    }
+                }
+            }
+        }
+
+        while (!unread.empty()) {
+            Resource resource = unread.back();
+            unread.pop_back();
+            for (int writer : resources[resource].writers) {
+                PassNode& node = passes[writer];
+                if (node.culled || --node.refCount > 0 || node.sideEffect) {
+                    continue;
+                }
+                node.culled = true;
+                for (Resource read : node.reads) {
+                    if (--resources[read].readerCount == 0) {
+                        unread.push_back(read);
+                    }
+                }
+            }
+        }
+    }
+
+    void RenderGraph::assignLifetimes() {
+        for (ResourceNode& resource : resources) {
+            resource.firstPass = resource.lastPass = -1;
+            resource.poolIndex = -1;
+            if (!resource.imported) {
+                resource.texture = 0;
+                resource.bytes = 0;
+            }
+        }
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            if (passes[pass].culled) {
+                continue;
+            }
+            int index = static_cast<int>(pass);
+            for (const std::vector<Resource>* list : { &passes[pass].reads, &passes[pass].writes }) {
+                for (Resource resource : *list) {
+                    ResourceNode& node = resources[resource];
+                    if (node.firstPass < 0) {
+                        node.firstPass = index;
+                    }
+                    node.lastPass = index;
+                }
+            }
+        }
+    }
+
+    void RenderGraph::execute() {
+        for (const PassNode& pass : passes) {
+            if (!pass.culled) {
+                GPS_PROFILE_GPU_ZONE_DYNAMIC(pass.name);
+                pass.execute();
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    GLuint RenderGraph::getTexture(Resource resource) const {
+        if (resource < 0 || resource >= static_cast<Resource>(resources.size())) {
+            return 0;
+        }
+        return resources[resource].texture;
+    }
+
+    glm::ivec2 RenderGraph::getSize(Resource resource) const {
+        if (resource < 0 || resource >= static_cast<Resource>(resources.size()) || resources[resource].imported) {
+            return glm::ivec2(windowWidth, windowHeight);
+        }
+        RenderTextureDesc desc = resolve(resources[resource].desc);
+        return glm::ivec2(desc.width, desc.height);
+    }
+
+    bool RenderGraph::isCulled(const std::string& pass) const {
+        for (const PassNode& node : passes) {
+            if (node.name == pass) {
+                return node.culled;
+            }
+        }
+        return true;
+    }
+
+    int RenderGraph::getCulledCount() const {
+        int culled = 0;
+        for (const PassNode& pass : passes) {
+            culled += pass.culled ? 1 : 0;
+        }
+        return culled;
+    }
+
+    size_t RenderGraph::getPoolBytes() const {
+        size_t bytes = 0;
+        for (const PoolTexture& texture : pool) {
+            bytes += textureBytes(texture.desc);
+        }
+        return bytes;
+    }
+
+    size_t RenderGraph::getImportedBytes() const {
+        size_t bytes = 0;
+        for (const ResourceNode& resource : resources) {
+            bytes += resource.imported ? resource.bytes : 0;
+        }
+        return bytes;
+    }
+
+    GLuint RenderGraph::bindFramebuffer(const std::vector<Resource>& colors, Resource depth) {
+        if (colors.size() == 1 && depth == NO_RESOURCE && resources[colors[0]].backbuffer) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return 0;
+        }
+
+        std::vector<GLuint> colorTextures;
+        for (Resource color : colors) {
+            colorTextures.push_back(getTexture(color));
+        }
+        GLuint depthTexture = getTexture(depth);
+        for (const CachedFramebuffer& cached : framebuffers) {
+            if (cached.colors == colorTextures && cached.depth == depthTexture) {
+                glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+                return cached.framebuffer;
+            }
+        }
+
+        CachedFramebuffer cached = { colorTextures, depthTexture, 0 };
+        glGenFramebuffers(1, &cached.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, cached.framebuffer);
+        std::vector<GLenum> drawBuffers;
+        for (size_t i = 0; i < colorTextures.size(); i++) {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i), colorTextures[i], 0);
+            drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i));
+        }
+        if (depthTexture != 0) {
+            // Cube maps attach layered, the point shadow geometry shader picks the face
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+        }
+        if (drawBuffers.empty()) {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        else {
+            glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Render graph framebuffer not complete!" << std::endl;
+        }
+        framebuffers.push_back(cached);
+        return cached.framebuffer;
+    }
+
+    RenderTextureDesc RenderGraph::resolve(const RenderTextureDesc& desc) const {
+        RenderTextureDesc resolved = desc;
+        if (resolved.width == 0 || resolved.height == 0) {
+            resolved.width = windowWidth;
+            resolved.height = windowHeight;
+        }
+        return resolved;
+    }
+
+    size_t RenderGraph::bytesPerTexel(GLenum internalFormat) {
+        switch (internalFormat) {
+        case GL_RGBA16F:
+            return 8;
+        case GL_RG16F:
+        case GL_R11F_G11F_B10F:
+        case GL_RGBA8:
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH_COMPONENT32F:
+            return 4;
+        default:
+            return 4;
+        }
+    }
+
+    size_t RenderGraph::textureBytes(const RenderTextureDesc& desc) {
+        return static_cast<size_t>(desc.width) * desc.height * bytesPerTexel(desc.internalFormat) * (desc.cubeMap ? 6 : 1);
+    }
+
+    int RenderGraph::acquire(const RenderTextureDesc& desc, bool windowSized) {
+        for (size_t i = 0; i < pool.size(); i++) {
+            if (!pool[i].inUse && pool[i].desc == desc) {
+                pool[i].inUse = true;
+                pool[i].lastUsedFrame = frameIndex;
+                return static_cast<int>(i);
+            }
+        }
+        PoolTexture texture = { desc, windowSized, createTexture(desc), true, frameIndex };
+        pool.push_back(texture);
+        return static_cast<int>(pool.size()) - 1;
+    }
+
+    GLuint RenderGraph::createTexture(const RenderTextureDesc& desc) {
+        GLenum format = GL_RGBA;
+        GLenum type = GL_FLOAT;
+        switch (desc.internalFormat) {
+        case GL_RG16F:
+            format = GL_RG;
+            break;
+        case GL_R11F_G11F_B10F:
+            format = GL_RGB;
+            break;
+        case GL_RGBA8:
+            type = GL_UNSIGNED_BYTE;
+            break;
+        case GL_DEPTH_COMPONENT24:
+        case GL_DEPTH_COMPONENT32F:
+            format = GL_DEPTH_COMPONENT;
+            break;
+        default:
+            break;
+        }
+
+        GLenum target = desc.cubeMap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        if (desc.cubeMap) {
+            for (GLenum face = 0; face < 6; face++) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+            }
+            glTexParameteri(target, GL_TEXTURE_WRAP_R, desc.wrap);
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+        }
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, desc.filter);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, desc.filter);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, desc.wrap);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, desc.wrap);
+        if (desc.whiteBorder) {
+            float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+            glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, borderColor);
+        }
+        glBindTexture(target, 0);
+        return texture;
+    }
+
+    // Along with every framebuffer it was attached to
+    void RenderGraph::deletePoolTexture(size_t index) {
+        GLuint texture = pool[index].texture;
+        for (size_t i = framebuffers.size(); i-- > 0;) {
+            const CachedFramebuffer& cached = framebuffers[i];
+            if (cached.depth == texture || std::find(cached.colors.begin(), cached.colors.end(), texture) != cached.colors.end()) {
+                glDeleteFramebuffers(1, &cached.framebuffer);
+                framebuffers.erase(framebuffers.begin() + i);
+            }
+        }
+        glDeleteTextures(1, &texture);
+        pool.erase(pool.begin() + index);
+    }
+
+    std::string RenderGraph::describe() const {
+        std::ostringstream out;
+        out << "Render graph, frame " << frameIndex << ": " << passes.size() << " passes, " << getCulledCount() << " culled" << std::endl;
+
+        for (size_t pass = 0; pass < passes.size(); pass++) {
+            const PassNode& node = passes[pass];
+            out << "  " << pass << " " << node.name << (node.culled ? " (culled)" : "") << (node.sideEffect ? " (side effect)" : "");
+            out << std::endl << "      reads:";
+            for (Resource resource : node.reads) {
+                out << " " << resources[resource].name;
+            }
+            out << std::endl << "      writes:";
+            for (Resource resource : node.writes) {
+                out << " " << resources[resource].name;
+            }
+            out << std::endl;
+        }
+
+        out << "Resources:" << std::endl;
+        for (const ResourceNode& resource : resources) {
+            out << "  " << resource.name;
+            if (resource.imported) {
+                out << " imported, " << resource.bytes / 1024 << " KB";
+            }
+            else if (resource.firstPass < 0) {
+                out << " unused";
+            }
+            else {
+                RenderTextureDesc desc = resolve(resource.desc);
+                out << " " << desc.width << "x" << desc.height << (desc.cubeMap ? " cube" : "") << ", " <<
+                    resource.bytes / 1024 << " KB, passes " << resource.firstPass << "-" << resource.lastPass <<
+                    ", pool texture " << resource.poolIndex;
+            }
+            out << std::endl;
+        }
+
+        out << "Memory: transient " << transientBytes / 1024 << " KB declared, " << aliasedBytes / 1024 <<
+            " KB after aliasing, pool " << getPoolBytes() / 1024 << " KB in " << pool.size() << " textures, imported " <<
+            getImportedBytes() / 1024 << " KB" << std::endl;
+        return out.str();
+    }
+
+}
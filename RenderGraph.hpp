@@ -0,0 +1,204 @@
+#ifndef RenderGraph_hpp
+#define RenderGraph_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "glm/glm.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Size and format of a texture the graph allocates. Window sized ones
+    // (width and height 0) follow setWindowSize.
+    struct RenderTextureDesc {
+        GLenum internalFormat;
+        int width, height;
+        bool cubeMap;
+        GLenum filter;
+        GLenum wrap;
+        // Depth one outside a clamp-to-border shadow map
+        bool whiteBorder;
+
+        static RenderTextureDesc windowSized(GLenum internalFormat, GLenum filter) {
+            return RenderTextureDesc{ internalFormat, 0, 0, false, filter, GL_CLAMP_TO_EDGE, false };
+        }
+
+        static RenderTextureDesc shadowMap(int size) {
+            return RenderTextureDesc{ GL_DEPTH_COMPONENT24, size, size, false, GL_NEAREST, GL_CLAMP_TO_BORDER, true };
+        }
+
+        static RenderTextureDesc shadowCubeMap(int size) {
+            return RenderTextureDesc{ GL_DEPTH_COMPONENT24, size, size, true, GL_NEAREST, GL_CLAMP_TO_EDGE, false };
+        }
+
+        bool operator==(const RenderTextureDesc& other) const {
+            return internalFormat == other.internalFormat && width == other.width && height == other.height &&
+                cubeMap == other.cubeMap && filter == other.filter && wrap == other.wrap && whiteBorder == other.whiteBorder;
+        }
+    };
+
+    // Frame graph. Every frame the passes are declared again, in the order
+    // they run, each with the textures it reads and writes. Before anything
+    // is drawn the graph drops the passes whose writes nothing reads (bloom
+    // while it is off, the water views while no water is visible, the shadow
+    // maps of lights that are off); only passes with a side effect, such as
+    // drawing to the window, are kept regardless.
+    //
+    // Textures a pass creates are transient: they exist from their first to
+    // their last pass this frame. GL has no placement into shared memory, so
+    // aliasing means reusing the texture object itself: two transients with
+    // the same size and format whose lifetimes do not overlap get the same
+    // texture, and textures live in a pool across frames so nothing is
+    // created in a steady state. Pool textures no frame has used for a while
+    // are deleted. Textures owned elsewhere (TAA history, the bloom chain,
+    // the water views) are imported and only take part in the culling.
+    //
+    // Passes bind their targets themselves, through bindFramebuffer, which
+    // keeps a framebuffer per set of attachments.
+    class RenderGraph {
+
+    public:
+        using Resource = int;
+        static const Resource NO_RESOURCE = -1;
+
+        // Frames a pool texture is kept without being used
+        static const unsigned int POOL_FRAMES = 120;
+
+        class PassBuilder {
+        public:
+            // A transient texture this pass writes first
+            Resource create(const std::string& name, const RenderTextureDesc& desc);
+            void read(Resource resource);
+            void write(Resource resource);
+            // Kept even if nothing reads its writes
+            void setSideEffect();
+
+        private:
+            friend class RenderGraph;
+            PassBuilder(RenderGraph& graph, int pass) : graph(graph), pass(pass) {}
+
+            RenderGraph& graph;
+            int pass;
+        };
+
+        using SetupFunction = std::function<void(PassBuilder& builder)>;
+        using ExecuteFunction = std::function<void()>;
+
+        RenderGraph();
+
+        void cleanup();
+
+        // Drops the pool's window sized textures
+        void setWindowSize(int width, int height);
+
+        // Forgets last frame's passes and resources
+        void beginFrame();
+
+        // Owned elsewhere, bytes is only reported
+        Resource import(const std::string& name, GLuint texture, size_t bytes);
+        // Framebuffer 0; passes writing it have a side effect
+        Resource importBackbuffer();
+
+        // setup runs now, execute during execute() unless the pass is culled
+        void addPass(const std::string& name, const SetupFunction& setup, const ExecuteFunction& execute);
+
+        // Culls, works out lifetimes and assigns pool textures
+        void compile();
+        // Runs the passes left after culling, in declaration order
+        void execute();
+
+        // 0 for culled or unknown resources. Valid from compile on.
+        GLuint getTexture(Resource resource) const;
+        // Imported resources report the window size
+        glm::ivec2 getSize(Resource resource) const;
+        bool isCulled(const std::string& pass) const;
+
+        // Binds a framebuffer with these attachments, colour in draw buffer
+        // order, and returns it. The backbuffer alone binds framebuffer 0.
+        GLuint bindFramebuffer(const std::vector<Resource>& colors, Resource depth = NO_RESOURCE);
+
+        int getPassCount() const { return static_cast<int>(passes.size()); }
+        int getCulledCount() const;
+        // Transient textures declared this frame, as if each had its own memory
+        size_t getTransientBytes() const { return transientBytes; }
+        // Pool textures this frame used, and all of them including idle ones
+        size_t getAliasedBytes() const { return aliasedBytes; }
+        size_t getPoolBytes() const;
+        size_t getImportedBytes() const;
+
+        // Passes, what they read and write, and which pool texture each
+        // transient ended up in, followed by the memory report
+        std::string describe() const;
+
+        static size_t bytesPerTexel(GLenum internalFormat);
+
+    private:
+        struct ResourceNode {
+            std::string name;
+            RenderTextureDesc desc;
+            bool imported;
+            bool backbuffer;
+            GLuint texture;
+            size_t bytes;
+            std::vector<int> writers;
+            int readerCount;
+            // Alive passes touching it, -1 if none
+            int firstPass, lastPass;
+            int poolIndex;
+        };
+
+        struct PassNode {
+            std::string name;
+            ExecuteFunction execute;
+            std::vector<Resource> reads;
+            std::vector<Resource> writes;
+            bool sideEffect;
+            int refCount;
+            bool culled;
+        };
+
+        struct PoolTexture {
+            // Resolved to the window size
+            RenderTextureDesc desc;
+            bool windowSized;
+            GLuint texture;
+            bool inUse;
+            unsigned int lastUsedFrame;
+        };
+
+        struct CachedFramebuffer {
+            std::vector<GLuint> colors;
+            GLuint depth;
+            GLuint framebuffer;
+        };
+
+        RenderTextureDesc resolve(const RenderTextureDesc& desc) const;
+        static size_t textureBytes(const RenderTextureDesc& desc);
+        int acquire(const RenderTextureDesc& desc, bool windowSized);
+        GLuint createTexture(const RenderTextureDesc& desc);
+        void deletePoolTexture(size_t index);
+        void cull();
+        void assignLifetimes();
+
+        std::vector<ResourceNode> resources;
+        std::vector<PassNode> passes;
+        std::vector<PoolTexture> pool;
+        std::vector<CachedFramebuffer> framebuffers;
+        int windowWidth, windowHeight;
+        unsigned int frameIndex;
+        size_t transientBytes;
+        size_t aliasedBytes;
+    };
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+#include "SceneCopy.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    SceneCopy::SceneCopy()
+        : sceneFramebuffer(0), sceneDepth(0), sceneWidth(0), sceneHeight(0),
+        colorFramebuffer(0), color(0), pyramidFramebuffer(0), depthPyramid(0), levelCount(0) {
+    }
+
+    void SceneCopy::init() {
+        pyramidShader.loadShader("shaders/particleFullscreen.vert", "shaders/depthPyramid.frag", PARTICLE_SHADER);
+        pyramidShader.useShaderProgram();
+        glUniform1i(pyramidShader.getUniformLocation("source"), 0);
+
+        triangle.init();
+        glGenFramebuffers(1, &colorFramebuffer);
+        glGenFramebuffers(1, &pyramidFramebuffer);
+    }
+
+    void SceneCopy::cleanup() {
+        deleteTargets();
+        glDeleteFramebuffers(1, &colorFramebuffer);
+        glDeleteFramebuffers(1, &pyramidFramebuffer);
+        triangle.cleanup();
+        glDeleteProgram(pyramidShader.shaderProgram);
+    }
+
+    void SceneCopy::setScene(GLuint framebuffer, GLuint depth, int width, int height) {
+        sceneFramebuffer = framebuffer;
+        sceneDepth = depth;
+        sceneWidth = width;
+        sceneHeight = height;
+
+        deleteTargets();
+        createTargets();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+    }
+
+    void SceneCopy::createTargets() {
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, sceneWidth, sceneHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, colorFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Scene copy framebuffer not complete!" << std::endl;
+        }
+
+        // Every level down to 1 x 1, allocated one by one (no glTexStorage in 4.1)
+        levelCount = 1;
+        while ((std::max(sceneWidth, sceneHeight) >> levelCount) > 0) {
+            levelCount++;
+        }
+        glGenTextures(1, &depthPyramid);
+        glBindTexture(GL_TEXTURE_2D, depthPyramid);
+        for (int level = 0; level < levelCount; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, std::max(sceneWidth >> level, 1), std::max(sceneHeight >> level, 1),
+                0, GL_RED, GL_FLOAT, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void SceneCopy::deleteTargets() {
+        if (color == 0) {
+            return;
+        }
+        glDeleteTextures(1, &color);
+        glDeleteTextures(1, &depthPyramid);
+        color = 0;
+        depthPyramid = 0;
+        levelCount = 0;
+    }
+
+    void SceneCopy::capture() {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, colorFramebuffer);
+        glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, sceneWidth, sceneHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        pyramidShader.useShaderProgram();
+        GLint copyDepthLoc = pyramidShader.getUniformLocation("copyDepth");
+        glBindFramebuffer(GL_FRAMEBUFFER, pyramidFramebuffer);
+        glActiveTexture(GL_TEXTURE0);
+        glDisable(GL_DEPTH_TEST);
+        triangle.bind();
+
+        for (int level = 0; level < levelCount; level++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, depthPyramid, level);
+            glViewport(0, 0, std::max(sceneWidth >> level, 1), std::max(sceneHeight >> level, 1));
+
+            if (level == 0) {
+                glBindTexture(GL_TEXTURE_2D, sceneDepth);
+                glUniform1i(copyDepthLoc, GL_TRUE);
+            }
+            else {
+                // Only the level below is readable, so the one being written
+                // is not part of a feedback loop
+                glBindTexture(GL_TEXTURE_2D, depthPyramid);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+                glUniform1i(copyDepthLoc, GL_FALSE);
+            }
+            triangle.draw();
+        }
+
+        glBindTexture(GL_TEXTURE_2D, depthPyramid);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+        glViewport(0, 0, sceneWidth, sceneHeight);
+    }
+
+}
@@ -0,0 +1,67 @@
+#ifndef SceneCopy_hpp
+#define SceneCopy_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "Shader.hpp"
+#include "FullscreenTriangle.hpp"
+
+namespace gps {
+
+    // A copy of the scene's colour and a depth pyramid, taken part way through
+    // the main pass for draws that read what is already on screen (the
+    // screen-space water) while drawing into the same framebuffer.
+    //
+    // Level 0 of the depth pyramid is the scene depth. Every level above keeps
+    // the nearest depth of the 2 x 2 texels below it (3 x 3 along an odd
+    // edge), so a ray that is in front of a texel is in front of everything
+    // it covers and can cross it in one step (hierarchical depth, Hi-Z).
+    class SceneCopy {
+
+    public:
+        SceneCopy();
+
+        void init();
+        void cleanup();
+
+        // The scene to copy: its framebuffer (colour attachment 0 is copied)
+        // and depth texture. Call again when they change size.
+        void setScene(GLuint framebuffer, GLuint depth, int width, int height);
+
+        // Copies the colour and rebuilds the depth pyramid, leaves the scene
+        // framebuffer bound with a full size viewport
+        void capture();
+
+        GLuint getColor() const { return color; }
+        // GL_R32F, nearest filtering; read it with texelFetch
+        GLuint getDepthPyramid() const { return depthPyramid; }
+        int getLevelCount() const { return levelCount; }
+
+    private:
+        void createTargets();
+        void deleteTargets();
+
+        Shader pyramidShader;
+        FullscreenTriangle triangle;
+
+        GLuint sceneFramebuffer;
+        GLuint sceneDepth;
+        int sceneWidth, sceneHeight;
+
+        GLuint colorFramebuffer;
+        GLuint color;
+        // Reattached to each level in turn while the pyramid is built
+        GLuint pyramidFramebuffer;
+        GLuint depthPyramid;
+        int levelCount;
+    };
+
+}
+
+#endif
@@ -1,7 +1,62 @@
 #include "Shader.hpp"
 
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+#if defined (__APPLE__) && !defined (GL_COMPUTE_SHADER)
+// Missing from the GL 4.1 headers, loadComputeShader is never used there
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+
 namespace gps {
 
+    GLuint Shader::boundProgram = 0;
+    ProgramCache* Shader::programCache = nullptr;
+    bool Shader::parallelCompile = false;
+
+    namespace {
+
+        const char* featureNames[FEATURE_COUNT] = {
+            "FEATURE_NORMAL_MAPPING",
+            "FEATURE_RAIN",
+            "FEATURE_FOG",
+            "FEATURE_WIND",
+            "FEATURE_DIR_LIGHT",
+            "FEATURE_POINT_LIGHT",
+            "FEATURE_SPOT_LIGHT",
+            "FEATURE_LEFT_HEADLIGHT",
+            "FEATURE_RIGHT_HEADLIGHT",
+            "FEATURE_FLASH_LIGHT",
+            "FEATURE_CLUSTERED_LIGHTS",
+            "FEATURE_BLINN_PHONG",
+            "FEATURE_WIND_MOVABLE",
+            "FEATURE_GRASS",
+            "FEATURE_FERN",
+            "FEATURE_PROCEDURAL_RAIN",
+            "FEATURE_SINGLE_SHADOW_TAP",
+            "FEATURE_SCREEN_SPACE_WATER",
+            "FEATURE_PROJECTED_WATER",
+        };
+
+        std::string directoryOf(const std::string& fileName) {
+            size_t slash = fileName.find_last_of("/\\");
+            return slash == std::string::npos ? std::string() : fileName.substr(0, slash + 1);
+        }
+
+        std::string featureDefines(unsigned int features) {
+            std::string defines;
+            for (unsigned int i = 0; i < FEATURE_COUNT; i++) {
+                if (features & (1u << i)) {
+                    defines += "#define ";
+                    defines += featureNames[i];
+                    defines += "\n";
+                }
+            }
+            return defines;
+        }
+    }
+
     std::string Shader::readShaderFile(std::string fileName) {
         std::ifstream shaderFile;
         std::string shaderString;
@@ -23,6 +78,52 @@ namespace gps {
         return shaderString;
     }
 
+    // Expands #include "file" recursively, paths are relative to the including
+    // file and each file is pasted only once per stage. #line directives keep
+    // the driver's error messages pointing at the right file (the index into
+    // includedFiles) and line.
+    std::string Shader::preprocessShaderFile(const std::string& fileName, std::vector<std::string>& includedFiles) {
+        int fileIndex = static_cast<int>(includedFiles.size());
+        includedFiles.push_back(fileName);
+
+        std::istringstream source(readShaderFile(fileName));
+        std::string result;
+        std::string line;
+        int lineNumber = 0;
+
+        while (std::getline(source, line)) {
+            lineNumber++;
+
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+                result += line;
+                result += "\n";
+                continue;
+            }
+
+            size_t open = line.find('"', start + 8);
+            size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+            if (close == std::string::npos) {
+                std::cerr << "Malformed #include in " << fileName << ":" << lineNumber << std::endl;
+                result += "\n";
+                continue;
+            }
+
+            std::string includeName = directoryOf(fileName) + line.substr(open + 1, close - open - 1);
+            if (std::find(includedFiles.begin(), includedFiles.end(), includeName) != includedFiles.end()) {
+                result += "\n";
+                continue;
+            }
+
+            int includeIndex = static_cast<int>(includedFiles.size());
+            result += "#line 1 " + std::to_string(includeIndex) + "\n";
+            result += preprocessShaderFile(includeName, includedFiles);
+            result += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+
+        return result;
+    }
+
     void Shader::shaderCompileLog(GLuint shaderId) {
 
         GLint success;
@@ -36,6 +137,19 @@ namespace gps {
         }
     }
 
+    void Shader::shaderCompileLog(GLuint shaderId, const std::vector<std::string>& sourceFiles) {
+
+        GLint success;
+        glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+
+        if (!success) {
+            shaderCompileLog(shaderId);
+            for (size_t i = 0; i < sourceFiles.size(); i++) {
+                std::cout << "  source " << i << ": " << sourceFiles[i] << std::endl;
+            }
+        }
+    }
+
     void Shader::shaderLinkLog(GLuint shaderProgramId) {
 
         GLint success;
@@ -48,107 +162,430 @@ namespace gps {
         }
     }
 
-    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, ShaderType type) {
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        shaderCompileLog(vertexShader);
+    std::string Shader::buildStageSource(const std::string& fileName, const std::string& defines, std::vector<std::string>& sourceFiles) {
+        std::string source = preprocessShaderFile(fileName, sourceFiles);
+
+        // Defines have to follow the #version line
+        if (!defines.empty()) {
+            size_t versionEnd = 0;
+            if (source.compare(0, 8, "#version") == 0) {
+                versionEnd = source.find('\n');
+                versionEnd = versionEnd == std::string::npos ? source.size() : versionEnd + 1;
+            }
+            source.insert(versionEnd, defines + "#line " + std::to_string(versionEnd == 0 ? 1 : 2) + " 0\n");
+        }
 
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
+        return source;
+    }
 
-        shaderCompileLog(fragmentShader);
+    // Issues the compile and link without querying any status, so drivers with
+    // parallel compilation can keep working while the caller does other things
+    Shader::PendingProgram Shader::beginProgram(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& geometryShaderFileName, const std::string& defines,
+        const std::string& computeShaderFileName) {
+        const GLenum stageTypes[STAGE_COUNT] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER, GL_COMPUTE_SHADER };
+        const std::string* fileNames[STAGE_COUNT] = { &vertexShaderFileName, &fragmentShaderFileName, &geometryShaderFileName, &computeShaderFileName };
+
+        PendingProgram build;
+        build.program = glCreateProgram();
+        build.cacheKey = 0;
+        build.fromCache = false;
+
+        std::vector<std::string> sources;
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            build.stages[i] = 0;
+            if (!fileNames[i]->empty()) {
+                sources.push_back(buildStageSource(*fileNames[i], defines, build.sourceFiles[i]));
+            }
+        }
 
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
+        if (programCache != nullptr && programCache->isEnabled()) {
+            std::vector<std::string> keySources = sources;
+            for (const std::string& varying : feedbackVaryings) {
+                keySources.push_back(varying);
+            }
+            build.cacheKey = programCache->makeKey(keySources);
+            if (programCache->load(build.cacheKey, build.program)) {
+                build.fromCache = true;
+                return build;
+            }
+        }
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        size_t sourceIndex = 0;
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            if (fileNames[i]->empty()) {
+                continue;
+            }
+            const GLchar* sourceString = sources[sourceIndex++].c_str();
+            build.stages[i] = glCreateShader(stageTypes[i]);
+            glShaderSource(build.stages[i], 1, &sourceString, NULL);
+            glCompileShader(build.stages[i]);
+            glAttachShader(build.program, build.stages[i]);
+        }
 
-        shaderLinkLog(this->shaderProgram);
+        if (!feedbackVaryings.empty()) {
+            std::vector<const GLchar*> names;
+            for (const std::string& varying : feedbackVaryings) {
+                names.push_back(varying.c_str());
+            }
+            glTransformFeedbackVaryings(build.program, static_cast<GLsizei>(names.size()), &names[0], GL_INTERLEAVED_ATTRIBS);
+        }
 
-        this->shaderType = type;
+        if (programCache != nullptr && programCache->isEnabled()) {
+            glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(build.program);
+
+        return build;
+    }
+
+    void Shader::finishProgram(PendingProgram& build) {
+        if (build.fromCache) {
+            return;
+        }
+
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            if (build.stages[i] != 0) {
+                shaderCompileLog(build.stages[i], build.sourceFiles[i]);
+                glDeleteShader(build.stages[i]);
+                build.stages[i] = 0;
+            }
+        }
+
+        shaderLinkLog(build.program);
+
+        GLint success;
+        glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+        if (success && programCache != nullptr) {
+            programCache->store(build.cacheKey, build.program);
+        }
+    }
+
+    void Shader::applyBlockBindings(GLuint program) {
+        for (const auto& binding : blockBindings) {
+            GLuint blockIndex = glGetUniformBlockIndex(program, binding.first.c_str());
+            if (blockIndex != GL_INVALID_INDEX) {
+                glUniformBlockBinding(program, blockIndex, binding.second);
+            }
+        }
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, ShaderType type) {
+        loadShader(vertexShaderFileName, fragmentShaderFileName, "", type);
     }
 
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string geometryShaderFileName, ShaderType type) {
+        this->pending = beginProgram(vertexShaderFileName, fragmentShaderFileName, geometryShaderFileName, "");
+        this->loading = true;
+        this->shaderProgram = pending.program;
+        this->shaderType = type;
+    }
+
+    void Shader::loadComputeShader(std::string computeShaderFileName, ShaderType type) {
+        this->pending = beginProgram("", "", "", "", computeShaderFileName);
+        this->loading = true;
+        this->shaderProgram = pending.program;
+        this->shaderType = type;
+    }
+
+    void Shader::loadVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string geometryShaderFileName, ShaderType type, unsigned int supportedFeatures) {
+        this->vertexFileName = vertexShaderFileName;
+        this->fragmentFileName = fragmentShaderFileName;
+        this->geometryFileName = geometryShaderFileName;
+        this->supportedFeatures = supportedFeatures;
+        this->shaderType = type;
+
+        // The base variant keeps shaderProgram valid before the first draw
+        this->currentVariant = &getVariant(0, true);
+        this->shaderProgram = currentVariant->program;
+    }
+
+    void Shader::finishLoading() {
+        if (!loading) {
+            return;
+        }
+        loading = false;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        finishProgram(pending);
+        if (!variants.empty()) {
+            applyBlockBindings(pending.program);
+            auto end = std::chrono::high_resolution_clock::now();
+            variantCompileMs += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+
+    bool Shader::isReady() const {
+        if (!loading || pending.fromCache || !parallelCompile) {
+            return true;
+        }
+#if defined (__APPLE__)
+        return true;
+#else
+        GLint done = GL_TRUE;
+        glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+#endif
+    }
+
+    void Shader::setProgramCache(ProgramCache* cache) {
+        programCache = cache;
+    }
 
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        shaderCompileLog(vertexShader);
+    bool Shader::enableParallelCompile() {
+#if defined (__APPLE__)
+        parallelCompile = false;
+#else
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+        else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+#endif
+        return parallelCompile;
+    }
+
+    unsigned int Shader::normalizeFeatures(unsigned int features) {
+        // Sway code is only compiled in when the object moves and wind is on
+        if (!((features & FEATURE_WIND) && (features & FEATURE_WIND_MOVABLE))) {
+            features &= ~(FEATURE_WIND_MOVABLE | FEATURE_GRASS | FEATURE_FERN);
+        }
+        // Otherwise wind only selects the animated fog
+        if (!(features & (FEATURE_WIND_MOVABLE | FEATURE_FOG))) {
+            features &= ~FEATURE_WIND;
+        }
+        if (features & FEATURE_GRASS) {
+            features &= ~FEATURE_FERN;
+        }
+        // Both only switch specular on
+        if (features & FEATURE_BLINN_PHONG) {
+            features &= ~FEATURE_RAIN;
+        }
+        return features;
+    }
+
+    Shader::Variant& Shader::getVariant(unsigned int features, bool deferred) {
+        auto found = variants.find(features);
+        if (found != variants.end()) {
+            return found->second;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
 
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        shaderCompileLog(fragmentShader);
+        PendingProgram build = beginProgram(vertexFileName, fragmentFileName, geometryFileName, featureDefines(features));
 
-        GLuint geometryShader = 0;
-        bool hasGeometryShader = !geometryShaderFileName.empty();
+        Variant variant;
+        variant.program = build.program;
+        variant.appliedGeneration = 0;
 
-        if (hasGeometryShader) {
-            std::string g = readShaderFile(geometryShaderFileName);
-            const GLchar* geometryShaderString = g.c_str();
-            geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometryShader, 1, &geometryShaderString, NULL);
-            glCompileShader(geometryShader);
-            shaderCompileLog(geometryShader);
+        if (deferred) {
+            pending = build;
+            loading = true;
         }
+        else {
+            finishProgram(build);
+            applyBlockBindings(build.program);
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        variantCompileMs += std::chrono::duration<double, std::milli>(end - start).count();
 
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        std::cout << "Compiled " << vertexFileName << " variant 0x" << std::hex << features << std::dec
+            << (build.fromCache ? " from cache" : "")
+            << " (" << variants.size() + 1 << " variants, " << variantCompileMs << " ms total)" << std::endl;
+
+        return variants.emplace(features, std::move(variant)).first->second;
+    }
 
-        if (hasGeometryShader) {
-            glAttachShader(this->shaderProgram, geometryShader);
+    void Shader::setTransformFeedbackVaryings(const std::vector<std::string>& varyings) {
+        feedbackVaryings = varyings;
+    }
+
+    void Shader::setPassFeatures(unsigned int features) {
+        passFeatures = features;
+    }
+
+    unsigned int Shader::getPassFeatures() const {
+        return passFeatures;
+    }
+
+    void Shader::useVariant(unsigned int materialFeatures) {
+        finishLoading();
+
+        if (variants.empty()) {
+            useShaderProgram();
+            return;
         }
 
-        glLinkProgram(this->shaderProgram);
+        unsigned int features = normalizeFeatures((passFeatures | materialFeatures) & supportedFeatures);
+        currentVariant = &getVariant(features);
+        shaderProgram = currentVariant->program;
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        if (hasGeometryShader) {
-            glDeleteShader(geometryShader);
+        if (boundProgram != shaderProgram) {
+            glUseProgram(shaderProgram);
+            boundProgram = shaderProgram;
         }
 
-        shaderLinkLog(this->shaderProgram);
-        this->shaderType = type;
+        if (currentVariant->appliedGeneration != sharedGeneration) {
+            applySharedUniforms(*currentVariant);
+        }
+    }
+
+    Shader::SharedUniform& Shader::findSharedUniform(const std::string& uniformName, GLenum type) {
+        for (SharedUniform& uniform : sharedUniforms) {
+            if (uniform.name == uniformName) {
+                return uniform;
+            }
+        }
+
+        SharedUniform uniform;
+        uniform.name = uniformName;
+        uniform.type = type;
+        uniform.assigned = false;
+        uniform.generation = 0;
+        std::memset(uniform.floats, 0, sizeof(uniform.floats));
+        std::memset(uniform.ints, 0, sizeof(uniform.ints));
+        sharedUniforms.push_back(uniform);
+        return sharedUniforms.back();
+    }
+
+    void Shader::markSharedChanged(SharedUniform& uniform) {
+        bool upToDate = currentVariant != nullptr && currentVariant->appliedGeneration == sharedGeneration;
+        uniform.generation = ++sharedGeneration;
+
+        // The bound variant gets the value right away so the next draw sees it
+        if (currentVariant != nullptr && boundProgram == currentVariant->program) {
+            applySharedUniform(*currentVariant, uniform);
+            if (upToDate) {
+                currentVariant->appliedGeneration = sharedGeneration;
+            }
+        }
+    }
+
+#define SET_SHARED_UNIFORM(TYPE, FIELD, COUNT, DATA) \
+    { \
+        SharedUniform& uniform = findSharedUniform(uniformName, TYPE); \
+        if (!uniform.assigned || std::memcmp(uniform.FIELD, DATA, sizeof(uniform.FIELD[0]) * COUNT) != 0) { \
+            std::memcpy(uniform.FIELD, DATA, sizeof(uniform.FIELD[0]) * COUNT); \
+            uniform.assigned = true; \
+            markSharedChanged(uniform); \
+        } \
+    }
+
+    void Shader::setUniform(const std::string& uniformName, GLint value) SET_SHARED_UNIFORM(GL_INT, ints, 1, &value)
+    void Shader::setUniform(const std::string& uniformName, GLfloat value) SET_SHARED_UNIFORM(GL_FLOAT, floats, 1, &value)
+    void Shader::setUniform(const std::string& uniformName, const glm::vec2& value) SET_SHARED_UNIFORM(GL_FLOAT_VEC2, floats, 2, &value[0])
+    void Shader::setUniform(const std::string& uniformName, const glm::vec3& value) SET_SHARED_UNIFORM(GL_FLOAT_VEC3, floats, 3, &value[0])
+    void Shader::setUniform(const std::string& uniformName, const glm::vec4& value) SET_SHARED_UNIFORM(GL_FLOAT_VEC4, floats, 4, &value[0])
+    void Shader::setUniform(const std::string& uniformName, const glm::ivec3& value) SET_SHARED_UNIFORM(GL_INT_VEC3, ints, 3, &value[0])
+    void Shader::setUniform(const std::string& uniformName, const glm::mat4& value) SET_SHARED_UNIFORM(GL_FLOAT_MAT4, floats, 16, &value[0][0])
+
+#undef SET_SHARED_UNIFORM
+
+    // Expects the variant's program to be bound
+    void Shader::applySharedUniform(Variant& variant, const SharedUniform& uniform) {
+        GLint location;
+        auto cached = variant.uniformLocationCache.find(uniform.name);
+        if (cached != variant.uniformLocationCache.end()) {
+            location = cached->second;
+        }
+        else {
+            // Unused uniforms are expected, a variant may have compiled them out
+            location = glGetUniformLocation(variant.program, uniform.name.c_str());
+            variant.uniformLocationCache[uniform.name] = location;
+        }
+
+        if (location == -1) {
+            return;
+        }
+
+        switch (uniform.type) {
+        case GL_INT:        glUniform1i(location, uniform.ints[0]); break;
+        case GL_INT_VEC3:   glUniform3iv(location, 1, uniform.ints); break;
+        case GL_FLOAT:      glUniform1f(location, uniform.floats[0]); break;
+        case GL_FLOAT_VEC2: glUniform2f(location, uniform.floats[0], uniform.floats[1]); break;
+        case GL_FLOAT_VEC3: glUniform3fv(location, 1, uniform.floats); break;
+        case GL_FLOAT_VEC4: glUniform4fv(location, 1, uniform.floats); break;
+        case GL_FLOAT_MAT4: glUniformMatrix4fv(location, 1, GL_FALSE, uniform.floats); break;
+        }
+    }
+
+    // Sends only the values that changed since the variant was last current
+    void Shader::applySharedUniforms(Variant& variant) {
+        for (const SharedUniform& uniform : sharedUniforms) {
+            if (uniform.generation > variant.appliedGeneration) {
+                applySharedUniform(variant, uniform);
+            }
+        }
+        variant.appliedGeneration = sharedGeneration;
+    }
+
+    size_t Shader::getVariantCount() const {
+        return variants.size();
+    }
+
+    double Shader::getVariantCompileMs() const {
+        return variantCompileMs;
+    }
+
+    void Shader::deletePrograms() {
+        finishLoading();
+        for (auto& variant : variants) {
+            glDeleteProgram(variant.second.program);
+        }
+        variants.clear();
+        currentVariant = nullptr;
+        boundProgram = 0;
     }
 
     void Shader::useShaderProgram() {
+        finishLoading();
         glUseProgram(this->shaderProgram);
+        boundProgram = this->shaderProgram;
     }
 
     GLint Shader::getUniformLocation(const std::string& uniformName) {
+        finishLoading();
+
+        std::unordered_map<std::string, GLint>& cache = currentVariant != nullptr ? currentVariant->uniformLocationCache : uniformLocationCache;
+
         // 1) Check if we already have it
-        if (uniformLocationCache.find(uniformName) != uniformLocationCache.end()) {
-            return uniformLocationCache[uniformName];
+        if (cache.find(uniformName) != cache.end()) {
+            return cache[uniformName];
         }
 
         // 2) If not, query from OpenGL
         GLint location = glGetUniformLocation(shaderProgram, uniformName.c_str());
         // 3) Store it in our map
-        uniformLocationCache[uniformName] = location;
+        cache[uniformName] = location;
 
-        if (location == -1) {
+        if (location == -1 && currentVariant == nullptr) {
             std::cerr << "Warning: Uniform '" << uniformName
                 << "' doesn't exist or isn't used in the shader!\n";
         }
         return location;
     }
 
+    void Shader::bindUniformBlock(const std::string& blockName, GLuint bindingPoint) {
+        finishLoading();
+
+        if (!variants.empty()) {
+            blockBindings.emplace_back(blockName, bindingPoint);
+            for (auto& variant : variants) {
+                GLuint blockIndex = glGetUniformBlockIndex(variant.second.program, blockName.c_str());
+                if (blockIndex != GL_INVALID_INDEX) {
+                    glUniformBlockBinding(variant.second.program, blockIndex, bindingPoint);
+                }
+            }
+            return;
+        }
+
+        GLuint blockIndex = glGetUniformBlockIndex(shaderProgram, blockName.c_str());
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(shaderProgram, blockIndex, bindingPoint);
+        }
+    }
+
 }
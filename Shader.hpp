@@ -9,11 +9,15 @@
 #include "GL/glew.h"
 #endif
 
+#include "glm/glm.hpp"
+#include "ProgramCache.hpp"
+
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace gps {
 
@@ -26,6 +30,41 @@ namespace gps {
 		FIRE_SHADER,
 		HDR_SHADER,
 		BLUR_SHADER,
+		DEFORM_SHADER,
+		PARTICLE_SHADER,
+    };
+
+    // Compile time switches for variant shaders, each bit becomes a
+    // FEATURE_* define. Pass bits come from global toggles, material bits
+    // from the mesh being drawn.
+    enum ShaderFeature : unsigned int {
+        // pass
+        FEATURE_NORMAL_MAPPING   = 1u << 0,
+        FEATURE_RAIN             = 1u << 1,
+        FEATURE_FOG              = 1u << 2,
+        FEATURE_WIND             = 1u << 3,
+        FEATURE_DIR_LIGHT        = 1u << 4,
+        FEATURE_POINT_LIGHT      = 1u << 5,
+        FEATURE_SPOT_LIGHT       = 1u << 6,
+        FEATURE_LEFT_HEADLIGHT   = 1u << 7,
+        FEATURE_RIGHT_HEADLIGHT  = 1u << 8,
+        FEATURE_FLASH_LIGHT      = 1u << 9,
+        FEATURE_CLUSTERED_LIGHTS = 1u << 10,
+        // material
+        FEATURE_BLINN_PHONG      = 1u << 11,
+        FEATURE_WIND_MOVABLE     = 1u << 12,
+        FEATURE_GRASS            = 1u << 13,
+        FEATURE_FERN             = 1u << 14,
+        // rain pass
+        FEATURE_PROCEDURAL_RAIN  = 1u << 15,
+        // secondary views, one depth compare per shadow map
+        FEATURE_SINGLE_SHADOW_TAP = 1u << 16,
+        // water pass, reflection and refraction traced in the main pass's colour
+        FEATURE_SCREEN_SPACE_WATER = 1u << 17,
+        // water pass, one camera projected grid instead of the tile quads
+        FEATURE_PROJECTED_WATER  = 1u << 18,
+
+        FEATURE_COUNT            = 19
     };
 
     class Shader {
@@ -35,16 +74,126 @@ namespace gps {
         ShaderType shaderType;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, ShaderType type);
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string geometryShaderFileName, ShaderType type);
+        // Single compute stage program, needs GL 4.3 (never available on macOS)
+        void loadComputeShader(std::string computeShaderFileName, ShaderType type);
+
+        // Keeps the sources and compiles one program per feature mask the first
+        // time that mask is used. Bits outside supportedFeatures are ignored.
+        void loadVariants(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::string geometryShaderFileName, ShaderType type, unsigned int supportedFeatures);
+
+        // Outputs captured with transform feedback, set before loading
+        void setTransformFeedbackVaryings(const std::vector<std::string>& varyings);
+
+        void setPassFeatures(unsigned int features);
+        unsigned int getPassFeatures() const;
+        // Makes the pass features combined with the draw's material features current
+        void useVariant(unsigned int materialFeatures = 0);
+
+        // Values shared by every variant. They are stored on the CPU and sent to
+        // a variant program the next time it is made current, if they changed.
+        void setUniform(const std::string& uniformName, GLint value);
+        void setUniform(const std::string& uniformName, GLfloat value);
+        void setUniform(const std::string& uniformName, const glm::vec2& value);
+        void setUniform(const std::string& uniformName, const glm::vec3& value);
+        void setUniform(const std::string& uniformName, const glm::vec4& value);
+        void setUniform(const std::string& uniformName, const glm::ivec3& value);
+        void setUniform(const std::string& uniformName, const glm::mat4& value);
+
+        size_t getVariantCount() const;
+        double getVariantCompileMs() const;
+        void deletePrograms();
+
+        // loadShader/loadVariants only issue the compile and link; the result is
+        // checked (and stored in the program cache) here, which blocks until the
+        // driver is done. Called on first use if nobody called it before.
+        void finishLoading();
+        // True once finishLoading would not block (always true without
+        // GL_KHR_parallel_shader_compile)
+        bool isReady() const;
+
+        // Shared by every Shader, may be null
+        static void setProgramCache(ProgramCache* cache);
+        // Lets the driver compile on its own threads when it supports it
+        static bool enableParallelCompile();
 
         void useShaderProgram();
         GLint getUniformLocation(const std::string& uniformName);
+        // No-op when the program does not declare (or optimised out) the block.
+        // Variant shaders remember the binding for programs compiled later.
+        void bindUniformBlock(const std::string& blockName, GLuint bindingPoint);
+
+        // Removes bits that cannot change the generated code, so equivalent
+        // masks share one program
+        static unsigned int normalizeFeatures(unsigned int features);
 
 
     private:
+        // Vertex, fragment, geometry, compute
+        static const int STAGE_COUNT = 4;
+
+        struct Variant {
+            GLuint program;
+            unsigned int appliedGeneration;
+            std::unordered_map<std::string, GLint> uniformLocationCache;
+        };
+
+        // Program whose compile/link has been issued but not checked yet
+        struct PendingProgram {
+            GLuint program;
+            GLuint stages[STAGE_COUNT];
+            std::vector<std::string> sourceFiles[STAGE_COUNT];
+            unsigned long long cacheKey;
+            bool fromCache;
+        };
+
+        struct SharedUniform {
+            std::string name;
+            GLenum type;
+            GLfloat floats[16];
+            GLint ints[4];
+            bool assigned;
+            unsigned int generation;
+        };
+
         std::string readShaderFile(std::string fileName);
+        std::string preprocessShaderFile(const std::string& fileName, std::vector<std::string>& includedFiles);
+        std::string buildStageSource(const std::string& fileName, const std::string& defines, std::vector<std::string>& sourceFiles);
+        PendingProgram beginProgram(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& geometryShaderFileName, const std::string& defines,
+            const std::string& computeShaderFileName = "");
+        void finishProgram(PendingProgram& build);
+        void applyBlockBindings(GLuint program);
         void shaderCompileLog(GLuint shaderId);
+        void shaderCompileLog(GLuint shaderId, const std::vector<std::string>& sourceFiles);
         void shaderLinkLog(GLuint shaderProgramId);
+
+        Variant& getVariant(unsigned int features, bool deferred = false);
+        SharedUniform& findSharedUniform(const std::string& uniformName, GLenum type);
+        void markSharedChanged(SharedUniform& uniform);
+        void applySharedUniform(Variant& variant, const SharedUniform& uniform);
+        void applySharedUniforms(Variant& variant);
+
         std::unordered_map<std::string, GLint> uniformLocationCache;
+
+        PendingProgram pending;
+        bool loading = false;
+
+        std::string vertexFileName, fragmentFileName, geometryFileName;
+        unsigned int supportedFeatures = 0;
+        unsigned int passFeatures = 0;
+        std::unordered_map<unsigned int, Variant> variants;
+        Variant* currentVariant = nullptr;
+        double variantCompileMs = 0.0;
+
+        std::vector<SharedUniform> sharedUniforms;
+        unsigned int sharedGeneration = 1;
+
+        std::vector<std::pair<std::string, GLuint>> blockBindings;
+        std::vector<std::string> feedbackVaryings;
+
+        // Last program passed to glUseProgram through any Shader
+        static GLuint boundProgram;
+        static ProgramCache* programCache;
+        static bool parallelCompile;
     };
 
 }
@@ -0,0 +1,192 @@
+#include "StreamBuffer.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+        const GLuint64 FENCE_TIMEOUT_NS = 1000000000;
+    }
+
+    StreamBuffer::StreamBuffer()
+        : buffer(0), frameSize(0), frameCount(0), persistent(false), mapped(nullptr),
+        fences(), partition(0), head(0), frame(0), generation(0),
+        stallCount(0), streamedBytes(0), overflowCount(0) {
+    }
+
+    void StreamBuffer::init(GLsizeiptr size, int count) {
+        frameSize = size;
+        frameCount = count;
+        fences.assign(frameCount, nullptr);
+        partition = 0;
+        head = 0;
+
+#if defined (__APPLE__)
+        persistent = false;
+#else
+        persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#endif
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+#if !defined (__APPLE__)
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * frameCount, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * frameCount, flags));
+            if (mapped == nullptr) {
+                std::cerr << "StreamBuffer: persistent mapping failed, using glMapBufferRange per allocation" << std::endl;
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                persistent = false;
+            }
+        }
+#endif
+        if (!persistent) {
+            glBufferData(GL_COPY_WRITE_BUFFER, frameSize * frameCount, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void StreamBuffer::cleanup() {
+        for (GLsync& fence : fences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        if (persistent && mapped != nullptr) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    void StreamBuffer::beginFrame() {
+        // Writes made before the first frame (or without endFrame) still need a fence
+        if (head > 0 && fences[partition] == nullptr) {
+            endFrame();
+        }
+
+        frame++;
+        partition = (partition + 1) % frameCount;
+        head = 0;
+
+        GLsync& fence = fences[partition];
+        if (fence == nullptr) {
+            return;
+        }
+
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            stallCount++;
+            if (persistent) {
+                GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+                do {
+                    status = glClientWaitSync(fence, flags, FENCE_TIMEOUT_NS);
+                    flags = 0;
+                } while (status == GL_TIMEOUT_EXPIRED);
+            }
+            else {
+                // Also drops every fence, including this one
+                orphan();
+                return;
+            }
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    void StreamBuffer::endFrame() {
+        if (fences[partition] != nullptr) {
+            glDeleteSync(fences[partition]);
+        }
+        fences[partition] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // The driver keeps the old storage alive for the draws still reading it
+    // and hands out fresh storage, so no partition has to be waited on
+    void StreamBuffer::orphan() {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, frameSize * frameCount, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        for (GLsync& fence : fences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        generation++;
+    }
+
+    StreamAllocation StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+        StreamAllocation allocation = { nullptr, 0, size, frame, generation };
+
+        GLsizeiptr start = ((head + alignment - 1) / alignment) * alignment;
+        if (size <= 0 || start + size > frameSize) {
+            if (size > 0) {
+                overflowCount++;
+            }
+            return allocation;
+        }
+
+        allocation.offset = partition * frameSize + start;
+        if (persistent) {
+            allocation.data = mapped + allocation.offset;
+        }
+        else {
+            // The partition is known to be idle, so the driver need not sync either
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            allocation.data = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.offset, size, flags);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            if (allocation.data == nullptr) {
+                return allocation;
+            }
+        }
+
+        head = start + size;
+        streamedBytes += static_cast<size_t>(size);
+        return allocation;
+    }
+
+    void StreamBuffer::commit(const StreamAllocation& allocation) {
+        // Coherent persistent writes are visible to the next draw as they are
+        if (persistent || allocation.data == nullptr) {
+            return;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    bool StreamBuffer::isCurrent(const StreamAllocation& allocation) const {
+        return allocation.data != nullptr &&
+            allocation.generation == generation &&
+            frame - allocation.frame < static_cast<unsigned long long>(frameCount);
+    }
+
+    unsigned int StreamBuffer::takeStallCount() {
+        unsigned int count = stallCount;
+        stallCount = 0;
+        return count;
+    }
+
+    size_t StreamBuffer::takeStreamedBytes() {
+        size_t bytes = streamedBytes;
+        streamedBytes = 0;
+        return bytes;
+    }
+
+    unsigned int StreamBuffer::takeOverflowCount() {
+        unsigned int count = overflowCount;
+        overflowCount = 0;
+        return count;
+    }
+
+}
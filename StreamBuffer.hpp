@@ -0,0 +1,97 @@
+#ifndef StreamBuffer_hpp
+#define StreamBuffer_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Space handed out by StreamBuffer::allocate. data is null when the
+    // frame's partition had no room left; the caller uploads on its own then.
+    struct StreamAllocation {
+        void* data;
+        GLintptr offset;
+        GLsizeiptr size;
+        unsigned long long frame;
+        unsigned int generation;
+    };
+
+    // One buffer for the data rewritten every frame (rain heights, fire
+    // instances, uniform blocks), split into frameCount partitions used in
+    // turn. A fence is placed after the frame that filled a partition and
+    // waited on before the partition is written again, so the CPU never
+    // overwrites what the GPU is still reading.
+    //
+    // With GL_ARB_buffer_storage (GL 4.4) the buffer is mapped once, persistent
+    // and coherent, and allocations are plain pointers into it. On GL 4.1 each
+    // allocation is mapped with glMapBufferRange (invalidate, unsynchronized)
+    // and unmapped by commit(); when the fence of the next partition has not
+    // signaled yet the whole buffer is orphaned instead of waiting.
+    //
+    // The buffer can be bound to any target, vertex and uniform data share it.
+    class StreamBuffer {
+
+    public:
+        static const int DEFAULT_FRAME_COUNT = 3;
+
+        StreamBuffer();
+
+        // frameSize is the most one frame may allocate
+        void init(GLsizeiptr frameSize, int frameCount = DEFAULT_FRAME_COUNT);
+        void cleanup();
+
+        // Moves to the next partition, waiting for the GPU if it still reads it
+        void beginFrame();
+        // Fences the partition written since beginFrame
+        void endFrame();
+
+        StreamAllocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+        // Makes the written bytes visible to the GPU, call before drawing with them
+        void commit(const StreamAllocation& allocation);
+        // True while the allocation's bytes are still intact and can be drawn
+        // from again without rewriting them
+        bool isCurrent(const StreamAllocation& allocation) const;
+
+        GLuint getBuffer() const { return buffer; }
+        bool isPersistent() const { return persistent; }
+
+        // Frames whose partition was still in use by the GPU (the CPU waited,
+        // or the buffer was orphaned on GL 4.1) since the last call
+        unsigned int takeStallCount();
+        // Bytes allocated since the last call
+        size_t takeStreamedBytes();
+        // Allocations refused because the partition was full, since the last call
+        unsigned int takeOverflowCount();
+
+    private:
+        void orphan();
+
+        GLuint buffer;
+        GLsizeiptr frameSize;
+        int frameCount;
+        bool persistent;
+        unsigned char* mapped;
+
+        std::vector<GLsync> fences;
+        int partition;
+        GLsizeiptr head;
+        unsigned long long frame;
+        // Bumped by orphan(), older allocations point at released storage
+        unsigned int generation;
+
+        unsigned int stallCount;
+        size_t streamedBytes;
+        unsigned int overflowCount;
+    };
+
+}
+
+#endif
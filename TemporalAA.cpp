@@ -0,0 +1,153 @@
+#include "TemporalAA.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace gps {
+
+    TemporalAA::TemporalAA()
+        : sceneScaleLoc(-1), jitterLoc(-1), historyValidLoc(-1),
+        framebuffer(0), current(0), width(0), height(0), historyValid(false),
+        frameIndex(0), jitterPixels(0.0f), jitterMatrix(1.0f), viewProjection(1.0f), previousViewProjection(1.0f),
+        previousValid(false) {
+        historyTextures[0] = historyTextures[1] = 0;
+    }
+
+    void TemporalAA::init() {
+        resolveShader.loadShader("shaders/particleFullscreen.vert", "shaders/taaResolve.frag", PARTICLE_SHADER);
+
+        resolveShader.useShaderProgram();
+        glUniform1i(resolveShader.getUniformLocation("sceneColor"), 0);
+        glUniform1i(resolveShader.getUniformLocation("velocityBuffer"), 1);
+        glUniform1i(resolveShader.getUniformLocation("depthBuffer"), 2);
+        glUniform1i(resolveShader.getUniformLocation("history"), 3);
+        sceneScaleLoc = resolveShader.getUniformLocation("sceneScale");
+        jitterLoc = resolveShader.getUniformLocation("jitter");
+        historyValidLoc = resolveShader.getUniformLocation("historyValid");
+
+        triangle.init();
+        glGenFramebuffers(1, &framebuffer);
+        timer.init();
+    }
+
+    void TemporalAA::cleanup() {
+        deleteTargets();
+        glDeleteFramebuffers(1, &framebuffer);
+        triangle.cleanup();
+        timer.cleanup();
+        glDeleteProgram(resolveShader.shaderProgram);
+    }
+
+    void TemporalAA::resize(int newWidth, int newHeight) {
+        deleteTargets();
+        width = newWidth;
+        height = newHeight;
+
+        glGenTextures(2, historyTextures);
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, historyTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[0], 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Temporal AA framebuffer not complete!" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        current = 0;
+        historyValid = false;
+    }
+
+    void TemporalAA::deleteTargets() {
+        if (historyTextures[0] != 0) {
+            glDeleteTextures(2, historyTextures);
+            historyTextures[0] = historyTextures[1] = 0;
+        }
+    }
+
+    size_t TemporalAA::getAllocatedBytes() const {
+        return historyTextures[0] != 0 ? 2 * static_cast<size_t>(width) * height * 8 : 0;
+    }
+
+    // Radical inverse of index in the given base, in [0, 1)
+    float TemporalAA::halton(unsigned int index, unsigned int base) {
+        float result = 0.0f;
+        float fraction = 1.0f / base;
+        while (index > 0) {
+            result += fraction * (index % base);
+            index /= base;
+            fraction /= base;
+        }
+        return result;
+    }
+
+    void TemporalAA::beginFrame(const glm::ivec2& sceneSize, const glm::mat4& frameViewProjection) {
+        previousViewProjection = previousValid ? viewProjection : frameViewProjection;
+        viewProjection = frameViewProjection;
+        previousValid = true;
+
+        // Index 0 is the pixel corner for every base, the sequence starts at 1
+        float pixelFraction = static_cast<float>(sceneSize.x) * sceneSize.y / (static_cast<float>(width) * height);
+        int phases = std::min(std::max(static_cast<int>(MIN_PHASES / pixelFraction + 0.5f), static_cast<int>(MIN_PHASES)),
+            static_cast<int>(MAX_PHASES));
+        frameIndex++;
+        unsigned int index = frameIndex % phases + 1;
+        jitterPixels = glm::vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+
+        glm::vec2 jitterClip = 2.0f * jitterPixels / glm::vec2(sceneSize);
+        jitterMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(jitterClip, 0.0f));
+    }
+
+    void TemporalAA::resolve(GLuint sceneColor, GLuint velocity, GLuint depth, const glm::vec2& sceneScale) {
+        if (historyTextures[0] == 0) {
+            return;
+        }
+
+        timer.begin();
+
+        int target = 1 - current;
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[target], 0);
+        glViewport(0, 0, width, height);
+        glDisable(GL_BLEND);
+
+        resolveShader.useShaderProgram();
+        glUniform2fv(sceneScaleLoc, 1, &sceneScale[0]);
+        glUniform2fv(jitterLoc, 1, &jitterPixels[0]);
+        glUniform1i(historyValidLoc, historyValid);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneColor);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, velocity);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depth);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, historyTextures[current]);
+
+        triangle.bind();
+        triangle.draw();
+        glBindVertexArray(0);
+
+        for (int unit = 3; unit >= 0; unit--) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        current = target;
+        historyValid = true;
+
+        timer.end();
+    }
+
+}
@@ -0,0 +1,107 @@
+#ifndef TemporalAA_hpp
+#define TemporalAA_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "Shader.hpp"
+#include "GpuTimer.hpp"
+#include "FullscreenTriangle.hpp"
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Temporal anti-aliasing with upsampling (TAAU). The main pass moves its
+    // samples by a different sub-pixel offset every frame (Halton 2, 3) and
+    // writes where each pixel was the frame before (motion vectors). The
+    // resolve gathers the scene's samples around each window pixel, weighted
+    // by their distance to it, and blends them into a window sized history
+    // fetched from where the pixel was last frame. Over a few frames every
+    // window pixel has had samples land close to it, so the main pass can be
+    // drawn smaller than the window and still resolve to window detail.
+    //
+    // History that no longer matches (disocclusion, lighting changes) is
+    // clipped to the colour box of the current samples around the pixel
+    // (mean +- standard deviation in YCoCg, within their min / max). The
+    // blend weighs both by 1 / (1 + luma) so lone bright pixels do not
+    // flicker, and trusts the history less the faster the pixel moves.
+    //
+    // The history is linear HDR, the tonemap runs after the resolve.
+    class TemporalAA {
+
+    public:
+        // Jitter phases at full resolution; smaller scenes use more so each
+        // window pixel still gets a sample close to it within one cycle
+        static const int MIN_PHASES = 8;
+        static const int MAX_PHASES = 64;
+
+        TemporalAA();
+
+        void init();
+        void cleanup();
+
+        // Window size, drops the history
+        void resize(int width, int height);
+        // Drops the history, the next resolve starts from the current frame
+        void reset() { historyValid = false; previousValid = false; }
+
+        // Picks this frame's jitter for a main pass of sceneSize pixels.
+        // viewProjection is this frame's, without jitter.
+        void beginFrame(const glm::ivec2& sceneSize, const glm::mat4& viewProjection);
+
+        // Moves clip space by this frame's jitter, multiply it on the left of
+        // the main pass projection
+        const glm::mat4& getJitterMatrix() const { return jitterMatrix; }
+        // Last frame's view projection with this frame's jitter, see
+        // ViewBlock::previousViewProjection
+        glm::mat4 getPreviousViewProjection() const { return jitterMatrix * previousViewProjection; }
+
+        // Resolves the lower left sceneScale part of the scene targets into
+        // the history. velocity is in texture coordinates (basic.frag).
+        // Leaves framebuffer 0 bound and a window sized viewport.
+        void resolve(GLuint sceneColor, GLuint velocity, GLuint depth, const glm::vec2& sceneScale);
+
+        // Window sized, linear HDR: the latest resolve
+        GLuint getTexture() const { return historyTextures[current]; }
+        size_t getAllocatedBytes() const;
+
+        // GPU time of the most recent resolve that has finished, in ms
+        double getGpuMs() const { return timer.getGpuMs(); }
+
+    private:
+        static float halton(unsigned int index, unsigned int base);
+
+        void deleteTargets();
+
+        Shader resolveShader;
+        GLint sceneScaleLoc;
+        GLint jitterLoc;
+        GLint historyValidLoc;
+        FullscreenTriangle triangle;
+
+        // Written in turn, the other one is read as the history
+        GLuint framebuffer;
+        GLuint historyTextures[2];
+        int current;
+        int width, height;
+        bool historyValid;
+
+        unsigned int frameIndex;
+        // In scene pixels, and as a clip space translation
+        glm::vec2 jitterPixels;
+        glm::mat4 jitterMatrix;
+        glm::mat4 viewProjection;
+        glm::mat4 previousViewProjection;
+        bool previousValid;
+
+        GpuTimer timer;
+    };
+
+}
+
+#endif
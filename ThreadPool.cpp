@@ -0,0 +1,106 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    ThreadPool::ThreadPool(size_t workerCount)
+        : job{ nullptr, 0, 1, 0 }, nextChunk(0), finishedChunks(0),
+        activeWorkers(0), generation(0), stopping(false) {
+
+        if (workerCount == 0) {
+            size_t hardwareThreads = std::thread::hardware_concurrency();
+            workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        for (size_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::parallelFor(size_t count, size_t minChunk, const RangeFunction& fn) {
+        if (count == 0) return;
+
+        minChunk = std::max<size_t>(minChunk, 1);
+        size_t chunk = std::max(minChunk, (count + getThreadCount() * 4 - 1) / (getThreadCount() * 4));
+        size_t chunks = (count + chunk - 1) / chunk;
+
+        // Not worth waking anybody up
+        if (chunks == 1 || workers.empty()) {
+            fn(0, count, 0);
+            return;
+        }
+
+        Job current = { &fn, count, chunk, chunks };
+        {
+            // The previous call waited for its workers, none is left in runChunks
+            std::lock_guard<std::mutex> lock(mutex);
+            job = current;
+            nextChunk = 0;
+            finishedChunks = 0;
+            generation++;
+        }
+        wakeCondition.notify_all();
+
+        runChunks(current, 0);
+
+        // Every chunk done and every worker out of runChunks, so the next
+        // call can reset the counters
+        std::unique_lock<std::mutex> lock(mutex);
+        doneCondition.wait(lock, [&] { return finishedChunks.load() == current.chunks && activeWorkers == 0; });
+        job.fn = nullptr;
+    }
+
+    void ThreadPool::runChunks(const Job& current, size_t workerIndex) {
+        size_t finishedHere = 0;
+        for (;;) {
+            size_t c = nextChunk.fetch_add(1);
+            if (c >= current.chunks) break;
+
+            size_t begin = c * current.chunk;
+            size_t end = std::min(begin + current.chunk, current.count);
+            (*current.fn)(begin, end, workerIndex);
+            finishedHere++;
+        }
+
+        if (finishedHere > 0 && finishedChunks.fetch_add(finishedHere) + finishedHere == current.chunks) {
+            std::lock_guard<std::mutex> lock(mutex);
+            doneCondition.notify_all();
+        }
+    }
+
+    void ThreadPool::workerLoop(size_t workerIndex) {
+        size_t seenGeneration = 0;
+        for (;;) {
+            Job current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeCondition.wait(lock, [&] { return stopping || (generation != seenGeneration && job.fn != nullptr); });
+                if (stopping) return;
+                seenGeneration = generation;
+                current = job;
+                activeWorkers++;
+            }
+            runChunks(current, workerIndex);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                activeWorkers--;
+                if (activeWorkers == 0) {
+                    doneCondition.notify_all();
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,62 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace gps {
+
+    // Small fork-join pool used by the CPU side simulation/culling code.
+    // parallelFor blocks until every chunk is done; the calling thread works too.
+    class ThreadPool {
+
+    public:
+        using RangeFunction = std::function<void(size_t begin, size_t end, size_t worker)>;
+
+        explicit ThreadPool(size_t workerCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        // Splits [0, count) into chunks of at least minChunk items.
+        void parallelFor(size_t count, size_t minChunk, const RangeFunction& fn);
+
+        // Workers plus the calling thread.
+        size_t getThreadCount() const { return workers.size() + 1; }
+
+    private:
+        // One parallelFor call, copied by each worker under the lock
+        struct Job {
+            const RangeFunction* fn;
+            size_t count;
+            size_t chunk;
+            size_t chunks;
+        };
+
+        void workerLoop(size_t workerIndex);
+        void runChunks(const Job& job, size_t workerIndex);
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+
+        // Valid while a parallelFor runs, job.fn is null otherwise
+        Job job;
+        std::atomic<size_t> nextChunk;
+        std::atomic<size_t> finishedChunks;
+        // Workers inside runChunks; the counters are only reset once it is
+        // zero, so nobody still leaving a call touches the next one's
+        size_t activeWorkers;
+        size_t generation;
+        bool stopping;
+    };
+
+}
+
+#endif
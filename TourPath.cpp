@@ -0,0 +1,77 @@
+#include "TourPath.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    const int TourPath::SAMPLES_PER_SEGMENT;
+
+    void TourPath::clear() {
+        keys.clear();
+        distances.clear();
+    }
+
+    void TourPath::addKey(const glm::vec3& position, const glm::vec3& target, const glm::vec3& up) {
+        keys.push_back(Pose{ position, target, up });
+        distances.clear();
+    }
+
+    void TourPath::build() {
+        distances.clear();
+        int segments = getSegmentCount();
+        if (segments == 0) {
+            return;
+        }
+
+        distances.reserve(segments * SAMPLES_PER_SEGMENT + 1);
+        distances.push_back(0.0f);
+        glm::vec3 previous = keys[1].position;
+        for (int segment = 0; segment < segments; segment++) {
+            for (int i = 1; i <= SAMPLES_PER_SEGMENT; i++) {
+                glm::vec3 point = evaluate(segment, static_cast<float>(i) / SAMPLES_PER_SEGMENT).position;
+                distances.push_back(distances.back() + glm::length(point - previous));
+                previous = point;
+            }
+        }
+    }
+
+    TourPath::Pose TourPath::sample(float distance) const {
+        if (distances.empty()) {
+            return keys.empty() ? Pose{ glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f) } : keys.front();
+        }
+        distance = glm::clamp(distance, 0.0f, getLength());
+
+        // First sample past the distance, and how far between it and the one before
+        size_t next = std::upper_bound(distances.begin(), distances.end(), distance) - distances.begin();
+        next = std::min(std::max(next, static_cast<size_t>(1)), distances.size() - 1);
+        float chord = distances[next] - distances[next - 1];
+        float fraction = chord > 0.0f ? (distance - distances[next - 1]) / chord : 0.0f;
+
+        float u = (static_cast<float>(next - 1) + fraction) / SAMPLES_PER_SEGMENT;
+        int segment = std::min(static_cast<int>(u), getSegmentCount() - 1);
+        return evaluate(segment, u - segment);
+    }
+
+    glm::vec3 TourPath::catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t) {
+        return 0.5f * (
+            (2.0f * p1) +
+            (-p0 + p2) * t +
+            (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t +
+            (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t * t * t
+            );
+    }
+
+    TourPath::Pose TourPath::evaluate(int segment, float t) const {
+        const Pose& p0 = keys[segment];
+        const Pose& p1 = keys[segment + 1];
+        const Pose& p2 = keys[segment + 2];
+        const Pose& p3 = keys[segment + 3];
+
+        Pose pose;
+        pose.position = catmullRom(p0.position, p1.position, p2.position, p3.position, t);
+        pose.target = catmullRom(p0.target, p1.target, p2.target, p3.target, t);
+        pose.up = catmullRom(p0.up, p1.up, p2.up, p3.up, t);
+        return pose;
+    }
+
+}
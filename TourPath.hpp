@@ -0,0 +1,56 @@
+#ifndef TourPath_hpp
+#define TourPath_hpp
+
+#include "glm/glm.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Camera path through the recorded waypoints, sampled by distance
+    // travelled rather than by spline parameter, so the camera moves at the
+    // same speed however far apart the waypoints are and a tour takes the
+    // same time at any frame rate.
+    //
+    // Position, target and up are each a uniform Catmull-Rom spline through
+    // the keys; the path runs from the second key to the one before last.
+    // Arc length is tabulated from SAMPLES_PER_SEGMENT chords per segment of
+    // the position spline and inverted by linear interpolation in the table.
+    class TourPath {
+
+    public:
+        static const int SAMPLES_PER_SEGMENT = 32;
+
+        struct Pose {
+            glm::vec3 position;
+            glm::vec3 target;
+            glm::vec3 up;
+        };
+
+        void clear();
+        void addKey(const glm::vec3& position, const glm::vec3& target, const glm::vec3& up);
+        // Builds the arc length table, call after the last addKey
+        void build();
+
+        // Needs four keys
+        bool isEmpty() const { return getSegmentCount() == 0; }
+        int getSegmentCount() const { return keys.size() < 4 ? 0 : static_cast<int>(keys.size()) - 3; }
+        float getLength() const { return distances.empty() ? 0.0f : distances.back(); }
+
+        // distance is clamped to the path
+        Pose sample(float distance) const;
+
+        static glm::vec3 catmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t);
+
+    private:
+        // Along segment, 0 to 1
+        Pose evaluate(int segment, float t) const;
+
+        std::vector<Pose> keys;
+        // Length up to sample i, SAMPLES_PER_SEGMENT per segment plus the end
+        std::vector<float> distances;
+    };
+
+}
+
+#endif
@@ -0,0 +1,252 @@
+#include "UniformBlocks.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    UniformBlocks::UniformBlocks()
+        : frameBuffer(0), viewBuffer(0), lightsBuffer(0), windBuffer(0), viewStride(sizeof(ViewBlock)), alignment(256),
+        streamBuffer(nullptr), frameLocation(), lightsLocation(), windLocation(), viewLocations(),
+        frameCopy(), lightsCopy(), windCopy(), viewCopies(), boundView(MAIN_VIEW),
+        frame(), views(), lights(), wind(),
+        frameDirty(true), lightsDirty(true), windDirty(true), uploadCount(0) {
+
+        for (int i = 0; i < VIEW_SLOT_COUNT; i++) {
+            viewDirty[i] = true;
+        }
+    }
+
+    void UniformBlocks::init() {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        viewStride = ((sizeof(ViewBlock) + alignment - 1) / alignment) * alignment;
+
+        glGenBuffers(1, &frameBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &viewBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, viewBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, viewStride * VIEW_SLOT_COUNT, nullptr, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &lightsBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, lightsBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), nullptr, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &windBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, windBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(WindBlock), nullptr, GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        setStreamBuffer(nullptr);
+    }
+
+    void UniformBlocks::setStreamBuffer(StreamBuffer* stream) {
+        streamBuffer = stream;
+
+        frameLocation = { frameBuffer, 0 };
+        lightsLocation = { lightsBuffer, 0 };
+        windLocation = { windBuffer, 0 };
+        for (int i = 0; i < VIEW_SLOT_COUNT; i++) {
+            viewLocations[i] = { viewBuffer, i * viewStride };
+            viewCopies[i] = StreamAllocation();
+            viewDirty[i] = true;
+        }
+        frameCopy = lightsCopy = windCopy = StreamAllocation();
+        frameDirty = lightsDirty = windDirty = true;
+
+        bindBlock(FRAME_BLOCK_BINDING, frameLocation, sizeof(FrameBlock));
+        bindBlock(LIGHTS_BLOCK_BINDING, lightsLocation, sizeof(LightsBlock));
+        bindBlock(WIND_BLOCK_BINDING, windLocation, sizeof(WindBlock));
+        bindView(boundView);
+    }
+
+    void UniformBlocks::cleanup() {
+        glDeleteBuffers(1, &frameBuffer);
+        glDeleteBuffers(1, &viewBuffer);
+        glDeleteBuffers(1, &lightsBuffer);
+        glDeleteBuffers(1, &windBuffer);
+    }
+
+    void UniformBlocks::attach(Shader& shader) const {
+        shader.bindUniformBlock("FrameBlock", FRAME_BLOCK_BINDING);
+        shader.bindUniformBlock("ViewBlock", VIEW_BLOCK_BINDING);
+        shader.bindUniformBlock("LightsBlock", LIGHTS_BLOCK_BINDING);
+        shader.bindUniformBlock("WindBlock", WIND_BLOCK_BINDING);
+    }
+
+    template <typename T>
+    void UniformBlocks::update(T& shadow, const T& data, bool& dirty) {
+        if (std::memcmp(&shadow, &data, sizeof(T)) != 0) {
+            shadow = data;
+            dirty = true;
+        }
+    }
+
+    void UniformBlocks::setFrame(const FrameBlock& data) {
+        update(frame, data, frameDirty);
+    }
+
+    void UniformBlocks::setView(ViewSlot slot, const ViewBlock& data) {
+        update(views[slot], data, viewDirty[slot]);
+    }
+
+    void UniformBlocks::setLights(const LightsBlock& data) {
+        update(lights, data, lightsDirty);
+    }
+
+    void UniformBlocks::setWind(const WindBlock& data) {
+        update(wind, data, windDirty);
+    }
+
+    void UniformBlocks::upload(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+        uploadCount++;
+    }
+
+    void UniformBlocks::flush() {
+        if (streamBuffer != nullptr) {
+            flushStream();
+            return;
+        }
+
+        if (frameDirty) {
+            upload(frameBuffer, 0, sizeof(FrameBlock), &frame);
+            frameDirty = false;
+        }
+        for (int i = 0; i < VIEW_SLOT_COUNT; i++) {
+            if (viewDirty[i]) {
+                upload(viewBuffer, i * viewStride, sizeof(ViewBlock), &views[i]);
+                viewDirty[i] = false;
+            }
+        }
+        if (lightsDirty) {
+            upload(lightsBuffer, 0, sizeof(LightsBlock), &lights);
+            lightsDirty = false;
+        }
+        if (windDirty) {
+            upload(windBuffer, 0, sizeof(WindBlock), &wind);
+            windDirty = false;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void UniformBlocks::flushStream() {
+        if (streamBlock(frameCopy, frameLocation, { frameBuffer, 0 }, sizeof(FrameBlock), &frame, frameDirty)) {
+            bindBlock(FRAME_BLOCK_BINDING, frameLocation, sizeof(FrameBlock));
+        }
+        for (int i = 0; i < VIEW_SLOT_COUNT; i++) {
+            BlockLocation own = { viewBuffer, i * viewStride };
+            if (streamBlock(viewCopies[i], viewLocations[i], own, sizeof(ViewBlock), &views[i], viewDirty[i]) && i == boundView) {
+                bindView(boundView);
+            }
+        }
+        if (streamBlock(lightsCopy, lightsLocation, { lightsBuffer, 0 }, sizeof(LightsBlock), &lights, lightsDirty)) {
+            bindBlock(LIGHTS_BLOCK_BINDING, lightsLocation, sizeof(LightsBlock));
+        }
+        if (streamBlock(windCopy, windLocation, { windBuffer, 0 }, sizeof(WindBlock), &wind, windDirty)) {
+            bindBlock(WIND_BLOCK_BINDING, windLocation, sizeof(WindBlock));
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Writes the block to a new stream copy when it changed or the previous
+    // copy is about to be overwritten. A full stream falls back to the block's
+    // own buffer. Returns true when the location moved.
+    bool UniformBlocks::streamBlock(StreamAllocation& copy, BlockLocation& location, const BlockLocation& own,
+        GLsizeiptr size, const void* data, bool& dirty) {
+
+        if (!dirty && streamBuffer->isCurrent(copy)) {
+            return false;
+        }
+        dirty = false;
+
+        copy = streamBuffer->allocate(size, alignment);
+        if (copy.data != nullptr) {
+            std::memcpy(copy.data, data, size);
+            streamBuffer->commit(copy);
+            uploadCount++;
+            location = { streamBuffer->getBuffer(), copy.offset };
+            return true;
+        }
+
+        upload(own.buffer, own.offset, size, data);
+        bool moved = location.buffer != own.buffer || location.offset != own.offset;
+        location = own;
+        return moved;
+    }
+
+    void UniformBlocks::bindBlock(GLuint binding, const BlockLocation& location, GLsizeiptr size) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, location.buffer, location.offset, size);
+    }
+
+    void UniformBlocks::bindView(ViewSlot slot) {
+        bindBlock(VIEW_BLOCK_BINDING, viewLocations[slot], sizeof(ViewBlock));
+        boundView = slot;
+    }
+
+    unsigned int UniformBlocks::takeUploadCount() {
+        unsigned int count = uploadCount;
+        uploadCount = 0;
+        return count;
+    }
+
+    namespace {
+        unsigned int uniformCallCount = 0;
+    }
+
+#if defined (__APPLE__)
+
+    void installUniformCallCounter() {
+    }
+
+#else
+
+#define COUNTED_UNIFORM(name, PROC, params, args) \
+    PROC real##name = nullptr; \
+    void GLAPIENTRY counted##name params { uniformCallCount++; real##name args; }
+
+    namespace {
+        COUNTED_UNIFORM(Uniform1i, PFNGLUNIFORM1IPROC, (GLint l, GLint v0), (l, v0))
+        COUNTED_UNIFORM(Uniform1f, PFNGLUNIFORM1FPROC, (GLint l, GLfloat v0), (l, v0))
+        COUNTED_UNIFORM(Uniform2f, PFNGLUNIFORM2FPROC, (GLint l, GLfloat v0, GLfloat v1), (l, v0, v1))
+        COUNTED_UNIFORM(Uniform3f, PFNGLUNIFORM3FPROC, (GLint l, GLfloat v0, GLfloat v1, GLfloat v2), (l, v0, v1, v2))
+        COUNTED_UNIFORM(Uniform1iv, PFNGLUNIFORM1IVPROC, (GLint l, GLsizei c, const GLint* v), (l, c, v))
+        COUNTED_UNIFORM(Uniform3iv, PFNGLUNIFORM3IVPROC, (GLint l, GLsizei c, const GLint* v), (l, c, v))
+        COUNTED_UNIFORM(Uniform3fv, PFNGLUNIFORM3FVPROC, (GLint l, GLsizei c, const GLfloat* v), (l, c, v))
+        COUNTED_UNIFORM(Uniform4fv, PFNGLUNIFORM4FVPROC, (GLint l, GLsizei c, const GLfloat* v), (l, c, v))
+        COUNTED_UNIFORM(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC, (GLint l, GLsizei c, GLboolean t, const GLfloat* v), (l, c, t, v))
+
+        PFNGLGETUNIFORMLOCATIONPROC realGetUniformLocation = nullptr;
+        GLint GLAPIENTRY countedGetUniformLocation(GLuint program, const GLchar* name) {
+            uniformCallCount++;
+            return realGetUniformLocation(program, name);
+        }
+    }
+
+#define INSTALL_COUNTED_UNIFORM(name) \
+    if (real##name == nullptr) { real##name = __glew##name; __glew##name = counted##name; }
+
+    void installUniformCallCounter() {
+        INSTALL_COUNTED_UNIFORM(Uniform1i)
+        INSTALL_COUNTED_UNIFORM(Uniform1f)
+        INSTALL_COUNTED_UNIFORM(Uniform2f)
+        INSTALL_COUNTED_UNIFORM(Uniform3f)
+        INSTALL_COUNTED_UNIFORM(Uniform1iv)
+        INSTALL_COUNTED_UNIFORM(Uniform3iv)
+        INSTALL_COUNTED_UNIFORM(Uniform3fv)
+        INSTALL_COUNTED_UNIFORM(Uniform4fv)
+        INSTALL_COUNTED_UNIFORM(UniformMatrix4fv)
+        INSTALL_COUNTED_UNIFORM(GetUniformLocation)
+    }
+
+#endif
+
+    unsigned int takeUniformCallCount() {
+        unsigned int count = uniformCallCount;
+        uniformCallCount = 0;
+        return count;
+    }
+
+}
@@ -0,0 +1,218 @@
+#ifndef UniformBlocks_hpp
+#define UniformBlocks_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "glm/glm.hpp"
+#include "Shader.hpp"
+#include "StreamBuffer.hpp"
+
+namespace gps {
+
+    // Fixed binding points, the same in every program (see attach)
+    enum UniformBlockBinding {
+        FRAME_BLOCK_BINDING = 0,
+        VIEW_BLOCK_BINDING = 1,
+        LIGHTS_BLOCK_BINDING = 2,
+        WIND_BLOCK_BINDING = 3
+    };
+
+    enum ViewSlot {
+        MAIN_VIEW = 0,
+        REFLECTION_VIEW = 1,
+        REFRACTION_VIEW = 2,
+        VIEW_SLOT_COUNT = 3
+    };
+
+    // CPU mirrors of the std140 blocks declared in the shaders.
+    // Keep the member order and padding in sync with the GLSL side.
+    struct FrameBlock {
+        float time;
+        float fogTime;
+        float globalLightIntensity;
+        float fogEnd;
+        float layeredFogTop;
+        float expFogDensity;
+        float dayNightBlend;
+        float pad0;
+        glm::vec3 fogColor;
+        float pad1;
+    };
+
+    struct ViewBlock {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::vec4 clipPlane;
+        glm::vec3 viewPos;
+        float pad0;
+        glm::vec3 cameraRight;
+        float pad1;
+        glm::vec3 cameraUp;
+        float pad2;
+        // Last frame's unjittered view projection with this frame's jitter
+        // applied, so motion vectors taken against it carry no jitter
+        glm::mat4 previousViewProjection;
+    };
+
+    struct DirLightBlock {
+        glm::vec3 direction;
+        float pad0;
+        glm::vec3 ambient;
+        float pad1;
+        glm::vec3 diffuse;
+        float pad2;
+        glm::vec3 specular;
+        float pad3;
+        glm::vec3 color;
+        int enabled;
+    };
+
+    struct PointLightBlock {
+        glm::vec3 position;
+        float pad0;
+        glm::vec3 ambient;
+        float pad1;
+        glm::vec3 diffuse;
+        float pad2;
+        glm::vec3 specular;
+        float pad3;
+        glm::vec3 color;
+        float constant;
+        float linear;
+        float quadratic;
+        int enabled;
+        float pad4;
+    };
+
+    struct SpotLightBlock {
+        glm::vec3 position;
+        float pad0;
+        glm::vec3 direction;
+        float cutOff;
+        float outerCutOff;
+        float pad1[3];
+        glm::vec3 ambient;
+        float pad2;
+        glm::vec3 diffuse;
+        float pad3;
+        glm::vec3 specular;
+        float pad4;
+        glm::vec3 color;
+        int enabled;
+    };
+
+    struct LightsBlock {
+        DirLightBlock dirLight;
+        DirLightBlock flashLight;
+        PointLightBlock pointLight;
+        SpotLightBlock spotLight;
+        SpotLightBlock leftHeadlight;
+        SpotLightBlock rightHeadlight;
+        glm::mat4 lightSpaceMatrix;
+        glm::mat4 leftHeadlightLightSpaceMatrix;
+        glm::mat4 rightHeadlightLightSpaceMatrix;
+        float farPlane;
+        float pad[3];
+    };
+
+    struct WindBlock {
+        glm::vec3 direction;
+        float strength;
+        float gustSize;
+        float gustSpeed;
+        float waveLength;
+        float pad;
+    };
+
+    static_assert(sizeof(FrameBlock) == 48, "FrameBlock does not match std140");
+    static_assert(sizeof(ViewBlock) == 256, "ViewBlock does not match std140");
+    static_assert(sizeof(DirLightBlock) == 80, "DirLight does not match std140");
+    static_assert(sizeof(PointLightBlock) == 96, "PointLight does not match std140");
+    static_assert(sizeof(SpotLightBlock) == 112, "SpotLight does not match std140");
+    static_assert(sizeof(LightsBlock) == 800, "LightsBlock does not match std140");
+    static_assert(sizeof(WindBlock) == 32, "WindBlock does not match std140");
+
+    // Owns the shared uniform buffers. The set* calls only copy into a shadow
+    // copy and flag the block dirty when something changed; flush() uploads
+    // each dirty block once. The view buffer holds one slot per ViewSlot and
+    // bindView() selects the slot used by the following draws.
+    //
+    // With a stream buffer attached the blocks are written into it instead and
+    // the bindings are moved to the new copy. A block that did not change is
+    // still rewritten once its last copy is about to be recycled.
+    class UniformBlocks {
+
+    public:
+        UniformBlocks();
+
+        void init();
+        void cleanup();
+        // May be null to go back to the block's own buffers
+        void setStreamBuffer(StreamBuffer* stream);
+
+        // Connects the blocks a program declares to the fixed binding points
+        void attach(Shader& shader) const;
+
+        void setFrame(const FrameBlock& data);
+        void setView(ViewSlot slot, const ViewBlock& data);
+        void setLights(const LightsBlock& data);
+        void setWind(const WindBlock& data);
+
+        void flush();
+        void bindView(ViewSlot slot);
+
+        // Buffer uploads since the last call
+        unsigned int takeUploadCount();
+
+    private:
+        template <typename T>
+        void update(T& shadow, const T& data, bool& dirty);
+        void upload(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+
+        // Where the shaders currently read a block from
+        struct BlockLocation {
+            GLuint buffer;
+            GLintptr offset;
+        };
+
+        void flushStream();
+        bool streamBlock(StreamAllocation& copy, BlockLocation& location, const BlockLocation& own,
+            GLsizeiptr size, const void* data, bool& dirty);
+        void bindBlock(GLuint binding, const BlockLocation& location, GLsizeiptr size) const;
+
+        GLuint frameBuffer, viewBuffer, lightsBuffer, windBuffer;
+        GLsizeiptr viewStride;
+        GLint alignment;
+
+        StreamBuffer* streamBuffer;
+        BlockLocation frameLocation, lightsLocation, windLocation;
+        BlockLocation viewLocations[VIEW_SLOT_COUNT];
+        StreamAllocation frameCopy, lightsCopy, windCopy;
+        StreamAllocation viewCopies[VIEW_SLOT_COUNT];
+        ViewSlot boundView;
+
+        FrameBlock frame;
+        ViewBlock views[VIEW_SLOT_COUNT];
+        LightsBlock lights;
+        WindBlock wind;
+
+        bool frameDirty, lightsDirty, windDirty;
+        bool viewDirty[VIEW_SLOT_COUNT];
+
+        unsigned int uploadCount;
+    };
+
+    // Wraps the glUniform*/glGetUniformLocation entry points so the calls issued
+    // per frame can be counted. Only available where GLEW loads the functions.
+    void installUniformCallCounter();
+    unsigned int takeUniformCallCount();
+
+}
+
+#endif
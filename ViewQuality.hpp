@@ -0,0 +1,46 @@
+#ifndef ViewQuality_hpp
+#define ViewQuality_hpp
+
+#include "Shader.hpp"
+#include "MeshBatch.hpp"
+
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // How much of the main pass a view renders. Secondary views (the water
+    // reflection and refraction) end up distorted and at a fraction of the
+    // resolution, so most of their detail is never seen.
+    struct ViewQuality {
+        // Pass features this view drops and adds on top of the main pass's
+        unsigned int removedFeatures;
+        unsigned int addedFeatures;
+        // Simplified index ranges and skipping batches below a screen size
+        bool simplifiedGeometry;
+        float minScreenSize;
+        // Render target size is the window's divided by this
+        int resolutionDivisor;
+
+        static ViewQuality full(int resolutionDivisor) {
+            return ViewQuality{ 0, 0, false, 0.0f, resolutionDivisor };
+        }
+
+        // One shadow tap, flat normals, coarse geometry and no batch under 2%
+        // of the view height
+        static ViewQuality secondary(int resolutionDivisor) {
+            return ViewQuality{ FEATURE_NORMAL_MAPPING, FEATURE_SINGLE_SHADOW_TAP, true, 0.02f, resolutionDivisor };
+        }
+
+        unsigned int apply(unsigned int passFeatures) const {
+            return (passFeatures & ~removedFeatures) | addedFeatures;
+        }
+
+        // eye in the space of the bounds being tested
+        GeometryDetail geometry(const glm::vec3& eye, const glm::mat4& projection) const {
+            return GeometryDetail{ eye, projection[1][1], simplifiedGeometry, minScreenSize };
+        }
+    };
+
+}
+
+#endif
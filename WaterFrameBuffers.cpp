@@ -4,7 +4,7 @@ WaterFrameBuffers::WaterFrameBuffers(int reflectionWidth, int reflectionHeight,
     : reflectionFrameBuffer(0), reflectionTexture(0), reflectionDepthBuffer(0),
     refractionFrameBuffer(0), refractionTexture(0), refractionDepthTexture(0),
     REFLECTION_WIDTH(reflectionWidth), REFLECTION_HEIGHT(reflectionHeight),
-    REFRACTION_WIDTH(refractionWidth), REFRACTION_HEIGHT(refractionHeight)
+    REFRACTION_WIDTH(refractionWidth), REFRACTION_HEIGHT(refractionHeight), divisor(2)
 {
     initialiseReflectionFrameBuffer();
     initialiseRefractionFrameBuffer();
@@ -189,12 +189,23 @@ GLuint WaterFrameBuffers::createDepthBufferAttachment(int width, int height)
     return depthBuffer;
 }
 
+// RGB colour is padded to four bytes, the depths are four bytes as well
+size_t WaterFrameBuffers::getReflectionBytes() const
+{
+    return static_cast<size_t>(REFLECTION_WIDTH) * REFLECTION_HEIGHT * 8;
+}
+
+size_t WaterFrameBuffers::getRefractionBytes() const
+{
+    return static_cast<size_t>(REFRACTION_WIDTH) * REFRACTION_HEIGHT * 8;
+}
+
 void WaterFrameBuffers::resize(int windowWidth, int windowHeight)
 {
-    REFLECTION_WIDTH = windowWidth / 2;
-    REFLECTION_HEIGHT = windowHeight / 2;
-    REFRACTION_WIDTH = windowWidth / 2;
-    REFRACTION_HEIGHT = windowHeight / 2;
+    REFLECTION_WIDTH = windowWidth / divisor;
+    REFLECTION_HEIGHT = windowHeight / divisor;
+    REFRACTION_WIDTH = windowWidth / divisor;
+    REFRACTION_HEIGHT = windowHeight / divisor;
 
     glDeleteFramebuffers(1, &reflectionFrameBuffer);
     glDeleteFramebuffers(1, &refractionFrameBuffer);
@@ -208,4 +219,11 @@ void WaterFrameBuffers::resize(int windowWidth, int windowHeight)
     initialiseRefractionFrameBuffer();
 }
 
-
+void WaterFrameBuffers::setDivisor(int newDivisor, int windowWidth, int windowHeight)
+{
+    if (newDivisor == divisor) {
+        return;
+    }
+    divisor = newDivisor;
+    resize(windowWidth, windowHeight);
+}
@@ -20,7 +20,13 @@ public:
     GLuint getReflectionTexture() const { return reflectionTexture; }
     GLuint getRefractionTexture() const { return refractionTexture; }
     GLuint getRefractionDepthTexture() const { return refractionDepthTexture; }
+    // Colour and depth of each view
+    size_t getReflectionBytes() const;
+    size_t getRefractionBytes() const;
+    // Both targets are the window size divided by the divisor (2 by default)
     void resize(int newWidth, int newHeight);
+    void setDivisor(int newDivisor, int windowWidth, int windowHeight);
+    int getDivisor() const { return divisor; }
 
 private:
     GLuint reflectionFrameBuffer;
@@ -36,6 +42,7 @@ private:
     int REFLECTION_HEIGHT;
     int REFRACTION_WIDTH;
     int REFRACTION_HEIGHT;
+    int divisor;
 
     void initialiseReflectionFrameBuffer();
     void initialiseRefractionFrameBuffer();
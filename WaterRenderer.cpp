@@ -1,20 +1,70 @@
 #include "WaterRenderer.hpp"
+#include "Frustum.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // Far plane of the main projection, where the grid's horizon ring sits
+    const float GRID_DISTANCE = 300.0f;
+    const float WAVE_AMPLITUDE = 0.15f;
+    // Largest tile mask side, the texels grow past it
+    const int MAX_TILE_MASK_SIZE = 4096;
+}
 
 WaterRenderer::WaterRenderer(const std::string& vertexShaderPath,
     const std::string& fragmentShaderPath,
-    const glm::mat4& projectionMatrix, const std::string& dudvMapPath, const std::string& normalMapPath)
+    const std::string& dudvMapPath, const std::string& normalMapPath)
 {
-    waterShader.loadShader(vertexShaderPath, fragmentShaderPath, gps::ShaderType::WATER_SHADER);
+    waterShader.loadVariants(vertexShaderPath, fragmentShaderPath, "", gps::ShaderType::WATER_SHADER,
+        gps::FEATURE_SCREEN_SPACE_WATER | gps::FEATURE_PROJECTED_WATER);
+    waterShader.bindUniformBlock("FrameBlock", gps::FRAME_BLOCK_BINDING);
+    waterShader.bindUniformBlock("ViewBlock", gps::VIEW_BLOCK_BINDING);
     setupWaterQuad();
-
-    waterShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(waterShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    setupGrid();
+
+    // Planar units, the screen-space variant reuses 1 and 4 for the scene
+    // colour and depth and adds the skyboxes
+    waterShader.setUniform("reflectionTexture", 0);
+    waterShader.setUniform("refractionTexture", 1);
+    waterShader.setUniform("dudvMap", 2);
+    waterShader.setUniform("normalMap", 3);
+    waterShader.setUniform("depthMap", 4);
+    waterShader.setUniform("sceneColor", 1);
+    waterShader.setUniform("depthPyramid", 4);
+    waterShader.setUniform("daySkybox", 5);
+    waterShader.setUniform("nightSkybox", 6);
+    waterShader.setUniform("tileMask", 7);
+    waterShader.setUniform("textureScale", 1.0f / (2.0f * WaterTile::TILE_SIZE));
+    waterShader.setUniform("tileSize", WaterTile::TILE_SIZE);
+    waterShader.setUniform("gridDistance", GRID_DISTANCE);
+    waterShader.setUniform("waveAmplitude", WAVE_AMPLITUDE);
+
+    // Every variant is linked here, so the per frame uniforms are looked up once
+    for (int i = 0; i < 4; i++) {
+        waterShader.setPassFeatures(((i & 1) ? gps::FEATURE_SCREEN_SPACE_WATER : 0u) |
+            ((i & 2) ? gps::FEATURE_PROJECTED_WATER : 0u));
+        waterShader.useVariant();
+        GLuint program = waterShader.shaderProgram;
+        Locations& variant = locations[i];
+        variant.lightPosition = glGetUniformLocation(program, "lightPosition");
+        variant.lightColor = glGetUniformLocation(program, "lightColor");
+        variant.moveFactor = glGetUniformLocation(program, "moveFactor");
+        variant.reflectionViewProjection = glGetUniformLocation(program, "reflectionViewProjection");
+        variant.refractionViewProjection = glGetUniformLocation(program, "refractionViewProjection");
+        variant.depthPyramidLevels = glGetUniformLocation(program, "depthPyramidLevels");
+        variant.gridInverseViewProjection = glGetUniformLocation(program, "gridInverseViewProjection");
+        variant.gridHeight = glGetUniformLocation(program, "gridHeight");
+    }
 
     dudvMap = loadTexture(dudvMapPath);
 	normalMap = loadTexture(normalMapPath);
+
+    glGenQueries(1, &occlusionQuery);
+    setTiles(std::vector<WaterTile>());
 }
 
 WaterRenderer::~WaterRenderer()
@@ -22,8 +72,180 @@ WaterRenderer::~WaterRenderer()
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(1, &instanceBuffer);
+    glDeleteVertexArrays(1, &gridVAO);
+    glDeleteBuffers(1, &gridVBO);
+    glDeleteBuffers(1, &gridEBO);
+    glDeleteTextures(1, &tileMask);
     glDeleteTextures(1, &dudvMap);
 	glDeleteTextures(1, &normalMap);
+    glDeleteQueries(1, &occlusionQuery);
+    waterShader.deletePrograms();
+}
+
+void WaterRenderer::setTiles(const std::vector<WaterTile>& waterTiles)
+{
+    tiles = waterTiles;
+    visibleInstances.reserve(tiles.size());
+
+    if (tiles.size() > instanceCapacity || instanceBuffer == 0) {
+        instanceCapacity = std::max<size_t>(tiles.size(), 1);
+        if (instanceBuffer == 0) {
+            glGenBuffers(1, &instanceBuffer);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(TileInstance), NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        pointInstanceAttribute(instanceBuffer, 0);
+    }
+
+    buildTileMask();
+}
+
+// Texels whose centre lies on a tile, with a ring of empty texels around
+// so lookups past the edge (clamped) find no water
+void WaterRenderer::buildTileMask()
+{
+    glm::vec2 minBounds(0.0f), maxBounds(0.0f);
+    if (!tiles.empty()) {
+        minBounds = glm::vec2(std::numeric_limits<float>::max());
+        maxBounds = glm::vec2(-std::numeric_limits<float>::max());
+        for (const WaterTile& tile : tiles) {
+            glm::vec2 center(tile.getX(), tile.getZ());
+            minBounds = glm::min(minBounds, center - WaterTile::TILE_SIZE);
+            maxBounds = glm::max(maxBounds, center + WaterTile::TILE_SIZE);
+        }
+    }
+
+    float texelSize = 2.0f * WaterTile::TILE_SIZE / TILE_MASK_TEXELS_PER_TILE;
+    glm::vec2 extent = maxBounds - minBounds;
+    texelSize = std::max(texelSize, std::max(extent.x, extent.y) / (MAX_TILE_MASK_SIZE - 2));
+    glm::vec2 origin = minBounds - texelSize;
+    int width = static_cast<int>(std::ceil(extent.x / texelSize)) + 2;
+    int height = static_cast<int>(std::ceil(extent.y / texelSize)) + 2;
+
+    std::vector<glm::vec2> texels(static_cast<size_t>(width) * height, glm::vec2(0.0f));
+    for (const WaterTile& tile : tiles) {
+        glm::vec2 low = (glm::vec2(tile.getX(), tile.getZ()) - WaterTile::TILE_SIZE - origin) / texelSize;
+        glm::vec2 high = (glm::vec2(tile.getX(), tile.getZ()) + WaterTile::TILE_SIZE - origin) / texelSize;
+        int x0 = std::max(static_cast<int>(std::ceil(low.x - 0.5f)), 0);
+        int x1 = std::min(static_cast<int>(std::floor(high.x - 0.5f)), width - 1);
+        int y0 = std::max(static_cast<int>(std::ceil(low.y - 0.5f)), 0);
+        int y1 = std::min(static_cast<int>(std::floor(high.y - 0.5f)), height - 1);
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                texels[static_cast<size_t>(y) * width + x] = glm::vec2(tile.getHeight(), 1.0f);
+            }
+        }
+    }
+
+    if (tileMask == 0) {
+        glGenTextures(1, &tileMask);
+    }
+    glBindTexture(GL_TEXTURE_2D, tileMask);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, &texels[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    waterShader.setUniform("tileMaskOrigin", origin);
+    waterShader.setUniform("tileMaskScale", glm::vec2(1.0f / (texelSize * width), 1.0f / (texelSize * height)));
+}
+
+size_t WaterRenderer::cull(const glm::mat4& view, const glm::mat4& projection, gps::StreamBuffer* stream)
+{
+    gps::Frustum frustum;
+    frustum.update(view, projection);
+    glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+
+    // The grid's waves rise above and sink below the tile
+    glm::vec3 halfSize(WaterTile::TILE_SIZE, projectedGrid ? WAVE_AMPLITUDE : 0.0f, WaterTile::TILE_SIZE);
+    float nearestDistance = std::numeric_limits<float>::max();
+    visibleInstances.clear();
+    for (const WaterTile& tile : tiles) {
+        glm::vec3 center(tile.getX(), tile.getHeight(), tile.getZ());
+        if (!frustum.isVisible(center - halfSize, center + halfSize)) {
+            continue;
+        }
+        visibleInstances.push_back(TileInstance{ center });
+
+        glm::vec3 closest = glm::clamp(eye, center - halfSize, center + halfSize);
+        float distance = glm::length(closest - eye);
+        if (distance < nearestDistance) {
+            nearestDistance = distance;
+            gridHeight = tile.getHeight();
+        }
+    }
+    visibleCount = visibleInstances.size();
+    gridInverseViewProjection = glm::inverse(projection * view);
+
+    // The grid needs no instances
+    if (visibleCount == 0 || projectedGrid) {
+        return visibleCount;
+    }
+
+    gps::StreamAllocation copy = {};
+    if (stream != nullptr) {
+        copy = stream->allocate(visibleCount * sizeof(TileInstance), sizeof(float));
+    }
+
+    GLuint source = instanceBuffer;
+    GLintptr offset = 0;
+    if (copy.data != nullptr) {
+        std::memcpy(copy.data, &visibleInstances[0], visibleCount * sizeof(TileInstance));
+        stream->commit(copy);
+        source = stream->getBuffer();
+        offset = copy.offset;
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, visibleCount * sizeof(TileInstance), &visibleInstances[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    if (source != instanceSource || offset != instanceOffset) {
+        pointInstanceAttribute(source, offset);
+    }
+    return visibleCount;
+}
+
+void WaterRenderer::pointInstanceAttribute(GLuint buffer, GLintptr offset)
+{
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TileInstance), reinterpret_cast<void*>(offset));
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    instanceSource = buffer;
+    instanceOffset = offset;
+}
+
+bool WaterRenderer::wasVisible()
+{
+    if (queryPending) {
+        GLint available = 0;
+        glGetQueryObjectiv(occlusionQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint passed = 0;
+            glGetQueryObjectuiv(occlusionQuery, GL_QUERY_RESULT, &passed);
+            if (!ignorePending) {
+                visible = passed != 0;
+            }
+            queryPending = false;
+        }
+    }
+    return visible;
+}
+
+void WaterRenderer::resetVisibility()
+{
+    visible = true;
+    ignorePending = queryPending;
 }
 
 GLuint WaterRenderer::loadTexture(const std::string& filepath) {
@@ -63,10 +285,10 @@ GLuint WaterRenderer::loadTexture(const std::string& filepath) {
 void WaterRenderer::setupWaterQuad()
 {
     float vertices[] = {
-        -1.0f, -1.0f,     0.0f, 0.0f,
-         1.0f, -1.0f,     1.0f, 0.0f,
-        -1.0f,  1.0f,     0.0f, 1.0f,
-         1.0f,  1.0f,     1.0f, 1.0f,
+        -1.0f, -1.0f,
+         1.0f, -1.0f,
+        -1.0f,  1.0f,
+         1.0f,  1.0f,
     };
 
     unsigned int indices[] = {
@@ -86,69 +308,155 @@ void WaterRenderer::setupWaterQuad()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
 
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glBindVertexArray(0);
+}
+
+// Screen space positions a little past the edges, so waves lowering the
+// border vertices do not open a gap
+void WaterRenderer::setupGrid()
+{
+    const int side = GRID_RESOLUTION + 1;
+    const float extent = 1.1f;
+    std::vector<float> vertices;
+    vertices.reserve(side * side * 2);
+    for (int y = 0; y < side; y++) {
+        for (int x = 0; x < side; x++) {
+            vertices.push_back((2.0f * x / GRID_RESOLUTION - 1.0f) * extent);
+            vertices.push_back((2.0f * y / GRID_RESOLUTION - 1.0f) * extent);
+        }
+    }
+
+    std::vector<unsigned int> indices;
+    indices.reserve(GRID_RESOLUTION * GRID_RESOLUTION * 6);
+    for (int y = 0; y < GRID_RESOLUTION; y++) {
+        for (int x = 0; x < GRID_RESOLUTION; x++) {
+            unsigned int corner = y * side + x;
+            indices.insert(indices.end(), { corner, corner + side, corner + 1, corner + 1, corner + side, corner + side + 1 });
+        }
+    }
+    gridIndexCount = static_cast<GLsizei>(indices.size());
+
+    glGenVertexArrays(1, &gridVAO);
+    glBindVertexArray(gridVAO);
+
+    glGenBuffers(1, &gridVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, gridVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+
+    glGenBuffers(1, &gridEBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
 
     glBindVertexArray(0);
 }
 
+const WaterRenderer::Locations& WaterRenderer::useVariant(unsigned int features)
+{
+    if (projectedGrid) {
+        features |= gps::FEATURE_PROJECTED_WATER;
+    }
+    waterShader.setPassFeatures(features);
+    waterShader.useVariant();
+    return locations[((features & gps::FEATURE_SCREEN_SPACE_WATER) ? 1 : 0) |
+        ((features & gps::FEATURE_PROJECTED_WATER) ? 2 : 0)];
+}
 
-void WaterRenderer::render(const std::vector<WaterTile>& waterTiles, const glm::mat4& viewMatrix,
-	const glm::vec3& cameraPosition, GLuint reflectionTexture, GLuint refractionTexture, GLuint depthTexture,
+void WaterRenderer::render(GLuint reflectionTexture, GLuint refractionTexture, GLuint depthTexture,
+    const glm::mat4& reflectionViewProjection, const glm::mat4& refractionViewProjection,
     double deltaTime, const glm::vec3& lightPosition, const glm::vec3& lightColor)
 {
-    waterShader.useShaderProgram();
-
-    glBindVertexArray(VAO);
-
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    const Locations& variant = useVariant(0);
+    glUniformMatrix4fv(variant.reflectionViewProjection, 1, GL_FALSE, glm::value_ptr(reflectionViewProjection));
+    glUniformMatrix4fv(variant.refractionViewProjection, 1, GL_FALSE, glm::value_ptr(refractionViewProjection));
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-    glUniform1i(glGetUniformLocation(waterShader.shaderProgram, "reflectionTexture"), 0);
 
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, refractionTexture);
-    glUniform1i(glGetUniformLocation(waterShader.shaderProgram, "refractionTexture"), 1);
-
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, dudvMap);
-    glUniform1i(glGetUniformLocation(waterShader.shaderProgram, "dudvMap"), 2);
-
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
-    glUniform1i(glGetUniformLocation(waterShader.shaderProgram, "normalMap"), 3);
 
 	glActiveTexture(GL_TEXTURE4);
 	glBindTexture(GL_TEXTURE_2D, depthTexture);
-	glUniform1i(glGetUniformLocation(waterShader.shaderProgram, "depthMap"), 4);
 
+    drawTiles(variant, deltaTime, lightPosition, lightColor);
+}
+
+void WaterRenderer::renderScreenSpace(const gps::SceneCopy& sceneCopy, GLuint daySkybox, GLuint nightSkybox,
+    double deltaTime, const glm::vec3& lightPosition, const glm::vec3& lightColor)
+{
+    const Locations& variant = useVariant(gps::FEATURE_SCREEN_SPACE_WATER);
+    glUniform1i(variant.depthPyramidLevels, sceneCopy.getLevelCount());
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, sceneCopy.getColor());
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, sceneCopy.getDepthPyramid());
+
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, daySkybox);
+
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, nightSkybox);
+
+    drawTiles(variant, deltaTime, lightPosition, lightColor);
+}
+
+void WaterRenderer::drawTiles(const Locations& variant, double deltaTime,
+    const glm::vec3& lightPosition, const glm::vec3& lightColor)
+{
     moveFactor += waveSpeed * deltaTime;
     moveFactor = fmod(moveFactor, 1.0f);
+    if (visibleCount == 0) {
+        glActiveTexture(GL_TEXTURE0);
+        return;
+    }
 
-    glUniform1f(glGetUniformLocation(waterShader.shaderProgram, "moveFactor"), moveFactor);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, dudvMap);
 
-    glUniform3fv(glGetUniformLocation(waterShader.shaderProgram, "cameraPos"), 1, glm::value_ptr(cameraPosition));
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, normalMap);
 
-    glUniform3fv(glGetUniformLocation(waterShader.shaderProgram, "lightPosition"), 1, glm::value_ptr(lightPosition));
+    glUniform1f(variant.moveFactor, moveFactor);
+    glUniform3fv(variant.lightPosition, 1, glm::value_ptr(lightPosition));
+    glUniform3fv(variant.lightColor, 1, glm::value_ptr(lightColor));
 
-    glUniform3fv(glGetUniformLocation(waterShader.shaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
+    // Only one query in flight, the result is read back frames later
+    bool querying = !queryPending;
+    if (querying) {
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, occlusionQuery);
+        ignorePending = false;
+    }
 
-    for (const auto& tile : waterTiles) {
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(tile.x, tile.height, tile.z));
-        model = glm::scale(model, glm::vec3(WaterTile::TILE_SIZE));
+    if (projectedGrid) {
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, tileMask);
+        glUniformMatrix4fv(variant.gridInverseViewProjection, 1, GL_FALSE, glm::value_ptr(gridInverseViewProjection));
+        glUniform1f(variant.gridHeight, gridHeight);
 
-        glUniformMatrix4fv(glGetUniformLocation(waterShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        glUniformMatrix4fv(glGetUniformLocation(waterShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+        glBindVertexArray(gridVAO);
+        glDrawElements(GL_TRIANGLES, gridIndexCount, GL_UNSIGNED_INT, 0);
+    }
+    else {
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(visibleCount));
+    }
 
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    if (querying) {
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        queryPending = true;
     }
 
     glDisable(GL_BLEND);
     glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
 }
-
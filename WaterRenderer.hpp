@@ -3,31 +3,124 @@
 
 #include <vector>
 #include "glm/glm.hpp"
+#include "SceneCopy.hpp"
 #include "Shader.hpp"
+#include "StreamBuffer.hpp"
+#include "UniformBlocks.hpp"
 #include "WaterTile.hpp"
 #include "stb_image.h"
 
+// Draws the water tiles in one call: either every tile in view as an
+// instance of one quad, or (projected grid) a single grid spanning the
+// screen whose vertices are moved onto the water plane, so they are dense
+// near the camera and sparse towards the horizon, and carry geometric
+// waves. The grid covers the whole plane; a mask with one texel per quarter
+// tile keeps only the fragments over a tile and gives each vertex its
+// tile's height.
 class WaterRenderer {
 public:
     WaterRenderer(const std::string& vertexShaderPath,
         const std::string& fragmentShaderPath,
-        const glm::mat4& projectionMatrix, const std::string& dudvMapPath, const std::string& normalMapPath);
+        const std::string& dudvMapPath, const std::string& normalMapPath);
     ~WaterRenderer();
 
-    void render(const std::vector<WaterTile>& waterTiles, const glm::mat4& viewMatrix,
-		const glm::vec3& cameraPosition, GLuint reflectionTexture, GLuint refractionTexture, GLuint depthTexture,
+    // Call again whenever the tiles change
+    void setTiles(const std::vector<WaterTile>& waterTiles);
+
+    // Once per frame, before the water passes and draws: culls the tiles
+    // against the camera and uploads those in view as instances (through
+    // the stream buffer when given). Returns how many are in view.
+    size_t cull(const glm::mat4& view, const glm::mat4& projection, gps::StreamBuffer* stream);
+    size_t getVisibleCount() const { return visibleCount; }
+    size_t getTileCount() const { return tiles.size(); }
+
+    void setProjectedGrid(bool enabled) { projectedGrid = enabled; }
+    bool isProjectedGrid() const { return projectedGrid; }
+
+    // View, projection and camera position come from the bound ViewBlock.
+    // The textures are looked up by projecting the water with the view
+    // projection each was rendered with, so one rendered a few frames ago
+    // still lines up (reprojection).
+    void render(GLuint reflectionTexture, GLuint refractionTexture, GLuint depthTexture,
+        const glm::mat4& reflectionViewProjection, const glm::mat4& refractionViewProjection,
         double deltaTime, const glm::vec3& lightPosition, const glm::vec3& lightColor);
 
+    // Reflection traced through the scene copy's depth pyramid, falling
+    // back to the day/night sky cubemaps where the ray leaves the screen or
+    // hits nothing; refraction is the copied colour below the surface. Needs
+    // the frame block and the main view block bound, and no earlier passes.
+    void renderScreenSpace(const gps::SceneCopy& sceneCopy, GLuint daySkybox, GLuint nightSkybox,
+        double deltaTime, const glm::vec3& lightPosition, const glm::vec3& lightColor);
+
+    // Whether any water sample passed the depth test in the latest render
+    // whose occlusion query has finished. True until one has.
+    bool wasVisible();
+    // Forget the last result, e.g. after frames without a render. A query
+    // still in flight is dropped too, only one issued afterwards counts.
+    void resetVisibility();
+
     GLuint loadTexture(const std::string& filepath);
 
 private:
+    // One per variant, every combination is compiled up front
+    struct Locations {
+        GLint lightPosition;
+        GLint lightColor;
+        GLint moveFactor;
+        GLint reflectionViewProjection;
+        GLint refractionViewProjection;
+        GLint depthPyramidLevels;
+        GLint gridInverseViewProjection;
+        GLint gridHeight;
+    };
+
+    // Per instance, read by water.vert at attribute 1
+    struct TileInstance {
+        glm::vec3 center;
+    };
+
+    static const int GRID_RESOLUTION = 160;
+    static const int TILE_MASK_TEXELS_PER_TILE = 4;
+
     void setupWaterQuad();
+    void setupGrid();
+    void buildTileMask();
+    void pointInstanceAttribute(GLuint buffer, GLintptr offset);
+    // Makes the variant current and returns its locations
+    const Locations& useVariant(unsigned int features);
+    // Shared by both modes, the textures are already bound
+    void drawTiles(const Locations& locations, double deltaTime,
+        const glm::vec3& lightPosition, const glm::vec3& lightColor);
 
+    // Planar or FEATURE_SCREEN_SPACE_WATER, each flat or FEATURE_PROJECTED_WATER
     gps::Shader waterShader;
+    Locations locations[4];
     unsigned int VAO, VBO, EBO;
     GLuint dudvMap;
 	GLuint normalMap;
 
+    std::vector<WaterTile> tiles;
+    std::vector<TileInstance> visibleInstances;
+    size_t visibleCount = 0;
+    GLuint instanceBuffer = 0;
+    size_t instanceCapacity = 0;
+    GLuint instanceSource = 0;
+    GLintptr instanceOffset = -1;
+
+    bool projectedGrid = false;
+    unsigned int gridVAO = 0, gridVBO = 0, gridEBO = 0;
+    GLsizei gridIndexCount = 0;
+    glm::mat4 gridInverseViewProjection = glm::mat4(1.0f);
+    // Height of the visible tile nearest the camera
+    float gridHeight = 0.0f;
+    GLuint tileMask = 0;
+
+    GLuint occlusionQuery = 0;
+    bool queryPending = false;
+    // The pending query predates resetVisibility, its result is dropped
+    bool ignorePending = false;
+    bool visible = true;
+
     float waveSpeed = 0.03f;
     float moveFactor = 0.0f;
 };
@@ -0,0 +1,102 @@
+#include "WindDeformer.hpp"
+
+namespace gps {
+
+    WindDeformer::WindDeformer()
+        : simplifyDistance(40.0f), freezeDistance(120.0f), simplifiedInterval(4),
+        frame(0), lastWindEnabled(false), forceUpdate(true),
+        updatedCount(0), skippedCount(0) {
+    }
+
+    void WindDeformer::init(const UniformBlocks& uniformBlocks) {
+        deformShader.setTransformFeedbackVaryings({ "displacedPosition" });
+        deformShader.loadVariants(
+            "shaders/windDeform.vert",
+            "",
+            "",
+            DEFORM_SHADER,
+            FEATURE_WIND | FEATURE_WIND_MOVABLE | FEATURE_GRASS | FEATURE_FERN
+        );
+        uniformBlocks.attach(deformShader);
+
+        timer.init();
+    }
+
+    void WindDeformer::cleanup() {
+        deformShader.deletePrograms();
+        timer.cleanup();
+    }
+
+    void WindDeformer::update(std::vector<MeshBatch>& batches, const glm::vec3& cameraPosition, bool windEnabled) {
+        updatedCount = 0;
+        skippedCount = 0;
+        frame++;
+
+        // Toggling the wind resets every batch, frozen ones included; with the
+        // wind off the rest pose stays in place and nothing needs updating
+        if (windEnabled != lastWindEnabled) {
+            lastWindEnabled = windEnabled;
+            forceUpdate = true;
+        }
+        if (!windEnabled && !forceUpdate) {
+            for (MeshBatch& batch : batches) {
+                if (batch.windVBO != 0) {
+                    batch.holdWindPose();
+                }
+            }
+            return;
+        }
+
+        deformShader.setPassFeatures(windEnabled ? static_cast<unsigned int>(FEATURE_WIND) : 0u);
+
+        timer.begin();
+
+        glEnable(GL_RASTERIZER_DISCARD);
+
+        for (size_t i = 0; i < batches.size(); i++) {
+            MeshBatch& batch = batches[i];
+            if (batch.windVBO == 0) {
+                continue;
+            }
+
+            if (!forceUpdate) {
+                glm::vec3 closest = glm::clamp(cameraPosition, batch.minBounds, batch.maxBounds);
+                float distance = glm::length(closest - cameraPosition);
+                bool skip = distance > freezeDistance ||
+                    (distance > simplifyDistance && (frame + i) % simplifiedInterval != 0);
+                if (skip) {
+                    batch.holdWindPose();
+                    skippedCount++;
+                    continue;
+                }
+            }
+
+            unsigned int materialFeatures = FEATURE_WIND_MOVABLE;
+            if (batch.isGrass) {
+                materialFeatures |= FEATURE_GRASS;
+            }
+            else if (batch.isFern) {
+                materialFeatures |= FEATURE_FERN;
+            }
+            deformShader.useVariant(materialFeatures);
+
+            batch.swapWindBuffers();
+            glBindVertexArray(batch.windSourceVAO);
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, batch.windVBO);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(batch.vertices.size()));
+            glEndTransformFeedback();
+
+            updatedCount++;
+        }
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        timer.end();
+
+        forceUpdate = false;
+    }
+
+}
@@ -0,0 +1,68 @@
+#ifndef WindDeformer_hpp
+#define WindDeformer_hpp
+
+#if defined (__APPLE__)
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#else
+#define GLEW_STATIC
+#include "GL/glew.h"
+#endif
+
+#include "glm/glm.hpp"
+#include "Shader.hpp"
+#include "MeshBatch.hpp"
+#include "UniformBlocks.hpp"
+#include "GpuTimer.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Evaluates the vegetation sway once per frame with transform feedback,
+    // writing every wind movable batch's windVBO. All passes then draw the
+    // displaced positions instead of running the noise per pass. The pose it
+    // replaces is kept as the batch's previous pose for motion vectors.
+    //
+    // Animation LOD, by distance from the camera to the batch bounds:
+    //   < simplifyDistance : updated every frame
+    //   < freezeDistance   : updated every simplifiedInterval frames (staggered)
+    //   beyond             : frozen in its last pose
+    class WindDeformer {
+
+    public:
+        WindDeformer();
+
+        void init(const UniformBlocks& uniformBlocks);
+        void cleanup();
+
+        // cameraPosition is in the batches' object space. Reads the frame and
+        // wind blocks, so call it after they were flushed.
+        void update(std::vector<MeshBatch>& batches, const glm::vec3& cameraPosition, bool windEnabled);
+
+        float simplifyDistance;
+        float freezeDistance;
+        unsigned int simplifiedInterval;
+
+        // Batches written by the last update / skipped by the LOD
+        unsigned int getUpdatedCount() const { return updatedCount; }
+        unsigned int getSkippedCount() const { return skippedCount; }
+        // GPU time of the most recent update that has finished, in ms
+        double getGpuMs() const { return timer.getGpuMs(); }
+
+    private:
+        Shader deformShader;
+
+        GpuTimer timer;
+
+        unsigned int frame;
+        bool lastWindEnabled;
+        bool forceUpdate;
+
+        unsigned int updatedCount;
+        unsigned int skippedCount;
+    };
+
+}
+
+#endif
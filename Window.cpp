@@ -1,5 +1,13 @@
 #include "Window.h"
 
+#if defined (__linux__)
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <string>
+
 namespace gps {
 
     void Window::Create(int width, int height, const char* title) {
@@ -28,22 +36,127 @@ namespace gps {
         glewInit();
 #endif
 
-        const GLubyte* renderer = glGetString(GL_RENDERER);
-        const GLubyte* version = glGetString(GL_VERSION);
-        std::cout << "Renderer: " << renderer << std::endl;
-        std::cout << "OpenGL version: " << version << std::endl;
+        printContext();
 
         glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
         glViewport(0, 0, dimensions.width, dimensions.height);
     }
 
+#if defined (__linux__)
+    void Window::CreateOffscreen(int width, int height) {
+        // The null platform needs no display and still keeps time
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+        if (!glfwInit()) {
+            throw std::runtime_error("Could not start GLFW3!");
+        }
+
+        EGLDisplay display = EGL_NO_DISPLAY;
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (clientExtensions != nullptr && std::string(clientExtensions).find("EGL_MESA_platform_surfaceless") != std::string::npos &&
+            getPlatformDisplay != nullptr) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            throw std::runtime_error("Could not initialise EGL!");
+        }
+        eglDisplay = display;
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            throw std::runtime_error("No EGL pbuffer config!");
+        }
+
+        const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+        EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+        if (surface == EGL_NO_SURFACE) {
+            throw std::runtime_error("Could not create EGL pbuffer!");
+        }
+        eglSurface = surface;
+
+        // Same context as Create asks GLFW for
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 1,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+            EGL_NONE
+        };
+        EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+            throw std::runtime_error("Could not create an OpenGL 4.1 EGL context!");
+        }
+        eglContext = context;
+        eglSwapInterval(display, 0);
+
+        // Without a GLX display glewInit reports so once the GL entry
+        // points are loaded, which is all that is needed here
+        glewExperimental = GL_TRUE;
+        if (glewInit() == GLEW_ERROR_NO_GL_VERSION) {
+            throw std::runtime_error("Could not load OpenGL with GLEW!");
+        }
+        glGetError();
+
+        printContext();
+
+        this->dimensions.width = width;
+        this->dimensions.height = height;
+        glViewport(0, 0, width, height);
+    }
+#else
+    void Window::CreateOffscreen(int width, int height) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_SCALE_TO_MONITOR, GLFW_FALSE);
+        Create(width, height, "OpenGL Forest benchmark");
+        glfwSwapInterval(0);
+    }
+#endif
+
+    void Window::printContext() {
+        const GLubyte* renderer = glGetString(GL_RENDERER);
+        const GLubyte* version = glGetString(GL_VERSION);
+        std::cout << "Renderer: " << renderer << std::endl;
+        std::cout << "OpenGL version: " << version << std::endl;
+    }
 
     void Window::Delete() {
         if (window)
             glfwDestroyWindow(window);
+#if defined (__linux__)
+        if (eglDisplay != nullptr) {
+            eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (eglContext != nullptr) eglDestroyContext(eglDisplay, eglContext);
+            if (eglSurface != nullptr) eglDestroySurface(eglDisplay, eglSurface);
+            eglTerminate(eglDisplay);
+            eglDisplay = eglSurface = eglContext = nullptr;
+        }
+#endif
         glfwTerminate();
     }
 
+    void Window::swapBuffers() {
+#if defined (__linux__)
+        if (eglDisplay != nullptr) {
+            eglSwapBuffers(eglDisplay, eglSurface);
+            return;
+        }
+#endif
+        glfwSwapBuffers(window);
+    }
+
     GLFWwindow* Window::getWindow() {
         return this->window;
     }
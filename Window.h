@@ -25,15 +25,29 @@ namespace gps {
 
     public:
         void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // No window: an EGL pbuffer on Mesa's surfaceless platform on Linux,
+        // so it runs without a display (llvmpipe on CI), and a hidden GLFW
+        // window elsewhere. GLFW is still initialised, for its timer.
+        void CreateOffscreen(int width, int height);
         void Delete();
 
+        // Either kind
+        void swapBuffers();
+
+        // Null for an EGL context
         GLFWwindow* getWindow();
         WindowDimensions getWindowDimensions();
         void setWindowDimensions(WindowDimensions dimensions);
 
     private:
+        void printContext();
+
         WindowDimensions dimensions;
-        GLFWwindow *window;
+        GLFWwindow *window = nullptr;
+        // EGLDisplay, EGLSurface and EGLContext, kept out of this header
+        void *eglDisplay = nullptr;
+        void *eglSurface = nullptr;
+        void *eglContext = nullptr;
     };
 }
 
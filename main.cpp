@@ -24,10 +24,32 @@
 #include "WaterTile.hpp"
 #include "WaterRenderer.hpp"
 #include "WaterFrameBuffers.hpp"
+#include "ThreadPool.hpp"
+#include "ClusteredLights.hpp"
+#include "UniformBlocks.hpp"
+#include "ProgramCache.hpp"
+#include "WindDeformer.hpp"
+#include "RainSimulation.hpp"
+#include "FireParticles.hpp"
+#include "GpuFireParticles.hpp"
+#include "StreamBuffer.hpp"
+#include "ParticleCompositor.hpp"
+#include "SceneCopy.hpp"
+#include "BloomChain.hpp"
+#include "DynamicResolution.hpp"
+#include "TemporalAA.hpp"
+#include "RenderGraph.hpp"
+#include "ParticleBudget.hpp"
+#include "ViewQuality.hpp"
+#include "GpuTimer.hpp"
+#include "Benchmarks.hpp"
+#include "Profiler.hpp"
+#include "TourPath.hpp"
 
 #include "AudioManager.h"
 
 #include <iostream>
+#include <chrono>
 #include <cmath>
 #include <ctime>
 #include <cstdlib>
@@ -71,189 +93,30 @@ GLenum currentPolygonMode;
 GLint polygonModeParams[2];
 
 //structs
-struct DirectionalLightUniforms {
-    GLint direction;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    GLint color;
-    GLint enabled;
-};
-
-struct FlashLightUniforms {
-    GLint direction;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    GLint color;
-    GLint enabled;
-};
-
-struct PointLightUniforms {
-    GLint position;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    GLint color;
-    GLint constant;
-    GLint linear;
-    GLint quadratic;
-    GLint enabled;
-};
-
-struct SpotLightUniforms {
-    GLint position;
-    GLint direction;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    GLint color;
-    GLint cutOff;
-    GLint outerCutOff;
-    GLint enabled;
-};
-
-struct HeadlightUniforms {
-    GLint position;
-    GLint direction;
-    GLint ambient;
-    GLint diffuse;
-    GLint specular;
-    GLint color;
-    GLint cutOff;
-    GLint outerCutOff;
-    GLint enabled;
-};
-
-struct BasicShaderUniforms {
-    GLint view;
-    GLint projection;
-    GLint viewPosition;
-    GLint model;
-    GLint clipPlane;
-    GLint u_Time;
-    GLint u_WindDirection;
-    GLint u_WindStrength;
-    GLint u_GustSize;
-	GLint u_GustSpeed;
-    GLint u_WindWaveLength;
-    GLint useNormalMapping;
-    GLint rainEnabled;
-    GLint windEnabled;
-    GLint fogEnabled;
-    GLint fogColor;
-    GLint gFogEnd;
-	GLint gLayeredFogTop;
-    GLint gFogTime;
-	GLint gExpFogDensity;
-    GLint globalLightIntensity;
-
-    // Lights
-    DirectionalLightUniforms dirLight;
-    FlashLightUniforms flashLight;
-    PointLightUniforms pointLight;
-    SpotLightUniforms spotLight;
-    HeadlightUniforms leftHeadlight;
-    HeadlightUniforms rightHeadlight;
-
-    //Shadows
-	GLint lightSpaceMatrix;
-	GLint leftHeadlightLightSpaceMatrix;
-	GLint rightHeadlightLightSpaceMatrix;
-    GLint shadowMap;
-	GLint pointLightShadowMap;
-	GLint leftHeadlightShadowMap;
-	GLint rightHeadlightShadowMap;
-    GLint farPlane;
-};
-
-struct RainShaderUniforms {
-    GLint view;
-    GLint projection;
-    GLint viewPosition;
-
-    DirectionalLightUniforms dirLight;
-    FlashLightUniforms flashLight;
-    PointLightUniforms pointLight;
-    SpotLightUniforms spotLight;
-    HeadlightUniforms leftHeadlight;
-    HeadlightUniforms rightHeadlight;
-
-    GLint environmentMap;
-
-    GLint shininess;
-    GLint maxDistance;
-    GLint motionBlurIntensity;
-};
-
 struct FireShaderUniforms {
-    GLint view;
-    GLint projection;
-    GLint viewPosition;
-    GLint cameraRight;
-    GLint cameraUp;
-    GLint time;
     GLint flameAspectX;
     GLint flameAspectY;
     GLint fireTextureArray;
 };
 
-struct ShadowShaderUniforms {
-    GLint model;
-    GLint lightSpaceMatrix;
-    GLint u_Time;
-    GLint u_WindDirection;
-    GLint u_WindStrength;
-    GLint u_GustSize;
-    GLint u_GustSpeed;
-    GLint u_WindWaveLength;
-    GLint windEnabled;
-};
-
-struct PointShadowShaderUniforms {
-    GLint model;
-    GLint shadowMatrices[6];
-    GLint far_plane;
-    GLint lightPos;
-    GLint u_Time;
-    GLint u_WindDirection;
-    GLint u_WindStrength;
-    GLint u_GustSize;
-    GLint u_GustSpeed;
-    GLint u_WindWaveLength;
-    GLint windEnabled;
-};
-
-struct HeadShadowShaderUniforms {
-    GLint model;
-    GLint lightSpaceMatrixHead;
-    GLint u_Time;
-    GLint u_WindDirection;
-    GLint u_WindStrength;
-    GLint u_GustSize;
-    GLint u_GustSpeed;
-    GLint u_WindWaveLength;
-    GLint windEnabled;
-};
-
 struct HDRShaderUniforms {
     GLint hdrBuffer;
     GLint bloomBlur;
     GLint bloom;
+    GLint bloomScale;
     GLint exposure;
+    GLint renderScale;
+    GLint sharpness;
 };
 
 struct BlurShaderUniforms {
     GLint horizontal;
+    GLint sourceScale;
 };
 
 struct SkyboxShaderUniforms {
-    GLint view;
-    GLint projection;
-    GLint viewPosition;
     GLint daySkybox;
     GLint nightSkybox;
-    GLint blendFactor;
 };
 
 struct AppState {
@@ -298,19 +161,6 @@ struct SpotLight {
     bool enabled;
 };
 
-struct FireParticle {
-    glm::vec3 position;
-    glm::vec3 velocity;
-    glm::vec4 color;
-    float life;
-    float size;
-    float initialLife;
-    float rotation;
-    float rotationSpeed;
-    int type;
-    int textureIndex;
-};
-
 struct IntensityPulse {
     float duration;
     float timer;
@@ -324,13 +174,8 @@ struct Location {
 };
 
 //instances
-RainShaderUniforms rainUniforms;
-BasicShaderUniforms basicUniforms;
 
 FireShaderUniforms fireUniforms;
-ShadowShaderUniforms shadowUniforms;
-PointShadowShaderUniforms pointShadowUniforms;
-HeadShadowShaderUniforms headShadowUniforms;
 HDRShaderUniforms hdrUniforms;
 BlurShaderUniforms blurUniforms;
 SkyboxShaderUniforms skyboxUniforms;
@@ -401,7 +246,6 @@ SpotLight rightHeadlight = {
     true
 };
 
-std::vector<FireParticle> fireParticles;
 std::vector<IntensityPulse> activePulses;
 AudioManager audioManager;
 
@@ -449,12 +293,17 @@ glm::vec3 nightDirection = glm::vec3(0.0f, -1.0f, 0.1f);
 bool useNormalMapping = true;
 
 
-//tour
+//tour: keyLocations are the recorded waypoints, tourPath is built from
+//them when a tour starts and played at TOUR_SPEED world units per second
 std::vector<Location> keyLocations;
 bool isTourActive = false;
-size_t currentWaypoint = 0;
-float t = 0.0f;
-const float tIncrement = 0.005f;
+gps::TourPath tourPath;
+float tourDistance = 0.0f;
+const float TOUR_SPEED = 15.0f;
+
+//random: rain, fire and rand() start from this, the clock unless --benchmark
+unsigned int randomSeed = static_cast<unsigned int>(time(nullptr));
+
 float blend = 1.0f;
 float transitionDuration = 3.0f;
 float transitionStartTime = 0.0f;
@@ -469,33 +318,29 @@ bool removeKeyPressed = false;
 
 
 //rain
-#define GRAVITY -4.905f
-#define TERMINAL_VELOCITY -25.0f
-GLuint rainVAO, rainVBO, rainParamsVBO;
-std::vector<glm::vec2> raindropParams;
-std::vector<glm::vec3> raindrops, raindropsVelocity;
+gps::RainSimulation rainSimulation;
 const int NUM_RAINDROPS = 1000000;
+// The CPU drops fill this square around the origin; rain.vert fades them out
+// by RAIN_VISIBLE_DISTANCE, so only the part within that of the camera spawns
+const float RAIN_HALF_EXTENT = 100.0f;
+const float RAIN_VISIBLE_DISTANCE = 50.0f;
+// Procedural density before the particle budget scales it
+float rainProceduralDensity = 0.0f;
 bool rainEnabled = false;
 bool rainPlaying = false;
-float rainMinX = -100.0f;
-float rainMaxX = 100.0f;
-float rainMinZ = -100.0f;
-float rainMaxZ = 100.0f;
-float rainTopY = 25.0f;
-float rainBottomY = -1.0f;
+// Drops computed in rain.vert from their ID and the time, no per-frame upload
+bool rainProcedural = true;
 
 //fire
-const GLfloat quad2Vertices[] = {
-    -0.5f, -0.5f,   0.0f, 0.0f,
-     0.5f, -0.5f,   1.0f, 0.0f,
-     0.5f,  0.5f,   1.0f, 1.0f,
-
-    -0.5f, -0.5f,   0.0f, 0.0f,
-     0.5f,  0.5f,   1.0f, 1.0f,
-    -0.5f,  0.5f,   0.0f, 1.0f
-};
+gps::FireParticles fireParticles;
+// Compute shader fire (GL 4.3+), same population plus room for ember sparks
+// unless --gpu-fire sizes it
+gps::GpuFireParticles gpuFireParticles;
+gps::GpuFireOptions gpuFireOptions;
+bool fireOnGpu = false;
+// Smoke sorted again for the mirrored camera instead of reusing the main order
+bool smokeReflectionSorted = false;
 GLuint fireTextureArray;
-GLuint quad2VAO, quad2VBO, instanceVBO;
 bool firePlaying = false;
 const float FLICKER_BASE_FREQUENCY = 5.0f;
 const float FLICKER_AMPLITUDE_AMBIENT = 0.05f;
@@ -505,12 +350,6 @@ const float FLICKER_RANDOMNESS = 0.02f;
 const int MAX_FIRE_PARTICLES = 10000;
 const int MAX_SMOKE_PARTICLES = 4000;
 const int MAX_EMBER_PARTICLES = 1000;
-const int MAX_TOTAL_PARTICLES = MAX_FIRE_PARTICLES + MAX_SMOKE_PARTICLES + MAX_EMBER_PARTICLES;
-float spawnRadius = 0.2f;
-float minUpVelocity = 1.8f;
-float maxUpVelocity = 2.6f;
-float minHorizontalVel = -0.15f;
-float maxHorizontalVel = 0.15f;
 
 //wind
 bool windEnabled = false;
@@ -535,18 +374,38 @@ float pulseIntervalMax = 0.3f;
 float timeSinceLastPulse = 0.0f;
 
 //shadows
-GLuint shadowMapFBO, depthMap;
-GLuint pointLightFBO, depthCubemap;
-GLuint leftHeadlightFBO, leftHeadlightDepthMap;
-GLuint rightHeadlightFBO, rightHeadlightDepthMap;
 const GLuint SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
 const GLuint SPOT_LIGHT_SHADOW_WIDTH = 1024, SPOT_LIGHT_SHADOW_HEIGHT = 1024;
 const GLuint POINT_SHADOW_WIDTH = 1024, POINT_SHADOW_HEIGHT = 1024;
 glm::mat4 lightProjection, lightView;
 glm::mat4 lightSpaceMatrix;
+// This frame's shadow maps in the render graph
+struct ShadowMaps {
+    gps::RenderGraph::Resource directional;
+    gps::RenderGraph::Resource point;
+    gps::RenderGraph::Resource leftHeadlight;
+    gps::RenderGraph::Resource rightHeadlight;
+};
+
+//render graph: the shadow maps, the HDR scene targets and the ping-pong
+//blur are its transient textures, declared every frame in renderScene
+gps::RenderGraph renderGraph;
+bool renderGraphDumpRequested = false;
+
+//profiler: CPU zones in the update and render functions, GPU zones around
+//the graph's passes. F10 writes a Chrome trace of the last frames, Shift+F10
+//a CSV, both with the percentile report on the console.
+gps::Profiler profiler;
+// What the particle compositor and the scene copy were last given; the
+// graph may hand the main pass other textures from one frame to the next
+struct SceneTargets {
+    GLuint framebuffer;
+    GLuint color, bright, depth;
+    glm::ivec2 size;
+};
+SceneTargets attachedSceneTargets = {};
 
 //hdr
-GLuint hdrFBO, colorBuffer, rbo;
 GLuint quadVAO = 0;
 GLuint quadVBO;
 bool hdrEnabled = true;
@@ -554,12 +413,71 @@ bool performHDR = true;
 float exposure = 1.0f;
 
 //bloom
-GLuint colorBuffers[2];
-GLuint pingpongFBO[2];
-GLuint pingpongColorbuffers[2];
 bool bloomEnabled = false;
 bool bloomKeyPressed = false;
 unsigned int blurIterations = 10;
+gps::GpuTimer pingpongTimer;
+// Half resolution downsample chain; the full resolution ping-pong blur is
+// kept to compare against
+gps::BloomChain bloomChain;
+bool bloomMipChain = true;
+
+//dynamic resolution (HDR only): the main pass draws into the lower left part
+//of the HDR targets, which stay window sized, and hdr.frag upscales it
+gps::DynamicResolution dynamicResolution;
+bool dynamicResolutionEnabled = true;
+const float upscaleSharpness = 0.5f;
+// Of the window, before dynamic resolution scales it further
+const float internalResolutionSteps[] = { 1.0f, 0.75f, 0.5f };
+int internalResolutionStep = 0;
+
+//temporal anti-aliasing (HDR only): the main pass is jittered and writes
+//motion vectors, the resolve upsamples it into a window sized history that
+//hdr.frag tonemaps in place of the scene
+gps::TemporalAA temporalAA;
+bool temporalAAEnabled = true;
+bool performTemporalAA = true;
+
+//reduced resolution particles (main pass, HDR only)
+gps::ParticleCompositor particleCompositor;
+const int particleDivisorSteps[] = { 1, 2, 4 };
+int fireDivisorStep = 0;
+int rainDivisorStep = 0;
+
+//particle budget, fire and rain counts follow their screen coverage
+gps::ParticleBudget particleBudget;
+int fireEmitter = 0;
+int rainEmitter = 0;
+// Particles simulated per frame over both, 0 for no limit
+const size_t particleBudgetSteps[] = { 0, 300000, 100000, 30000 };
+int particleBudgetStep = 0;
+
+//shared uniform blocks
+gps::UniformBlocks uniformBlocks;
+
+//per frame uploads (rain heights, fire instances, uniform blocks)
+gps::StreamBuffer streamBuffer;
+
+//program binaries from previous runs
+gps::ProgramCache programCache;
+double shaderIssueSeconds = 0.0;
+
+//shader variants
+const unsigned int ALL_BASIC_FEATURES = ((1u << gps::FEATURE_COUNT) - 1) &
+    ~(gps::FEATURE_WIND_MOVABLE | gps::FEATURE_GRASS | gps::FEATURE_FERN);
+const unsigned int SHADOW_FEATURES = 0;
+
+//vegetation sway, evaluated once per frame for every pass
+gps::WindDeformer windDeformer;
+
+//clustered lights
+gps::ThreadPool workerPool;
+gps::ClusteredLights clusteredLights;
+std::vector<glm::vec3> clusteredLightAnchors;
+const int clusteredLightSteps[] = { 0, 1, 10, 100, 250, 500, 1000 };
+int clusteredLightStep = 0;
+bool clusteredLightsKeyPressed = false;
+const GLuint CLUSTER_TEXTURE_UNIT = 8;
 
 //lake
 WaterRenderer* waterRenderer;
@@ -568,6 +486,38 @@ WaterFrameBuffers* waterFrameBuffers;
 glm::vec3 lakeLightPosition = glm::vec3(0.0f, 0.0f, 0.0f);
 glm::vec3 lakeLightColor = glm::vec3(0.0f, 0.0f, 0.0f);
 
+//water passes, skipped while no tile is in view and spread over frames
+//while the camera moves slowly (water.frag reprojects the older one)
+const int waterUpdateSteps[] = { 1, 2, 4 };
+int waterUpdateStep = 1;
+const float WATER_SLOW_SPEED = 1.5f;
+const float WATER_SLOW_TURN = glm::radians(30.0f);
+bool waterReflectionValid = false;
+bool waterRefractionValid = false;
+// View projections the current water textures were rendered with
+glm::mat4 waterReflectionViewProjection;
+glm::mat4 waterRefractionViewProjection;
+glm::vec3 waterLastCameraPosition;
+glm::vec3 waterLastCameraFront;
+unsigned int waterFrame = 0;
+// Quality of the reflection and refraction views: the main pass's at half
+// resolution, the secondary profile, and that at a quarter resolution
+const gps::ViewQuality waterQualitySteps[] = {
+    gps::ViewQuality::full(2), gps::ViewQuality::secondary(2), gps::ViewQuality::secondary(4)
+};
+int waterQualityStep = 1;
+// GPU time of the water's off-screen work: the reflection and refraction
+// passes, or the scene copy in screen-space mode
+gps::GpuTimer waterPassTimer;
+// Screen-space mode: no reflection or refraction pass, the water traces the
+// main pass's colour and depth (HDR only, planar otherwise)
+bool waterScreenSpace = false;
+gps::SceneCopy sceneCopy;
+// Frames since the title was updated, for the counters
+int waterSkippedFrames = 0;
+int waterReflectionReuses = 0;
+int waterRefractionReuses = 0;
+
 
 //error checker
 GLenum glCheckError_(const char* file, int line)
@@ -675,20 +625,21 @@ GLuint LoadFireTextureArray(const std::vector<std::string>& filePaths)
     return texArrayID;
 }
 
-//tour interpolation and waypoints generation
-glm::vec3 catmullRomInterpolate(const glm::vec3& P0, const glm::vec3& P1,
-    const glm::vec3& P2, const glm::vec3& P3, float t) {
-    return 0.5f * (
-        (2.0f * P1) +
-        (-P0 + P2) * t +
-        (2.0f * P0 - 5.0f * P1 + 4.0f * P2 - P3) * t * t +
-        (-P0 + 3.0f * P1 - 3.0f * P2 + P3) * t * t * t
-        );
+//tour and waypoints generation
+bool startTour() {
+    tourPath.clear();
+    for (const Location& location : keyLocations) {
+        tourPath.addKey(location.position, location.target, location.up);
+    }
+    tourPath.build();
+    tourDistance = 0.0f;
+    isTourActive = !tourPath.isEmpty();
+    if (!isTourActive) {
+        std::cerr << "A tour needs at least 4 waypoints, there are " << keyLocations.size() << std::endl;
+    }
+    return isTourActive;
 }
 
-float easeInOut(float t) {
-    return t < 0.5f ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
-}
 void recordWaypoint() {
 
     glm::vec3 currentPos = myCamera.getPosition();
@@ -756,339 +707,38 @@ bool loadWaypoints(const std::string& filename) {
 
 
 //retrievers
-void retrieveRainUniformLocations() {
-    rainShader.useShaderProgram();
-
-    rainUniforms.view = glGetUniformLocation(rainShader.shaderProgram, "view");
-    rainUniforms.projection = glGetUniformLocation(rainShader.shaderProgram, "projection");
-    rainUniforms.viewPosition = glGetUniformLocation(rainShader.shaderProgram, "viewPosition");
-
-    rainUniforms.dirLight.direction = glGetUniformLocation(rainShader.shaderProgram, "dirLight.direction");
-    rainUniforms.dirLight.ambient = glGetUniformLocation(rainShader.shaderProgram, "dirLight.ambient");
-    rainUniforms.dirLight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "dirLight.diffuse");
-    rainUniforms.dirLight.specular = glGetUniformLocation(rainShader.shaderProgram, "dirLight.specular");
-    rainUniforms.dirLight.color = glGetUniformLocation(rainShader.shaderProgram, "dirLight.color");
-    rainUniforms.dirLight.enabled = glGetUniformLocation(rainShader.shaderProgram, "dirLight.enabled");
-
-	rainUniforms.flashLight.direction = glGetUniformLocation(rainShader.shaderProgram, "flashLight.direction");
-	rainUniforms.flashLight.ambient = glGetUniformLocation(rainShader.shaderProgram, "flashLight.ambient");
-	rainUniforms.flashLight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "flashLight.diffuse");
-	rainUniforms.flashLight.specular = glGetUniformLocation(rainShader.shaderProgram, "flashLight.specular");
-	rainUniforms.flashLight.color = glGetUniformLocation(rainShader.shaderProgram, "flashLight.color");
-	rainUniforms.flashLight.enabled = glGetUniformLocation(rainShader.shaderProgram, "flashLight.enabled");
-
-	rainUniforms.pointLight.position = glGetUniformLocation(rainShader.shaderProgram, "pointLight.position");
-	rainUniforms.pointLight.ambient = glGetUniformLocation(rainShader.shaderProgram, "pointLight.ambient");
-	rainUniforms.pointLight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "pointLight.diffuse");
-	rainUniforms.pointLight.specular = glGetUniformLocation(rainShader.shaderProgram, "pointLight.specular");
-	rainUniforms.pointLight.color = glGetUniformLocation(rainShader.shaderProgram, "pointLight.color");
-	rainUniforms.pointLight.constant = glGetUniformLocation(rainShader.shaderProgram, "pointLight.constant");
-	rainUniforms.pointLight.linear = glGetUniformLocation(rainShader.shaderProgram, "pointLight.linear");
-	rainUniforms.pointLight.quadratic = glGetUniformLocation(rainShader.shaderProgram, "pointLight.quadratic");
-	rainUniforms.pointLight.enabled = glGetUniformLocation(rainShader.shaderProgram, "pointLight.enabled");
-
-	rainUniforms.spotLight.position = glGetUniformLocation(rainShader.shaderProgram, "spotLight.position");
-	rainUniforms.spotLight.direction = glGetUniformLocation(rainShader.shaderProgram, "spotLight.direction");
-	rainUniforms.spotLight.ambient = glGetUniformLocation(rainShader.shaderProgram, "spotLight.ambient");
-	rainUniforms.spotLight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "spotLight.diffuse");
-	rainUniforms.spotLight.specular = glGetUniformLocation(rainShader.shaderProgram, "spotLight.specular");
-	rainUniforms.spotLight.color = glGetUniformLocation(rainShader.shaderProgram, "spotLight.color");
-	rainUniforms.spotLight.cutOff = glGetUniformLocation(rainShader.shaderProgram, "spotLight.cutOff");
-	rainUniforms.spotLight.outerCutOff = glGetUniformLocation(rainShader.shaderProgram, "spotLight.outerCutOff");
-	rainUniforms.spotLight.enabled = glGetUniformLocation(rainShader.shaderProgram, "spotLight.enabled");
-
-	rainUniforms.leftHeadlight.position = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.position");
-	rainUniforms.leftHeadlight.direction = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.direction");
-	rainUniforms.leftHeadlight.ambient = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.ambient");
-	rainUniforms.leftHeadlight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.diffuse");
-	rainUniforms.leftHeadlight.specular = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.specular");
-	rainUniforms.leftHeadlight.color = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.color");
-	rainUniforms.leftHeadlight.cutOff = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.cutOff");
-	rainUniforms.leftHeadlight.outerCutOff = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.outerCutOff");
-	rainUniforms.leftHeadlight.enabled = glGetUniformLocation(rainShader.shaderProgram, "leftHeadlight.enabled");
-
-	rainUniforms.rightHeadlight.position = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.position");
-	rainUniforms.rightHeadlight.direction = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.direction");
-	rainUniforms.rightHeadlight.ambient = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.ambient");
-	rainUniforms.rightHeadlight.diffuse = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.diffuse");
-	rainUniforms.rightHeadlight.specular = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.specular");
-	rainUniforms.rightHeadlight.color = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.color");
-	rainUniforms.rightHeadlight.cutOff = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.cutOff");
-	rainUniforms.rightHeadlight.outerCutOff = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.outerCutOff");
-	rainUniforms.rightHeadlight.enabled = glGetUniformLocation(rainShader.shaderProgram, "rightHeadlight.enabled");
-
-    rainUniforms.environmentMap = glGetUniformLocation(rainShader.shaderProgram, "environmentMap");
-
-    rainUniforms.shininess = glGetUniformLocation(rainShader.shaderProgram, "shininess");
-    rainUniforms.maxDistance = glGetUniformLocation(rainShader.shaderProgram, "maxDistance");
-    rainUniforms.motionBlurIntensity = glGetUniformLocation(rainShader.shaderProgram, "motionBlurIntensity");
-}
-
-void retrieveBasicUniformLocations() {
-    myBasicShader.useShaderProgram();
-
-    basicUniforms.model = glGetUniformLocation(myBasicShader.shaderProgram, "model");
-    basicUniforms.view = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-    basicUniforms.projection = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    basicUniforms.viewPosition = glGetUniformLocation(myBasicShader.shaderProgram, "viewPos");
-    basicUniforms.clipPlane = glGetUniformLocation(myBasicShader.shaderProgram, "plane");
-    basicUniforms.u_Time = glGetUniformLocation(myBasicShader.shaderProgram, "u_Time");
-    basicUniforms.u_WindDirection = glGetUniformLocation(myBasicShader.shaderProgram, "u_WindDirection");
-    basicUniforms.u_WindStrength = glGetUniformLocation(myBasicShader.shaderProgram, "u_WindStrength");
-	basicUniforms.u_GustSize = glGetUniformLocation(myBasicShader.shaderProgram, "u_GustSize");
-	basicUniforms.u_GustSpeed = glGetUniformLocation(myBasicShader.shaderProgram, "u_GustSpeed");
-	basicUniforms.u_WindWaveLength = glGetUniformLocation(myBasicShader.shaderProgram, "u_WindWaveLength");
-
-    basicUniforms.dirLight.direction = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.direction");
-    basicUniforms.dirLight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.ambient");
-    basicUniforms.dirLight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.diffuse");
-    basicUniforms.dirLight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.specular");
-    basicUniforms.dirLight.color = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.color");
-    basicUniforms.dirLight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "dirLight.enabled");
-
-	basicUniforms.flashLight.direction = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.direction");
-	basicUniforms.flashLight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.ambient");
-	basicUniforms.flashLight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.diffuse");
-	basicUniforms.flashLight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.specular");
-	basicUniforms.flashLight.color = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.color");
-	basicUniforms.flashLight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "flashLight.enabled");
-
-	basicUniforms.pointLight.position = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.position");
-	basicUniforms.pointLight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.ambient");
-	basicUniforms.pointLight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.diffuse");
-	basicUniforms.pointLight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.specular");
-	basicUniforms.pointLight.color = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.color");
-	basicUniforms.pointLight.constant = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.constant");
-	basicUniforms.pointLight.linear = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.linear");
-	basicUniforms.pointLight.quadratic = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.quadratic");
-	basicUniforms.pointLight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "pointLight.enabled");
-
-	basicUniforms.spotLight.position = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.position");
-	basicUniforms.spotLight.direction = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.direction");
-	basicUniforms.spotLight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.ambient");
-	basicUniforms.spotLight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.diffuse");
-    basicUniforms.spotLight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.specular");
-	basicUniforms.spotLight.color = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.color");
-	basicUniforms.spotLight.cutOff = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.cutOff");
-	basicUniforms.spotLight.outerCutOff = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.outerCutOff");
-	basicUniforms.spotLight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "spotLight.enabled");
-
-	basicUniforms.leftHeadlight.position = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.position");
-	basicUniforms.leftHeadlight.direction = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.direction");
-	basicUniforms.leftHeadlight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.ambient");
-    basicUniforms.leftHeadlight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight");
-	basicUniforms.leftHeadlight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.specular");
-	basicUniforms.leftHeadlight.color = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.color");
-	basicUniforms.leftHeadlight.cutOff = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.cutOff");
-	basicUniforms.leftHeadlight.outerCutOff = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.outerCutOff");
-	basicUniforms.leftHeadlight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlight.enabled");
-
-	basicUniforms.rightHeadlight.position = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.position");
-	basicUniforms.rightHeadlight.direction = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.direction");
-	basicUniforms.rightHeadlight.ambient = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.ambient");
-	basicUniforms.rightHeadlight.diffuse = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.diffuse");
-	basicUniforms.rightHeadlight.specular = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.specular");
-	basicUniforms.rightHeadlight.color = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.color");
-	basicUniforms.rightHeadlight.cutOff = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.cutOff");
-	basicUniforms.rightHeadlight.outerCutOff = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.outerCutOff");
-	basicUniforms.rightHeadlight.enabled = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlight.enabled");
-
-    basicUniforms.useNormalMapping = glGetUniformLocation(myBasicShader.shaderProgram, "useNormalMapping");
-    basicUniforms.rainEnabled = glGetUniformLocation(myBasicShader.shaderProgram, "rainEnabled");
-    basicUniforms.windEnabled = glGetUniformLocation(myBasicShader.shaderProgram, "windEnabled");
-    basicUniforms.fogEnabled = glGetUniformLocation(myBasicShader.shaderProgram, "fogEnabled");
-    basicUniforms.fogColor = glGetUniformLocation(myBasicShader.shaderProgram, "fogColor");
-	basicUniforms.gFogEnd = glGetUniformLocation(myBasicShader.shaderProgram, "gFogEnd");
-	basicUniforms.gLayeredFogTop = glGetUniformLocation(myBasicShader.shaderProgram, "gLayeredFogTop");
-	basicUniforms.gExpFogDensity = glGetUniformLocation(myBasicShader.shaderProgram, "gExpFogDensity");
-	basicUniforms.gFogTime = glGetUniformLocation(myBasicShader.shaderProgram, "gFogTime");
-    basicUniforms.globalLightIntensity = glGetUniformLocation(myBasicShader.shaderProgram, "globalLightIntensity");
-
-	basicUniforms.lightSpaceMatrix = glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceMatrix");
-	basicUniforms.leftHeadlightLightSpaceMatrix = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlightLightSpaceMatrix");
-	basicUniforms.rightHeadlightLightSpaceMatrix = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlightLightSpaceMatrix");
-	basicUniforms.shadowMap = glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap");
-	basicUniforms.pointLightShadowMap = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightShadowMap");
-	basicUniforms.leftHeadlightShadowMap = glGetUniformLocation(myBasicShader.shaderProgram, "leftHeadlightShadowMap");
-	basicUniforms.rightHeadlightShadowMap = glGetUniformLocation(myBasicShader.shaderProgram, "rightHeadlightShadowMap");
-	basicUniforms.farPlane = glGetUniformLocation(myBasicShader.shaderProgram, "farPlane");
-}
-
 void retrieveFireUniformLocations() {
     fireShader.useShaderProgram();
 
-    fireUniforms.view = glGetUniformLocation(fireShader.shaderProgram, "view");
-    fireUniforms.projection = glGetUniformLocation(fireShader.shaderProgram, "projection");
-	fireUniforms.viewPosition = glGetUniformLocation(fireShader.shaderProgram, "viewPosition");
-
-	fireUniforms.cameraRight = glGetUniformLocation(fireShader.shaderProgram, "cameraRight");
-	fireUniforms.cameraUp = glGetUniformLocation(fireShader.shaderProgram, "cameraUp");
-	fireUniforms.time = glGetUniformLocation(fireShader.shaderProgram, "time");
 	fireUniforms.flameAspectX = glGetUniformLocation(fireShader.shaderProgram, "flameAspectX");
 	fireUniforms.flameAspectY = glGetUniformLocation(fireShader.shaderProgram, "flameAspectY");
 	fireUniforms.fireTextureArray = glGetUniformLocation(fireShader.shaderProgram, "fireTextureArray");
 }
 
-void retrieveShadowUniformLocations() {
-    shadowShader.useShaderProgram();
-	shadowUniforms.model = glGetUniformLocation(shadowShader.shaderProgram, "model");
-	shadowUniforms.lightSpaceMatrix = glGetUniformLocation(shadowShader.shaderProgram, "lightSpaceMatrix");
-	shadowUniforms.u_Time = glGetUniformLocation(shadowShader.shaderProgram, "u_Time");
-	shadowUniforms.u_WindDirection = glGetUniformLocation(shadowShader.shaderProgram, "u_WindDirection");
-	shadowUniforms.u_WindStrength = glGetUniformLocation(shadowShader.shaderProgram, "u_WindStrength");
-	shadowUniforms.u_GustSize = glGetUniformLocation(shadowShader.shaderProgram, "u_GustSize");
-	shadowUniforms.u_GustSpeed = glGetUniformLocation(shadowShader.shaderProgram, "u_GustSpeed");
-	shadowUniforms.u_WindWaveLength = glGetUniformLocation(shadowShader.shaderProgram, "u_WindWaveLength");
-	shadowUniforms.windEnabled = glGetUniformLocation(shadowShader.shaderProgram, "windEnabled");
-}
-
-void retrievePointShadowUniformLocations() {
-    pointShadowShader.useShaderProgram();
-	pointShadowUniforms.model = glGetUniformLocation(pointShadowShader.shaderProgram, "model");
-    for (unsigned int i = 0; i < 6; ++i) {
-        std::string uniformName = "shadowMatrices[" + std::to_string(i) + "]";
-		pointShadowUniforms.shadowMatrices[i] = glGetUniformLocation(pointShadowShader.shaderProgram, uniformName.c_str());
-    }
-	pointShadowUniforms.far_plane = glGetUniformLocation(pointShadowShader.shaderProgram, "far_plane");
-	pointShadowUniforms.lightPos = glGetUniformLocation(pointShadowShader.shaderProgram, "lightPos");
-	pointShadowUniforms.u_Time = glGetUniformLocation(pointShadowShader.shaderProgram, "u_Time");
-	pointShadowUniforms.u_WindDirection = glGetUniformLocation(pointShadowShader.shaderProgram, "u_WindDirection");
-	pointShadowUniforms.u_WindStrength = glGetUniformLocation(pointShadowShader.shaderProgram, "u_WindStrength");
-	pointShadowUniforms.u_GustSize = glGetUniformLocation(pointShadowShader.shaderProgram, "u_GustSize");
-	pointShadowUniforms.u_GustSpeed = glGetUniformLocation(pointShadowShader.shaderProgram, "u_GustSpeed");
-	pointShadowUniforms.u_WindWaveLength = glGetUniformLocation(pointShadowShader.shaderProgram, "u_WindWaveLength");
-	pointShadowUniforms.windEnabled = glGetUniformLocation(pointShadowShader.shaderProgram, "windEnabled");
-}
-
-void retrieveHeadShadowUniformLocations() {
-    headShadowShader.useShaderProgram();
-	headShadowUniforms.model = glGetUniformLocation(headShadowShader.shaderProgram, "model");
-	headShadowUniforms.lightSpaceMatrixHead = glGetUniformLocation(headShadowShader.shaderProgram, "lightSpaceMatrixHead");
-	headShadowUniforms.u_Time = glGetUniformLocation(headShadowShader.shaderProgram, "u_Time");
-	headShadowUniforms.u_WindDirection = glGetUniformLocation(headShadowShader.shaderProgram, "u_WindDirection");
-	headShadowUniforms.u_WindStrength = glGetUniformLocation(headShadowShader.shaderProgram, "u_WindStrength");
-	headShadowUniforms.u_GustSize = glGetUniformLocation(headShadowShader.shaderProgram, "u_GustSize");
-	headShadowUniforms.u_GustSpeed = glGetUniformLocation(headShadowShader.shaderProgram, "u_GustSpeed");
-	headShadowUniforms.u_WindWaveLength = glGetUniformLocation(headShadowShader.shaderProgram, "u_WindWaveLength");
-	headShadowUniforms.windEnabled = glGetUniformLocation(headShadowShader.shaderProgram, "windEnabled");
-}
-
 void retrieveHDRUniformLocations() {
     hdrShader.useShaderProgram();
 
 	hdrUniforms.hdrBuffer = glGetUniformLocation(hdrShader.shaderProgram, "hdrBuffer");
 	hdrUniforms.bloomBlur = glGetUniformLocation(hdrShader.shaderProgram, "bloomBlur");
 	hdrUniforms.bloom = glGetUniformLocation(hdrShader.shaderProgram, "bloom");
+	hdrUniforms.bloomScale = glGetUniformLocation(hdrShader.shaderProgram, "bloomScale");
 	hdrUniforms.exposure = glGetUniformLocation(hdrShader.shaderProgram, "exposure");
+	hdrUniforms.renderScale = glGetUniformLocation(hdrShader.shaderProgram, "renderScale");
+	hdrUniforms.sharpness = glGetUniformLocation(hdrShader.shaderProgram, "sharpness");
 }
 
 void retrieveBlurUniformLocations() {
     blurShader.useShaderProgram();
 
 	blurUniforms.horizontal = glGetUniformLocation(blurShader.shaderProgram, "horizontal");
+	blurUniforms.sourceScale = glGetUniformLocation(blurShader.shaderProgram, "sourceScale");
 }
 
 void retrieveSkyboxUniformLocations() {
     skyboxShader.useShaderProgram();
 
-	skyboxUniforms.view = glGetUniformLocation(skyboxShader.shaderProgram, "view");
-	skyboxUniforms.projection = glGetUniformLocation(skyboxShader.shaderProgram, "projection");
-	skyboxUniforms.viewPosition = glGetUniformLocation(skyboxShader.shaderProgram, "viewPosition");
 	skyboxUniforms.daySkybox = glGetUniformLocation(skyboxShader.shaderProgram, "daySkybox");
 	skyboxUniforms.nightSkybox = glGetUniformLocation(skyboxShader.shaderProgram, "nightSkybox");
-	skyboxUniforms.blendFactor = glGetUniformLocation(skyboxShader.shaderProgram, "blendFactor");
-}
-
-//respawners for fire particles
-
-void respawnFireParticle(FireParticle& p)
-{
-    float angle = glm::linearRand(0.0f, 2.f * 3.14159f);
-    float r = glm::linearRand(0.0f, spawnRadius);
-    float xOff = r * cos(angle);
-    float zOff = r * sin(angle);
-    float yOff = glm::linearRand(0.01f, 0.03f);
-
-    p.position = pointLight.position + glm::vec3(xOff, yOff, zOff);
-
-    p.velocity = glm::vec3(
-        glm::linearRand(minHorizontalVel, maxHorizontalVel),
-        glm::linearRand(minUpVelocity, maxUpVelocity),
-        glm::linearRand(minHorizontalVel, maxHorizontalVel)
-    );
-
-    p.life = glm::linearRand(2.0f, 4.0f);
-    p.initialLife = p.life;
-    p.color = glm::vec4(1.0f);
-    p.size = glm::linearRand(0.1f, 0.18f);
-    p.rotation = glm::linearRand(0.0f, 360.0f);
-    p.rotationSpeed = glm::linearRand(-60.0f, 60.0f);
-    p.type = 0;
-
-    p.textureIndex = glm::linearRand(0, 6);
-}
-
-void respawnSmokeParticle(FireParticle& p)
-{
-    float angle = glm::linearRand(0.0f, 2.f * 3.14159f);
-    float r = glm::linearRand(0.0f, spawnRadius * 0.6f);
-    float xOff = r * cos(angle);
-    float zOff = r * sin(angle);
-    float yOff = glm::linearRand(0.7f, 1.0f);
-
-    p.position = pointLight.position + glm::vec3(xOff, yOff, zOff);
-
-    p.velocity = glm::vec3(
-        glm::linearRand(-0.1f, 0.1f),
-        glm::linearRand(0.3f, 0.6f),
-        glm::linearRand(-0.1f, 0.1f)
-    );;
-
-    p.life = glm::linearRand(0.6f, 1.2f);
-    p.initialLife = p.life;
-    p.color = glm::vec4(1.0f);
-
-    p.size = glm::linearRand(0.2f, 0.35f);
-
-    p.rotation = glm::linearRand(0.0f, 360.0f);
-    p.rotationSpeed = glm::linearRand(-20.0f, 20.0f);
-    p.type = 1;
-
-    p.textureIndex = glm::linearRand(0, 6);
-}
-
-void respawnEmberParticle(FireParticle& p)
-{
-    float angle = glm::linearRand(0.0f, 2.f * 3.14159f);
-    float r = glm::linearRand(0.0f, spawnRadius * 0.4f);
-    float xOff = r * cos(angle);
-    float zOff = r * sin(angle);
-    float yOff = glm::linearRand(0.03f, 0.06f);
-
-    p.position = pointLight.position + glm::vec3(xOff, yOff, zOff);
-
-    float upMin = 2.5f;
-    float upMax = 3.5f;
-
-    if (glm::linearRand(0.0f, 1.0f) < 0.1f) {
-        upMax = 5.0f;
-    }
-
-    p.velocity = glm::vec3(
-        glm::linearRand(-0.2f, 0.2f),
-        glm::linearRand(upMin, upMax),
-        glm::linearRand(-0.2f, 0.2f)
-    );
-
-    p.life = glm::linearRand(0.4f, 1.5f);
-    p.initialLife = p.life;
-    p.color = glm::vec4(1.0f);
-    p.size = glm::linearRand(0.07f, 0.12f);
-    p.rotation = glm::linearRand(0.0f, 360.0f);
-    p.rotationSpeed = glm::linearRand(-80.0f, 80.0f);
-    p.type = 2;
-
-    p.textureIndex = glm::linearRand(0, 6);
 }
 
 //initializers
@@ -1126,11 +776,17 @@ void initModels() {
     nightSkybox = new Skybox(nightFaces);
 }
 
+// Only issues the compiles and links, see finishShaders
 void initShaders() {
-    myBasicShader.loadShader(
+    double start = glfwGetTime();
+
+    // Variant shaders, one program per used feature combination
+    myBasicShader.loadVariants(
         "shaders/basic.vert",
         "shaders/basic.frag",
-        gps::ShaderType::MAIN_SHADER
+        "",
+        gps::ShaderType::MAIN_SHADER,
+        ALL_BASIC_FEATURES
     );
 
     // Load SKYBOX_SHADER
@@ -1141,33 +797,39 @@ void initShaders() {
     );
 
     // Load SHADOW_SHADER
-    shadowShader.loadShader(
+    shadowShader.loadVariants(
         "shaders/depth.vert",
         "shaders/depth.frag",
-        gps::ShaderType::SHADOW_SHADER
+        "",
+        gps::ShaderType::SHADOW_SHADER,
+        SHADOW_FEATURES
     );
 
     // Load POINT_SHADOW_SHADER with Geometry Shader
-    pointShadowShader.loadShader(
+    pointShadowShader.loadVariants(
         "shaders/pointdepth.vert",
         "shaders/pointdepth.frag",
         "shaders/pointdepth.geom",
-        gps::ShaderType::SHADOW_SHADER
+        gps::ShaderType::SHADOW_SHADER,
+        SHADOW_FEATURES
     );
 
     // Load HEAD_SHADOW_SHADER
-    headShadowShader.loadShader(
+    headShadowShader.loadVariants(
         "shaders/headDepth.vert",
         "shaders/headDepth.frag",
-        gps::ShaderType::SHADOW_SHADER
+        "",
+        gps::ShaderType::SHADOW_SHADER,
+        SHADOW_FEATURES
     );
 
-    // Load RAIN_SHADER with Geometry Shader
-    rainShader.loadShader(
+    // Load RAIN_SHADER
+    rainShader.loadVariants(
         "shaders/rain.vert",
         "shaders/rain.frag",
-        "shaders/rain.geom",
-        gps::ShaderType::RAIN_SHADER
+        "",
+        gps::ShaderType::RAIN_SHADER,
+        gps::FEATURE_PROCEDURAL_RAIN
     );
 
     // Load HDR_SHADER
@@ -1191,375 +853,158 @@ void initShaders() {
         gps::ShaderType::BLUR_SHADER
     );
 
-    retrieveRainUniformLocations();
-    retrieveBasicUniformLocations();
+    shaderIssueSeconds = glfwGetTime() - start;
+}
+
+// Waits for the programs started in initShaders, ideally after the driver has
+// compiled them on its own threads while the models were loading
+void finishShaders() {
+    double start = glfwGetTime();
+
+    gps::Shader* shaders[] = {
+        &myBasicShader, &skyboxShader, &shadowShader, &pointShadowShader, &headShadowShader,
+        &rainShader, &hdrShader, &fireShader, &blurShader
+    };
+    int readyCount = 0;
+    for (gps::Shader* shader : shaders) {
+        if (shader->isReady()) {
+            readyCount++;
+        }
+        shader->finishLoading();
+    }
+
     retrieveFireUniformLocations();
-    retrieveShadowUniformLocations();
-    retrievePointShadowUniformLocations();
-    retrieveHeadShadowUniformLocations();
     retrieveHDRUniformLocations();
     retrieveBlurUniformLocations();
     retrieveSkyboxUniformLocations();
+
+    uniformBlocks.attach(myBasicShader);
+    uniformBlocks.attach(skyboxShader);
+    uniformBlocks.attach(shadowShader);
+    uniformBlocks.attach(pointShadowShader);
+    uniformBlocks.attach(headShadowShader);
+    uniformBlocks.attach(rainShader);
+    uniformBlocks.attach(fireShader);
+
+    double waitSeconds = glfwGetTime() - start;
+    std::cout << "Shader startup (" << (programCache.getMissCount() > 0 ? "cold" : "warm") << "): "
+        << programCache.getHitCount() << " programs from cache, " << programCache.getMissCount() << " compiled, "
+        << readyCount << " ready before use; issue " << shaderIssueSeconds * 1000.0 << " ms, wait "
+        << waitSeconds * 1000.0 << " ms" << std::endl;
+
+    programCache.save();
 }
 
 void initRainUniforms() {
-    rainShader.useShaderProgram();
-    view = myCamera.getViewMatrix();
-    projection = glm::perspective(glm::radians(myCamera.getFov()),
-        (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-        0.1f, 300.0f);
-    glUniformMatrix4fv(rainUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(rainUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
-    glUniform3fv(rainUniforms.viewPosition, 1, glm::value_ptr(myCamera.getPosition()));
-
-    glUniform3fv(rainUniforms.dirLight.direction, 1, glm::value_ptr(dirLight.direction));
-    glUniform3fv(rainUniforms.dirLight.ambient, 1, glm::value_ptr(dirLight.ambient));
-    glUniform3fv(rainUniforms.dirLight.diffuse, 1, glm::value_ptr(dirLight.diffuse));
-    glUniform3fv(rainUniforms.dirLight.specular, 1, glm::value_ptr(dirLight.specular));
-    glUniform3fv(rainUniforms.dirLight.color, 1, glm::value_ptr(dirLight.color));
-    glUniform1i(rainUniforms.dirLight.enabled, dirLight.enabled);
-
-    glUniform3fv(rainUniforms.flashLight.direction, 1, glm::value_ptr(flashLight.direction));
-    glUniform3fv(rainUniforms.flashLight.ambient, 1, glm::value_ptr(flashLight.ambient));
-    glUniform3fv(rainUniforms.flashLight.diffuse, 1, glm::value_ptr(flashLight.diffuse));
-    glUniform3fv(rainUniforms.flashLight.specular, 1, glm::value_ptr(flashLight.specular));
-    glUniform3fv(rainUniforms.flashLight.color, 1, glm::value_ptr(flashLight.color));
-    glUniform1i(rainUniforms.flashLight.enabled, flashLight.enabled);
-
-    glUniform3fv(rainUniforms.pointLight.position, 1, glm::value_ptr(pointLight.position));
-    glUniform3fv(rainUniforms.pointLight.ambient, 1, glm::value_ptr(pointLight.ambient));
-    glUniform3fv(rainUniforms.pointLight.diffuse, 1, glm::value_ptr(pointLight.diffuse));
-    glUniform3fv(rainUniforms.pointLight.specular, 1, glm::value_ptr(pointLight.specular));
-    glUniform3fv(rainUniforms.pointLight.color, 1, glm::value_ptr(pointLight.color));
-    glUniform1i(rainUniforms.pointLight.enabled, pointLight.enabled);
-    glUniform1f(rainUniforms.pointLight.constant, pointLight.constant);
-    glUniform1f(rainUniforms.pointLight.linear, pointLight.linear);
-    glUniform1f(rainUniforms.pointLight.quadratic, pointLight.quadratic);
-
-    glUniform3fv(rainUniforms.spotLight.position, 1, glm::value_ptr(spotLight.position));
-    glUniform3fv(rainUniforms.spotLight.direction, 1, glm::value_ptr(spotLight.direction));
-    glUniform1f(rainUniforms.spotLight.cutOff, spotLight.cutOff);
-    glUniform1f(rainUniforms.spotLight.outerCutOff, spotLight.outerCutOff);
-    glUniform3fv(rainUniforms.spotLight.ambient, 1, glm::value_ptr(spotLight.ambient));
-    glUniform3fv(rainUniforms.spotLight.diffuse, 1, glm::value_ptr(spotLight.diffuse));
-    glUniform3fv(rainUniforms.spotLight.specular, 1, glm::value_ptr(spotLight.specular));
-    glUniform3fv(rainUniforms.spotLight.color, 1, glm::value_ptr(spotLight.color));
-    glUniform1i(rainUniforms.spotLight.enabled, spotLight.enabled);
-
-    glUniform3fv(rainUniforms.leftHeadlight.position, 1, glm::value_ptr(leftHeadlight.position));
-    glUniform3fv(rainUniforms.leftHeadlight.direction, 1, glm::value_ptr(leftHeadlight.direction));
-    glUniform1f(rainUniforms.leftHeadlight.cutOff, leftHeadlight.cutOff);
-    glUniform1f(rainUniforms.leftHeadlight.outerCutOff, leftHeadlight.outerCutOff);
-    glUniform3fv(rainUniforms.leftHeadlight.ambient, 1, glm::value_ptr(leftHeadlight.ambient));
-    glUniform3fv(rainUniforms.leftHeadlight.diffuse, 1, glm::value_ptr(leftHeadlight.diffuse));
-    glUniform3fv(rainUniforms.leftHeadlight.specular, 1, glm::value_ptr(leftHeadlight.specular));
-    glUniform3fv(rainUniforms.leftHeadlight.color, 1, glm::value_ptr(leftHeadlight.color));
-    glUniform1i(rainUniforms.leftHeadlight.enabled, leftHeadlight.enabled);
-
-    glUniform3fv(rainUniforms.rightHeadlight.position, 1, glm::value_ptr(rightHeadlight.position));
-    glUniform3fv(rainUniforms.rightHeadlight.direction, 1, glm::value_ptr(rightHeadlight.direction));
-    glUniform1f(rainUniforms.rightHeadlight.cutOff, rightHeadlight.cutOff);
-    glUniform1f(rainUniforms.rightHeadlight.outerCutOff, rightHeadlight.outerCutOff);
-    glUniform3fv(rainUniforms.rightHeadlight.ambient, 1, glm::value_ptr(rightHeadlight.ambient));
-    glUniform3fv(rainUniforms.rightHeadlight.diffuse, 1, glm::value_ptr(rightHeadlight.diffuse));
-    glUniform3fv(rainUniforms.rightHeadlight.specular, 1, glm::value_ptr(rightHeadlight.specular));
-    glUniform3fv(rainUniforms.rightHeadlight.color, 1, glm::value_ptr(rightHeadlight.color));
-    glUniform1i(rainUniforms.rightHeadlight.enabled, rightHeadlight.enabled);
+    rainShader.setUniform("environmentMap", 0);
+    rainShader.setUniform("rainDrops", gps::RainSimulation::DROP_TEXTURE_UNIT);
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, isDay ? daySkybox->getCubemapTexture() : nightSkybox->getCubemapTexture());
-    glUniform1i(rainUniforms.environmentMap, 0);
+    rainShader.setUniform("shininess", 32.0f);
 
-    glUniform1f(rainUniforms.shininess, 32.0f);
-
-    glUniform1f(rainUniforms.maxDistance, 50.0f);
-    glUniform1f(rainUniforms.motionBlurIntensity, 0.7f);
+    rainShader.setUniform("maxDistance", RAIN_VISIBLE_DISTANCE);
+    rainShader.setUniform("motionBlurIntensity", 0.7f);
 }
 
+// Everything shared between programs lives in the uniform blocks and is sent
+// once per frame from renderScene; only constant sampler units are set here.
 void initUniforms() {
-    myBasicShader.useShaderProgram();
+    uniformBlocks.init();
 
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
 
     view = myCamera.getViewMatrix();
 
-    glUniformMatrix4fv(basicUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-
     projection = glm::perspective(glm::radians(myCamera.getFov()),
         (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
         0.1f, 300.0f);
 
-    glUniformMatrix4fv(basicUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
-    glUniform3fv(basicUniforms.viewPosition, 1, glm::value_ptr(myCamera.getPosition()));
-
-    glUniform4fv(basicUniforms.clipPlane, 1, glm::value_ptr(glm::vec4(0.0f, -1.0f, 0.0f, 15.0f)));
-
-    glUniform1f(basicUniforms.u_Time, u_Time);
-    glUniform3fv(basicUniforms.u_WindDirection, 1, glm::value_ptr(u_WindDirection));
-    glUniform1f(basicUniforms.u_WindStrength, u_WindStrength);
-	glUniform1f(basicUniforms.u_GustSize, gustSize);
-	glUniform1f(basicUniforms.u_GustSpeed, gustSpeed);
-	glUniform1f(basicUniforms.u_WindWaveLength, windWaveLength);
-
-
-    glUniform3fv(basicUniforms.dirLight.direction, 1, glm::value_ptr(dirLight.direction));
-    glUniform3fv(basicUniforms.dirLight.ambient, 1, glm::value_ptr(dirLight.ambient));
-    glUniform3fv(basicUniforms.dirLight.diffuse, 1, glm::value_ptr(dirLight.diffuse));
-    glUniform3fv(basicUniforms.dirLight.specular, 1, glm::value_ptr(dirLight.specular));
-    glUniform3fv(basicUniforms.dirLight.color, 1, glm::value_ptr(dirLight.color));
-    glUniform1i(basicUniforms.dirLight.enabled, dirLight.enabled);
-
-    glUniform3fv(basicUniforms.flashLight.direction, 1, glm::value_ptr(flashLight.direction));
-    glUniform3fv(basicUniforms.flashLight.ambient, 1, glm::value_ptr(flashLight.ambient));
-    glUniform3fv(basicUniforms.flashLight.diffuse, 1, glm::value_ptr(flashLight.diffuse));
-    glUniform3fv(basicUniforms.flashLight.specular, 1, glm::value_ptr(flashLight.specular));
-    glUniform3fv(basicUniforms.flashLight.color, 1, glm::value_ptr(flashLight.color));
-    glUniform1i(basicUniforms.flashLight.enabled, flashLight.enabled);
-
-    glUniform3fv(basicUniforms.pointLight.position, 1, glm::value_ptr(pointLight.position));
-    glUniform3fv(basicUniforms.pointLight.ambient, 1, glm::value_ptr(pointLight.ambient));
-    glUniform3fv(basicUniforms.pointLight.diffuse, 1, glm::value_ptr(pointLight.diffuse));
-    glUniform3fv(basicUniforms.pointLight.specular, 1, glm::value_ptr(pointLight.specular));
-    glUniform3fv(basicUniforms.pointLight.color, 1, glm::value_ptr(pointLight.color));
-    glUniform1i(basicUniforms.pointLight.enabled, pointLight.enabled);
-    glUniform1f(basicUniforms.pointLight.constant, pointLight.constant);
-    glUniform1f(basicUniforms.pointLight.linear, pointLight.linear);
-    glUniform1f(basicUniforms.pointLight.quadratic, pointLight.quadratic);
-
-    glUniform3fv(basicUniforms.spotLight.position, 1, glm::value_ptr(spotLight.position));
-    glUniform3fv(basicUniforms.spotLight.direction, 1, glm::value_ptr(spotLight.direction));
-    glUniform1f(basicUniforms.spotLight.cutOff, spotLight.cutOff);
-    glUniform1f(basicUniforms.spotLight.outerCutOff, spotLight.outerCutOff);
-    glUniform3fv(basicUniforms.spotLight.ambient, 1, glm::value_ptr(spotLight.ambient));
-    glUniform3fv(basicUniforms.spotLight.diffuse, 1, glm::value_ptr(spotLight.diffuse));
-    glUniform3fv(basicUniforms.spotLight.specular, 1, glm::value_ptr(spotLight.specular));
-    glUniform3fv(basicUniforms.spotLight.color, 1, glm::value_ptr(spotLight.color));
-    glUniform1i(basicUniforms.spotLight.enabled, spotLight.enabled);
-
-
-    glUniform3fv(basicUniforms.leftHeadlight.position, 1, glm::value_ptr(leftHeadlight.position));
-    glUniform3fv(basicUniforms.leftHeadlight.direction, 1, glm::value_ptr(leftHeadlight.direction));
-    glUniform3fv(basicUniforms.leftHeadlight.ambient, 1, glm::value_ptr(leftHeadlight.ambient));
-    glUniform3fv(basicUniforms.leftHeadlight.diffuse, 1, glm::value_ptr(leftHeadlight.diffuse));
-    glUniform3fv(basicUniforms.leftHeadlight.specular, 1, glm::value_ptr(leftHeadlight.specular));
-    glUniform3fv(basicUniforms.leftHeadlight.color, 1, glm::value_ptr(leftHeadlight.color));
-    glUniform1f(basicUniforms.leftHeadlight.cutOff, leftHeadlight.cutOff);
-    glUniform1f(basicUniforms.leftHeadlight.outerCutOff, leftHeadlight.outerCutOff);
-    glUniform1i(basicUniforms.leftHeadlight.enabled, leftHeadlight.enabled);
-
-    glUniform3fv(basicUniforms.rightHeadlight.position, 1, glm::value_ptr(rightHeadlight.position));
-    glUniform3fv(basicUniforms.rightHeadlight.direction, 1, glm::value_ptr(rightHeadlight.direction));
-    glUniform3fv(basicUniforms.rightHeadlight.ambient, 1, glm::value_ptr(rightHeadlight.ambient));
-    glUniform3fv(basicUniforms.rightHeadlight.diffuse, 1, glm::value_ptr(rightHeadlight.diffuse));
-    glUniform3fv(basicUniforms.rightHeadlight.specular, 1, glm::value_ptr(rightHeadlight.specular));
-    glUniform3fv(basicUniforms.rightHeadlight.color, 1, glm::value_ptr(rightHeadlight.color));
-    glUniform1f(basicUniforms.rightHeadlight.cutOff, rightHeadlight.cutOff);
-    glUniform1f(basicUniforms.rightHeadlight.outerCutOff, rightHeadlight.outerCutOff);
-    glUniform1i(basicUniforms.rightHeadlight.enabled, rightHeadlight.enabled);
-
-    glUniform1i(basicUniforms.useNormalMapping, useNormalMapping);
-    glUniform1i(basicUniforms.rainEnabled, rainEnabled);
-    glUniform1i(basicUniforms.windEnabled, windEnabled);
-
-    glUniform1i(basicUniforms.fogEnabled, fogEnabled);
-    glUniform3fv(basicUniforms.fogColor, 1, glm::value_ptr(glm::vec3(0.5f, 0.5f, 0.5f)));
-	glUniform1f(basicUniforms.gFogEnd, 50.0f);
-	glUniform1f(basicUniforms.gLayeredFogTop, 20.0f);
-	glUniform1f(basicUniforms.gExpFogDensity, 0.02f);
-	glUniform1f(basicUniforms.gFogTime, fogTime);
-
-    glUniform1f(basicUniforms.globalLightIntensity, 1.0f);
-
-    rainShader.useShaderProgram();
-    initRainUniforms();
-
-
-}
-
-void initShadowMapping() {
-    glGenFramebuffers(1, &shadowMapFBO);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cerr << "Framebuffer is not complete!" << std::endl;
+    myBasicShader.setUniform("shadowMap", 4);
+    myBasicShader.setUniform("pointLightShadowMap", 5);
+    myBasicShader.setUniform("leftHeadlightShadowMap", 6);
+    myBasicShader.setUniform("rightHeadlightShadowMap", 7);
+    myBasicShader.setUniform("clusterLightData", static_cast<GLint>(CLUSTER_TEXTURE_UNIT));
+    myBasicShader.setUniform("clusterGrid", static_cast<GLint>(CLUSTER_TEXTURE_UNIT + 1));
+    myBasicShader.setUniform("clusterLightIndices", static_cast<GLint>(CLUSTER_TEXTURE_UNIT + 2));
 
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    if (!glIsTexture(depthMap))
-        std::cerr << "Error: depthMap texture is invalid!" << std::endl;
+    fireShader.useShaderProgram();
+    glUniform1f(fireUniforms.flameAspectX, 1.0f);
+    glUniform1f(fireUniforms.flameAspectY, 3.0f);
+    glUniform1i(fireUniforms.fireTextureArray, 0);
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    skyboxShader.useShaderProgram();
+    glUniform1i(skyboxUniforms.daySkybox, 0);
+    glUniform1i(skyboxUniforms.nightSkybox, 1);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cerr << "Framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    initRainUniforms();
 }
 
-void initPointLightShadowMapping() {
-    glGenFramebuffers(1, &pointLightFBO);
-    glGenTextures(1, &depthCubemap);
-
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-    for (unsigned int i = 0; i < 6; ++i) {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, POINT_SHADOW_WIDTH, POINT_SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, pointLightFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "Point Light Framebuffer is not complete!" << std::endl;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void initRain() {
+    rainSimulation.minX = rainSimulation.minZ = -RAIN_HALF_EXTENT;
+    rainSimulation.maxX = rainSimulation.maxZ = RAIN_HALF_EXTENT;
+    rainSimulation.reset(NUM_RAINDROPS, randomSeed);
+    rainSimulation.initBuffers();
+    rainProceduralDensity = rainSimulation.proceduralDensity;
 }
 
-void initHeadlightShadowMapping(GLuint& FBO, GLuint& depthMap) {
-    glGenFramebuffers(1, &FBO);
-    glGenTextures(1, &depthMap);
-
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-        SPOT_LIGHT_SHADOW_WIDTH, SPOT_LIGHT_SHADOW_HEIGHT,
-        0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        std::cerr << "Headlight Framebuffer is not complete!" << std::endl;
-    }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// The least each emitter keeps while off-screen or over budget
+void initParticleBudget()
+{
+    size_t fireCount = fireParticles.getCapacity();
+    fireEmitter = particleBudget.addEmitter("fire", fireCount, fireCount / 8);
+    rainEmitter = particleBudget.addEmitter("rain", NUM_RAINDROPS, NUM_RAINDROPS / 50);
 }
 
-void initRain() {
-    raindrops.resize(NUM_RAINDROPS);
-    raindropsVelocity.resize(NUM_RAINDROPS);
-    raindropParams.resize(NUM_RAINDROPS);
-
-    for (int i = 0; i < NUM_RAINDROPS; i++) {
-        float x = rainMinX + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (rainMaxX - rainMinX)));
-        float z = rainMinZ + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (rainMaxZ - rainMinZ)));
-        float y = rainTopY + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 5.0f));
+void initBloomBuffers()
+{
+    pingpongTimer.init();
 
-        float lengthFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
-        float speedFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
+    bloomChain.init();
+    bloomChain.resize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+}
 
-        raindrops[i] = glm::vec3(x, y, z);
-        raindropsVelocity[i] = glm::vec3(0.0f, GRAVITY * speedFactor, 0.0f);
-        raindropParams[i] = glm::vec2(lengthFactor, speedFactor);
+// Size the main pass draws at. Without HDR it draws straight to the window,
+// which nothing scales up afterwards, so the whole window.
+glm::ivec2 getSceneSize() {
+    glm::vec2 windowSize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+    if (!performHDR) {
+        return glm::ivec2(windowSize);
     }
-
-    glGenVertexArrays(1, &rainVAO);
-    glBindVertexArray(rainVAO);
-
-    glGenBuffers(1, &rainVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, rainVBO);
-    glBufferData(GL_ARRAY_BUFFER, NUM_RAINDROPS * sizeof(glm::vec3), &raindrops[0], GL_DYNAMIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-
-    glGenBuffers(1, &rainParamsVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, rainParamsVBO);
-    glBufferData(GL_ARRAY_BUFFER, NUM_RAINDROPS * sizeof(glm::vec2), &raindropParams[0], GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
-
-    glBindVertexArray(0);
+    float scale = internalResolutionSteps[internalResolutionStep] * dynamicResolution.getScale();
+    return glm::max(glm::ivec2(windowSize * scale + 0.5f), glm::ivec2(1));
 }
 
-void initHDRFramebuffer() {
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++)
-    {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F,
-            myWindow.getWindowDimensions().width,
-            myWindow.getWindowDimensions().height,
-            0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glFramebufferTexture2D(GL_FRAMEBUFFER,
-            GL_COLOR_ATTACHMENT0 + i,
-            GL_TEXTURE_2D,
-            colorBuffers[i], 0);
-    }
-
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-        myWindow.getWindowDimensions().width,
-        myWindow.getWindowDimensions().height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-        GL_RENDERBUFFER, rbo);
-
-    GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "HDR Framebuffer not complete!" << std::endl;
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Of the window, per axis, after rounding to whole pixels
+glm::vec2 getSceneScale() {
+    return glm::vec2(getSceneSize()) /
+        glm::vec2(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 }
 
-void initBloomBuffers()
-{
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-
-    for (unsigned int i = 0; i < 2; i++)
+// Everything sized to the main pass rather than the window, after a resize or
+// a dynamic resolution change. The particle compositor and the scene copy
+// follow in attachSceneTargets.
+void resizeSceneTargets() {
+    glm::ivec2 sceneSize = getSceneSize();
+    if (waterFrameBuffers)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F,
-            myWindow.getWindowDimensions().width,
-            myWindow.getWindowDimensions().height,
-            0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-            GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Ping-Pong FBO " << i << " not complete!" << std::endl;
+        waterFrameBuffers->resize(sceneSize.x, sceneSize.y);
+        waterReflectionValid = false;
+        waterRefractionValid = false;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
+
+// Both draw into the main pass's targets. Binds the scene framebuffer.
+void attachSceneTargets(GLuint framebuffer, GLuint color, GLuint bright, GLuint depth) {
+    glm::ivec2 sceneSize = getSceneSize();
+    const SceneTargets& attached = attachedSceneTargets;
+    if (framebuffer != attached.framebuffer || color != attached.color || bright != attached.bright ||
+        depth != attached.depth || sceneSize != attached.size) {
+        particleCompositor.setScene(framebuffer, color, bright, depth, sceneSize.x, sceneSize.y);
+        sceneCopy.setScene(framebuffer, depth, sceneSize.x, sceneSize.y);
+        attachedSceneTargets = { framebuffer, color, bright, depth, sceneSize };
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
 void initFire()
 {
 
@@ -1578,122 +1023,55 @@ void initFire()
 
     fireTextureArray = LoadFireTextureArray(firePaths);
 
-    fireParticles.reserve(MAX_TOTAL_PARTICLES);
+    fireParticles.reset(MAX_FIRE_PARTICLES, MAX_SMOKE_PARTICLES, MAX_EMBER_PARTICLES, pointLight.position, randomSeed);
+    fireParticles.initBuffers();
 
-    for (int i = 0; i < MAX_FIRE_PARTICLES; ++i) {
-        FireParticle p;
-        respawnFireParticle(p);
-        fireParticles.push_back(p);
-    }
-
-    for (int i = 0; i < MAX_SMOKE_PARTICLES; ++i) {
-        FireParticle p;
-        respawnSmokeParticle(p);
-        fireParticles.push_back(p);
+    if (gps::GpuFireParticles::isSupported()) {
+        if (gpuFireOptions.enabled) {
+            gpuFireParticles.init(gpuFireOptions.flames, gpuFireOptions.smoke, gpuFireOptions.embers, gpuFireOptions.sparkRoom, randomSeed);
+            fireOnGpu = true;
+            std::cout << "Fire: " << gpuFireParticles.getPopulation() << " particles on the GPU" << std::endl;
+        }
+        else {
+            gpuFireParticles.init(MAX_FIRE_PARTICLES, MAX_SMOKE_PARTICLES, MAX_EMBER_PARTICLES, MAX_EMBER_PARTICLES, randomSeed);
+        }
     }
-
-    for (int i = 0; i < MAX_EMBER_PARTICLES; ++i) {
-        FireParticle p;
-        respawnEmberParticle(p);
-        fireParticles.push_back(p);
+    else if (gpuFireOptions.enabled) {
+        std::cout << "Fire: --gpu-fire ignored, compute shaders need GL 4.3" << std::endl;
     }
+}
 
-    glGenVertexArrays(1, &quad2VAO);
-    glGenBuffers(1, &quad2VBO);
-    glBindVertexArray(quad2VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, quad2VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quad2Vertices), quad2Vertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
-        4 * sizeof(GLfloat), (void*)0);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
-        4 * sizeof(GLfloat), (void*)(2 * sizeof(GLfloat)));
-
-    glGenBuffers(1, &instanceVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, MAX_TOTAL_PARTICLES * sizeof(FireParticle),
-        &fireParticles[0], GL_STREAM_DRAW);
-
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE,
-        sizeof(FireParticle),
-        (void*)offsetof(FireParticle, position));
-    glVertexAttribDivisor(2, 1);
-
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE,
-        sizeof(FireParticle),
-        (void*)offsetof(FireParticle, color));
-    glVertexAttribDivisor(3, 1);
-
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE,
-        sizeof(FireParticle),
-        (void*)offsetof(FireParticle, size));
-    glVertexAttribDivisor(4, 1);
-
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE,
-        sizeof(FireParticle),
-        (void*)offsetof(FireParticle, rotation));
-    glVertexAttribDivisor(5, 1);
-
-    glEnableVertexAttribArray(6);
-    glVertexAttribIPointer(6, 1, GL_INT,
-        sizeof(FireParticle),
-        (void*)offsetof(FireParticle, textureIndex));
-    glVertexAttribDivisor(6, 1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+void initStreaming()
+{
+    // Room for the CPU rain heights and a frame's worth of respawns (about
+    // one drop in 150 at 60 Hz, twice that here), every fire instance and the
+    // uniform blocks
+    GLsizeiptr frameSize = NUM_RAINDROPS * sizeof(float) + NUM_RAINDROPS / 75 * sizeof(gps::RainSimulation::RespawnRecord) +
+        fireParticles.getInstanceCapacity() * sizeof(gps::FireInstance) + 64 * 1024;
+    streamBuffer.init(frameSize);
+    uniformBlocks.setStreamBuffer(&streamBuffer);
+
+    std::cout << "Stream buffer: " << (streamBuffer.isPersistent() ? "persistent mapped" : "glMapBufferRange") <<
+        ", " << gps::StreamBuffer::DEFAULT_FRAME_COUNT << " x " << frameSize / 1024 << " KB" << std::endl;
 }
 
 //updaters
-void updateTour() {
-    if (!isTourActive || currentWaypoint >= keyLocations.size() - 3) return;
-    size_t idx = currentWaypoint;
-    if (idx + 3 >= keyLocations.size()) {
-        std::cerr << "Error: Attempting to access keyLocations out of bounds." << std::endl;
+// Time based: the camera covers TOUR_SPEED * deltaTime of the path whatever
+// the frame rate
+void updateTour(float deltaTime) {
+    GPS_PROFILE_ZONE("updateTour");
+    if (!isTourActive) return;
+
+    gps::TourPath::Pose pose = tourPath.sample(tourDistance);
+    myCamera.setPosition(pose.position);
+    myCamera.setTarget(pose.target);
+    myCamera.setUpDirection(pose.up);
+
+    if (tourDistance >= tourPath.getLength()) {
         isTourActive = false;
-        return;
-    }
-    const Location& P0 = keyLocations[idx];
-    const Location& P1 = keyLocations[idx + 1];
-    const Location& P2 = keyLocations[idx + 2];
-    const Location& P3 = keyLocations[idx + 3];
-
-    float easedT = easeInOut(t);
-
-    glm::vec3 interpolatedPos = catmullRomInterpolate(P0.position, P1.position, P2.position, P3.position, easedT);
-    glm::vec3 interpolatedTarget = catmullRomInterpolate(P0.target, P1.target, P2.target, P3.target, easedT);
-    glm::vec3 interpolatedUp = catmullRomInterpolate(P0.up, P1.up, P2.up, P3.up, easedT);
-    glCheckError();
-
-    myCamera.setPosition(interpolatedPos);
-    myCamera.setTarget(interpolatedTarget);
-    myCamera.setUpDirection(interpolatedUp);
-
-    glm::mat4 view = myCamera.getViewMatrix();
-    glCheckError();
-
-    myBasicShader.useShaderProgram();
-    glCheckError();
-    glUniformMatrix4fv(basicUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glCheckError();
-
-    t += tIncrement;
-    if (t > 1.0f) {
-        t = 0.0f;
-        currentWaypoint++;
-        if (currentWaypoint >= keyLocations.size() - 3) {
-            isTourActive = false;
-            std::cout << "Tour completed" << std::endl;
-        }
+        std::cout << "Tour completed" << std::endl;
     }
+    tourDistance += TOUR_SPEED * deltaTime;
 }
 
 void updateGlobalLightIntensity(float deltaTime) {
@@ -1713,8 +1091,6 @@ void updateGlobalLightIntensity(float deltaTime) {
     }
 
     globalLightIntensity = glm::clamp(globalLightIntensity, 1.0f, 15.0f);
-    myBasicShader.useShaderProgram();
-    glUniform1f(basicUniforms.globalLightIntensity, globalLightIntensity);
 }
 
 void updatePointLightIntensity(PointLight& pointLight, float deltaTime) {
@@ -1757,34 +1133,77 @@ void updatePointLightIntensity(PointLight& pointLight, float deltaTime) {
 
 
 
-void updateRain(float deltaTime) {
-    if (!rainEnabled) return;
-    for (int i = 0; i < NUM_RAINDROPS; i++) {
-        raindropsVelocity[i].y += GRAVITY * deltaTime;
-
-        if (raindropsVelocity[i].y < TERMINAL_VELOCITY) {
-            raindropsVelocity[i].y = TERMINAL_VELOCITY;
+// Bounds of fire and rain for this frame's budget, then applies the counts
+// it hands out. Simulation rates are applied by updateRain/updateFire.
+void updateParticleBudget()
+{
+    GPS_PROFILE_ZONE("updateParticleBudget");
+    glm::vec3 eye = myCamera.getPosition();
+
+    // The lake mirrors the fire, so its reflection counts as part of it
+    glm::vec3 fireMin = pointLight.position + glm::vec3(-1.5f, -0.2f, -1.5f);
+    glm::vec3 fireMax = pointLight.position + glm::vec3(1.5f, 4.0f, 1.5f);
+    if (!waterTiles.empty()) {
+        fireMin.y = std::min(fireMin.y, 2.0f * waterTiles[0].getHeight() - fireMax.y);
+    }
+    particleBudget.setBounds(fireEmitter, fireMin, fireMax);
+    particleBudget.setEnabled(fireEmitter, pointLight.enabled);
+
+    size_t rainMaxCount;
+    glm::vec2 rainMin, rainMax;
+    if (rainProcedural) {
+        float halfGrid = rainSimulation.tileSize * rainSimulation.tileGrid * 0.5f;
+        rainMin = glm::vec2(eye.x, eye.z) - halfGrid;
+        rainMax = glm::vec2(eye.x, eye.z) + halfGrid;
+        rainMaxCount = static_cast<size_t>(rainProceduralDensity * rainSimulation.tileSize * rainSimulation.tileSize) *
+            rainSimulation.tileGrid * rainSimulation.tileGrid;
+    }
+    else {
+        rainMin = glm::max(glm::vec2(eye.x, eye.z) - RAIN_VISIBLE_DISTANCE, glm::vec2(-RAIN_HALF_EXTENT));
+        rainMax = glm::min(glm::vec2(eye.x, eye.z) + RAIN_VISIBLE_DISTANCE, glm::vec2(RAIN_HALF_EXTENT));
+        glm::vec2 extent = glm::max(rainMax - rainMin, glm::vec2(0.0f));
+        float share = extent.x * extent.y / (4.0f * RAIN_HALF_EXTENT * RAIN_HALF_EXTENT);
+        rainMaxCount = static_cast<size_t>(NUM_RAINDROPS * share);
+        if (rainMaxCount > 0) {
+            rainSimulation.minX = rainMin.x;
+            rainSimulation.maxX = rainMax.x;
+            rainSimulation.minZ = rainMin.y;
+            rainSimulation.maxZ = rainMax.y;
         }
+    }
+    particleBudget.setMaxCount(rainEmitter, rainMaxCount, rainMaxCount / 50);
+    particleBudget.setBounds(rainEmitter,
+        glm::vec3(rainMin.x, rainSimulation.bottomY, rainMin.y),
+        glm::vec3(rainMax.x, rainSimulation.topY, rainMax.y));
+    particleBudget.setEnabled(rainEmitter, rainEnabled && rainMaxCount > 0);
 
-        raindrops[i] += raindropsVelocity[i] * deltaTime;
+    particleBudget.update(myCamera.getViewMatrix(), projection);
 
-        if (raindrops[i].y < rainBottomY) {
-            float x = rainMinX + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (rainMaxX - rainMinX)));
-            float z = rainMinZ + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / (rainMaxZ - rainMinZ)));
-            float y = rainTopY + static_cast<float>(rand()) / (static_cast<float>(RAND_MAX / 5.0f));
+    fireParticles.setTargetCount(particleBudget.getAllocation(fireEmitter).count);
+    size_t rainCount = particleBudget.getAllocation(rainEmitter).count;
+    if (rainProcedural) {
+        rainSimulation.proceduralDensity = rainMaxCount > 0 ?
+            rainProceduralDensity * static_cast<float>(rainCount) / rainMaxCount : 0.0f;
+    }
+    else {
+        rainSimulation.setActiveCount(rainCount);
+    }
+}
 
-            float lengthFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
-            float speedFactor = 0.5f + static_cast<float>(rand()) / RAND_MAX * 2.0f;
+void updateRain(float deltaTime) {
+    GPS_PROFILE_ZONE("updateRain");
+    if (!rainEnabled) return;
 
-            raindrops[i] = glm::vec3(x, y, z);
-            raindropsVelocity[i] = glm::vec3(0.0f, GRAVITY * speedFactor, 0.0f);
-            raindropParams[i] = glm::vec2(lengthFactor, speedFactor);
-        }
+    if (rainProcedural) {
+        rainSimulation.setProceduralUniforms(rainShader, myCamera.getPosition(), static_cast<float>(glfwGetTime()));
+        return;
     }
-
-    glBindBuffer(GL_ARRAY_BUFFER, rainVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, NUM_RAINDROPS * sizeof(glm::vec3), &raindrops[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Skipped frames still upload, the stream copy of the last one is not kept
+    float tickTime = 0.0f;
+    if (particleBudget.tick(rainEmitter, deltaTime, tickTime)) {
+        rainSimulation.update(tickTime, workerPool);
+    }
+    rainSimulation.upload(&streamBuffer);
 }
 
 void updateSpotlightRange(float fovDegrees) {
@@ -1795,286 +1214,126 @@ void updateSpotlightRange(float fovDegrees) {
     spotLight.cutOff = glm::cos(glm::radians(innerAngle));
     spotLight.outerCutOff = glm::cos(glm::radians(outerAngle));
 
-    myBasicShader.useShaderProgram();
-    glUniform1f(basicUniforms.spotLight.cutOff, spotLight.cutOff);
-    glUniform1f(basicUniforms.spotLight.outerCutOff, spotLight.outerCutOff);
-
     std::cout << "Spotlight angles updated based on FOV " << fovDegrees << "°: "
         << "Inner Angle = " << innerAngle << "°, "
         << "Outer Angle = " << outerAngle << "°" << std::endl;
 }
 
 
-glm::vec4 multiStageColor(const FireParticle& p)
-{
-    float lifeRatio = p.life / p.initialLife;
-
-    switch (p.type) {
-    case 0: {
-        glm::vec3 cStart = glm::vec3(1.0f, 0.9f, 0.6f);
-        glm::vec3 cMid = glm::vec3(1.0f, 0.5f, 0.1f);
-        glm::vec3 cLate = glm::vec3(0.6f, 0.0f, 0.0f);
-        glm::vec3 cEnd = glm::vec3(0.15f, 0.0f, 0.0f);
-
-        if (lifeRatio < 0.4f) {
-            float t = lifeRatio / 0.4f;
-            return glm::vec4(glm::mix(cStart, cMid, t), 1.0f);
-        }
-        else if (lifeRatio < 0.8f) {
-            float t = (lifeRatio - 0.4f) / 0.4f;
-            return glm::vec4(glm::mix(cMid, cLate, t), 1.0f);
-        }
-        else {
-            float t = (lifeRatio - 0.8f) / 0.2f;
-            glm::vec3 c = glm::mix(cLate, cEnd, t);
-            float alphaFade = 1.0f - 0.5f * t;
-            return glm::vec4(c, alphaFade);
-        }
-    }
-    case 1: {
-        glm::vec3 c0 = glm::vec3(0.1f, 0.1f, 0.1f);
-        glm::vec3 c1 = glm::vec3(0.45f, 0.45f, 0.45f);
-        glm::vec3 c = glm::mix(c0, c1, 1.0f - lifeRatio);
+void setClusteredLightCount(int count) {
+    // Fireflies/lanterns spread over the forest floor around the lake
+    clusteredLights.scatter(count, glm::vec3(-60.0f, 0.5f, -60.0f), glm::vec3(60.0f, 4.0f, 60.0f), 1337u);
 
-        float alpha = lifeRatio * 0.7f;
-        return glm::vec4(c, alpha);
+    clusteredLightAnchors.resize(clusteredLights.lights.size());
+    for (size_t i = 0; i < clusteredLights.lights.size(); i++) {
+        clusteredLightAnchors[i] = clusteredLights.lights[i].position;
     }
-    case 2: {
-        glm::vec3 cStart = glm::vec3(1.0f, 0.9f, 0.4f);
-        glm::vec3 cEnd = glm::vec3(1.0f, 0.2f, 0.0f);
+    std::cout << "Clustered lights: " << clusteredLights.lights.size() << std::endl;
+}
 
-        glm::vec3 c = glm::mix(cStart, cEnd, 1.0f - lifeRatio);
-        float alpha = glm::mix(1.0f, 0.0f, 1.0f - lifeRatio);
-        return glm::vec4(c, alpha);
-    }
+void updateClusteredLights(float globalTime) {
+    GPS_PROFILE_ZONE("updateClusteredLights");
+    for (size_t i = 0; i < clusteredLights.lights.size(); i++) {
+        float phase = static_cast<float>(i) * 1.618f;
+        clusteredLights.lights[i].position = clusteredLightAnchors[i] + glm::vec3(
+            sin(globalTime * 0.4f + phase),
+            0.3f * sin(globalTime * 1.3f + phase * 2.0f),
+            cos(globalTime * 0.35f + phase));
     }
-    return glm::vec4(1.0f);
 }
 
-
 void updateFire(float deltaTime, float globalTime)
 {
-    for (auto& p : fireParticles)
-    {
-        p.life -= deltaTime;
-        if (p.life <= 0.0f)
-        {
-
-            float roll = glm::linearRand(0.0f, 1.0f);
-            if (roll < 0.70f) respawnFireParticle(p);
-            else if (roll < 0.90f) respawnSmokeParticle(p);
-            else                   respawnEmberParticle(p);
-            continue;
-        }
-
-        float lifeRatio = p.life / p.initialLife;
-
-        float swirlSpeed = 0.0f;
-        if (p.type == 0) {
-
-            swirlSpeed = (0.3f + 0.1f * sin(globalTime * 1.5f))
-                + glm::linearRand(-0.05f, 0.05f);
-
-            float heightAbove = p.position.y - pointLight.position.y;
-
-            float topFactor = glm::smoothstep(0.2f, 0.6f, heightAbove);
-            swirlSpeed += 0.2f * topFactor;
-
-            if (glm::linearRand(0.0f, 1.0f) < 0.005f) {
-                p.velocity.y += glm::linearRand(0.5f, 1.5f);
-            }
-
-            if (heightAbove > 0.4f) {
-                float flickerFactor = glm::smoothstep(0.4f, 1.0f, heightAbove);
-                float randomShift = glm::linearRand(-0.1f, 0.1f) * flickerFactor;
-                p.color.r += randomShift;
-                p.color.g += randomShift * 0.5f;
-                p.color.r = glm::clamp(p.color.r, 0.0f, 1.0f);
-                p.color.g = glm::clamp(p.color.g, 0.0f, 1.0f);
-            }
-        }
-        else if (p.type == 1) {
-            swirlSpeed = (0.3f + 0.2f * glm::linearRand(0.0f, 1.0f))
-                + glm::linearRand(-0.05f, 0.05f);
-
-            p.velocity.y += sin(p.position.x + p.position.z + globalTime * 2.0f)
-                * 0.07f * deltaTime;
-        }
-        else {
-            swirlSpeed = (0.25f + glm::linearRand(-0.05f, 0.05f))
-                + glm::linearRand(-0.05f, 0.05f);
-        }
-
-        float swirlAngle = swirlSpeed * deltaTime;
-        float c = cos(swirlAngle);
-        float s = sin(swirlAngle);
-
-        float vx = p.velocity.x * c - p.velocity.z * s;
-        float vz = p.velocity.x * s + p.velocity.z * c;
-        p.velocity.x = vx;
-        p.velocity.z = vz;
-
-        float noiseScale = (p.type == 0) ? 3.0f : 2.0f;
-        float noiseStrength = (p.type == 0) ? 0.05f
-            : ((p.type == 1) ? 0.02f : 0.03f);
-        glm::vec3 noiseVec = glm::vec3(
-            glm::perlin(p.position * noiseScale + glm::vec3(0.0f, 1.0f, 0.0f)),
-            0.0f,
-            glm::perlin(p.position * noiseScale + glm::vec3(2.0f, 1.0f, 0.0f))
-        ) * noiseStrength;
-
-        p.velocity += noiseVec * deltaTime;
-        p.position += p.velocity * deltaTime;
-
-        if (p.type == 0) {
-            float maxHeight = pointLight.position.y + 1.0f;
-            if (p.position.y > maxHeight) {
-                p.position.y = maxHeight;
-                p.velocity.y *= 0.3f;
-            }
-        }
-        else if (p.type == 1) {
-            p.velocity.y += 0.03f * deltaTime;
-        }
-        else {
-            p.velocity.y -= 0.5f * deltaTime;
-        }
-
-        glm::vec4 cStage = multiStageColor(p);
-
-        if (p.type == 0) {
-            float flicker = 0.8f + 0.05f * glm::linearRand(0.0f, 1.0f);
-            cStage.a *= flicker;
-
-            float heightAbove = p.position.y - pointLight.position.y;
-            if (heightAbove > 0.3f) {
-                float fadeFactor = glm::clamp(1.0f - (heightAbove - 0.3f) * 2.0f,
-                    0.0f, 1.0f);
-                cStage.a *= fadeFactor;
-            }
-
-            cStage.r *= p.color.r;
-            cStage.g *= p.color.g;
-
-            cStage.r = glm::clamp(cStage.r, 0.0f, 1.0f);
-            cStage.g = glm::clamp(cStage.g, 0.0f, 1.0f);
-            cStage.b = glm::clamp(cStage.b, 0.0f, 1.0f);
-            cStage.a = glm::clamp(cStage.a, 0.0f, 1.0f);
-        }
-        p.color = cStage;
-
-        if (p.type == 0) {
-            if (lifeRatio > 0.9f) {
-                float t = (1.0f - lifeRatio) / 0.1f;
-                float maxSize = 0.22f;
-                p.size = maxSize * t;
-            }
-            else {
-                float t = lifeRatio / 0.9f;
-                p.size = glm::mix(0.05f, 0.22f, t);
-            }
-        }
-        else if (p.type == 1) {
-            float startSize = 0.15f, endSize = 0.35f;
-            p.size = glm::mix(endSize, startSize, lifeRatio);
-        }
-        else {
-            p.size = glm::mix(0.02f, 0.1f, lifeRatio);
+    GPS_PROFILE_ZONE("updateFire");
+    // The GPU fire only follows the budget's rate, its count is fixed at init
+    float tickTime = 0.0f;
+    bool ticked = particleBudget.tick(fireEmitter, deltaTime, tickTime);
+    if (fireOnGpu) {
+        if (ticked) {
+            gpuFireParticles.update(tickTime, globalTime, pointLight.position);
         }
-
-        p.rotation += p.rotationSpeed * deltaTime;
-        if (p.rotation > 360.f) p.rotation -= 360.f;
-        if (p.rotation < 0.f)   p.rotation += 360.f;
-
-        if (p.type == 2 && glm::linearRand(0.0f, 1.0f) < 0.05f && fireParticles.size() < MAX_TOTAL_PARTICLES) {
-            FireParticle trail;
-            trail.position = p.position - p.velocity * 0.02f;
-            trail.velocity = glm::vec3(0.0f);
-            trail.life = 0.5f;
-            trail.initialLife = 0.5f;
-            trail.color = glm::vec4(1.0f);
-            trail.size = 0.03f;
-            trail.rotation = glm::linearRand(0.0f, 360.0f);
-            trail.rotationSpeed = glm::linearRand(-80.0f, 80.0f);
-            trail.type = 2;
-            trail.textureIndex = glm::linearRand(0, 6);
-            fireParticles.push_back(trail);
-        }
-
-
+        return;
+    }
+    if (!ticked) {
+        fireParticles.upload(&streamBuffer);
+        return;
+    }
+    fireParticles.update(tickTime, globalTime, pointLight.position, workerPool);
+
+    // The refraction pass uses the main camera. The mirrored camera only
+    // flips the vertical part of the view direction, so while looking
+    // roughly level the main order is close enough to share.
+    glm::vec3 eye = myCamera.getPosition();
+    glm::vec3 forward = myCamera.getFront();
+    fireParticles.sortSmoke(gps::MAIN_VIEW, eye, forward, &workerPool);
+    fireParticles.shareSmokeOrder(gps::REFRACTION_VIEW, gps::MAIN_VIEW);
+    if (smokeReflectionSorted) {
+        float waterHeight = waterTiles[0].getHeight();
+        glm::vec3 mirroredEye(eye.x, 2.0f * waterHeight - eye.y, eye.z);
+        glm::vec3 mirroredForward(forward.x, -forward.y, forward.z);
+        fireParticles.sortSmoke(gps::REFLECTION_VIEW, mirroredEye, mirroredForward, &workerPool);
+    }
+    else {
+        fireParticles.shareSmokeOrder(gps::REFLECTION_VIEW, gps::MAIN_VIEW);
     }
 
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-        fireParticles.size() * sizeof(FireParticle),
-        &fireParticles[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    fireParticles.upload(&streamBuffer);
 }
 
 
 //renderers
 
 void renderRain() {
+    GPS_PROFILE_ZONE("renderRain");
     if (!rainEnabled) return;
 
-    rainShader.useShaderProgram();
-    glUniformMatrix4fv(rainUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(rainUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform3fv(rainUniforms.viewPosition, 1, glm::value_ptr(myCamera.getPosition()));
-
-    glUniform3fv(rainUniforms.spotLight.position, 1, glm::value_ptr(spotLight.position));
-    glUniform3fv(rainUniforms.spotLight.direction, 1, glm::value_ptr(spotLight.direction));
-
-    glUniform1i(rainUniforms.dirLight.enabled, dirLight.enabled);
-    glUniform1i(rainUniforms.spotLight.enabled, spotLight.enabled);
-    glUniform1i(rainUniforms.flashLight.enabled, flashLight.enabled);
-    glUniform1i(rainUniforms.pointLight.enabled, pointLight.enabled);
-    glUniform1i(rainUniforms.leftHeadlight.enabled, leftHeadlight.enabled);
-    glUniform1i(rainUniforms.rightHeadlight.enabled, rightHeadlight.enabled);
+    rainShader.setPassFeatures(rainProcedural ? static_cast<unsigned int>(gps::FEATURE_PROCEDURAL_RAIN) : 0u);
+    rainShader.useVariant();
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, isDay ? daySkybox->getCubemapTexture() : nightSkybox->getCubemapTexture());
-    glUniform1i(rainUniforms.environmentMap, 0);
 
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gps::ParticleCompositor::alphaBlend();
 
-    glBindVertexArray(rainVAO);
-    glDrawArrays(GL_POINTS, 0, NUM_RAINDROPS);
-    glBindVertexArray(0);
+    if (rainProcedural) {
+        rainSimulation.drawProcedural();
+    }
+    else {
+        rainSimulation.draw();
+    }
 
     glDisable(GL_BLEND);
 }
 
 
-void renderForest(gps::Shader& shader, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix) {
-
-    shader.useShaderProgram();
+// With a clip plane the BVH also drops what the pass clips away, and a
+// detail coarsens the geometry of a secondary view
+void renderForest(gps::Shader& shader, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+    const glm::vec4* clipPlane = nullptr, const gps::GeometryDetail* detail = nullptr) {
+    GPS_PROFILE_ZONE("renderForest");
 
     glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    shader.setUniform("model", model);
 
-    if (shader.shaderProgram == myBasicShader.shaderProgram) {
-        glUniformMatrix4fv(basicUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
-    }
-    else if (shader.shaderProgram == shadowShader.shaderProgram) {
-        glUniformMatrix4fv(shadowUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
-    }
-    else if (shader.shaderProgram == pointShadowShader.shaderProgram) {
-        glUniformMatrix4fv(pointShadowUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
-    }
-    else if (shader.shaderProgram == headShadowShader.shaderProgram) {
-        glUniformMatrix4fv(headShadowUniforms.model, 1, GL_FALSE, glm::value_ptr(model));
+    // Draw the forest with frustum culling
+    if (clipPlane != nullptr) {
+        forest.Draw(shader, viewMatrix, projectionMatrix, *clipPlane, detail);
     }
     else {
-        std::cerr << "Warning: Model uniform location not defined for the current shader program!" << std::endl;
+        forest.Draw(shader, viewMatrix, projectionMatrix);
     }
+}
 
-    // Draw the forest with frustum culling
-    forest.Draw(shader, viewMatrix, projectionMatrix);
+// Also culls and uploads the tiles the water draw instances
+bool isWaterInView(const glm::mat4& viewMatrix) {
+    GPS_PROFILE_ZONE("water culling");
+    return waterRenderer->cull(viewMatrix, projection, &streamBuffer) > 0;
 }
 
 
-void renderDepthMap() {
+// The lights block needs it whether or not the shadow pass runs
+void updateLightSpaceMatrix() {
     glm::vec3 lightPos = glm::normalize(-dirLight.direction) * 180.0f;
 
     lightProjection = glm::ortho(-75.0f, 75.0f, -75.0f, 75.0f, 0.1f, 300.0f);
@@ -2084,29 +1343,22 @@ void renderDepthMap() {
         glm::vec3(0.0f, 1.0f, 0.0f)
     );
     lightSpaceMatrix = lightProjection * lightView;
+}
 
-    shadowShader.useShaderProgram();
-    glUniformMatrix4fv(shadowUniforms.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-    glUniform1f(shadowUniforms.u_Time, u_Time);
-    glUniform3fv(shadowUniforms.u_WindDirection, 1, glm::value_ptr(u_WindDirection));
-    glUniform1f(shadowUniforms.u_WindStrength, u_WindStrength);
-	glUniform1f(shadowUniforms.u_GustSize, gustSize);
-	glUniform1f(shadowUniforms.u_GustSpeed, gustSpeed);
-	glUniform1f(shadowUniforms.u_WindWaveLength, windWaveLength);
-
-    glUniform1i(shadowUniforms.windEnabled, windEnabled);
+// The shadow passes draw into whatever the render graph bound
+void renderDepthMap() {
+    GPS_PROFILE_ZONE("renderDepthMap");
+    shadowShader.setUniform("lightSpaceMatrix", lightSpaceMatrix);
 
     glEnable(GL_DEPTH_TEST);
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
 
     glClear(GL_DEPTH_BUFFER_BIT);
 	renderForest(shadowShader, lightView, lightProjection);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void renderDepthCubemap() {
+    GPS_PROFILE_ZONE("renderDepthCubemap");
     float nearPlane = 0.1f;
     float farPlane = 300.0f;
     glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane);
@@ -2120,115 +1372,119 @@ void renderDepthCubemap() {
         shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f))
     };
 
-    pointShadowShader.useShaderProgram();
     for (unsigned int i = 0; i < 6; ++i) {
-        glUniformMatrix4fv(pointShadowUniforms.shadowMatrices[i], 1, GL_FALSE, glm::value_ptr(shadowTransforms[i]));
+        pointShadowShader.setUniform("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
     }
 
-    glUniform1f(pointShadowUniforms.far_plane, farPlane);
-    glUniform3fv(pointShadowUniforms.lightPos, 1, glm::value_ptr(pointLight.position));
-    glUniform1f(pointShadowUniforms.u_Time, u_Time);
-    glUniform3fv(pointShadowUniforms.u_WindDirection, 1, glm::value_ptr(u_WindDirection));
-    glUniform1f(pointShadowUniforms.u_WindStrength, u_WindStrength);
-	glUniform1f(pointShadowUniforms.u_GustSize, gustSize);
-	glUniform1f(pointShadowUniforms.u_GustSpeed, gustSpeed);
-	glUniform1f(pointShadowUniforms.u_WindWaveLength, windWaveLength);
-    glUniform1i(pointShadowUniforms.windEnabled, windEnabled);
+    pointShadowShader.setUniform("far_plane", farPlane);
+    pointShadowShader.setUniform("lightPos", pointLight.position);
 
 
     glViewport(0, 0, POINT_SHADOW_WIDTH, POINT_SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, pointLightFBO);
     glClear(GL_DEPTH_BUFFER_BIT);
 
 	renderForest(pointShadowShader, shadowTransforms[0], shadowProj);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
-glm::mat4 renderHeadlightDepthMap(SpotLight& headlight, GLuint FBO, GLuint depthMap) {
-    glm::mat4 lightProjectionHead = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 300.0f);
-    glm::mat4 lightViewHead = glm::lookAt(
+glm::mat4 getHeadlightProjection() {
+    return glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 300.0f);
+}
+
+glm::mat4 getHeadlightView(const SpotLight& headlight) {
+    return glm::lookAt(
         headlight.position,
         headlight.position + headlight.direction,
         glm::vec3(0.0f, 1.0f, 0.0f)
     );
+}
+
+void renderHeadlightDepthMap(const SpotLight& headlight) {
+    GPS_PROFILE_ZONE("renderHeadlightDepthMap");
+    glm::mat4 lightProjectionHead = getHeadlightProjection();
+    glm::mat4 lightViewHead = getHeadlightView(headlight);
     glm::mat4 lightSpaceMatrixHead = lightProjectionHead * lightViewHead;
 
-    headShadowShader.useShaderProgram();
-    glUniformMatrix4fv(headShadowUniforms.lightSpaceMatrixHead, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrixHead));
-    glUniform1f(headShadowUniforms.u_Time, u_Time);
-    glUniform3fv(headShadowUniforms.u_WindDirection, 1, glm::value_ptr(u_WindDirection));
-    glUniform1f(headShadowUniforms.u_WindStrength, u_WindStrength);\
-	glUniform1f(headShadowUniforms.u_GustSize, gustSize);
-	glUniform1f(headShadowUniforms.u_GustSpeed, gustSpeed);
-	glUniform1f(headShadowUniforms.u_WindWaveLength, windWaveLength);
-    glUniform1i(headShadowUniforms.windEnabled, windEnabled);
+    headShadowShader.setUniform("lightSpaceMatrixHead", lightSpaceMatrixHead);
 
 
     glViewport(0, 0, SPOT_LIGHT_SHADOW_WIDTH, SPOT_LIGHT_SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
     glClear(GL_DEPTH_BUFFER_BIT);
 
 	renderForest(headShadowShader, lightViewHead, lightProjectionHead);
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Units 4 to 7 of the basic shader. A map the pass did not read is culled
+// and leaves its unit empty, its light's feature is off then.
+void bindShadowMaps(const ShadowMaps& shadowMaps) {
+    glActiveTexture(GL_TEXTURE0 + 4);
+    glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(shadowMaps.directional));
+
+    glActiveTexture(GL_TEXTURE0 + 5);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, renderGraph.getTexture(shadowMaps.point));
+
+    glActiveTexture(GL_TEXTURE0 + 6);
+    glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(shadowMaps.leftHeadlight));
+
+    glActiveTexture(GL_TEXTURE0 + 7);
+    glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(shadowMaps.rightHeadlight));
+}
+
+// Units 0 and 1 of the skybox shader
+void bindSkyboxes() {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, daySkybox->getCubemapTexture());
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, nightSkybox->getCubemapTexture());
+}
 
-    return lightSpaceMatrixHead;
+// The maps a basic shader pass with these features samples, see basic.frag
+void readShadowMaps(gps::RenderGraph::PassBuilder& builder, const ShadowMaps& shadowMaps, unsigned int features) {
+    if (features & gps::FEATURE_DIR_LIGHT) {
+        builder.read(shadowMaps.directional);
+    }
+    if (features & gps::FEATURE_POINT_LIGHT) {
+        builder.read(shadowMaps.point);
+    }
+    if (features & gps::FEATURE_LEFT_HEADLIGHT) {
+        builder.read(shadowMaps.leftHeadlight);
+    }
+    if (features & gps::FEATURE_RIGHT_HEADLIGHT) {
+        builder.read(shadowMaps.rightHeadlight);
+    }
 }
 
 
-void renderFire(float currentTime)
+void renderFire(gps::ViewSlot viewSlot)
 {
+    GPS_PROFILE_ZONE("renderFire");
     fireShader.useShaderProgram();
 
-	glUniformMatrix4fv(fireUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(fireUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
-    glUniform3fv(fireUniforms.cameraRight, 1, glm::value_ptr(myCamera.getRight()));
-    glUniform3fv(fireUniforms.cameraUp, 1, glm::value_ptr(myCamera.getUp()));
-    glUniform1f(fireUniforms.time, currentTime);
-    glUniform1f(fireUniforms.flameAspectX, 1.0f);
-    glUniform1f(fireUniforms.flameAspectY, 3.0f);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, fireTextureArray);
-	glUniform1i(fireUniforms.fireTextureArray, 0);
     glDepthMask(GL_FALSE);
 
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    glBindVertexArray(quad2VAO);
+    gps::ParticleCompositor::additiveBlend();
 
-    std::vector<FireParticle> pass1;
-    pass1.reserve(fireParticles.size());
-    for (auto& p : fireParticles) {
-        if (p.type == 0 || p.type == 2) {
-            pass1.push_back(p);
-        }
+    // Flames and embers add light, smoke is drawn over them
+    if (fireOnGpu) {
+        gpuFireParticles.drawAdditive();
+    }
+    else {
+        fireParticles.drawAdditive();
     }
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, pass1.size() * sizeof(FireParticle), &pass1[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, pass1.size());
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gps::ParticleCompositor::alphaBlend();
 
-    std::vector<FireParticle> pass2;
-    pass2.reserve(fireParticles.size());
-    for (auto& p : fireParticles) {
-        if (p.type == 1) {
-            pass2.push_back(p);
-        }
+    if (fireOnGpu) {
+        gpuFireParticles.drawSmoke();
+    }
+    else {
+        fireParticles.drawSmoke(viewSlot);
     }
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, pass2.size() * sizeof(FireParticle), &pass2[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, pass2.size());
 
-    glBindVertexArray(0);
     glDepthMask(GL_TRUE);
     glDisable(GL_BLEND);
 
@@ -2236,6 +1492,38 @@ void renderFire(float currentTime)
 
 }
 
+// Fire and rain of the main pass. Into the HDR buffer each is drawn at its
+// own resolution and timed; without HDR straight into the backbuffer.
+void renderMainParticles()
+{
+    GPS_PROFILE_ZONE("renderMainParticles");
+    // Off-screen fire may still show in the reflection, only this pass skips it
+    bool fireVisible = pointLight.enabled && particleBudget.getAllocation(fireEmitter).visible;
+    if (!performHDR) {
+        if (fireVisible) {
+            renderFire(gps::MAIN_VIEW);
+        }
+        if (rainEnabled) {
+            renderRain();
+        }
+        return;
+    }
+
+    particleCompositor.beginFrame();
+    if (fireVisible) {
+        particleCompositor.begin(gps::ParticleCompositor::FIRE_EFFECT);
+        renderFire(gps::MAIN_VIEW);
+        particleCompositor.end(gps::ParticleCompositor::FIRE_EFFECT);
+    }
+    if (rainEnabled) {
+        particleCompositor.begin(gps::ParticleCompositor::RAIN_EFFECT);
+        renderRain();
+        particleCompositor.end(gps::ParticleCompositor::RAIN_EFFECT);
+    }
+    glm::ivec2 sceneSize = getSceneSize();
+    glViewport(0, 0, sceneSize.x, sceneSize.y);
+}
+
 void renderQuad()
 {
     if (quadVAO == 0)
@@ -2261,7 +1549,112 @@ void renderQuad()
     glBindVertexArray(0);
 }
 
+//uniform blocks
+gps::DirLightBlock toBlock(const DirLight& light) {
+    gps::DirLightBlock block = {};
+    block.direction = light.direction;
+    block.ambient = light.ambient;
+    block.diffuse = light.diffuse;
+    block.specular = light.specular;
+    block.color = light.color;
+    block.enabled = light.enabled;
+    return block;
+}
+
+gps::PointLightBlock toBlock(const PointLight& light) {
+    gps::PointLightBlock block = {};
+    block.position = light.position;
+    block.ambient = light.ambient;
+    block.diffuse = light.diffuse;
+    block.specular = light.specular;
+    block.color = light.color;
+    block.constant = light.constant;
+    block.linear = light.linear;
+    block.quadratic = light.quadratic;
+    block.enabled = light.enabled;
+    return block;
+}
+
+gps::SpotLightBlock toBlock(const SpotLight& light) {
+    gps::SpotLightBlock block = {};
+    block.position = light.position;
+    block.direction = light.direction;
+    block.cutOff = light.cutOff;
+    block.outerCutOff = light.outerCutOff;
+    block.ambient = light.ambient;
+    block.diffuse = light.diffuse;
+    block.specular = light.specular;
+    block.color = light.color;
+    block.enabled = light.enabled;
+    return block;
+}
+
+// projectionMatrix and previousViewProjection differ from the global
+// projection in the jittered main view only
+void setViewBlock(gps::ViewSlot slot, const glm::mat4& viewMatrix, const glm::vec4& clipPlane,
+    const glm::mat4& projectionMatrix, const glm::mat4& previousViewProjection) {
+    gps::ViewBlock block = {};
+    block.view = viewMatrix;
+    block.projection = projectionMatrix;
+    block.clipPlane = clipPlane;
+    block.viewPos = glm::vec3(glm::inverse(viewMatrix)[3]);
+    block.cameraRight = glm::vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+    block.cameraUp = glm::vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+    block.previousViewProjection = previousViewProjection;
+    uniformBlocks.setView(slot, block);
+}
+
+// Global toggles for the basic shader, material bits are added per mesh
+unsigned int basicPassFeatures() {
+    unsigned int features = 0;
+    if (useNormalMapping) features |= gps::FEATURE_NORMAL_MAPPING;
+    if (rainEnabled) features |= gps::FEATURE_RAIN;
+    if (fogEnabled) features |= gps::FEATURE_FOG;
+    if (windEnabled) features |= gps::FEATURE_WIND;
+    if (dirLight.enabled) features |= gps::FEATURE_DIR_LIGHT;
+    if (pointLight.enabled) features |= gps::FEATURE_POINT_LIGHT;
+    if (spotLight.enabled) features |= gps::FEATURE_SPOT_LIGHT;
+    if (leftHeadlight.enabled) features |= gps::FEATURE_LEFT_HEADLIGHT;
+    if (rightHeadlight.enabled) features |= gps::FEATURE_RIGHT_HEADLIGHT;
+    if (flashLight.enabled) features |= gps::FEATURE_FLASH_LIGHT;
+    return features;
+}
+
+//blur extractor for bloom, into two textures of the render graph
+void blurBrightTexture(const glm::vec2& sceneScale, gps::RenderGraph::Resource bright, const gps::RenderGraph::Resource pingpong[2])
+{
+    GPS_PROFILE_ZONE("blurBrightTexture");
+    pingpongTimer.begin();
+    bool horizontal = true, firstIteration = true;
+    blurShader.useShaderProgram();
+    unsigned int amount = blurIterations;
+
+    for (unsigned int i = 0; i < amount; i++)
+    {
+        renderGraph.bindFramebuffer({ pingpong[horizontal] });
+        glUniform1i(blurUniforms.horizontal, horizontal);
+        // Only the first pass reads the part the main pass drew
+        glUniform2fv(blurUniforms.sourceScale, 1, glm::value_ptr(firstIteration ? sceneScale : glm::vec2(1.0f)));
+
+        glActiveTexture(GL_TEXTURE0);
+        if (firstIteration) {
+            glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(bright));
+        }
+        else {
+            glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(pingpong[!horizontal]));
+        }
+        renderQuad();
+
+        horizontal = !horizontal;
+        if (firstIteration)
+            firstIteration = false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    pingpongTimer.end();
+}
+
 void renderScene() {
+    GPS_PROFILE_ZONE("renderScene");
 
     spotLight.position = myCamera.getPosition();
     spotLight.direction = myCamera.getFront();
@@ -2287,21 +1680,8 @@ void renderScene() {
 
     if (pointLight.enabled) {
         updatePointLightIntensity(pointLight, deltaTime);
-
-        myBasicShader.useShaderProgram();
-        glUniform3fv(basicUniforms.pointLight.ambient, 1, glm::value_ptr(pointLight.ambient));
-        glUniform3fv(basicUniforms.pointLight.diffuse, 1, glm::value_ptr(pointLight.diffuse));
-        glUniform3fv(basicUniforms.pointLight.specular, 1, glm::value_ptr(pointLight.specular));
-        glUniform1f(basicUniforms.pointLight.constant, pointLight.constant);
-        glUniform1f(basicUniforms.pointLight.linear, pointLight.linear);
-        glUniform1f(basicUniforms.pointLight.quadratic, pointLight.quadratic);
     }
 
-    renderDepthMap();
-    renderDepthCubemap();
-    glm::mat4 leftHeadlightLightSpaceMatrix = renderHeadlightDepthMap(leftHeadlight, leftHeadlightFBO, leftHeadlightDepthMap);
-    glm::mat4 rightHeadlightLightSpaceMatrix = renderHeadlightDepthMap(rightHeadlight, rightHeadlightFBO, rightHeadlightDepthMap);
-
     glGetIntegerv(GL_POLYGON_MODE, polygonModeParams);
     currentPolygonMode = polygonModeParams[0];
 
@@ -2314,7 +1694,6 @@ void renderScene() {
         glPointSize(1.0f);
     }
 
-	currentTime = static_cast<float>(glfwGetTime());
     if (transitioning) {
         float elapsed = currentTime - transitionStartTime;
         float progress = elapsed / transitionDuration;
@@ -2334,190 +1713,425 @@ void renderScene() {
     lakeLightPosition = glm::mix(lakeNightPosition, lakeDayPosition, blend);
     lakeLightColor = glm::mix(lakeNightColor, lakeDayColor, blend);
 
-    glm::vec3 currentFogColor = glm::mix(nightFogColor, dayFogColor, blend);
-	float currentgFogEnd = glm::mix(nightgFogEnd, daygFogEnd, blend);
-	float currentgExpFogDensity = glm::mix(nightgExpFogDensity, daygExpFogDensity, blend);
-	float currentgLayeredFogTop = glm::mix(nightgLayeredFogTop, daygLayeredFogTop, blend);
+    gps::FrameBlock frameBlock = {};
+    frameBlock.time = u_Time;
+    frameBlock.fogTime = fogTime;
+    frameBlock.globalLightIntensity = globalLightIntensity;
+    frameBlock.fogEnd = glm::mix(nightgFogEnd, daygFogEnd, blend);
+    frameBlock.layeredFogTop = glm::mix(nightgLayeredFogTop, daygLayeredFogTop, blend);
+    frameBlock.expFogDensity = glm::mix(nightgExpFogDensity, daygExpFogDensity, blend);
+    frameBlock.dayNightBlend = blend;
+    frameBlock.fogColor = glm::mix(nightFogColor, dayFogColor, blend);
+    uniformBlocks.setFrame(frameBlock);
+
+    gps::WindBlock windBlock = {};
+    windBlock.direction = u_WindDirection;
+    windBlock.strength = u_WindStrength;
+    windBlock.gustSize = gustSize;
+    windBlock.gustSpeed = gustSpeed;
+    windBlock.waveLength = windWaveLength;
+    uniformBlocks.setWind(windBlock);
+
+    // The wind update and the shadow passes only read the frame and wind blocks
+    uniformBlocks.flush();
+
+    glm::mat4 forestModel = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec3 forestCamera = glm::vec3(glm::inverse(forestModel) * glm::vec4(myCamera.getPosition(), 1.0f));
+    windDeformer.update(forest.meshBatches, forestCamera, windEnabled);
+
+    updateLightSpaceMatrix();
+
+    gps::LightsBlock lightsBlock = {};
+    lightsBlock.dirLight = toBlock(dirLight);
+    lightsBlock.flashLight = toBlock(flashLight);
+    lightsBlock.pointLight = toBlock(pointLight);
+    lightsBlock.spotLight = toBlock(spotLight);
+    lightsBlock.leftHeadlight = toBlock(leftHeadlight);
+    lightsBlock.rightHeadlight = toBlock(rightHeadlight);
+    lightsBlock.lightSpaceMatrix = lightSpaceMatrix;
+    lightsBlock.leftHeadlightLightSpaceMatrix = getHeadlightProjection() * getHeadlightView(leftHeadlight);
+    lightsBlock.rightHeadlightLightSpaceMatrix = getHeadlightProjection() * getHeadlightView(rightHeadlight);
+    lightsBlock.farPlane = 300.0f;
+    uniformBlocks.setLights(lightsBlock);
+
+    // All three views are known up front, so they go out in a single flush
+    view = myCamera.getViewMatrix();
+    // Mirrored in the water plane. Camera::invertPitch only flips the stored
+    // angle, not the direction, so the view is built here.
+    float waterHeight = waterTiles[0].getHeight();
+    glm::vec3 mirroredEye = myCamera.getPosition();
+    mirroredEye.y = 2.0f * waterHeight - mirroredEye.y;
+    glm::vec3 mirroredFront = myCamera.getFront();
+    mirroredFront.y = -mirroredFront.y;
+    glm::mat4 reflectionView = glm::lookAt(mirroredEye, mirroredEye + mirroredFront, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    glm::vec4 reflectionClipPlane(0, 1, 0, -waterHeight + 1.0f);
+    glm::vec4 refractionClipPlane(0, -1, 0, waterHeight);
+    // The main view alone is jittered and moves between frames; culling
+    // keeps the plain projection, the jitter is below a pixel
+    glm::mat4 mainProjection = projection;
+    glm::mat4 mainPreviousViewProjection = projection * view;
+    if (performTemporalAA) {
+        temporalAA.beginFrame(getSceneSize(), projection * view);
+        mainProjection = temporalAA.getJitterMatrix() * projection;
+        mainPreviousViewProjection = temporalAA.getPreviousViewProjection();
+    }
+    setViewBlock(gps::MAIN_VIEW, view, glm::vec4(0, 1, 0, 10000), mainProjection, mainPreviousViewProjection);
+    setViewBlock(gps::REFLECTION_VIEW, reflectionView, reflectionClipPlane, projection, projection * reflectionView);
+    setViewBlock(gps::REFRACTION_VIEW, view, refractionClipPlane, projection, projection * view);
+    uniformBlocks.flush();
 
     myBasicShader.useShaderProgram();
-    glUniform1f(basicUniforms.u_Time, u_Time);
-    glUniform3fv(basicUniforms.u_WindDirection, 1, glm::value_ptr(u_WindDirection));
-    glUniform1f(basicUniforms.u_WindStrength, u_WindStrength);
-
-    glUniform1i(basicUniforms.dirLight.enabled, dirLight.enabled);
-    glUniform1i(basicUniforms.pointLight.enabled, pointLight.enabled);
-    glUniform1i(basicUniforms.spotLight.enabled, spotLight.enabled);
-    glUniform1i(basicUniforms.leftHeadlight.enabled, leftHeadlight.enabled);
-    glUniform1i(basicUniforms.rightHeadlight.enabled, rightHeadlight.enabled);
-
-    glUniform3fv(basicUniforms.dirLight.direction, 1, glm::value_ptr(dirLight.direction));
-    glUniform3fv(basicUniforms.dirLight.ambient, 1, glm::value_ptr(dirLight.ambient));
-    glUniform3fv(basicUniforms.dirLight.diffuse, 1, glm::value_ptr(dirLight.diffuse));
-    glUniform3fv(basicUniforms.dirLight.specular, 1, glm::value_ptr(dirLight.specular));
-    glUniform3fv(basicUniforms.dirLight.color, 1, glm::value_ptr(dirLight.color));
-
-    glUniform3fv(basicUniforms.viewPosition, 1, glm::value_ptr(myCamera.getPosition()));
-
-    glUniform3fv(basicUniforms.spotLight.position, 1, glm::value_ptr(spotLight.position));
-    glUniform3fv(basicUniforms.spotLight.direction, 1, glm::value_ptr(spotLight.direction));
-
-    glUniform1i(basicUniforms.useNormalMapping, useNormalMapping);
-    glUniform1i(basicUniforms.rainEnabled, rainEnabled);
-    glUniform1i(basicUniforms.windEnabled, windEnabled);
-    glUniform1i(basicUniforms.fogEnabled, fogEnabled);
-
-	glUniform3fv(basicUniforms.fogColor, 1, glm::value_ptr(currentFogColor));
-	glUniform1f(basicUniforms.gFogEnd, currentgFogEnd);
-	glUniform1f(basicUniforms.gExpFogDensity, currentgExpFogDensity);
-	glUniform1f(basicUniforms.gLayeredFogTop, currentgLayeredFogTop);
-	glUniform1f(basicUniforms.gFogTime, fogTime);
-
-
-    glUniformMatrix4fv(basicUniforms.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-    glUniform1f(basicUniforms.farPlane, 300.0f);
-
-    glUniformMatrix4fv(basicUniforms.leftHeadlightLightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(leftHeadlightLightSpaceMatrix));
-    glUniformMatrix4fv(basicUniforms.rightHeadlightLightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(rightHeadlightLightSpaceMatrix));
-
-    glActiveTexture(GL_TEXTURE0 + 4);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glUniform1i(basicUniforms.shadowMap, 4);
-
-    glActiveTexture(GL_TEXTURE0 + 5);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-    glUniform1i(basicUniforms.pointLightShadowMap, 5);
-
-    glActiveTexture(GL_TEXTURE0 + 6);
-    glBindTexture(GL_TEXTURE_2D, leftHeadlightDepthMap);
-    glUniform1i(basicUniforms.leftHeadlightShadowMap, 6);
-
-    glActiveTexture(GL_TEXTURE0 + 7);
-    glBindTexture(GL_TEXTURE_2D, rightHeadlightDepthMap);
-    glUniform1i(basicUniforms.rightHeadlightShadowMap, 7);
-
-    skyboxShader.useShaderProgram();
-
-    glm::mat4 skyboxView = glm::mat4(glm::mat3(view));
-
-    glUniformMatrix4fv(skyboxUniforms.view, 1, GL_FALSE, glm::value_ptr(skyboxView));
-    glUniformMatrix4fv(skyboxUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, daySkybox->getCubemapTexture());
-    glUniform1i(skyboxUniforms.daySkybox, 0);
+    // The froxel grid is built for the main camera only, the water passes skip it
+    bool clusteredLightsActive = !clusteredLights.lights.empty();
+    if (clusteredLightsActive) {
+        clusteredLights.assign(view, projection, 0.1f, 300.0f, workerPool);
+        clusteredLights.upload();
+        clusteredLights.bindTextures(CLUSTER_TEXTURE_UNIT);
+
+        myBasicShader.setUniform("clusterDims", clusteredLights.getDimensions());
+        myBasicShader.setUniform("clusterZParams", clusteredLights.getZParams());
+        myBasicShader.setUniform("clusterScreenSize", glm::vec2(getSceneSize()));
+    }
+    // The water passes draw with the secondary view profile
+    const gps::ViewQuality& waterQuality = waterQualitySteps[waterQualityStep];
+    unsigned int waterFeatures = waterQuality.apply(basicPassFeatures());
+    unsigned int mainFeatures = basicPassFeatures() | (clusteredLightsActive ? static_cast<unsigned int>(gps::FEATURE_CLUSTERED_LIGHTS) : 0u);
+
+    // No water in the frustum, or none of it passed the depth test last
+    // time it was drawn: the main pass does not read the water textures and
+    // the render graph culls the water pass
+    bool waterInView = isWaterInView(view);
+    if (!waterInView) {
+        waterRenderer->resetVisibility();
+    }
+    bool waterVisible = waterInView && waterRenderer->wasVisible();
+
+    bool waterTraced = waterScreenSpace && performHDR;
+    if (waterTraced) {
+        waterReflectionValid = false;
+        waterRefractionValid = false;
+    }
+
+    // A slow camera sees little change between frames, so the two textures
+    // are re-rendered in turn every few frames
+    glm::vec3 cameraPosition = myCamera.getPosition();
+    glm::vec3 cameraFront = myCamera.getFront();
+    float cameraMoved = glm::length(cameraPosition - waterLastCameraPosition);
+    float cameraTurned = std::acos(glm::clamp(glm::dot(cameraFront, waterLastCameraFront), -1.0f, 1.0f));
+    bool slowCamera = cameraMoved <= WATER_SLOW_SPEED * deltaTime && cameraTurned <= WATER_SLOW_TURN * deltaTime;
+    waterLastCameraPosition = cameraPosition;
+    waterLastCameraFront = cameraFront;
+
+    int waterInterval = slowCamera ? waterUpdateSteps[waterUpdateStep] : 1;
+    waterFrame++;
+    bool updateReflection = !waterTraced &&
+        (!waterReflectionValid || waterFrame % waterInterval == 0);
+    bool updateRefraction = !waterTraced &&
+        (!waterRefractionValid || waterFrame % waterInterval == static_cast<unsigned int>(waterInterval / 2));
+
+    if (!waterVisible) {
+        waterSkippedFrames++;
+    }
+    else if (!waterTraced) {
+        waterReflectionReuses += updateReflection ? 0 : 1;
+        waterRefractionReuses += updateRefraction ? 0 : 1;
+    }
+
+    // Batch bounds are in the forest's model space
+    glm::mat4 forestInverse = glm::rotate(glm::mat4(1.0f), glm::radians(-angle), glm::vec3(0.0f, 1.0f, 0.0f));
+    gps::GeometryDetail reflectionDetail = waterQuality.geometry(glm::vec3(forestInverse * glm::vec4(mirroredEye, 1.0f)), projection);
+    gps::GeometryDetail refractionDetail = waterQuality.geometry(glm::vec3(forestInverse * glm::vec4(cameraPosition, 1.0f)), projection);
+
+    glm::ivec2 sceneSize = getSceneSize();
+    glm::vec2 sceneScale = getSceneScale();
+    glm::ivec2 windowSize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+
+    // The passes below run in this order once the graph has dropped the
+    // ones nothing reads
+    renderGraph.beginFrame();
+    gps::RenderGraph::Resource backbuffer = renderGraph.importBackbuffer();
+    gps::RenderGraph::Resource waterReflection = renderGraph.import("water reflection",
+        waterFrameBuffers->getReflectionTexture(), waterFrameBuffers->getReflectionBytes());
+    gps::RenderGraph::Resource waterRefraction = renderGraph.import("water refraction",
+        waterFrameBuffers->getRefractionTexture(), waterFrameBuffers->getRefractionBytes());
+
+    ShadowMaps shadowMaps = { gps::RenderGraph::NO_RESOURCE, gps::RenderGraph::NO_RESOURCE,
+        gps::RenderGraph::NO_RESOURCE, gps::RenderGraph::NO_RESOURCE };
+    renderGraph.addPass("directional shadow",
+        [&](gps::RenderGraph::PassBuilder& builder) {
+            shadowMaps.directional = builder.create("directional shadow map", gps::RenderTextureDesc::shadowMap(SHADOW_WIDTH));
+        },
+        [&]() {
+            renderGraph.bindFramebuffer({}, shadowMaps.directional);
+            renderDepthMap();
+        });
+    renderGraph.addPass("point shadow",
+        [&](gps::RenderGraph::PassBuilder& builder) {
+            shadowMaps.point = builder.create("point shadow cube map", gps::RenderTextureDesc::shadowCubeMap(POINT_SHADOW_WIDTH));
+        },
+        [&]() {
+            renderGraph.bindFramebuffer({}, shadowMaps.point);
+            renderDepthCubemap();
+        });
+    renderGraph.addPass("left headlight shadow",
+        [&](gps::RenderGraph::PassBuilder& builder) {
+            shadowMaps.leftHeadlight = builder.create("left headlight shadow map",
+                gps::RenderTextureDesc::shadowMap(SPOT_LIGHT_SHADOW_WIDTH));
+        },
+        [&]() {
+            renderGraph.bindFramebuffer({}, shadowMaps.leftHeadlight);
+            renderHeadlightDepthMap(leftHeadlight);
+        });
+    renderGraph.addPass("right headlight shadow",
+        [&](gps::RenderGraph::PassBuilder& builder) {
+            shadowMaps.rightHeadlight = builder.create("right headlight shadow map",
+                gps::RenderTextureDesc::shadowMap(SPOT_LIGHT_SHADOW_WIDTH));
+        },
+        [&]() {
+            renderGraph.bindFramebuffer({}, shadowMaps.rightHeadlight);
+            renderHeadlightDepthMap(rightHeadlight);
+        });
+
+    // Both water views in one pass, they share the timer
+    if (updateReflection || updateRefraction) {
+        renderGraph.addPass("water views",
+            [&](gps::RenderGraph::PassBuilder& builder) {
+                readShadowMaps(builder, shadowMaps, waterFeatures);
+                if (updateReflection) {
+                    builder.write(waterReflection);
+                }
+                if (updateRefraction) {
+                    builder.write(waterRefraction);
+                }
+            },
+            [&]() {
+                waterPassTimer.begin();
+                myBasicShader.setPassFeatures(waterFeatures);
+                bindShadowMaps(shadowMaps);
+                bindSkyboxes();
+
+                if (updateReflection) {
+                    waterFrameBuffers->bindReflectionFrameBuffer();
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    uniformBlocks.bindView(gps::REFLECTION_VIEW);
+                    daySkybox->Draw(skyboxShader);
+
+                    renderForest(myBasicShader, reflectionView, projection, &reflectionClipPlane, &reflectionDetail);
+
+                    if (pointLight.enabled) {
+                        renderFire(gps::REFLECTION_VIEW);
+                    }
+                    if (rainEnabled) {
+                        renderRain();
+                    }
+                    waterReflectionViewProjection = projection * reflectionView;
+                    waterReflectionValid = true;
+                }
+                if (updateRefraction) {
+                    waterFrameBuffers->bindRefractionFrameBuffer();
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    uniformBlocks.bindView(gps::REFRACTION_VIEW);
+                    daySkybox->Draw(skyboxShader);
+                    renderForest(myBasicShader, view, projection, &refractionClipPlane, &refractionDetail);
+                    if (pointLight.enabled) {
+                        renderFire(gps::REFRACTION_VIEW);
+                    }
+                    if (rainEnabled) {
+                        renderRain();
+                    }
+                    waterRefractionViewProjection = projection * view;
+                    waterRefractionValid = true;
+                }
 
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, nightSkybox->getCubemapTexture());
-    glUniform1i(skyboxUniforms.nightSkybox, 1);
+                waterPassTimer.end();
+            });
+    }
+
+    // Without HDR the main pass draws straight into the window
+    gps::RenderGraph::Resource sceneColor = gps::RenderGraph::NO_RESOURCE;
+    gps::RenderGraph::Resource sceneBright = gps::RenderGraph::NO_RESOURCE;
+    gps::RenderGraph::Resource velocity = gps::RenderGraph::NO_RESOURCE;
+    gps::RenderGraph::Resource sceneDepth = gps::RenderGraph::NO_RESOURCE;
+    renderGraph.addPass("main",
+        [&](gps::RenderGraph::PassBuilder& builder) {
+            readShadowMaps(builder, shadowMaps, mainFeatures);
+            // An occluded tile is still drawn for its occlusion query, what
+            // it samples then is never seen
+            if (waterVisible && !waterTraced) {
+                builder.read(waterReflection);
+                builder.read(waterRefraction);
+            }
+            if (!performHDR) {
+                builder.write(backbuffer);
+                return;
+            }
+            sceneColor = builder.create("scene color", gps::RenderTextureDesc::windowSized(GL_RGBA16F, GL_LINEAR));
+            sceneBright = builder.create("scene bright", gps::RenderTextureDesc::windowSized(GL_RGBA16F, GL_LINEAR));
+            // Screen motion in texture coordinates, only the temporal resolve reads it
+            if (performTemporalAA) {
+                velocity = builder.create("velocity", gps::RenderTextureDesc::windowSized(GL_RG16F, GL_NEAREST));
+            }
+            // A texture rather than a renderbuffer, the particle compositor
+            // and the scene copy sample it
+            sceneDepth = builder.create("scene depth", gps::RenderTextureDesc::windowSized(GL_DEPTH_COMPONENT24, GL_NEAREST));
+        },
+        [&]() {
+            bindShadowMaps(shadowMaps);
+            bindSkyboxes();
+
+            // The sky and the forest write motion vectors, everything drawn
+            // over them keeps the motion of what is behind it
+            GLenum opaqueAttachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+            bool writesVelocity = velocity != gps::RenderGraph::NO_RESOURCE;
+            if (performHDR) {
+                std::vector<gps::RenderGraph::Resource> colors = { sceneColor, sceneBright };
+                if (writesVelocity) {
+                    colors.push_back(velocity);
+                }
+                GLuint framebuffer = renderGraph.bindFramebuffer(colors, sceneDepth);
+                attachSceneTargets(framebuffer, renderGraph.getTexture(sceneColor), renderGraph.getTexture(sceneBright),
+                    renderGraph.getTexture(sceneDepth));
+                if (writesVelocity) {
+                    glDrawBuffers(3, opaqueAttachments);
+                }
+            }
+            else {
+                renderGraph.bindFramebuffer({ backbuffer });
+            }
 
-    glUniform1f(skyboxUniforms.blendFactor, blend);
+            glViewport(0, 0, sceneSize.x, sceneSize.y);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            uniformBlocks.bindView(gps::MAIN_VIEW);
+            myBasicShader.setPassFeatures(mainFeatures);
+            daySkybox->Draw(skyboxShader);
 
+            renderForest(myBasicShader, view, projection);
 
-    waterFrameBuffers->bindReflectionFrameBuffer();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    float distance = 2 * (myCamera.getPosition().y - waterTiles[0].getHeight());
-    glm::vec3 position = myCamera.getPosition();
-    position.y -= distance;
-    myCamera.setPosition(position);
-    myCamera.invertPitch();
-    view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(basicUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glUniform4fv(basicUniforms.clipPlane, 1, glm::value_ptr(glm::vec4(0, 1, 0, -waterTiles[0].getHeight() + 1.0f)));
-    daySkybox->Draw(skyboxShader);
+            if (writesVelocity) {
+                glDrawBuffers(2, opaqueAttachments);
+            }
 
-	renderForest(myBasicShader, view, projection);
+            renderMainParticles();
 
-    if (pointLight.enabled) {
-        renderFire(currentTime);
-    }
-    if (rainEnabled) {
-        renderRain();
-    }
-    position.y += distance;
-    myCamera.setPosition(position);
-    myCamera.invertPitch();
-    view = myCamera.getViewMatrix();
-    waterFrameBuffers->bindRefractionFrameBuffer();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(basicUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
-    glUniform4fv(basicUniforms.clipPlane, 1, glm::value_ptr(glm::vec4(0, -1, 0, waterTiles[0].getHeight())));
-    daySkybox->Draw(skyboxShader);
-	renderForest(myBasicShader, view, projection);
-    if (pointLight.enabled) {
-        renderFire(currentTime);
-    }
-    if (rainEnabled) {
-        renderRain();
-    }
+            GLuint reflectionTexture = waterFrameBuffers->getReflectionTexture();
+            GLuint refractionTexture = waterFrameBuffers->getRefractionTexture();
+            GLuint depthTexture = waterFrameBuffers->getRefractionDepthTexture();
 
-    waterFrameBuffers->unbindCurrentFrameBuffer(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-    performHDR = hdrEnabled && !isWireframe && !isPointMode;
+            if (waterInView && waterTraced) {
+                waterPassTimer.begin();
+                sceneCopy.capture();
+                waterPassTimer.end();
+                waterRenderer->renderScreenSpace(sceneCopy, daySkybox->getCubemapTexture(), nightSkybox->getCubemapTexture(),
+                    deltaTime, lakeLightPosition, lakeLightColor);
+            }
+            else if (waterInView) {
+                waterRenderer->render(reflectionTexture, refractionTexture, depthTexture,
+                    waterReflectionViewProjection, waterRefractionViewProjection, deltaTime, lakeLightPosition, lakeLightColor);
+            }
+        });
+
+    // Resolve, bloom and tonemapping of the HDR scene. Of the two bloom
+    // passes only the one hdr.frag reads survives culling, none while bloom
+    // is off.
+    gps::RenderGraph::Resource history = gps::RenderGraph::NO_RESOURCE;
+    gps::RenderGraph::Resource chain = gps::RenderGraph::NO_RESOURCE;
+    // The blur starts in the second texture and ends in the first after an
+    // even number of iterations
+    gps::RenderGraph::Resource pingpong[2] = { gps::RenderGraph::NO_RESOURCE, gps::RenderGraph::NO_RESOURCE };
     if (performHDR) {
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    }
-    else {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
-
-    glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    myBasicShader.useShaderProgram();
-    glUniform4fv(basicUniforms.clipPlane, 1, glm::value_ptr(glm::vec4(0, 1, 0, 10000)));
-    daySkybox->Draw(skyboxShader);
+        history = renderGraph.import("taa history", temporalAA.getTexture(), temporalAA.getAllocatedBytes());
+        renderGraph.addPass("temporal resolve",
+            [&](gps::RenderGraph::PassBuilder& builder) {
+                builder.read(sceneColor);
+                builder.read(velocity);
+                builder.read(sceneDepth);
+                builder.write(history);
+            },
+            [&]() {
+                temporalAA.resolve(renderGraph.getTexture(sceneColor), renderGraph.getTexture(velocity),
+                    renderGraph.getTexture(sceneDepth), sceneScale);
+            });
+
+        chain = renderGraph.import("bloom chain", bloomChain.getTexture(), bloomChain.getAllocatedBytes());
+        renderGraph.addPass("bloom chain",
+            [&](gps::RenderGraph::PassBuilder& builder) {
+                builder.read(sceneBright);
+                builder.write(chain);
+            },
+            [&]() {
+                bloomChain.render(renderGraph.getTexture(sceneBright), sceneScale);
+            });
+
+        renderGraph.addPass("bloom blur",
+            [&](gps::RenderGraph::PassBuilder& builder) {
+                builder.read(sceneBright);
+                pingpong[0] = builder.create("bloom ping", gps::RenderTextureDesc::windowSized(GL_RGBA16F, GL_LINEAR));
+                pingpong[1] = builder.create("bloom pong", gps::RenderTextureDesc::windowSized(GL_RGBA16F, GL_LINEAR));
+            },
+            [&]() {
+                glViewport(0, 0, windowSize.x, windowSize.y);
+                blurBrightTexture(sceneScale, sceneBright, pingpong);
+            });
+
+        // Resolved to the window size, nothing left for hdr.frag to upscale
+        renderGraph.addPass("tonemap",
+            [&](gps::RenderGraph::PassBuilder& builder) {
+                builder.read(performTemporalAA ? history : sceneColor);
+                if (bloomEnabled) {
+                    builder.read(bloomMipChain ? chain : pingpong[blurIterations % 2 == 0 ? 0 : 1]);
+                }
+                builder.write(backbuffer);
+            },
+            [&]() {
+                GLuint sceneTexture = renderGraph.getTexture(sceneColor);
+                glm::vec2 renderScale = sceneScale;
+                if (performTemporalAA) {
+                    sceneTexture = temporalAA.getTexture();
+                    renderScale = glm::vec2(1.0f);
+                }
 
-	renderForest(myBasicShader, view, projection);
+                renderGraph.bindFramebuffer({ backbuffer });
+                glViewport(0, 0, windowSize.x, windowSize.y);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (pointLight.enabled) {
-        renderFire(currentTime);
-    }
-    if (rainEnabled) {
-        renderRain();
-    }
+                hdrShader.useShaderProgram();
 
-    GLuint reflectionTexture = waterFrameBuffers->getReflectionTexture();
-    GLuint refractionTexture = waterFrameBuffers->getRefractionTexture();
-    GLuint depthTexture = waterFrameBuffers->getRefractionDepthTexture();
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, sceneTexture);
+                glUniform1i(hdrUniforms.hdrBuffer, 0);
 
-    currentTime = glfwGetTime();
-    waterRenderer->render(waterTiles, view, myCamera.getPosition(), reflectionTexture, refractionTexture, depthTexture, deltaTime, lakeLightPosition, lakeLightColor);
-    if (performHDR) {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    }
+                glActiveTexture(GL_TEXTURE1);
 
+                if (bloomMipChain) {
+                    glBindTexture(GL_TEXTURE_2D, bloomChain.getTexture());
+                    glUniform1f(hdrUniforms.bloomScale, bloomChain.getScale());
+                }
+                else {
+                    glBindTexture(GL_TEXTURE_2D, renderGraph.getTexture(pingpong[blurIterations % 2 == 0 ? 0 : 1]));
+                    glUniform1f(hdrUniforms.bloomScale, 1.0f);
+                }
+                glUniform1i(hdrUniforms.bloomBlur, 1);
 
-}
+                glUniform1i(hdrUniforms.bloom, bloomEnabled);
 
-//blur extractor for bloom
-void blurBrightTexture()
-{
-    bool horizontal = true, firstIteration = true;
-    blurShader.useShaderProgram();
-    unsigned int amount = blurIterations;
+                glUniform1f(hdrUniforms.exposure, exposure);
+                glUniform2fv(hdrUniforms.renderScale, 1, glm::value_ptr(renderScale));
+                glUniform1f(hdrUniforms.sharpness, upscaleSharpness);
 
-    for (unsigned int i = 0; i < amount; i++)
-    {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-        glUniform1i(blurUniforms.horizontal, horizontal);
-
-        glActiveTexture(GL_TEXTURE0);
-        if (firstIteration) {
-            glBindTexture(GL_TEXTURE_2D, colorBuffers[1]);
-        }
-        else {
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        }
-        renderQuad();
+                renderQuad();
+            });
+    }
 
-        horizontal = !horizontal;
-        if (firstIteration)
-            firstIteration = false;
+    renderGraph.compile();
+    if (renderGraphDumpRequested) {
+        std::cout << renderGraph.describe();
+        renderGraphDumpRequested = false;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    renderGraph.execute();
 }
 
-
 //resizers,movement and callbacks
 void toggleFullscreen(bool enable) {
     if (enable) {
@@ -2573,11 +2187,10 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         glPointSize(1.0f);
     }
 
-    if (key == GLFW_KEY_T) {
-        isTourActive = true;
-        currentWaypoint = 0;
-        t = 0.0f;
-        std::cout << "Tour started" << std::endl;
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        if (startTour()) {
+            std::cout << "Tour started, " << static_cast<int>(tourPath.getLength() / TOUR_SPEED) << " s" << std::endl;
+        }
     }
     if (key == GLFW_KEY_Y) {
         isTourActive = false;
@@ -2704,9 +2317,6 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
                 isFlashing = false;
                 flashLight.enabled = false;
                 globalLightIntensity = 1.0f;
-                myBasicShader.useShaderProgram();
-                glUniform1i(basicUniforms.flashLight.enabled, flashLight.enabled);
-                glUniform1f(basicUniforms.globalLightIntensity, globalLightIntensity);
                 std::cout << "Ongoing flash terminated due to rain being disabled." << std::endl;
             }
         }
@@ -2789,62 +2399,138 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         removeKeyPressed = false;
     }
 
-}
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        rainProcedural = !rainProcedural;
+        std::cout << "Rain: " << (rainProcedural ? "procedural (GPU)" : "simulated (CPU)") << std::endl;
+    }
 
-void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
-    if (isTourActive) return;
-    myCamera.updateMousePosition(xpos, ypos);
-}
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        if (gpuFireParticles.isInitialized()) {
+            fireOnGpu = !fireOnGpu;
+            std::cout << "Fire: " << (fireOnGpu ? "compute shaders (GPU)" : "worker pool (CPU)") << std::endl;
+        }
+        else {
+            std::cout << "Fire: compute shaders need GL 4.3" << std::endl;
+        }
+    }
 
-void resizeHDRFramebuffer(int width, int height) {
-    glDeleteTextures(2, colorBuffers);
+    if ((key == GLFW_KEY_8 || key == GLFW_KEY_9) && action == GLFW_PRESS) {
+        const int steps = sizeof(particleDivisorSteps) / sizeof(particleDivisorSteps[0]);
+        bool fire = key == GLFW_KEY_8;
+        int& step = fire ? fireDivisorStep : rainDivisorStep;
+        step = (step + 1) % steps;
+        gps::ParticleCompositor::Effect effect = fire ? gps::ParticleCompositor::FIRE_EFFECT : gps::ParticleCompositor::RAIN_EFFECT;
+        particleCompositor.setDivisor(effect, particleDivisorSteps[step]);
+        std::cout << (fire ? "Fire" : "Rain") << " resolution: 1/" << particleDivisorSteps[step] << std::endl;
+    }
 
-    for (unsigned int i = 0; i < 2; i++) {
-        glGenTextures(1, &colorBuffers[i]);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (key == GLFW_KEY_J && action == GLFW_PRESS) {
+        const int steps = sizeof(waterUpdateSteps) / sizeof(waterUpdateSteps[0]);
+        waterUpdateStep = (waterUpdateStep + 1) % steps;
+        std::cout << "Water reflection/refraction while the camera is slow: every " <<
+            waterUpdateSteps[waterUpdateStep] << " frame(s)" << std::endl;
+    }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        const int steps = sizeof(waterQualitySteps) / sizeof(waterQualitySteps[0]);
+        waterQualityStep = (waterQualityStep + 1) % steps;
+        const gps::ViewQuality& quality = waterQualitySteps[waterQualityStep];
+        glm::ivec2 sceneSize = getSceneSize();
+        waterFrameBuffers->setDivisor(quality.resolutionDivisor, sceneSize.x, sceneSize.y);
+        waterReflectionValid = false;
+        waterRefractionValid = false;
+        std::cout << "Water views: " << (quality.simplifiedGeometry ? "secondary profile" : "full quality") <<
+            " at 1/" << quality.resolutionDivisor << " resolution" << std::endl;
     }
 
-    glDeleteRenderbuffers(1, &rbo);
+    if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+        waterScreenSpace = !waterScreenSpace;
+        std::cout << "Water reflections: " << (waterScreenSpace ? "screen-space" : "planar") << std::endl;
+    }
 
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
+    if (key == GLFW_KEY_0 && action == GLFW_PRESS) {
+        dynamicResolutionEnabled = !dynamicResolutionEnabled;
+        std::cout << "Dynamic resolution: " << (dynamicResolutionEnabled ? "ON" : "OFF") << std::endl;
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
+    if (key == GLFW_KEY_F7 && action == GLFW_PRESS) {
+        temporalAAEnabled = !temporalAAEnabled;
+        std::cout << "Temporal anti-aliasing: " << (temporalAAEnabled ? "ON" : "OFF") << std::endl;
+    }
 
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Resized HDR Framebuffer not complete!" << std::endl;
+    if (key == GLFW_KEY_F8 && action == GLFW_PRESS) {
+        const int steps = sizeof(internalResolutionSteps) / sizeof(internalResolutionSteps[0]);
+        internalResolutionStep = (internalResolutionStep + 1) % steps;
+        resizeSceneTargets();
+        std::cout << "Internal resolution: " << static_cast<int>(internalResolutionSteps[internalResolutionStep] * 100.0f) <<
+            "% of the window" << std::endl;
+    }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS) {
+        renderGraphDumpRequested = true;
+    }
 
-    glDeleteTextures(2, pingpongColorbuffers);
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS) {
+        std::string path = (mode & GLFW_MOD_SHIFT) ? "profile.csv" : "profile_trace.json";
+        bool written = (mode & GLFW_MOD_SHIFT) ? profiler.writeCsv(path) : profiler.writeChromeTrace(path);
+        if (written) {
+            std::cout << "Profile of " << profiler.getHistory().size() << " frames written to " << path << std::endl;
+        }
+        std::cout << profiler.report();
+    }
 
-    for (unsigned int i = 0; i < 2; i++) {
-        glGenTextures(1, &pingpongColorbuffers[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        bloomMipChain = !bloomMipChain;
+        std::cout << "Bloom blur: " << (bloomMipChain ? "downsample chain" : "full resolution ping-pong") << std::endl;
+    }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
+    if (key == GLFW_KEY_I && action == GLFW_PRESS) {
+        waterRenderer->setProjectedGrid(!waterRenderer->isProjectedGrid());
+        std::cout << "Water geometry: " << (waterRenderer->isProjectedGrid() ? "projected grid" : "instanced tiles") << std::endl;
+    }
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Resized Ping-Pong FBO " << i << " not complete!" << std::endl;
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        const int steps = sizeof(particleBudgetSteps) / sizeof(particleBudgetSteps[0]);
+        particleBudgetStep = (particleBudgetStep + 1) % steps;
+        particleBudget.budget = particleBudgetSteps[particleBudgetStep];
+        if (particleBudget.budget == 0) {
+            std::cout << "Particle budget: off" << std::endl;
+        }
+        else {
+            std::cout << "Particle budget: " << particleBudget.budget << " per frame" << std::endl;
+        }
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        smokeReflectionSorted = !smokeReflectionSorted;
+        std::cout << "Smoke in the reflection: " << (smokeReflectionSorted ? "own sort" : "main view order") << std::endl;
+    }
+
+    if (key == GLFW_KEY_K && action == GLFW_PRESS && !clusteredLightsKeyPressed) {
+        const int steps = sizeof(clusteredLightSteps) / sizeof(clusteredLightSteps[0]);
+        clusteredLightStep = (clusteredLightStep + 1) % steps;
+        setClusteredLightCount(clusteredLightSteps[clusteredLightStep]);
+        clusteredLightsKeyPressed = true;
+    }
+    if (key == GLFW_KEY_K && action == GLFW_RELEASE) {
+        clusteredLightsKeyPressed = false;
+    }
+
+}
+
+void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+    if (isTourActive) return;
+    myCamera.updateMousePosition(xpos, ypos);
+}
+
+// Everything sized to the window. The render graph recreates its own
+// textures at the new size when they are next used.
+void resizeRenderTargets(int width, int height) {
+    renderGraph.setWindowSize(width, height);
+    bloomChain.resize(width, height);
+    temporalAA.resize(width, height);
+
+    resizeSceneTargets();
 }
 
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
@@ -2863,20 +2549,12 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
     projection = glm::perspective(glm::radians(myCamera.getFov()),
         static_cast<float>(width) / static_cast<float>(height),
         0.1f, 300.0f);
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(basicUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
 
     double xpos, ypos;
     glfwGetCursorPos(window, &xpos, &ypos);
     myCamera.setLastMousePosition(static_cast<float>(xpos), static_cast<float>(ypos));
 
-    resizeHDRFramebuffer(width, height);
-
-    if (waterFrameBuffers)
-    {
-        waterFrameBuffers->resize(width, height);
-    }
-
+    resizeRenderTargets(width, height);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -2889,15 +2567,6 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
         static_cast<float>(width) / static_cast<float>(height),
         0.1f, 300.0f);
 
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(basicUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
-    rainShader.useShaderProgram();
-    glUniformMatrix4fv(rainUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
-    skyboxShader.useShaderProgram();
-    glUniformMatrix4fv(skyboxUniforms.projection, 1, GL_FALSE, glm::value_ptr(projection));
-
     float currentFOV = myCamera.getFov();
     updateSpotlightRange(currentFOV);
 }
@@ -2918,6 +2587,7 @@ void setWindowCallbacks() {
 }
 
 void processMovement() {
+    GPS_PROFILE_ZONE("processMovement");
     if (isTourActive) return;
 
     if (pressedKeys[GLFW_KEY_W]) {
@@ -2940,83 +2610,220 @@ void processMovement() {
     }
 
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(basicUniforms.view, 1, GL_FALSE, glm::value_ptr(view));
 }
 
 //cleanup
+// Everything a frame does but the swap, shared by the window and --benchmark
+void updateAndRenderFrame(float deltaTime, float currentTime) {
+    // Everything written to the stream buffer until endFrame shares a partition
+    streamBuffer.beginFrame();
+
+    processMovement();
+    updateParticleBudget();
+    updateRain(deltaTime);
+    updateFire(deltaTime, currentTime);
+    updateClusteredLights(currentTime);
+
+    if (isTourActive) {
+        updateTour(deltaTime);
+    }
+
+    // The main pass has no depth texture without HDR, nor a target
+    // to draw smaller into
+    bool wasHDR = performHDR;
+    performHDR = hdrEnabled && !isWireframe && !isPointMode;
+    if (dynamicResolution.setEnabled(dynamicResolutionEnabled && performHDR) || performHDR != wasHDR) {
+        resizeSceneTargets();
+    }
+    performTemporalAA = temporalAAEnabled && performHDR;
+    if (!performTemporalAA) {
+        temporalAA.reset();
+    }
+    dynamicResolution.beginFrame();
+
+    renderScene();
+
+    if (dynamicResolution.endFrame()) {
+        resizeSceneTargets();
+    }
+    streamBuffer.endFrame();
+}
+
+// --benchmark: the tour without a window, input or audio. Every frame
+// advances the simulation and glfwGetTime by the same time step, so with the
+// fixed seed two runs draw the same frames. Rain, fire and wind are on and
+// the resolution fixed, so frame times only depend on the machine.
+int runTourBenchmark(const gps::TourBenchmarkOptions& options) {
+    if (!startTour()) {
+        return EXIT_FAILURE;
+    }
+    rainEnabled = true;
+    pointLight.enabled = true;
+    windEnabled = true;
+    dynamicResolutionEnabled = false;
+
+    double simulatedTime = 0.0;
+    auto advanceFrame = [&]() {
+        simulatedTime += options.timeStep;
+        glfwSetTime(simulatedTime);
+        updateAndRenderFrame(options.timeStep, static_cast<float>(simulatedTime));
+        {
+            GPS_PROFILE_ZONE("swap");
+            myWindow.swapBuffers();
+        }
+        glCheckError();
+    };
+
+    for (int frame = 0; frame < options.warmupFrames; frame++) {
+        advanceFrame();
+    }
+
+    // Timed from the start of the tour again, keeping every frame
+    startTour();
+    int expectedFrames = static_cast<int>(std::ceil(tourPath.getLength() / (TOUR_SPEED * options.timeStep))) + 1;
+    profiler.setHistoryFrames(expectedFrames);
+    std::cout << "Benchmark: " << expectedFrames << " frames at " << options.width << "x" << options.height << std::endl;
+
+    // Around each whole frame, so its GPU time is there without GPS_PROFILING
+    static const int frameZone = gps::Profiler::registerZone("frame");
+    auto start = std::chrono::steady_clock::now();
+    int frames = 0;
+    while (isTourActive) {
+        profiler.beginFrame();
+        profiler.beginZone(frameZone, true);
+        advanceFrame();
+        profiler.endZone();
+        profiler.endFrame();
+        frames++;
+    }
+    profiler.flush();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<std::pair<std::string, std::string>> info = {
+        { "renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)) },
+        { "version", reinterpret_cast<const char*>(glGetString(GL_VERSION)) },
+        { "resolution", std::to_string(options.width) + "x" + std::to_string(options.height) },
+        { "time_step", std::to_string(options.timeStep) },
+        { "seed", std::to_string(options.seed) },
+        { "warmup_frames", std::to_string(options.warmupFrames) },
+        { "frames", std::to_string(frames) },
+        { "tour_length", std::to_string(tourPath.getLength()) },
+        { "tour_speed", std::to_string(TOUR_SPEED) },
+        { "wall_seconds", std::to_string(wallSeconds) },
+        { "profiling_zones", GPS_PROFILING ? "on" : "off" },
+        { "fire", fireOnGpu ? "gpu " + std::to_string(gpuFireParticles.getPopulation()) : "cpu " + std::to_string(fireParticles.getTotalCount()) }
+    };
+    std::cout << profiler.report();
+    if (!profiler.writeJson(options.outputPath, info)) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "Benchmark: " << frames << " frames in " << wallSeconds << " s written to " << options.outputPath << std::endl;
+    return EXIT_SUCCESS;
+}
+
 void cleanup() {
     glDeleteVertexArrays(1, &quadVAO);
-    glDeleteVertexArrays(1, &quad2VAO);
-    glDeleteVertexArrays(1, &rainVAO);
 
     glDeleteBuffers(1, &quadVBO);
-    glDeleteBuffers(1, &quad2VBO);
-    glDeleteBuffers(1, &instanceVBO);
-    glDeleteBuffers(1, &rainVBO);
-    glDeleteBuffers(1, &rainParamsVBO);
-
-    glDeleteTextures(2, colorBuffers);
-    glDeleteTextures(2, pingpongColorbuffers);
-    glDeleteTextures(1, &depthMap);
-    glDeleteTextures(1, &depthCubemap);
-    glDeleteTextures(1, &leftHeadlightDepthMap);
-    glDeleteTextures(1, &rightHeadlightDepthMap);
-    glDeleteTextures(1, &fireTextureArray);
 
-    glDeleteFramebuffers(1, &hdrFBO);
-    glDeleteFramebuffers(2, pingpongFBO);
-    glDeleteFramebuffers(1, &shadowMapFBO);
-    glDeleteFramebuffers(1, &pointLightFBO);
-    glDeleteFramebuffers(1, &leftHeadlightFBO);
-    glDeleteFramebuffers(1, &rightHeadlightFBO);
-
-    glDeleteRenderbuffers(1, &rbo);
+    glDeleteTextures(1, &fireTextureArray);
 
-    glDeleteProgram(myBasicShader.shaderProgram);
+    myBasicShader.deletePrograms();
     glDeleteProgram(skyboxShader.shaderProgram);
-    glDeleteProgram(shadowShader.shaderProgram);
-    glDeleteProgram(pointShadowShader.shaderProgram);
-    glDeleteProgram(headShadowShader.shaderProgram);
-    glDeleteProgram(rainShader.shaderProgram);
+    shadowShader.deletePrograms();
+    pointShadowShader.deletePrograms();
+    headShadowShader.deletePrograms();
+    rainShader.deletePrograms();
     glDeleteProgram(hdrShader.shaderProgram);
     glDeleteProgram(fireShader.shaderProgram);
     glDeleteProgram(blurShader.shaderProgram);
 
+    clusteredLights.cleanup();
+    windDeformer.cleanup();
+    particleCompositor.cleanup();
+    sceneCopy.cleanup();
+    rainSimulation.cleanup();
+    fireParticles.cleanup();
+    gpuFireParticles.cleanup();
+    uniformBlocks.setStreamBuffer(nullptr);
+    uniformBlocks.cleanup();
+    streamBuffer.cleanup();
+    bloomChain.cleanup();
+    dynamicResolution.cleanup();
+    temporalAA.cleanup();
+    renderGraph.cleanup();
+    gps::Profiler::setActive(nullptr);
+    profiler.cleanup();
+    // Keeps the variants compiled during this run
+    programCache.save();
+
     delete daySkybox;
     delete nightSkybox;
     delete waterRenderer;
 	delete waterFrameBuffers;
+    waterPassTimer.cleanup();
+    pingpongTimer.cleanup();
 
     audioManager.shutdown();
 
-    glfwTerminate();
+    myWindow.Delete();
 }
 
 //main
 int main(int argc, const char* argv[]) {
 
+    if (gps::runBenchmarks(argc, argv)) {
+        return EXIT_SUCCESS;
+    }
+    gps::TourBenchmarkOptions benchmark = gps::parseTourBenchmarkOptions(argc, argv);
+    gpuFireOptions = gps::parseGpuFireOptions(argc, argv);
+    if (benchmark.enabled) {
+        randomSeed = benchmark.seed;
+    }
+    srand(randomSeed);
+
     try {
-        initOpenGLWindow();
+        if (benchmark.enabled) {
+            myWindow.CreateOffscreen(benchmark.width, benchmark.height);
+        }
+        else {
+            initOpenGLWindow();
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
+    gps::installUniformCallCounter();
+
+    programCache.init("shader_cache.bin");
+    gps::Shader::setProgramCache(&programCache);
+    gps::Shader::enableParallelCompile();
+
+    profiler.init();
+    gps::Profiler::setActive(&profiler);
 
     initOpenGLState();
-    initModels();
     initShaders();
-    initShadowMapping();
-    initPointLightShadowMapping();
-    initHeadlightShadowMapping(leftHeadlightFBO, leftHeadlightDepthMap);
-    initHeadlightShadowMapping(rightHeadlightFBO, rightHeadlightDepthMap);
+    initModels();
+    finishShaders();
     initUniforms();
     initRain();
-    initHDRFramebuffer();
+    renderGraph.setWindowSize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     initBloomBuffers();
+    particleCompositor.init(uniformBlocks);
+    sceneCopy.init();
+    dynamicResolution.init();
+    temporalAA.init();
+    temporalAA.resize(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     initFire();
-    setWindowCallbacks();
+    initParticleBudget();
+    initStreaming();
+    clusteredLights.init();
+    windDeformer.init(uniformBlocks);
+    if (!benchmark.enabled) {
+        setWindowCallbacks();
+    }
 
     int windowWidth = myWindow.getWindowDimensions().width;
     int windowHeight = myWindow.getWindowDimensions().height;
@@ -3027,6 +2834,23 @@ int main(int argc, const char* argv[]) {
     int refractionHeight = windowHeight / 2;
 
     waterFrameBuffers = new WaterFrameBuffers(reflectionWidth, reflectionHeight, refractionWidth, refractionHeight);
+    waterPassTimer.init();
+
+    waterRenderer = new WaterRenderer(
+        "shaders/water.vert",
+        "shaders/water.frag",
+        "models/forest/textures/waterDUDV.png",
+        "models/forest/textures/waterNORMAL.png");
+
+    waterTiles.emplace_back(15.0f, 15.0f, -3.0f);
+    waterRenderer->setTiles(waterTiles);
+    loadWaypoints("waypoints.txt");
+
+    if (benchmark.enabled) {
+        int result = runTourBenchmark(benchmark);
+        cleanup();
+        return result;
+    }
 
     if (!audioManager.initialize()) {
         std::cerr << "Failed to initialize AudioManager." << std::endl;
@@ -3060,29 +2884,64 @@ int main(int argc, const char* argv[]) {
     float thunderDelay = 1.0f;
     float thunderTimer = 0.0f;
 
-    srand(static_cast<unsigned int>(time(nullptr)));
-
     nextFlashTime = static_cast<float>(rand()) / RAND_MAX * (flashIntervalMax - flashIntervalMin) + flashIntervalMin;
 
-    waterRenderer = new WaterRenderer(
-        "shaders/water.vert",
-        "shaders/water.frag",
-        projection,
-        "models/forest/textures/waterDUDV.png",
-        "models/forest/textures/waterNORMAL.png");
-
-
-   waterTiles.emplace_back(15.0f, 15.0f, -3.0f);
-   loadWaypoints("waypoints.txt");
-
     while (!glfwWindowShouldClose(myWindow.getWindow())) {
+        profiler.beginFrame();
         currentTime = glfwGetTime();
         timeDiff = currentTime - prevTime;
         counter++;
         if (timeDiff >= 1.0 / 30.0) {
             std::string FPS = std::to_string((1.0 / timeDiff) * counter);
             std::string ms = std::to_string((timeDiff / counter) * 1000);
-            std::string title = "OpenGL Forest | FPS: " + FPS + " | ms: " + ms;
+            std::string uniformCalls = std::to_string(gps::takeUniformCallCount() / counter);
+            std::string blockUploads = std::to_string(uniformBlocks.takeUploadCount() / counter);
+            std::string streamed = std::to_string(streamBuffer.takeStreamedBytes() / counter / 1024) + " KB/frame, " +
+                std::to_string(streamBuffer.takeStallCount()) + " stalls";
+            std::string variants = std::to_string(myBasicShader.getVariantCount() + shadowShader.getVariantCount() +
+                pointShadowShader.getVariantCount() + headShadowShader.getVariantCount());
+            std::string wind = std::to_string(windDeformer.getGpuMs()) + " ms (" +
+                std::to_string(windDeformer.getUpdatedCount()) + " swayed, " +
+                std::to_string(windDeformer.getSkippedCount()) + " lod)";
+            std::string particles = "fire " + std::to_string(particleCompositor.getGpuMs(gps::ParticleCompositor::FIRE_EFFECT)) +
+                " ms (1/" + std::to_string(particleCompositor.getDivisor(gps::ParticleCompositor::FIRE_EFFECT)) + "), rain " +
+                std::to_string(particleCompositor.getGpuMs(gps::ParticleCompositor::RAIN_EFFECT)) + " ms (1/" +
+                std::to_string(particleCompositor.getDivisor(gps::ParticleCompositor::RAIN_EFFECT)) + ")";
+            std::string budget = std::to_string(particleBudget.getGrantedCost()) + "/" +
+                std::to_string(particleBudget.getRequestedCost()) + " (fire " +
+                std::to_string(particleBudget.getAllocation(fireEmitter).count) + ", rain " +
+                std::to_string(particleBudget.getAllocation(rainEmitter).count) + ", " +
+                std::to_string(particleBudget.getOffscreenCount()) + " off-screen)";
+            std::string water = std::string(waterScreenSpace ? "screen-space " : "planar ") +
+                (waterRenderer->isProjectedGrid() ? "grid " : "quads ") + std::to_string(waterRenderer->getVisibleCount()) + "/" +
+                std::to_string(waterRenderer->getTileCount()) + " tiles, " +
+                std::to_string(waterPassTimer.getGpuMs()) + " ms, skipped " + std::to_string(waterSkippedFrames) + "/" + std::to_string(counter) +
+                " frames, reused reflection " + std::to_string(waterReflectionReuses) + ", refraction " +
+                std::to_string(waterRefractionReuses);
+            waterSkippedFrames = waterReflectionReuses = waterRefractionReuses = 0;
+            std::string resolution = std::to_string(static_cast<int>(getSceneScale().x * 100.0f + 0.5f)) + "% (GPU " +
+                std::to_string(dynamicResolution.getGpuMs()) + " / " + std::to_string(dynamicResolution.getTargetMs()) + " ms)";
+            std::string taa = performTemporalAA ?
+                std::to_string(temporalAA.getGpuMs()) + " ms, " + std::to_string(temporalAA.getAllocatedBytes() / 1024) + " KB" :
+                std::string("off");
+            size_t pingpongBytes = 2 * static_cast<size_t>(myWindow.getWindowDimensions().width) *
+                myWindow.getWindowDimensions().height * 8;
+            std::string bloom = bloomMipChain ?
+                "chain " + std::to_string(bloomChain.getGpuMs()) + " ms, " +
+                    std::to_string(bloomChain.getAllocatedBytes() / 1024) + " KB" :
+                "ping-pong " + std::to_string(pingpongTimer.getGpuMs()) + " ms, " + std::to_string(pingpongBytes / 1024) + " KB";
+            std::string graph = std::to_string(renderGraph.getPassCount() - renderGraph.getCulledCount()) + "/" +
+                std::to_string(renderGraph.getPassCount()) + " passes, transient " +
+                std::to_string(renderGraph.getAliasedBytes() / 1024) + " KB (" +
+                std::to_string(renderGraph.getTransientBytes() / 1024) + " KB unaliased)";
+            std::string profile = "cpu p95 " + std::to_string(profiler.getFramePercentile(95.0, false)) + " ms, gpu p95 " +
+                std::to_string(profiler.getFramePercentile(95.0, true)) + " ms, overhead " +
+                std::to_string(profiler.getMeanOverheadUs()) + " us";
+            std::string title = "OpenGL Forest | FPS: " + FPS + " | ms: " + ms +
+                " | uniform calls: " + uniformCalls + " | block uploads: " + blockUploads +
+                " | shader variants: " + variants + " | wind: " + wind + " | stream: " + streamed +
+                " | particles: " + particles + " | budget: " + budget + " | water: " + water + " | bloom: " + bloom + " | resolution: " + resolution +
+                " | taa: " + taa + " | graph: " + graph + " | profile: " + profile;
             glfwSetWindowTitle(myWindow.getWindow(), title.c_str());
             counter = 0;
             prevTime = currentTime;
@@ -3104,30 +2963,24 @@ int main(int argc, const char* argv[]) {
                     flashDuration = 0.3f + static_cast<float>(rand()) / RAND_MAX * 1.2f;
                     flashTimer = flashDuration;
 
-                    myBasicShader.useShaderProgram();
-
                     activePulses.clear();
                     timeSinceLastPulse = 0.0f;
 
                     flashLight.enabled = true;
-					glUniform1i(basicUniforms.flashLight.enabled, flashLight.enabled);
 
                     flashLight.direction = glm::normalize(glm::vec3(
                         static_cast<float>(rand()) / RAND_MAX * 2.0f - 1.0f,
                         static_cast<float>(rand()) / RAND_MAX * 0.5f + 0.5f,
                         static_cast<float>(rand()) / RAND_MAX * 2.0f - 1.0f
                     ));
-					glUniform3fv(basicUniforms.flashLight.direction, 1, glm::value_ptr(flashLight.direction));
 
                     flashLight.color = glm::vec3(
                         10.0f + static_cast<float>(rand()) / RAND_MAX * 2.0f,
                         10.0f + static_cast<float>(rand()) / RAND_MAX * 2.0f,
                         12.0f + static_cast<float>(rand()) / RAND_MAX * 2.0f
                     );
-					glUniform3fv(basicUniforms.flashLight.color, 1, glm::value_ptr(flashLight.color));
 
                     globalLightIntensity = 1.0f;
-                    glUniform1f(basicUniforms.globalLightIntensity, globalLightIntensity);
 
                     isThunderScheduled = true;
                     thunderDelay = 0.8f + static_cast<float>(rand()) / RAND_MAX * 1.2f;
@@ -3142,11 +2995,6 @@ int main(int argc, const char* argv[]) {
                     flashLight.enabled = false;
                     globalLightIntensity = 1.0f;
 
-                    myBasicShader.useShaderProgram();
-					glUniform1i(basicUniforms.flashLight.enabled, flashLight.enabled);
-
-                    glUniform1f(basicUniforms.globalLightIntensity, globalLightIntensity);
-
                     activePulses.clear();
                     timeSinceLastPulse = 0.0f;
 
@@ -3174,15 +3022,7 @@ int main(int argc, const char* argv[]) {
         }
 
 
-        processMovement();
-        updateRain(deltaTime);
-        updateFire(deltaTime, static_cast<float>(currentTime));
-
-        if (isTourActive) {
-            updateTour();
-        }
-
-        renderScene();
+        updateAndRenderFrame(deltaTime, static_cast<float>(currentTime));
 
         if (rainEnabled) {
             if (!rainPlaying) {
@@ -3212,34 +3052,14 @@ int main(int argc, const char* argv[]) {
             }
         }
 
-        if (performHDR) {
-            blurBrightTexture();
-
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            hdrShader.useShaderProgram();
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-			glUniform1i(hdrUniforms.hdrBuffer, 0);
-
-            glActiveTexture(GL_TEXTURE1);
-
-            bool finalTexIndex = (blurIterations % 2 == 0) ? 0 : 1;
-            glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[finalTexIndex]);
-			glUniform1i(hdrUniforms.bloomBlur, 1);
-
-			glUniform1i(hdrUniforms.bloom, bloomEnabled);
-
-			glUniform1f(hdrUniforms.exposure, exposure);
-
-            renderQuad();
-        }
         glfwPollEvents();
-        glfwSwapBuffers(myWindow.getWindow());
+        {
+            GPS_PROFILE_ZONE("swap");
+            glfwSwapBuffers(myWindow.getWindow());
+        }
 
         glCheckError();
+        profiler.endFrame();
     }
     cleanup();
     return EXIT_SUCCESS;
@@ -7,55 +7,26 @@ in mat3 TBN;
 in vec4 FragPosLightSpace;
 in vec4 FragPosLightSpaceLeftHeadlight;
 in vec4 FragPosLightSpaceRightHeadlight;
+in vec4 fClipPosition;
+in vec4 fPreviousClipPosition;
 
 layout(location = 0) out vec4 gFragColor;
 layout(location = 1) out vec4 gBrightColor;
+// Screen motion since the last frame in texture coordinates, read by the
+// temporal resolve (gps::TemporalAA)
+layout(location = 2) out vec2 gVelocity;
 
 
-// Lighting structures
-struct DirLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 color;
-    int enabled;
-};
-
-struct PointLight {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 color;
-    float constant;
-    float linear;
-    float quadratic;
-    int enabled;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    vec3 color;
-    int enabled;
-};
-
-uniform DirLight dirLight;
-uniform DirLight flashLight;
-uniform PointLight pointLight;
-uniform SpotLight spotLight;
-uniform SpotLight leftHeadlight;
-uniform SpotLight rightHeadlight;
-uniform vec3 viewPos;
-uniform int useBlinnPhong;
-uniform int useNormalMapping;
-uniform int rainEnabled;
+// Shared uniform blocks (bound by gps::UniformBlocks)
+#include "include/frame.glsl"
+#include "include/view.glsl"
+#include "include/lights.glsl"
+
+// Feature switches come in as FEATURE_* defines, one program per combination
+// (see gps::Shader::useVariant). Specular is only lit on rock or wet surfaces.
+#if defined(FEATURE_BLINN_PHONG) || defined(FEATURE_RAIN)
+#define USE_SPECULAR
+#endif
 
 uniform sampler2D diffuseTexture;
 uniform sampler2D normalTexture;
@@ -66,18 +37,13 @@ uniform samplerCube pointLightShadowMap;
 uniform sampler2D leftHeadlightShadowMap;
 uniform sampler2D rightHeadlightShadowMap;
 
-uniform float farPlane;
-
-uniform float globalLightIntensity;
-
-uniform int fogEnabled;
-uniform vec3 fogColor;
-uniform float gFogEnd;
-uniform float gLayeredFogTop;
-uniform float gFogTime;
-uniform float gExpFogDensity;
-
-uniform int windEnabled;
+// Clustered point lights (see ClusteredLights.hpp)
+uniform samplerBuffer clusterLightData;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterLightIndices;
+uniform ivec3 clusterDims;
+uniform vec4 clusterZParams;   // near, far, slice scale, slice bias
+uniform vec2 clusterScreenSize;
 
 vec3 sampleOffsetDirections[20] = vec3[](
     vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
@@ -87,6 +53,8 @@ vec3 sampleOffsetDirections[20] = vec3[](
     vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
 );
 
+#ifdef FEATURE_FOG
+
 float CalcLayeredFogFactor()
 {
     vec3 CameraProj = viewPos;
@@ -155,6 +123,8 @@ float CalcAnimatedFogFactor()
     return FogFactor;
 }
 
+#endif
+
 
 
 float PointShadowCalculation(vec3 normal, vec3 fragPos, vec3 lightDir)
@@ -171,7 +141,11 @@ float PointShadowCalculation(vec3 normal, vec3 fragPos, vec3 lightDir)
     
     float shadow = 0.0;
     
+#ifdef FEATURE_SINGLE_SHADOW_TAP
+    int samples = 1;
+#else
     int samples = 20;
+#endif
     for (int i = 0; i < samples; ++i)
     {
         float closestDepth = texture(pointLightShadowMap, fragToLight + sampleOffsetDirections[i] * diskRadius).r;
@@ -183,14 +157,14 @@ float PointShadowCalculation(vec3 normal, vec3 fragPos, vec3 lightDir)
     
     shadow /= float(samples);
 
-    if (spotLight.enabled == 1) {
-        vec3 spotDir = normalize(spotLight.position - fragPos);
-        float theta = dot(spotDir, normalize(-spotLight.direction));
-        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
-        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+#ifdef FEATURE_SPOT_LIGHT
+    vec3 spotDir = normalize(spotLight.position - fragPos);
+    float theta = dot(spotDir, normalize(-spotLight.direction));
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
 
-        shadow *= 1.0 - intensity;
-    }
+    shadow *= 1.0 - intensity;
+#endif
     
     return shadow;
 }
@@ -205,7 +179,11 @@ float ShadowCalculation(vec3 normal, vec4 fragPosLightSpace, vec3 fragPos, vec3
 
     float bias = max(0.025 * (1.0f - dot(normal,lightDir)), 0.0005);
     float shadow = 0.0;
+#ifdef FEATURE_SINGLE_SHADOW_TAP
+    int sampleRadius = 0;
+#else
     int sampleRadius = 3;
+#endif
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
 
     for (int y = -sampleRadius; y <= sampleRadius; y++) {
@@ -216,14 +194,14 @@ float ShadowCalculation(vec3 normal, vec4 fragPosLightSpace, vec3 fragPos, vec3
     }
     shadow /= pow((sampleRadius * 2 + 1), 2);
 
-    if (spotLight.enabled == 1) {
-        vec3 spotDir = normalize(spotLight.position - fragPos);
-        float theta = dot(spotDir, normalize(-spotLight.direction));
-        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
-        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+#ifdef FEATURE_SPOT_LIGHT
+    vec3 spotDir = normalize(spotLight.position - fragPos);
+    float theta = dot(spotDir, normalize(-spotLight.direction));
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
 
-        shadow *= 1.0 - intensity;
-    }
+    shadow *= 1.0 - intensity;
+#endif
 
     return shadow;
 }
@@ -237,7 +215,11 @@ float HeadlightShadowCalculation(vec3 normal, vec4 fragPosLightSpace, vec3 fragP
     float bias = max(0.00025 * (1.0f - dot(normal, lightDir)), 0.000005); 
 
     float shadow = 0.0;
+#ifdef FEATURE_SINGLE_SHADOW_TAP
+    int sampleRadius = 0;
+#else
     int sampleRadius = 3;
+#endif
     vec2 texelSize = 1.0 / textureSize(headlightShadowMap, 0);
 
     for (int y = -sampleRadius; y <= sampleRadius; y++) {
@@ -248,14 +230,14 @@ float HeadlightShadowCalculation(vec3 normal, vec4 fragPosLightSpace, vec3 fragP
     }
     shadow /= pow((sampleRadius * 2 + 1), 2);
 
-    if (spotLight.enabled == 1) {
-        vec3 spotDir = normalize(spotLight.position - fragPos);
-        float theta = dot(spotDir, normalize(-spotLight.direction));
-        float epsilon = spotLight.cutOff - spotLight.outerCutOff;
-        float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
+#ifdef FEATURE_SPOT_LIGHT
+    vec3 spotDir = normalize(spotLight.position - fragPos);
+    float theta = dot(spotDir, normalize(-spotLight.direction));
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
 
-        shadow *= 1.0 - intensity;
-    }
+    shadow *= 1.0 - intensity;
+#endif
 
     return shadow;
 }
@@ -265,13 +247,11 @@ float HeadlightShadowCalculation(vec3 normal, vec4 fragPosLightSpace, vec3 fragP
 
 
 vec3 computeAmbientDirLight(vec3 normal) {
-    if (dirLight.enabled == 0) return vec3(0.0);
     vec3 ambient = dirLight.ambient * dirLight.color;
     return ambient;
 }
 
 vec3 computeDiffuseDirLight(vec3 normal, vec3 lightDir) {
-    if (dirLight.enabled == 0) return vec3(0.0);
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 diffuse = diff * dirLight.diffuse * dirLight.color;
     return diffuse;
@@ -284,7 +264,6 @@ vec3 computeSpecularDirLight(vec3 normal, vec3 viewDir, vec3 lightDir) {
 }
 
 vec3 computeAmbientPointLight(vec3 normal, vec3 fragPos) {
-    if (pointLight.enabled == 0) return vec3(0.0);
     float distance = length(pointLight.position - fragPos);
     float attenuation = 1.0 / (pointLight.constant + pointLight.linear * distance + pointLight.quadratic * (distance * distance));
     vec3 ambient = pointLight.ambient * pointLight.color * attenuation;
@@ -292,7 +271,6 @@ vec3 computeAmbientPointLight(vec3 normal, vec3 fragPos) {
 }
 
 vec3 computeDiffusePointLight(vec3 normal, vec3 fragPos, vec3 lightDir) {
-    if (pointLight.enabled == 0) return vec3(0.0);
     float distance = length(pointLight.position - fragPos);
     float attenuation = 1.0 / (pointLight.constant + pointLight.linear * distance + pointLight.quadratic * (distance * distance));
     float diff = max(dot(normal, lightDir), 0.0);
@@ -309,13 +287,11 @@ vec3 computeSpecularPointLight(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 lig
 }
 
 vec3 computeAmbientSpotLight(vec3 normal, vec3 fragPos) {
-    if (spotLight.enabled == 0) return vec3(0.0);
     vec3 ambient = spotLight.ambient * spotLight.color;
     return ambient;
 }
 
 vec3 computeDiffuseSpotLight(vec3 normal, vec3 fragPos, vec3 lightDir) {
-    if (spotLight.enabled == 0) return vec3(0.0);
     float theta = dot(lightDir, normalize(-spotLight.direction));
     float epsilon = spotLight.cutOff - spotLight.outerCutOff;
     float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
@@ -335,13 +311,11 @@ vec3 computeSpecularSpotLight(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 ligh
 }
 
 vec3 computeAmbientLeftHeadLight(vec3 normal, vec3 fragPos) {
-    if (leftHeadlight.enabled == 0) return vec3(0.0);
     vec3 ambient = leftHeadlight.ambient * leftHeadlight.color;
     return ambient;
 }
 
 vec3 computeDiffuseLeftLight(vec3 normal, vec3 fragPos, vec3 lightDir) {
-    if (leftHeadlight.enabled == 0) return vec3(0.0);
     float theta = dot(lightDir, normalize(-leftHeadlight.direction));
     float epsilon = leftHeadlight.cutOff - leftHeadlight.outerCutOff;
     float intensity = clamp((theta - leftHeadlight.outerCutOff) / epsilon, 0.0, 1.0);
@@ -361,13 +335,11 @@ vec3 computeSpecularLeftHeadLight(vec3 normal, vec3 fragPos, vec3 viewDir, vec3
 }
 
 vec3 computeAmbientRightHeadLight(vec3 normal, vec3 fragPos) {
-    if (rightHeadlight.enabled == 0) return vec3(0.0);
     vec3 ambient = rightHeadlight.ambient * rightHeadlight.color;
     return ambient;
 }
 
 vec3 computeDiffuseRightLight(vec3 normal, vec3 fragPos, vec3 lightDir) {
-    if (rightHeadlight.enabled == 0) return vec3(0.0);
     float theta = dot(lightDir, normalize(-rightHeadlight.direction));
     float epsilon = rightHeadlight.cutOff - rightHeadlight.outerCutOff;
     float intensity = clamp((theta - rightHeadlight.outerCutOff) / epsilon, 0.0, 1.0);
@@ -386,153 +358,192 @@ vec3 computeSpecularRightHeadLight(vec3 normal, vec3 fragPos, vec3 viewDir, vec3
     return rightHeadlight.specular * spec * intensity;
 }
 
+#ifdef FEATURE_CLUSTERED_LIGHTS
+vec3 computeClusteredLights(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 textureColor, vec3 specularColor) {
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    if (viewDepth < clusterZParams.x || viewDepth > clusterZParams.y) return vec3(0.0);
+
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusterScreenSize * vec2(clusterDims.xy));
+    tile = clamp(tile, ivec2(0), clusterDims.xy - 1);
+    int slice = clamp(int(log(viewDepth) * clusterZParams.z - clusterZParams.w), 0, clusterDims.z - 1);
+    int cluster = tile.x + tile.y * clusterDims.x + slice * clusterDims.x * clusterDims.y;
+
+    uvec2 range = texelFetch(clusterGrid, cluster).xy;
+    vec3 result = vec3(0.0);
+
+    for (uint i = 0u; i < range.y; i++) {
+        int lightIndex = int(texelFetch(clusterLightIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLightData, lightIndex * 2);
+        vec4 colorIntensity = texelFetch(clusterLightData, lightIndex * 2 + 1);
+
+        vec3 toLight = positionRadius.xyz - fragPos;
+        float distance = length(toLight);
+        if (distance >= positionRadius.w) continue;
+
+        // Windowed inverse square falloff, reaches exactly zero at the radius
+        float window = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (distance * distance + 1.0);
+
+        vec3 lightDir = toLight / max(distance, 0.0001);
+        vec3 radiance = colorIntensity.rgb * colorIntensity.a * attenuation;
+        float diff = max(dot(normal, lightDir), 0.0);
+        float spec = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), 32.0);
+
+        result += radiance * (diff * textureColor + spec * specularColor);
+    }
+
+    return result;
+}
+#endif
+
 void main() {
     vec3 normal = fNormal;
 
-    if (useNormalMapping == 1) {
-        normal = texture(normalTexture, fTexCoords).rgb * 2.0 - 1.0;
-        normal = normalize(TBN * normal);
-    }
+#ifdef FEATURE_NORMAL_MAPPING
+    normal = texture(normalTexture, fTexCoords).rgb * 2.0 - 1.0;
+    normal = normalize(TBN * normal);
+#endif
 
     vec3 viewDir = normalize(viewPos - fPosition);
 
-    vec3 DirectionalLightDir = normalize(-dirLight.direction);
-    vec3 PointLightDir = normalize(pointLight.position - fPosition);
-    vec3 SpotLightDir = normalize(spotLight.position - fPosition);
-    vec3 LeftHeadlightDir = normalize(leftHeadlight.position - fPosition);
-    vec3 RightHeadlightDir = normalize(rightHeadlight.position - fPosition);
-
     vec3 textureColor = texture(diffuseTexture, fTexCoords).rgb;
     vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
     vec4 dissolveColor = texture(dissolveTexture, fTexCoords);
     if (dissolveColor.a < 0.1) discard;
 
-    float dirShadow = ShadowCalculation(normal, FragPosLightSpace, fPosition, DirectionalLightDir);
-    float pointShadow = PointShadowCalculation(normal, fPosition, PointLightDir);  // Added Point Light Shadow Calculation
-    float leftHeadlightShadow = HeadlightShadowCalculation(normal, FragPosLightSpaceLeftHeadlight, fPosition, LeftHeadlightDir, leftHeadlightShadowMap);
-    float rightHeadlightShadow = HeadlightShadowCalculation(normal, FragPosLightSpaceRightHeadlight, fPosition, RightHeadlightDir, rightHeadlightShadowMap);
-
     vec3 finalResult = vec3(0.0);
 
-    if (dirLight.enabled == 1) {
+#ifdef FEATURE_DIR_LIGHT
+    {
+        vec3 DirectionalLightDir = normalize(-dirLight.direction);
+        float dirShadow = ShadowCalculation(normal, FragPosLightSpace, fPosition, DirectionalLightDir);
         vec3 ambient = computeAmbientDirLight(normal);
         vec3 diffuse = computeDiffuseDirLight(normal, DirectionalLightDir);
         vec3 specular = vec3(0.0);
-        if(useBlinnPhong == 1) {
-            specular = computeSpecularDirLight(normal, viewDir, DirectionalLightDir);
-        }
-        else if (rainEnabled == 1) {
-            specular = computeSpecularDirLight(normal, viewDir, DirectionalLightDir);
-        }
-        
+#ifdef USE_SPECULAR
+        specular = computeSpecularDirLight(normal, viewDir, DirectionalLightDir);
+#endif
+
         vec3 dirLightResult = ambient * textureColor;
         dirLightResult += (1.0 - dirShadow) * (diffuse * textureColor + specular * specularColor);
         finalResult += dirLightResult;
     }
+#endif
 
-    if (pointLight.enabled == 1) {
+#ifdef FEATURE_POINT_LIGHT
+    {
+        vec3 PointLightDir = normalize(pointLight.position - fPosition);
+        float pointShadow = PointShadowCalculation(normal, fPosition, PointLightDir);
         vec3 ambient = computeAmbientPointLight(normal, fPosition);
         vec3 diffuse = computeDiffusePointLight(normal, fPosition, PointLightDir);
         vec3 specular = vec3(0.0);
-        if (useBlinnPhong == 1) {
-            specular = computeSpecularPointLight(normal, fPosition, viewDir, PointLightDir);
-        }
-        else if (rainEnabled == 1) {
-            specular = computeSpecularPointLight(normal, fPosition, viewDir, PointLightDir);
-		}
+#ifdef USE_SPECULAR
+        specular = computeSpecularPointLight(normal, fPosition, viewDir, PointLightDir);
+#endif
 
         vec3 pointLightResult = ambient * textureColor;
         pointLightResult += (1.0 - pointShadow) * (diffuse * textureColor + specular * specularColor);
         finalResult += pointLightResult;
     }
+#endif
 
-    if (spotLight.enabled == 1) {
+#ifdef FEATURE_SPOT_LIGHT
+    {
+        vec3 SpotLightDir = normalize(spotLight.position - fPosition);
         vec3 ambient = computeAmbientSpotLight(normal, fPosition);
         vec3 diffuse = computeDiffuseSpotLight(normal, fPosition, SpotLightDir);
         vec3 specular = vec3(0.0);
-        if(useBlinnPhong == 1) {
-            specular = computeSpecularSpotLight(normal, fPosition, viewDir, SpotLightDir);
-        }
-        else if (rainEnabled == 1) {
-            specular = computeSpecularSpotLight(normal, fPosition, viewDir, SpotLightDir);
-        }
+#ifdef USE_SPECULAR
+        specular = computeSpecularSpotLight(normal, fPosition, viewDir, SpotLightDir);
+#endif
 
         vec3 spotLightResult = ambient * textureColor;
         spotLightResult += (diffuse * textureColor + specular * specularColor);
         finalResult += spotLightResult;
     }
+#endif
 
-    if (leftHeadlight.enabled == 1) {
+#ifdef FEATURE_LEFT_HEADLIGHT
+    {
+        vec3 LeftHeadlightDir = normalize(leftHeadlight.position - fPosition);
+        float leftHeadlightShadow = HeadlightShadowCalculation(normal, FragPosLightSpaceLeftHeadlight, fPosition, LeftHeadlightDir, leftHeadlightShadowMap);
         vec3 ambient = computeAmbientLeftHeadLight(normal, fPosition);
         vec3 diffuse = computeDiffuseLeftLight(normal, fPosition, LeftHeadlightDir);
         vec3 specular = vec3(0.0);
-        if(useBlinnPhong == 1) {
-            specular = computeSpecularLeftHeadLight(normal, fPosition, viewDir, LeftHeadlightDir);
-        }
-        else if (rainEnabled == 1) {
-			specular = computeSpecularLeftHeadLight(normal, fPosition, viewDir, LeftHeadlightDir);
-		}
+#ifdef USE_SPECULAR
+        specular = computeSpecularLeftHeadLight(normal, fPosition, viewDir, LeftHeadlightDir);
+#endif
 
         vec3 leftHeadlightResult = ambient * textureColor;
         leftHeadlightResult += (1.0 - leftHeadlightShadow) * (diffuse * textureColor + specular * specularColor);
         finalResult += leftHeadlightResult;
     }
+#endif
 
-    if (rightHeadlight.enabled == 1) {
+#ifdef FEATURE_RIGHT_HEADLIGHT
+    {
+        vec3 RightHeadlightDir = normalize(rightHeadlight.position - fPosition);
+        float rightHeadlightShadow = HeadlightShadowCalculation(normal, FragPosLightSpaceRightHeadlight, fPosition, RightHeadlightDir, rightHeadlightShadowMap);
         vec3 ambient = computeAmbientRightHeadLight(normal, fPosition);
         vec3 diffuse = computeDiffuseRightLight(normal, fPosition, RightHeadlightDir);
         vec3 specular = vec3(0.0);
-        if(useBlinnPhong == 1){
-            specular = computeSpecularRightHeadLight(normal, fPosition, viewDir, RightHeadlightDir);
-        }
-        else if (rainEnabled == 1) {
-			specular = computeSpecularRightHeadLight(normal, fPosition, viewDir, RightHeadlightDir);
-            }
+#ifdef USE_SPECULAR
+        specular = computeSpecularRightHeadLight(normal, fPosition, viewDir, RightHeadlightDir);
+#endif
 
         vec3 rightHeadlightResult = ambient * textureColor;
         rightHeadlightResult += (1.0 - rightHeadlightShadow) * (diffuse * textureColor + specular * specularColor);
         finalResult += rightHeadlightResult;
     }
+#endif
+
+#ifdef FEATURE_CLUSTERED_LIGHTS
+    finalResult += computeClusteredLights(normal, fPosition, viewDir, textureColor, specularColor);
+#endif
 
-     if (flashLight.enabled == 1) {
+#ifdef FEATURE_FLASH_LIGHT
+    {
         vec3 ambient = flashLight.ambient * flashLight.color;
-        vec3 diffuse = computeDiffuseDirLight(normal, normalize(-flashLight.direction));
+        vec3 diffuse = vec3(0.0);
+#ifdef FEATURE_DIR_LIGHT
+        diffuse = computeDiffuseDirLight(normal, normalize(-flashLight.direction));
+#endif
         vec3 specular = vec3(0.0);
-        if(useBlinnPhong == 1) {
-            specular = computeSpecularDirLight(normal, viewDir, normalize(-flashLight.direction));
-        }
-        else if (rainEnabled == 1) {
-            specular = computeSpecularDirLight(normal, viewDir, normalize(-flashLight.direction));
-        }
+#ifdef USE_SPECULAR
+        specular = computeSpecularDirLight(normal, viewDir, normalize(-flashLight.direction));
+#endif
 
         vec3 flashLightResult = ambient * textureColor;
         flashLightResult += diffuse * textureColor + specular * specularColor;
         finalResult += flashLightResult;
     }
+#endif
 
-    if (fogEnabled == 1) {
+#ifdef FEATURE_FOG
+    {
         float fogFactor = 0.0;
 
-        if (windEnabled == 1) {
-            fogFactor = CalcAnimatedFogFactor(); // Use animated fog when wind is enabled
-        } else {
-            fogFactor = CalcLayeredFogFactor(); // Use layered fog otherwise
-        }
+#ifdef FEATURE_WIND
+        fogFactor = CalcAnimatedFogFactor(); // Use animated fog when wind is enabled
+#else
+        fogFactor = CalcLayeredFogFactor(); // Use layered fog otherwise
+#endif
 
         // Clamp the fog factor to ensure it's within valid range
         fogFactor = clamp(fogFactor, 0.0, 1.0);
 
         // Apply the fog effect to the final result
         finalResult = mix(fogColor, finalResult, fogFactor);
-}
+    }
+#endif
 
-     finalResult *= globalLightIntensity;
+    finalResult *= globalLightIntensity;
 
-     if (flashLight.enabled == 1) {
-        vec3 flashTint = vec3(0.5, 0.5, 1.0);
-        float tintStrength = 0.3;
-        finalResult = mix(finalResult, flashTint * finalResult, tintStrength);
-    }
+#ifdef FEATURE_FLASH_LIGHT
+    vec3 flashTint = vec3(0.5, 0.5, 1.0);
+    float tintStrength = 0.3;
+    finalResult = mix(finalResult, flashTint * finalResult, tintStrength);
+#endif
 
     gFragColor = vec4(finalResult, 1.0);
 
@@ -546,4 +557,5 @@ void main() {
         gBrightColor = vec4(0.0);
     }
 
+    gVelocity = (fClipPosition.xy / fClipPosition.w - fPreviousClipPosition.xy / fPreviousClipPosition.w) * 0.5;
 }
@@ -0,0 +1,50 @@
+#version 410 core
+
+// One step down gps::BloomChain below its first level: 13 taps around the
+// source texels this texel covers, read as five overlapping 2 x 2 boxes, the
+// centre one weighted most (Jimenez, "Next Generation Post Processing in Call
+// of Duty: Advanced Warfare"). The first step is bloomPrefilter.frag.
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+
+out vec3 bloomColor;
+
+vec3 tap(vec2 uv, vec2 offset, vec2 texel)
+{
+    return texture(source, uv + texel * offset).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+
+    vec3 a = tap(TexCoords, vec2(-2.0, 2.0), texel);
+    vec3 b = tap(TexCoords, vec2(0.0, 2.0), texel);
+    vec3 c = tap(TexCoords, vec2(2.0, 2.0), texel);
+    vec3 d = tap(TexCoords, vec2(-2.0, 0.0), texel);
+    vec3 e = tap(TexCoords, vec2(0.0), texel);
+    vec3 f = tap(TexCoords, vec2(2.0, 0.0), texel);
+    vec3 g = tap(TexCoords, vec2(-2.0, -2.0), texel);
+    vec3 h = tap(TexCoords, vec2(0.0, -2.0), texel);
+    vec3 i = tap(TexCoords, vec2(2.0, -2.0), texel);
+    vec3 j = tap(TexCoords, vec2(-1.0, 1.0), texel);
+    vec3 k = tap(TexCoords, vec2(1.0, 1.0), texel);
+    vec3 l = tap(TexCoords, vec2(-1.0, -1.0), texel);
+    vec3 m = tap(TexCoords, vec2(1.0, -1.0), texel);
+
+    vec3 boxes[5] = vec3[](
+        (j + k + l + m) * 0.25,
+        (a + b + d + e) * 0.25,
+        (b + c + e + f) * 0.25,
+        (d + e + g + h) * 0.25,
+        (e + f + h + i) * 0.25);
+    float weights[5] = float[](0.5, 0.125, 0.125, 0.125, 0.125);
+
+    vec3 sum = vec3(0.0);
+    for (int box = 0; box < 5; box++) {
+        sum += boxes[box] * weights[box];
+    }
+    bloomColor = sum;
+}
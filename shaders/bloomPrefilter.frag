@@ -0,0 +1,43 @@
+#version 410 core
+
+// The first step down gps::BloomChain, from the full resolution bright
+// texture: the most texels of the whole chain, so it takes the 4 x 4
+// footprint of bloomDownsample.frag as four disjoint 2 x 2 boxes, one
+// bilinear tap each. Each box is weighed by 1 / (1 + luma) (Karis average)
+// so single very bright pixels do not flicker.
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+// Part of the source to read, from the lower left corner (dynamic resolution)
+uniform vec2 sourceScale;
+
+out vec3 bloomColor;
+
+// Clamped to the part read, what lies past it is from an earlier frame
+vec3 tap(vec2 uv, vec2 offset, vec2 texel)
+{
+    return texture(source, clamp(uv + texel * offset, texel * 0.5, sourceScale - texel * 0.5)).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+    vec2 uv = TexCoords * sourceScale;
+
+    vec3 boxes[4] = vec3[](
+        tap(uv, vec2(-1.0, 1.0), texel),
+        tap(uv, vec2(1.0, 1.0), texel),
+        tap(uv, vec2(-1.0, -1.0), texel),
+        tap(uv, vec2(1.0, -1.0), texel));
+
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (int box = 0; box < 4; box++) {
+        float weight = 1.0 / (1.0 + dot(boxes[box], vec3(0.2126, 0.7152, 0.0722)));
+        sum += boxes[box] * weight;
+        weightSum += weight;
+    }
+    // Never negative, the target is unsigned floating point
+    bloomColor = max(sum / weightSum, vec3(0.0));
+}
@@ -0,0 +1,26 @@
+#version 410 core
+
+// One step up gps::BloomChain: the smaller level blurred with a 3 x 3 tent,
+// added onto this one by the blend state.
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+
+out vec3 bloomColor;
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(source, 0));
+
+    vec3 sum = texture(source, TexCoords).rgb * 4.0;
+    sum += (texture(source, TexCoords + texel * vec2(0.0, 1.0)).rgb +
+        texture(source, TexCoords + texel * vec2(-1.0, 0.0)).rgb +
+        texture(source, TexCoords + texel * vec2(1.0, 0.0)).rgb +
+        texture(source, TexCoords + texel * vec2(0.0, -1.0)).rgb) * 2.0;
+    sum += texture(source, TexCoords + texel * vec2(-1.0, 1.0)).rgb +
+        texture(source, TexCoords + texel * vec2(1.0, 1.0)).rgb +
+        texture(source, TexCoords + texel * vec2(-1.0, -1.0)).rgb +
+        texture(source, TexCoords + texel * vec2(1.0, -1.0)).rgb;
+    bloomColor = sum / 16.0;
+}
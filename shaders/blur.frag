@@ -4,22 +4,31 @@ in vec2 TexCoords;
 
 uniform sampler2D image;
 uniform int horizontal;
+// Part of the image to read, from the lower left corner: the bright texture
+// under dynamic resolution, 1 for the ping-pong buffers
+uniform vec2 sourceScale;
+
+vec3 fetch(vec2 uv, vec2 tex_offset)
+{
+    return texture(image, clamp(uv, tex_offset * 0.5, sourceScale - tex_offset * 0.5)).rgb;
+}
 
 void main()
-{             
+{
     float weight[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
 
     vec2 tex_offset = 1.0 / vec2(textureSize(image, 0));
-    vec3 result = texture(image, TexCoords).rgb * weight[0];
+    vec2 uv = TexCoords * sourceScale;
+    vec3 result = fetch(uv, tex_offset) * weight[0];
 
     for(int i = 1; i < 5; ++i)
     {
         if(horizontal == 1) {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
+            result += fetch(uv + vec2(tex_offset.x * i, 0.0), tex_offset) * weight[i];
+            result += fetch(uv - vec2(tex_offset.x * i, 0.0), tex_offset) * weight[i];
         } else {
-            result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-            result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
+            result += fetch(uv + vec2(0.0, tex_offset.y * i), tex_offset) * weight[i];
+            result += fetch(uv - vec2(0.0, tex_offset.y * i), tex_offset) * weight[i];
         }
     }
     FragColor = vec4(result, 1.0);
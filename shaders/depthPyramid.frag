@@ -0,0 +1,34 @@
+#version 410 core
+
+// One level of gps::SceneCopy's depth pyramid. Level 0 copies the scene
+// depth, every other level keeps the nearest depth of the texels it covers in
+// the level below. The source's base level is set to the level read, which
+// texelFetch and textureSize count from, so the lod is always 0.
+
+uniform sampler2D source;
+uniform bool copyDepth;
+
+out float nearestDepth;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (copyDepth) {
+        nearestDepth = texelFetch(source, texel, 0).r;
+        return;
+    }
+
+    ivec2 size = textureSize(source, 0);
+    ivec2 origin = texel * 2;
+    // The last texel along an odd edge also covers the row or column left over
+    ivec2 extent = ivec2(2) + ivec2(equal(origin + 3, size));
+
+    float nearest = 1.0;
+    for (int y = 0; y < extent.y; y++) {
+        for (int x = 0; x < extent.x; x++) {
+            ivec2 sourceTexel = min(origin + ivec2(x, y), size - 1);
+            nearest = min(nearest, texelFetch(source, sourceTexel, 0).r);
+        }
+    }
+    nearestDepth = nearest;
+}
@@ -4,7 +4,9 @@ in vec2 TexCoord;
 in vec4 ParticleColor;
 flat in int texLayer;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor;
+// The flames glow: they add to the bloom as much as to the colour
+layout(location = 1) out vec4 BrightColor;
 
 uniform sampler2DArray fireTextureArray;
 
@@ -31,4 +33,5 @@ void main()
         discard;
 
     FragColor = outColor;
+    BrightColor = outColor;
 }
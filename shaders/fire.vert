@@ -6,19 +6,17 @@ layout (location = 2) in vec3 inPosition;
 layout (location = 3) in vec4 inColor;
 layout (location = 4) in float inSize;
 layout (location = 5) in float inRotation;
-layout (location = 6) in int   inTexIndex;
+layout (location = 6) in uint  inTexIndex;
 
 out vec2 TexCoord;
 out vec4 ParticleColor;
 flat out int texLayer;
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 cameraRight;
-uniform vec3 cameraUp;
+#include "include/frame.glsl"
+#include "include/view.glsl"
+
 uniform float flameAspectX;
 uniform float flameAspectY;
-uniform float time;
 
 void main()
 {
@@ -31,7 +29,7 @@ void main()
     );
 
     if (inQuadPos.y > 0.3) {
-        float swirl = sin((inQuadPos.x + time * 3.0) * 10.0) * 0.03;
+        float swirl = sin((inQuadPos.x + u_Time * 3.0) * 10.0) * 0.03;
         rotatedPos.x += swirl * (inQuadPos.y - 0.3) * 1.5;
     }
 
@@ -39,7 +37,7 @@ void main()
     float taper = mix(1.0, 0.75, heightFactor);
     vec2 taperedPos = rotatedPos * vec2(taper, 1.0);
 
-    float distortion = sin(taperedPos.x * 12.0 + time * 6.0) * 0.02;
+    float distortion = sin(taperedPos.x * 12.0 + u_Time * 6.0) * 0.02;
     taperedPos.y += distortion;
 
     vec3 worldPos = inPosition
@@ -49,5 +47,5 @@ void main()
     gl_Position   = projection * view * vec4(worldPos, 1.0);
     TexCoord      = inTexCoord;
     ParticleColor = inColor;
-    texLayer      = inTexIndex;
+    texLayer      = int(inTexIndex);
 }
@@ -5,23 +5,88 @@ in vec2 TexCoords;
 uniform sampler2D hdrBuffer;
 uniform sampler2D bloomBlur;
 uniform int bloom;
+// Brings a summed bloom chain back to the bright buffer's energy
+uniform float bloomScale;
 uniform float exposure;
+// Part of hdrBuffer the main pass drew into (dynamic resolution), from the
+// lower left corner. Below 1 it is upscaled and sharpened.
+uniform vec2 renderScale;
+uniform float sharpness;
 
-void main() 
+vec3 toneMap(vec3 color)
 {
-    vec3 hdrColor = texture(hdrBuffer, TexCoords).rgb;
+    vec3 mapped = vec3(1.0) - exp(-color * exposure);
+
+    float gamma = 2.2;
+    return pow(mapped, vec3(1.0 / gamma));
+}
+
+// Clamped to the drawn part, what lies past it is from an earlier frame
+vec3 fetchScene(vec2 uv, vec2 texelSize)
+{
+    return texture(hdrBuffer, clamp(uv, texelSize * 0.5, renderScale - texelSize * 0.5)).rgb;
+}
+
+// 4 x 4 Catmull-Rom filter from nine bilinear lookups: the middle two taps
+// of each axis share one lookup placed between them by their weights
+vec3 sampleCatmullRom(vec2 uv, vec2 texelSize)
+{
+    vec2 samplePosition = uv / texelSize;
+    vec2 texel1 = floor(samplePosition - 0.5) + 0.5;
+    vec2 f = samplePosition - texel1;
 
-    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
 
-    vec3 color = hdrColor;
+    vec2 uv0 = (texel1 - 1.0) * texelSize;
+    vec2 uv12 = (texel1 + w2 / w12) * texelSize;
+    vec2 uv3 = (texel1 + 2.0) * texelSize;
+
+    vec3 result = fetchScene(vec2(uv0.x, uv0.y), texelSize) * w0.x * w0.y +
+        fetchScene(vec2(uv12.x, uv0.y), texelSize) * w12.x * w0.y +
+        fetchScene(vec2(uv3.x, uv0.y), texelSize) * w3.x * w0.y +
+        fetchScene(vec2(uv0.x, uv12.y), texelSize) * w0.x * w12.y +
+        fetchScene(vec2(uv12.x, uv12.y), texelSize) * w12.x * w12.y +
+        fetchScene(vec2(uv3.x, uv12.y), texelSize) * w3.x * w12.y +
+        fetchScene(vec2(uv0.x, uv3.y), texelSize) * w0.x * w3.y +
+        fetchScene(vec2(uv12.x, uv3.y), texelSize) * w12.x * w3.y +
+        fetchScene(vec2(uv3.x, uv3.y), texelSize) * w3.x * w3.y;
+    // The negative lobes can overshoot below zero next to bright edges
+    return max(result, vec3(0.0));
+}
+
+void main()
+{
+    vec3 bloomColor = vec3(0.0);
     if(bloom == 1) {
-        color += bloomColor;
+        bloomColor = texture(bloomBlur, TexCoords).rgb * bloomScale;
     }
 
-    vec3 mapped = vec3(1.0) - exp(-color * exposure);
+    if (renderScale.x >= 1.0 && renderScale.y >= 1.0) {
+        FragColor = vec4(toneMap(texture(hdrBuffer, TexCoords).rgb + bloomColor), 1.0);
+        return;
+    }
 
-    float gamma = 2.2;
-    vec3 gammaCorrected = pow(mapped, vec3(1.0 / gamma));
+    vec2 texelSize = 1.0 / vec2(textureSize(hdrBuffer, 0));
+    vec2 uv = TexCoords * renderScale;
+    vec3 center = toneMap(sampleCatmullRom(uv, texelSize) + bloomColor);
+
+    // Contrast adaptive sharpening: the cross of neighbours one drawn texel
+    // away is subtracted, less where the neighbourhood already has contrast
+    // or is close to black or white, so edges do not ring
+    vec3 north = toneMap(fetchScene(uv + vec2(0.0, texelSize.y), texelSize) + bloomColor);
+    vec3 south = toneMap(fetchScene(uv - vec2(0.0, texelSize.y), texelSize) + bloomColor);
+    vec3 east = toneMap(fetchScene(uv + vec2(texelSize.x, 0.0), texelSize) + bloomColor);
+    vec3 west = toneMap(fetchScene(uv - vec2(texelSize.x, 0.0), texelSize) + bloomColor);
+
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1e-4)), 0.0, 1.0));
+    vec3 weight = -amount * mix(0.125, 0.2, sharpness);
 
-    FragColor = vec4(gammaCorrected, 1.0);
+    vec3 sharpened = (center + (north + south + east + west) * weight) / (1.0 + 4.0 * weight);
+    FragColor = vec4(clamp(sharpened, 0.0, 1.0), 1.0);
 }
@@ -0,0 +1,120 @@
+// Shared by the fire*.comp kernels (see gps::GpuFireParticles). Mirrors the
+// CPU fire in FireParticles.cpp: same spawn ranges, forces and colours.
+
+#define FIRE_FLAME 0u
+#define FIRE_SMOKE 1u
+#define FIRE_EMBER 2u
+
+// Set next to FIRE_EMBER on the sparks embers leave behind. They are not part
+// of the population: when they die their slot is only spare room again.
+#define FIRE_SPARK 0x80u
+
+// Alive list entry of a particle that died this frame
+#define FIRE_INVALID 0xFFFFFFFFu
+
+#define FIRE_PI 3.14159265
+
+struct Particle {
+    vec4 positionLife;      // xyz, life left (s)
+    vec4 velocityInitial;   // xyz, initial life (s)
+    vec4 color;
+    vec4 shape;             // size, rotation (degrees), rotation speed, type | spark | texture << 8 (bits)
+};
+
+layout(std430, binding = 0) buffer Particles {
+    Particle particles[];
+};
+
+// Counters and indirect arguments, byte offsets are in GpuFireParticles.cpp
+layout(std430, binding = 1) buffer FireState {
+    uint simulateArgs[3];
+    uint emitArgs[3];
+    uint aliveCount;
+    uint nextAliveCount;
+    uint deadCount;
+    uint deathCount;        // sparks not included
+    uint trailCount;
+    uint emitRespawns;
+    uint emitTrails;
+    uint additiveCount;
+    uint smokeCount;
+    uint statePad;
+    uvec4 additiveDraw;
+    uvec4 smokeDraw;
+};
+
+layout(std430, binding = 2) buffer DeadList {
+    uint deadList[];
+};
+
+// Alive lists, read this frame and built for the next one
+layout(std430, binding = 3) buffer CurrentAlive {
+    uint currentAlive[];
+};
+
+layout(std430, binding = 4) buffer NextAlive {
+    uint nextAlive[];
+};
+
+// FireInstance (28 bytes) as 7 words: position, half colour (2 words),
+// half size and rotation, texture index in the low byte
+layout(std430, binding = 5) buffer Instances {
+    uint instanceWords[];
+};
+
+// Positions embers leave sparks at, emitted next frame
+layout(std430, binding = 6) buffer Trails {
+    vec4 trails[];
+};
+
+uniform uint fireSeed;
+uniform uint fireFrame;
+uniform uint fireCapacity;
+uniform vec3 fireOrigin;
+uniform float fireDeltaTime;
+uniform float fireTime;
+
+uint pcgHash(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// One stream per particle, kernel and frame
+uint randomSeed(uint index, uint kernel) {
+    return pcgHash(fireSeed ^ pcgHash(fireFrame * 4u + kernel) ^ (index * 0x9E3779B9u));
+}
+
+float randomRange(inout uint state, float minValue, float maxValue) {
+    state = state * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    word = (word >> 22u) ^ word;
+    return minValue + float(word >> 8u) * (1.0 / 16777216.0) * (maxValue - minValue);
+}
+
+uint particleType(Particle p) {
+    return floatBitsToUint(p.shape.w) & 0x7Fu;
+}
+
+bool isSpark(Particle p) {
+    return (floatBitsToUint(p.shape.w) & FIRE_SPARK) != 0u;
+}
+
+// Adds the particle to the next alive list and writes its instance. Flames
+// and embers fill the instance buffer from the front, smoke from the back.
+void appendAlive(uint index, Particle p) {
+    nextAlive[atomicAdd(nextAliveCount, 1u)] = index;
+
+    uint slot = particleType(p) == FIRE_SMOKE ?
+        fireCapacity - 1u - atomicAdd(smokeCount, 1u) :
+        atomicAdd(additiveCount, 1u);
+
+    uint base = slot * 7u;
+    instanceWords[base + 0u] = floatBitsToUint(p.positionLife.x);
+    instanceWords[base + 1u] = floatBitsToUint(p.positionLife.y);
+    instanceWords[base + 2u] = floatBitsToUint(p.positionLife.z);
+    instanceWords[base + 3u] = packHalf2x16(p.color.rg);
+    instanceWords[base + 4u] = packHalf2x16(p.color.ba);
+    instanceWords[base + 5u] = packHalf2x16(p.shape.xy);
+    instanceWords[base + 6u] = floatBitsToUint(p.shape.w) >> 8u;
+}
@@ -0,0 +1,11 @@
+// Per frame values, see gps::FrameBlock
+layout(std140) uniform FrameBlock {
+    float u_Time;
+    float gFogTime;
+    float globalLightIntensity;
+    float gFogEnd;
+    float gLayeredFogTop;
+    float gExpFogDensity;
+    float dayNightBlend;
+    vec3 fogColor;
+};
@@ -0,0 +1,46 @@
+// Scene lights and their shadow matrices, see gps::LightsBlock
+struct DirLight {
+    vec3 direction;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 color;
+    int enabled;
+};
+
+struct PointLight {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 color;
+    float constant;
+    float linear;
+    float quadratic;
+    int enabled;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    vec3 color;
+    int enabled;
+};
+
+layout(std140) uniform LightsBlock {
+    DirLight dirLight;
+    DirLight flashLight;
+    PointLight pointLight;
+    SpotLight spotLight;
+    SpotLight leftHeadlight;
+    SpotLight rightHeadlight;
+    mat4 lightSpaceMatrix;
+    mat4 leftHeadlightLightSpaceMatrix;
+    mat4 rightHeadlightLightSpaceMatrix;
+    float farPlane;
+};
@@ -0,0 +1,10 @@
+// Camera of the current pass, see gps::ViewBlock
+layout(std140) uniform ViewBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 plane;
+    vec3 viewPos;
+    vec3 cameraRight;
+    vec3 cameraUp;
+    mat4 previousViewProjection;
+};
@@ -0,0 +1,66 @@
+#version 410 core
+
+#include "include/view.glsl"
+
+// Upsamples a gps::ParticleCompositor target into the scene. Blended with
+// (ONE, SRC_ALPHA): rgb is the premultiplied particle colour, alpha what is
+// left of the scene behind it. The bright (bloom) channel is upsampled with
+// the same weights and covered by the same alpha.
+
+in vec2 TexCoords;
+
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out vec4 BrightColor;
+
+uniform sampler2D particleColor;
+uniform sampler2D particleBright;
+uniform sampler2D particleDepth;
+uniform sampler2D sceneDepth;
+
+// Relative depth difference that halves a texel's weight
+const float DEPTH_TOLERANCE = 0.02;
+
+float linearDepth(float depth)
+{
+    return projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+}
+
+void main()
+{
+    ivec2 lowSize = textureSize(particleColor, 0);
+    vec2 position = TexCoords * vec2(lowSize) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    float pixelDepth = linearDepth(texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+    vec4 sum = vec4(0.0);
+    vec3 brightSum = vec3(0.0);
+    float total = 0.0;
+    vec4 nearest = vec4(0.0, 0.0, 0.0, 1.0);
+    vec3 nearestBright = vec3(0.0);
+    float nearestDifference = 1.0e30;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), lowSize - 1);
+        vec4 color = texelFetch(particleColor, texel, 0);
+        vec3 bright = texelFetch(particleBright, texel, 0).rgb;
+        float difference = abs(linearDepth(texelFetch(particleDepth, texel, 0).r) - pixelDepth) / pixelDepth;
+
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y / (1.0 + difference / DEPTH_TOLERANCE);
+        sum += color * weight;
+        brightSum += bright * weight;
+        total += weight;
+
+        if (difference < nearestDifference) {
+            nearestDifference = difference;
+            nearest = color;
+            nearestBright = bright;
+        }
+    }
+
+    // No texel at this depth (a thin edge): take the closest one
+    FragColor = total > 1.0e-3 ? sum / total : nearest;
+    BrightColor = vec4(total > 1.0e-3 ? brightSum / total : nearestBright, FragColor.a);
+}
@@ -0,0 +1,22 @@
+#version 410 core
+
+// Reduces the scene depth for gps::ParticleCompositor: the farthest depth of
+// each divisor x divisor block of scene pixels
+
+uniform sampler2D sceneDepth;
+uniform int divisor;
+
+void main()
+{
+    ivec2 size = textureSize(sceneDepth, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * divisor;
+
+    float farthest = 0.0;
+    for (int y = 0; y < divisor; y++) {
+        for (int x = 0; x < divisor; x++) {
+            ivec2 texel = min(origin + ivec2(x, y), size - 1);
+            farthest = max(farthest, texelFetch(sceneDepth, texel, 0).r);
+        }
+    }
+    gl_FragDepth = farthest;
+}
@@ -1,18 +1,247 @@
 #version 410 core
 
-layout (location = 0) in vec3 inPosition;
-layout (location = 1) in vec2 inParams;
+// One instance per drop, drawn as a 4 vertex strip. The streak shape and the
+// lighting are worked out here once per vertex instead of per fragment.
 
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/view.glsl"
+#include "include/lights.glsl"
 
-out vec3 vPosition;
-out float vLengthFactor;
-out float vSpeedFactor;
+// Static streak template: x is the side (-1 left, 1 right), y the position
+// along the drop (0 top, 1 bottom)
+layout (location = 5) in vec2 inStreak;
+
+uniform float baseDropLength = 0.2;
+uniform float curvature = 0.1;
+uniform float maxThickness = 0.02;
+
+uniform vec4 rainColor = vec4(0.7, 0.7, 1.0, 0.5);
+uniform float maxDistance = 50.0;
+uniform float shininess = 32.0;
+uniform float motionBlurIntensity = 0.7;
+
+uniform samplerCube environmentMap;
+
+out float vDropPos;
+// Lit color, alpha is the per drop part of the fade
+out vec4 vColor;
+
+#ifdef FEATURE_PROCEDURAL_RAIN
+
+// Every drop is a closed-form function of gl_InstanceID, the seed and the time,
+// see RainSimulation::setProceduralUniforms
+uniform float rainTime;
+uniform int rainSeed;
+uniform vec2 rainTileOrigin;
+uniform float rainTileSize;
+uniform int rainTileGrid;
+uniform int rainDropsPerTile;
+uniform float rainGravity;
+uniform float rainTerminalVelocity;
+uniform float rainTopY;
+uniform float rainBottomY;
+
+// Same hash as RainSimulation on the CPU
+uint pcgHash(uint value) {
+    uint state = value * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+float unitFloat(uint bits) {
+    return float(bits >> 8u) * (1.0 / 16777216.0);
+}
+
+void computeDrop(out vec3 position, out float lengthFactor, out float speedFactor) {
+    int tile = gl_InstanceID / rainDropsPerTile;
+    int local = gl_InstanceID - tile * rainDropsPerTile;
+    ivec2 tileCoord = ivec2(rainTileOrigin) + ivec2(tile % rainTileGrid, tile / rainTileGrid);
+
+    // Keyed on the world tile, so a tile keeps its drops while the grid follows the camera
+    uint dropHash = pcgHash(uint(rainSeed) ^ pcgHash(uint(local) ^ pcgHash(uint(tileCoord.x) ^ pcgHash(uint(tileCoord.y)))));
+
+    uint state = pcgHash(dropHash);
+    lengthFactor = 0.5 + unitFloat(state) * 2.0;
+    state = pcgHash(state);
+    speedFactor = 0.5 + unitFloat(state) * 2.0;
+    state = pcgHash(state);
+    float spawnY = rainTopY + unitFloat(state) * 5.0;
+    state = pcgHash(state);
+    float phase = unitFloat(state);
+
+    // Falls from spawnY at gravity * speedFactor, accelerates up to terminal
+    // velocity, and respawns at the bottom. Speeds here are magnitudes.
+    float g = -rainGravity;
+    float terminal = -rainTerminalVelocity;
+    float startSpeed = g * speedFactor;
+    float height = spawnY - rainBottomY;
+
+    float accelTime = max(terminal - startSpeed, 0.0) / g;
+    float accelDistance = startSpeed * accelTime + 0.5 * g * accelTime * accelTime;
+    float period = height <= accelDistance
+        ? (sqrt(startSpeed * startSpeed + 2.0 * g * height) - startSpeed) / g
+        : accelTime + (height - accelDistance) / terminal;
+
+    float cycles = rainTime / period + phase;
+    float cycle = floor(cycles);
+    float t = (cycles - cycle) * period;
+    float ta = min(t, accelTime);
+    float fallen = startSpeed * ta + 0.5 * g * ta * ta + terminal * max(t - accelTime, 0.0);
+
+    // Each respawn lands somewhere else in the tile
+    uint spot = pcgHash(dropHash ^ pcgHash(uint(int(cycle))));
+    vec2 xz = (vec2(tileCoord) + vec2(unitFloat(spot), unitFloat(pcgHash(spot)))) * rainTileSize;
+
+    position = vec3(xz.x, spawnY - fallen, xz.y);
+}
+
+#else
+
+// The height is uploaded every frame, the rest of a drop only changes when it
+// respawns and is kept in a texture, one texel per drop (see RainSimulation)
+layout (location = 1) in float inY;
+
+// x, z, length factor, speed factor
+uniform sampler2D rainDrops;
+
+void computeDrop(out vec3 position, out float lengthFactor, out float speedFactor) {
+    int width = textureSize(rainDrops, 0).x;
+    vec4 drop = texelFetch(rainDrops, ivec2(gl_InstanceID % width, gl_InstanceID / width), 0);
+    position = vec3(drop.x, inY, drop.y);
+    lengthFactor = drop.z;
+    speedFactor = drop.w;
+}
+
+#endif
+
+vec3 CalcDirLight(DirLight light, vec3 norm, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 norm, vec3 fragPos, vec3 viewDir);
+vec3 CalcSpotLight(SpotLight light, vec3 norm, vec3 fragPos, vec3 viewDir);
+vec3 CalcHeadlight(SpotLight light, vec3 norm, vec3 fragPos, vec3 viewDir);
 
 void main() {
-    vPosition = inPosition;
-    vLengthFactor = inParams.x;
-    vSpeedFactor = inParams.y;
-    gl_Position = projection * view * vec4(inPosition, 1.0);
+    vec3 dropPosition;
+    float lengthFactor;
+    float speedFactor;
+    computeDrop(dropPosition, lengthFactor, speedFactor);
+
+    vDropPos = inStreak.y;
+
+    // Fully faded out, put every vertex past the far plane so the strip is
+    // clipped before it reaches the rasterizer
+    float distance = length(dropPosition - viewPos);
+    if (distance >= maxDistance) {
+        vColor = vec4(0.0);
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    float dropLength = baseDropLength * lengthFactor * (1.0 + speedFactor / 2.0);
+    float thickness = maxThickness * clamp(speedFactor / 2.0, 0.5, 1.0);
+
+    // Top, two middle corners bent by the curvature, bottom
+    float bend = 1.0 - abs(2.0 * inStreak.y - 1.0);
+    vec2 offset = vec2(inStreak.x * thickness, -dropLength * inStreak.y + curvature * bend);
+
+    vec3 worldPosition = dropPosition + vec3(offset, 0.0);
+    gl_Position = projection * view * vec4(dropPosition, 1.0) + vec4(offset, 0.0, 0.0);
+
+    vec3 norm = normalize(viewPos - dropPosition);
+    vec3 viewDir = normalize(viewPos - worldPosition);
+
+    vec3 lighting = vec3(0.0);
+
+    if (dirLight.enabled == 1) {
+        lighting += CalcDirLight(dirLight, norm, viewDir);
+    }
+    if (pointLight.enabled == 1) {
+        lighting += CalcPointLight(pointLight, norm, worldPosition, viewDir);
+    }
+    if (spotLight.enabled == 1) {
+        lighting += CalcSpotLight(spotLight, norm, worldPosition, viewDir);
+    }
+    if (leftHeadlight.enabled == 1) {
+        lighting += CalcHeadlight(leftHeadlight, norm, worldPosition, viewDir);
+    }
+    if (rightHeadlight.enabled == 1) {
+        lighting += CalcHeadlight(rightHeadlight, norm, worldPosition, viewDir);
+    }
+    if (flashLight.enabled == 1) {
+        lighting += CalcDirLight(flashLight, norm, viewDir);
+    }
+
+    vec3 R = reflect(viewDir, norm);
+    vec3 reflection = textureLod(environmentMap, R, 0.0).rgb;
+
+    vec3 finalColor = lighting * rainColor.rgb + reflection * 0.3; // 0.3 is reflection strength
+
+    float alphaSpeed = clamp(speedFactor / 2.0, 0.5, 1.0);
+    float alphaDepth = clamp(1.0 - (distance / maxDistance), 0.0, 1.0);
+    vColor = vec4(finalColor, rainColor.a * motionBlurIntensity * alphaSpeed * alphaDepth);
+}
+
+
+vec3 CalcDirLight(DirLight light, vec3 norm, vec3 viewDir) {
+    vec3 lightDir = normalize(-light.direction);
+    vec3 ambient = light.ambient * light.color;
+
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * light.diffuse * light.color;
+
+    vec3 halfDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(norm, halfDir), 0.0), shininess);
+    vec3 specular = light.specular * spec;
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    vec3 ambient = light.ambient * light.color * attenuation;
+
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * light.color * diff * attenuation;
+
+    vec3 halfDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfDir), 0.0), 32.0);
+    vec3 specular = light.specular * spec * attenuation;
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
+    vec3 ambient = light.ambient * light.color;
+
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * light.color * diff;
+
+    vec3 halfDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(normal, halfDir), 0.0), 32.0);
+    vec3 specular = light.specular * spec;
+    float theta = dot(lightDir, normalize(-light.direction));
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+    diffuse *= intensity;
+    specular *= intensity;
+    return (ambient + diffuse + specular);
+}
+
+vec3 CalcHeadlight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
+	vec3 ambient = light.ambient * light.color;
+
+	vec3 lightDir = normalize(light.position - fragPos);
+	float diff = max(dot(normal, lightDir), 0.0);
+	vec3 diffuse = light.diffuse * light.color * diff;
+
+	vec3 halfDir = normalize(lightDir + viewDir);
+	float spec = pow(max(dot(normal, halfDir), 0.0), 32.0);
+	vec3 specular = light.specular * spec;
+	float theta = dot(lightDir, normalize(-light.direction));
+	float epsilon = light.cutOff - light.outerCutOff;
+	float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+
+	diffuse *= intensity;
+	specular *= intensity;
+	return (ambient + diffuse + specular);
 }
@@ -0,0 +1,9 @@
+#version 410 core
+
+flat in vec4 vDrop;
+
+layout(location = 0) out vec4 dropData;
+
+void main() {
+    dropData = vDrop;
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+// Writes the drops RainSimulation respawned into its drop texture: one point
+// per drop, on the drop's texel
+
+layout (location = 0) in uint inIndex;
+// x, z, length factor, speed factor
+layout (location = 1) in vec4 inDrop;
+
+uniform int dropTextureWidth;
+uniform vec2 dropTextureSize;
+
+flat out vec4 vDrop;
+
+void main() {
+    int index = int(inIndex);
+    vec2 texel = vec2(index % dropTextureWidth, index / dropTextureWidth) + 0.5;
+    gl_Position = vec4(texel / dropTextureSize * 2.0 - 1.0, 0.0, 1.0);
+    vDrop = inDrop;
+}
@@ -1,13 +1,18 @@
 #version 410 core
 in vec3 TexCoords;
-out vec4 FragColor;
+in vec4 ClipPosition;
+in vec4 PreviousClipPosition;
+layout(location = 0) out vec4 FragColor;
+// See basic.frag
+layout(location = 2) out vec2 Velocity;
 
 uniform samplerCube daySkybox;
 uniform samplerCube nightSkybox;
-uniform float blendFactor;
+#include "include/frame.glsl"
 
 void main() {
     vec4 dayColor = texture(daySkybox, TexCoords);
     vec4 nightColor = texture(nightSkybox, TexCoords);
-    FragColor = mix(nightColor, dayColor, blendFactor);
+    FragColor = mix(nightColor, dayColor, dayNightBlend);
+    Velocity = (ClipPosition.xy / ClipPosition.w - PreviousClipPosition.xy / PreviousClipPosition.w) * 0.5;
 }
@@ -2,12 +2,17 @@
 layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
+out vec4 ClipPosition;
+out vec4 PreviousClipPosition;
 
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/view.glsl"
 
 void main() {
     TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
     gl_Position = pos.xyww;
+
+    // A direction, w = 0: only the camera's turn moves the sky
+    ClipPosition = pos;
+    PreviousClipPosition = previousViewProjection * vec4(aPos, 0.0);
 }
@@ -0,0 +1,167 @@
+#version 410 core
+
+// Temporal resolve and upsample of gps::TemporalAA, run once per window
+// pixel. The scene's samples near the pixel are filtered into this frame's
+// colour, the history is fetched from where the pixel was a frame ago,
+// clipped to what this frame's samples allow and blended with it.
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneColor;
+uniform sampler2D velocityBuffer;
+uniform sampler2D depthBuffer;
+uniform sampler2D history;
+// Part of the scene targets the main pass drew into, from the lower left corner
+uniform vec2 sceneScale;
+// This frame's sample offset, in scene pixels: scene pixel p was sampled at
+// p + 0.5 - jitter
+uniform vec2 jitter;
+uniform bool historyValid;
+
+out vec4 resolvedColor;
+
+// Share of the current frame where one of its samples lies on the pixel
+const float CURRENT_WEIGHT = 0.1;
+// And the least, so the history cannot hold on for ever
+const float MIN_CURRENT_WEIGHT = 0.02;
+// Reached at MOTION_PIXELS of motion: every resample of a moving history
+// blurs it a little, so it is trusted less the faster things move
+const float MOVING_CURRENT_WEIGHT = 0.25;
+const float MOTION_PIXELS = 4.0;
+// Standard deviations the history may lie from the samples' mean
+const float CLIP_GAMMA = 1.25;
+
+vec3 toYCoCg(vec3 color)
+{
+    return vec3(dot(color, vec3(0.25, 0.5, 0.25)),
+        dot(color, vec3(0.5, 0.0, -0.5)),
+        dot(color, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 fromYCoCg(vec3 color)
+{
+    return vec3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+// 1 / (1 + luma), Y is the luma in YCoCg. Weighs the blend so a lone bright
+// sample does not flicker in and out of the history.
+float lumaWeight(vec3 color)
+{
+    return 1.0 / (1.0 + color.x);
+}
+
+// Pulls color along the line to the box centre until it is inside
+vec3 clipToBox(vec3 color, vec3 boxMin, vec3 boxMax)
+{
+    vec3 center = 0.5 * (boxMax + boxMin);
+    vec3 extents = max(0.5 * (boxMax - boxMin), vec3(1e-4));
+    vec3 offset = color - center;
+    vec3 units = abs(offset / extents);
+    float maxUnit = max(units.x, max(units.y, units.z));
+    return maxUnit > 1.0 ? center + offset / maxUnit : color;
+}
+
+// 4 x 4 Catmull-Rom from nine bilinear lookups (see hdr.frag), keeps the
+// history from blurring a little more every frame
+vec3 sampleHistory(vec2 uv)
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(history, 0));
+    vec2 samplePosition = uv / texelSize;
+    vec2 texel1 = floor(samplePosition - 0.5) + 0.5;
+    vec2 f = samplePosition - texel1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 uv0 = (texel1 - 1.0) * texelSize;
+    vec2 uv12 = (texel1 + w2 / w12) * texelSize;
+    vec2 uv3 = (texel1 + 2.0) * texelSize;
+
+    vec3 result = texture(history, vec2(uv0.x, uv0.y)).rgb * w0.x * w0.y +
+        texture(history, vec2(uv12.x, uv0.y)).rgb * w12.x * w0.y +
+        texture(history, vec2(uv3.x, uv0.y)).rgb * w3.x * w0.y +
+        texture(history, vec2(uv0.x, uv12.y)).rgb * w0.x * w12.y +
+        texture(history, vec2(uv12.x, uv12.y)).rgb * w12.x * w12.y +
+        texture(history, vec2(uv3.x, uv12.y)).rgb * w3.x * w12.y +
+        texture(history, vec2(uv0.x, uv3.y)).rgb * w0.x * w3.y +
+        texture(history, vec2(uv12.x, uv3.y)).rgb * w12.x * w3.y +
+        texture(history, vec2(uv3.x, uv3.y)).rgb * w3.x * w3.y;
+    return max(result, vec3(0.0));
+}
+
+void main()
+{
+    ivec2 sceneSize = max(ivec2(vec2(textureSize(sceneColor, 0)) * sceneScale + 0.5), ivec2(1));
+    // This pixel's centre in scene pixels, and the scene pixel whose sample
+    // is closest to it
+    vec2 position = TexCoords * vec2(sceneSize);
+    ivec2 nearest = ivec2(floor(position + jitter));
+
+    vec3 filtered = vec3(0.0);
+    float filteredWeight = 0.0;
+    float closestWeight = 0.0;
+    vec3 moment1 = vec3(0.0);
+    vec3 moment2 = vec3(0.0);
+    vec3 boxMin = vec3(1e9);
+    vec3 boxMax = vec3(-1e9);
+    // Motion is taken from the nearest surface around the pixel, so edges of
+    // moving objects carry their motion instead of the background's
+    float closestDepth = 1.0;
+    ivec2 closest = clamp(nearest, ivec2(0), sceneSize - 1);
+
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 pixel = clamp(nearest + ivec2(x, y), ivec2(0), sceneSize - 1);
+            vec3 color = toYCoCg(texelFetch(sceneColor, pixel, 0).rgb);
+
+            // Gaussian fit of a Blackman-Harris window one window pixel wide:
+            // below full resolution a sample far from the pixel counts for
+            // little and the history fills in
+            vec2 offset = (vec2(pixel) + 0.5 - jitter - position) / sceneScale;
+            float weight = exp(-2.29 * dot(offset, offset));
+            filtered += color * weight;
+            filteredWeight += weight;
+            closestWeight = max(closestWeight, weight);
+
+            moment1 += color;
+            moment2 += color * color;
+            boxMin = min(boxMin, color);
+            boxMax = max(boxMax, color);
+
+            float depth = texelFetch(depthBuffer, pixel, 0).r;
+            if (depth < closestDepth) {
+                closestDepth = depth;
+                closest = pixel;
+            }
+        }
+    }
+    // Never zero, the nearest sample is within a scene pixel
+    vec3 current = filtered / filteredWeight;
+
+    vec2 velocity = texelFetch(velocityBuffer, closest, 0).rg;
+    vec2 previousUv = TexCoords - velocity;
+    if (!historyValid || any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0)))) {
+        resolvedColor = vec4(fromYCoCg(current), 1.0);
+        return;
+    }
+
+    vec3 mean = moment1 / 9.0;
+    vec3 deviation = sqrt(max(moment2 / 9.0 - mean * mean, vec3(0.0)));
+    vec3 clipMin = max(boxMin, mean - CLIP_GAMMA * deviation);
+    vec3 clipMax = min(boxMax, mean + CLIP_GAMMA * deviation);
+    vec3 previous = clipToBox(toYCoCg(sampleHistory(previousUv)), clipMin, clipMax);
+
+    // Below full resolution most pixels only get a close sample every few
+    // frames, the history carries them in between
+    float currentShare = max(CURRENT_WEIGHT * closestWeight, MIN_CURRENT_WEIGHT);
+    float motion = length(velocity * vec2(textureSize(history, 0)));
+    currentShare = mix(currentShare, MOVING_CURRENT_WEIGHT, clamp(motion / MOTION_PIXELS, 0.0, 1.0));
+    float currentWeight = currentShare * lumaWeight(current);
+    float previousWeight = (1.0 - currentShare) * lumaWeight(previous);
+    vec3 resolved = (current * currentWeight + previous * previousWeight) / (currentWeight + previousWeight);
+
+    resolvedColor = vec4(max(fromYCoCg(resolved), vec3(0.0)), 1.0);
+}
@@ -1,37 +1,158 @@
 #version 410 core
 
-in vec4 clipSpace;
 in vec2 texCoord;
 in vec3 toCameraVector;
 in vec3 fromLightVector;
+in vec3 worldPosition;
 
 out vec4 FragColor;
-uniform sampler2D reflectionTexture;
-uniform sampler2D refractionTexture;
 uniform sampler2D dudvMap;
 uniform sampler2D normalMap;
-uniform sampler2D depthMap;
 uniform vec3 lightColor;
 uniform float moveFactor;
 
+#ifdef FEATURE_PROJECTED_WATER
+// See water.vert, the grid covers the whole plane
+uniform sampler2D tileMask;
+uniform vec2 tileMaskOrigin;
+uniform vec2 tileMaskScale;
+#endif
+
+#ifdef FEATURE_SCREEN_SPACE_WATER
+#include "include/frame.glsl"
+#include "include/view.glsl"
+
+// Taken from the main pass before the water is drawn, see gps::SceneCopy
+uniform sampler2D sceneColor;
+uniform sampler2D depthPyramid;
+uniform int depthPyramidLevels;
+uniform samplerCube daySkybox;
+uniform samplerCube nightSkybox;
+
+const int maxTraceSteps = 64;
+const float maxTraceDistance = 150.0;
+// How far behind the depth buffer a ray may end and still count as a hit
+const float hitThickness = 2.0;
+#else
+uniform sampler2D reflectionTexture;
+uniform sampler2D refractionTexture;
+uniform sampler2D depthMap;
+// View projections the reflection and refraction were rendered with, may be
+// from an earlier frame
+uniform mat4 reflectionViewProjection;
+uniform mat4 refractionViewProjection;
+#endif
+
 const float waveStrength = 0.04;
 const float shineDamper = 20.0;
 const float reflectivity = 0.5;
 const vec4 mudColor = vec4(0.22, 0.35, 0.25, 0.6);
+const float near = 0.1;
+const float far = 300.0;
+
+float linearDepth(float depth)
+{
+    return 2.0 * near * far / (far + near - (2.0 * depth - 1.0) * (far - near));
+}
+
+#ifdef FEATURE_SCREEN_SPACE_WATER
+// Texture coordinates and window depth of a view space point
+vec3 toScreen(vec3 viewPosition)
+{
+    vec4 clip = projection * vec4(viewPosition, 1.0);
+    return clip.xyz / clip.w * 0.5 + 0.5;
+}
+
+// Follows the ray from origin to end (screen positions, window depth in z,
+// which is linear along the ray) through the depth pyramid. While the ray
+// is in front of a cell's nearest depth it cannot hit anything in that cell:
+// it moves to the cell's edge and carries on one level coarser. Otherwise it
+// refines one level, and a hit is a level 0 texel the ray is behind.
+// Returns the hit position, or z < 0 when nothing is hit on screen.
+vec3 traceDepthPyramid(vec3 origin, vec3 end)
+{
+    vec3 ray = end - origin;
+    // Only an exact 0 is replaced: the sign picks the cell edge, and a
+    // larger floor would put a false edge just ahead of a near-vertical ray
+    vec2 safeRay = vec2(ray.x < 0.0 ? min(ray.x, -1e-12) : max(ray.x, 1e-12),
+        ray.y < 0.0 ? min(ray.y, -1e-12) : max(ray.y, 1e-12));
+    vec2 baseSize = vec2(textureSize(depthPyramid, 0));
+    // Ray parameter of one level 0 texel
+    float texelStep = 1.0 / max(max(abs(ray.x) * baseSize.x, abs(ray.y) * baseSize.y), 1.0);
+
+    float t = texelStep;
+    int level = 0;
+    for (int i = 0; i < maxTraceSteps && level >= 0; i++) {
+        vec3 position = origin + ray * t;
+        if (t > 1.0 || any(lessThan(position.xy, vec2(0.0))) || any(greaterThan(position.xy, vec2(1.0)))) {
+            return vec3(0.0, 0.0, -1.0);
+        }
+
+        vec2 cellCount = vec2(textureSize(depthPyramid, level));
+        vec2 cell = floor(position.xy * cellCount);
+        float nearest = texelFetch(depthPyramid, ivec2(cell), level).r;
+
+        if (position.z < nearest) {
+            vec2 boundary = (cell + step(0.0, safeRay)) / cellCount;
+            vec2 boundaryT = (boundary - origin.xy) / safeRay;
+            float cellT = min(boundaryT.x, boundaryT.y);
+            float depthT = ray.z > 0.0 ? (nearest - origin.z) / ray.z : 2.0;
+            if (depthT < cellT) {
+                t = max(t, depthT);
+                level--;
+            }
+            else {
+                t = max(t, cellT) + 0.1 * texelStep;
+                level = min(level + 1, depthPyramidLevels - 1);
+            }
+        }
+        else {
+            level--;
+        }
+    }
+    if (level >= 0) {
+        return vec3(0.0, 0.0, -1.0);
+    }
+
+    vec3 hit = origin + ray * t;
+    float sceneDepth = texelFetch(depthPyramid, ivec2(hit.xy * baseSize), 0).r;
+    if (linearDepth(hit.z) - linearDepth(sceneDepth) > hitThickness) {
+        return vec3(0.0, 0.0, -1.0);
+    }
+    return hit;
+}
+
+vec3 skyColor(vec3 direction)
+{
+    return mix(texture(nightSkybox, direction).rgb, texture(daySkybox, direction).rgb, dayNightBlend);
+}
+#endif
 
 
 void main()
 {
-	vec2 ndc = (clipSpace.xy / clipSpace.w) / 2.0 + 0.5;
-    vec2 reflectionTexCoord = vec2(ndc.x, 1.0 - ndc.y);
-    vec2 refractionTexCoord = vec2(ndc.x, ndc.y);
+#ifdef FEATURE_PROJECTED_WATER
+    if (textureLod(tileMask, (worldPosition.xz - tileMaskOrigin) * tileMaskScale, 0.0).g < 0.5) {
+        discard;
+    }
+#endif
+
+#ifdef FEATURE_SCREEN_SPACE_WATER
+    vec2 screenSize = vec2(textureSize(depthPyramid, 0));
+    vec2 screenTexCoord = gl_FragCoord.xy / screenSize;
+    float floorDepth = texelFetch(depthPyramid, ivec2(gl_FragCoord.xy), 0).r;
+#else
+    // The mirrored camera sees the surface flipped vertically, which its
+    // own projection already accounts for
+    vec4 reflectionClip = reflectionViewProjection * vec4(worldPosition, 1.0);
+    vec4 refractionClip = refractionViewProjection * vec4(worldPosition, 1.0);
+    vec2 reflectionTexCoord = (reflectionClip.xy / reflectionClip.w) / 2.0 + 0.5;
+    vec2 refractionTexCoord = (refractionClip.xy / refractionClip.w) / 2.0 + 0.5;
 
-    float near = 0.1;
-    float far = 300.0;
     float floorDepth = texture(depthMap, refractionTexCoord).r;
-    float floorDistance = 2.0 * near * far / (far + near - (2.0 * floorDepth - 1.0) * (far - near));
-    float fragmentDepth = gl_FragCoord.z;
-    float fragmentDistance = 2.0 * near * far / (far + near - (2.0 * fragmentDepth - 1.0) * (far - near));
+#endif
+    float floorDistance = linearDepth(floorDepth);
+    float fragmentDistance = linearDepth(gl_FragCoord.z);
     float waterDepth = floorDistance - fragmentDistance;
 
 
@@ -40,6 +161,36 @@ void main()
 	vec2 totalDistortion = (texture(dudvMap, distortedTexCoords).rg * 2.0 - 1.0) * waveStrength * clamp(waterDepth / 20.0, 0.0, 1.0);
 
 
+#ifdef FEATURE_SCREEN_SPACE_WATER
+    // Reflection: traced off the flat surface, the waves only distort the
+    // lookup, as they do the planar reflection's
+    vec3 reflected = reflect(-normalize(toCameraVector), vec3(0.0, 1.0, 0.0));
+    vec3 surface = (view * vec4(worldPosition, 1.0)).xyz;
+    vec3 reflectedView = mat3(view) * reflected;
+    float traceDistance = maxTraceDistance;
+    if (reflectedView.z > 0.0) {
+        // Stop short of the near plane
+        traceDistance = min(traceDistance, (-near * 1.01 - surface.z) / reflectedView.z);
+    }
+    vec3 hit = traceDepthPyramid(toScreen(surface), toScreen(surface + reflectedView * traceDistance));
+
+    vec3 sky = skyColor(reflected + vec3(totalDistortion.x, 0.0, totalDistortion.y));
+    vec4 reflectionColor = vec4(sky, 1.0);
+    if (hit.z >= 0.0) {
+        vec2 hitTexCoord = clamp(hit.xy + totalDistortion, 0.001, 0.999);
+        // Fade to the sky near the screen edges, where the trace gives out
+        vec2 edge = smoothstep(0.0, 0.1, hit.xy) * (1.0 - smoothstep(0.9, 1.0, hit.xy));
+        reflectionColor.rgb = mix(sky, textureLod(sceneColor, hitTexCoord, 0.0).rgb, edge.x * edge.y);
+    }
+
+    // Refraction: the scene behind the water, undistorted where the
+    // distorted lookup would land on something in front of it
+    vec2 refractionTexCoord = clamp(screenTexCoord + totalDistortion, 0.001, 0.999);
+    if (texelFetch(depthPyramid, ivec2(refractionTexCoord * screenSize), 0).r < gl_FragCoord.z) {
+        refractionTexCoord = screenTexCoord;
+    }
+    vec4 refractionColor = vec4(textureLod(sceneColor, refractionTexCoord, 0.0).rgb, 1.0);
+#else
     reflectionTexCoord += totalDistortion;
     reflectionTexCoord = clamp(reflectionTexCoord, 0.001, 0.999);
     refractionTexCoord += totalDistortion;
@@ -47,13 +198,14 @@ void main()
 
     vec4 reflectionColor = texture(reflectionTexture, reflectionTexCoord);
     vec4 refractionColor = texture(refractionTexture, refractionTexCoord);
+#endif
     refractionColor = mix(refractionColor, mudColor, clamp(waterDepth / 60.0, 0.0, 1.0));
 
     vec4 normalColor = texture(normalMap, distortedTexCoords);
     vec3 normal = vec3(normalColor.r * 2.0 - 1.0, normalColor.b * 3.0, normalColor.g * 2.0 - 1.0);
     normal = normalize(normal);
 
-    
+
     vec3 viewVector = normalize(toCameraVector);
     float refractiveFactor = dot(viewVector, normal);
     refractiveFactor = pow(refractiveFactor, 0.5);
@@ -71,4 +223,4 @@ void main()
     FragColor.a = clamp(waterDepth / 5.0, 0.0, 1.0);
 
 
-}
\ No newline at end of file
+}
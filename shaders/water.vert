@@ -1,29 +1,90 @@
 #version 410 core
 
-in vec2 position;
+// Flat tiles: the unit quad, instanced once per visible tile.
+// Projected grid: a grid over the screen, each vertex moved to where its
+// view ray meets the water plane.
+layout(location = 0) in vec2 position;
+
+#include "include/frame.glsl"
+#include "include/view.glsl"
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 cameraPos;
 uniform vec3 lightPosition;
+uniform float textureScale;
+
+#ifdef FEATURE_PROJECTED_WATER
+uniform mat4 gridInverseViewProjection;
+uniform float gridHeight;
+uniform float gridDistance;
+uniform float waveAmplitude;
+// Height of the water in red, 1 in green where there is a tile
+uniform sampler2D tileMask;
+uniform vec2 tileMaskOrigin;
+uniform vec2 tileMaskScale;
+#else
+// Centre of the tile, with the water height in y
+layout(location = 1) in vec3 tileCenter;
+uniform float tileSize;
+#endif
 
-out vec4 clipSpace;
 out vec2 texCoord;
 out vec3 toCameraVector;
 out vec3 fromLightVector;
+out vec3 worldPosition;
 
 const float tiling = 4.0;
 
+#ifdef FEATURE_PROJECTED_WATER
+// Three travelling sines, flattened with distance where the grid is too
+// coarse to carry them
+float waveHeight(vec2 xz, float distance)
+{
+    float height = sin(dot(xz, vec2(0.21, 0.13)) + u_Time * 1.3) * 0.5 +
+        sin(dot(xz, vec2(-0.17, 0.29)) + u_Time * 1.7) * 0.3 +
+        sin(dot(xz, vec2(0.43, -0.37)) + u_Time * 2.3) * 0.2;
+    return height * waveAmplitude * (1.0 - smoothstep(0.25 * gridDistance, 0.5 * gridDistance, distance));
+}
+
+vec3 projectToWater(vec2 ndc)
+{
+    vec4 nearPoint = gridInverseViewProjection * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = gridInverseViewProjection * vec4(ndc, 1.0, 1.0);
+    vec3 origin = nearPoint.xyz / nearPoint.w;
+    vec3 direction = farPoint.xyz / farPoint.w - origin;
+
+    // Rays that miss the plane (above the horizon, or a camera below the
+    // water) end on a ring at gridDistance
+    vec2 flatDirection = length(direction.xz) > 1e-6 ? normalize(direction.xz) : vec2(0.0, 1.0);
+    vec2 xz = viewPos.xz + flatDirection * gridDistance;
+    if (direction.y < -1e-6) {
+        float t = (gridHeight - origin.y) / direction.y;
+        vec3 hit = origin + direction * t;
+        if (t > 0.0 && length(hit.xz - viewPos.xz) < gridDistance) {
+            xz = hit.xz;
+        }
+    }
+    return vec3(xz.x, gridHeight, xz.y);
+}
+#endif
+
 void main()
 {
-    vec4 worldPos = model * vec4(position.x, 0.0, position.y, 1.0);
+#ifdef FEATURE_PROJECTED_WATER
+    vec3 worldPos = projectToWater(position);
+    vec2 tile = textureLod(tileMask, (worldPos.xz - tileMaskOrigin) * tileMaskScale, 0.0).rg;
+    if (tile.g > 0.5) {
+        worldPos.y = tile.r;
+    }
+    worldPos.y += waveHeight(worldPos.xz, length(worldPos.xz - viewPos.xz));
+#else
+    vec3 worldPos = tileCenter + vec3(position.x, 0.0, position.y) * tileSize;
+#endif
 
-    clipSpace = projection * view * worldPos;
-    gl_Position = clipSpace;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
 
-    texCoord = (vec2(position.x / 2.0 + 0.5, position.y / 2.0 + 0.5)) * tiling;
+    // World space, so neighbouring tiles and the grid line up
+    texCoord = worldPos.xz * textureScale * tiling;
 
-    toCameraVector = cameraPos - worldPos.xyz;
-    fromLightVector = worldPos.xyz - lightPosition;
+    toCameraVector = viewPos - worldPos;
+    fromLightVector = worldPos - lightPosition;
+    worldPosition = worldPos;
 }
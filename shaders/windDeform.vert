@@ -0,0 +1,15 @@
+#version 410 core
+
+// Rest pose of a wind movable batch, the swayed positions are captured with
+// transform feedback and read by every pass (see gps::WindDeformer)
+layout(location = 0) in vec3 vPosition;
+layout(location = 1) in vec3 vNormal;
+
+out vec3 displacedPosition;
+
+#include "include/wind.glsl"
+
+void main()
+{
+    displacedPosition = applyWind(vPosition, vNormal);
+}